@@ -0,0 +1,294 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file apply-metrics.cc
+
+#include "apply-metrics.h"
+
+#include <stdio.h>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+/// Names of the phases (as in the model and in Prometheus labels)
+const char* PHASE_NAMES[] = {
+    "collect", "translate", "fetch", "render", "send", "kea", "test", "rollback",
+    "total"
+};
+
+/// Names of the counters (as in the model)
+const char* COUNTER_NAMES[] = {
+    "applies", "failures", "retries", "sysrepo-calls", "bytes-sent",
+    "commands", "skipped-pushes", "rejected-commits", "rollbacks"
+};
+
+/// Prometheus names of the counters
+const char* COUNTER_METRICS[] = {
+    "kea_plugin_applies_total", "kea_plugin_apply_failures_total",
+    "kea_plugin_retries_total", "kea_plugin_sysrepo_calls_total",
+    "kea_plugin_bytes_sent_total", "kea_plugin_commands_total",
+    "kea_plugin_skipped_pushes_total", "kea_plugin_rejected_commits_total",
+    "kea_plugin_rollbacks_total"
+};
+
+/// Help texts of the counters
+const char* COUNTER_HELP[] = {
+    "Configuration changes applied to Kea.",
+    "Configuration changes Kea did not accept or did not answer.",
+    "Commands resent on a fresh connection and fallbacks to config-set.",
+    "Sysrepo calls made to translate the configuration.",
+    "Bytes of commands sent to Kea.",
+    "Commands sent to Kea.",
+    "Pushes skipped because Kea already had the configuration.",
+    "Commits rejected because Kea failed config-test.",
+    "Rollbacks of Kea to a configuration it accepted before."
+};
+
+/// @brief Returns the bucket of a value.
+size_t
+bucketOf(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    size_t bucket = 0;
+    while (bucket < LatencyHistogram::BUCKETS - 1 &&
+           us >= LatencyHistogram::getBucketLimit(bucket)) {
+        bucket++;
+    }
+    return (bucket);
+}
+
+/// @brief Writes nanoseconds as milliseconds.
+void
+writeMs(ostringstream& out, uint64_t ns) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.3f ms", ns / 1e6);
+    out << text;
+}
+
+}
+
+uint64_t
+LatencyHistogram::Snapshot::quantile(double q) const {
+    if (!count) {
+        return (0);
+    }
+    uint64_t rank = static_cast<uint64_t>(q * count);
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS - 1; b++) {
+        seen += buckets[b];
+        if (seen > rank) {
+            return (getBucketLimit(b));
+        }
+    }
+    return (max_ns / 1000);
+}
+
+LatencyHistogram::LatencyHistogram()
+    :count_(0), sum_ns_(0), max_ns_(0) {
+    for (size_t b = 0; b < BUCKETS; b++) {
+        buckets_[b].store(0, memory_order_relaxed);
+    }
+}
+
+void
+LatencyHistogram::record(uint64_t ns) {
+    buckets_[bucketOf(ns)].fetch_add(1, memory_order_relaxed);
+    sum_ns_.fetch_add(ns, memory_order_relaxed);
+    uint64_t max = max_ns_.load(memory_order_relaxed);
+    while (ns > max &&
+           !max_ns_.compare_exchange_weak(max, ns, memory_order_relaxed)) {
+    }
+    // Counted last, so the count does not run ahead of the buckets.
+    count_.fetch_add(1, memory_order_release);
+}
+
+LatencyHistogram::Snapshot
+LatencyHistogram::getSnapshot() const {
+    Snapshot s;
+    s.count = count_.load(memory_order_acquire);
+    s.sum_ns = sum_ns_.load(memory_order_relaxed);
+    s.max_ns = max_ns_.load(memory_order_relaxed);
+    for (size_t b = 0; b < BUCKETS; b++) {
+        s.buckets[b] = buckets_[b].load(memory_order_relaxed);
+    }
+    return (s);
+}
+
+const char*
+ApplyMetrics::getPhaseName(Phase phase) {
+    return (PHASE_NAMES[phase]);
+}
+
+const char*
+ApplyMetrics::getCounterName(Counter counter) {
+    return (COUNTER_NAMES[counter]);
+}
+
+ApplyMetrics::Trace::Trace()
+    :start_(Clock::now()) {
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        ns_[p] = 0;
+        used_[p] = false;
+    }
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        counters_[c] = 0;
+    }
+}
+
+void
+ApplyMetrics::Trace::addSince(Phase phase, const Clock::time_point& start) {
+    add(phase, chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+string
+ApplyMetrics::Trace::toText() const {
+    ostringstream out;
+    bool first = true;
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        if (!used_[p]) {
+            continue;
+        }
+        out << (first ? "" : ", ") << PHASE_NAMES[p] << " ";
+        writeMs(out, ns_[p]);
+        first = false;
+    }
+    out << "; " << counters_[COUNTER_SYSREPO_CALLS] << " sysrepo call(s), "
+        << counters_[COUNTER_COMMANDS] << " command(s), "
+        << counters_[COUNTER_BYTES] << " bytes";
+    if (counters_[COUNTER_SKIPPED]) {
+        out << ", push skipped";
+    }
+    if (counters_[COUNTER_RETRIES]) {
+        out << ", " << counters_[COUNTER_RETRIES] << " retries";
+    }
+    if (counters_[COUNTER_ROLLBACKS]) {
+        out << ", rolled back";
+    }
+    return (out.str());
+}
+
+ApplyMetrics::ApplyMetrics(const string& file)
+    :file_(file), tracing_(false) {
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        counters_[c].store(0, memory_order_relaxed);
+    }
+}
+
+void
+ApplyMetrics::record(Trace& trace, bool ok) {
+    trace.ns_[PHASE_TOTAL] = 0;
+    trace.addSince(PHASE_TOTAL, trace.start_);
+    trace.count(COUNTER_APPLIES);
+    if (!ok) {
+        trace.count(COUNTER_FAILURES);
+    }
+    recordTrace(trace, ok ? "apply done" : "apply failed");
+}
+
+void
+ApplyMetrics::recordVerify(Trace& trace, bool ok) {
+    if (!ok) {
+        trace.count(COUNTER_REJECTED);
+    }
+    recordTrace(trace, ok ? "verify done" : "verify rejected");
+}
+
+void
+ApplyMetrics::recordRollback(Trace& trace, bool ok) {
+    recordTrace(trace, ok ? "rollback done" : "rollback failed");
+}
+
+void
+ApplyMetrics::recordTrace(Trace& trace, const string& what) {
+    if (trace.used_[PHASE_TRANSLATE]) {
+        // With several threads fetching may take longer than translate.
+        uint64_t fetch = trace.ns_[PHASE_FETCH];
+        trace.add(PHASE_RENDER, trace.ns_[PHASE_TRANSLATE] > fetch ?
+                  trace.ns_[PHASE_TRANSLATE] - fetch : 0);
+        trace.used_[PHASE_FETCH] = true;
+    } else {
+        // Nothing translated (e.g. sent as verified), nothing fetched.
+        trace.used_[PHASE_FETCH] = false;
+    }
+
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        if (trace.used_[p]) {
+            phases_[p].record(trace.ns_[p]);
+        }
+    }
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        counters_[c].fetch_add(trace.counters_[c], memory_order_relaxed);
+    }
+
+    if (isTracing()) {
+        cerr << "plugin-kea " << what << ": " << trace.toText() << endl;
+    }
+    writeFile();
+}
+
+string
+ApplyMetrics::toPrometheus() const {
+    ostringstream out;
+
+    out << "# HELP kea_plugin_apply_phase_seconds Time spent in each phase "
+        << "of applying configuration changes to Kea." << endl
+        << "# TYPE kea_plugin_apply_phase_seconds histogram" << endl;
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        LatencyHistogram::Snapshot s = phases_[p].getSnapshot();
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < LatencyHistogram::BUCKETS - 1; b++) {
+            cumulative += s.buckets[b];
+            out << "kea_plugin_apply_phase_seconds_bucket{phase=\""
+                << PHASE_NAMES[p] << "\",le=\""
+                << LatencyHistogram::getBucketLimit(b) / 1e6 << "\"} "
+                << cumulative << endl;
+        }
+        out << "kea_plugin_apply_phase_seconds_bucket{phase=\""
+            << PHASE_NAMES[p] << "\",le=\"+Inf\"} " << s.count << endl
+            << "kea_plugin_apply_phase_seconds_sum{phase=\""
+            << PHASE_NAMES[p] << "\"} " << s.sum_ns / 1e9 << endl
+            << "kea_plugin_apply_phase_seconds_count{phase=\""
+            << PHASE_NAMES[p] << "\"} " << s.count << endl;
+    }
+
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        out << "# HELP " << COUNTER_METRICS[c] << " " << COUNTER_HELP[c] << endl
+            << "# TYPE " << COUNTER_METRICS[c] << " counter" << endl
+            << COUNTER_METRICS[c] << " " << getCounter(static_cast<Counter>(c))
+            << endl;
+    }
+
+    out << "# HELP kea_plugin_tracing Whether every apply is logged." << endl
+        << "# TYPE kea_plugin_tracing gauge" << endl
+        << "kea_plugin_tracing " << (isTracing() ? 1 : 0) << endl;
+    return (out.str());
+}
+
+bool
+ApplyMetrics::writeFile() const {
+    if (file_.empty()) {
+        return (true);
+    }
+
+    const string text = toPrometheus();
+    const string tmp = file_ + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    bool ok = f && fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (f && fclose(f) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp.c_str(), file_.c_str()) != 0) {
+        cerr << "plugin-kea failed to write " << file_ << endl;
+        remove(tmp.c_str());
+        return (false);
+    }
+    return (true);
+}
@@ -0,0 +1,234 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file apply-metrics.h
+///
+/// Timers and counters of the apply pipeline (from the change
+/// notification to Kea's answer).
+
+#ifndef APPLY_METRICS_H
+#define APPLY_METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/// @brief Latency histogram that can be recorded to from any thread.
+///
+/// Buckets are powers of two of microseconds. Recording is a few
+/// relaxed atomic increments, no lock is taken, so readers never slow
+/// the recording thread down. A snapshot taken while recording goes
+/// on may be off by the values being recorded.
+class LatencyHistogram {
+public:
+    /// Number of buckets: below 1 us, below 2 us, ... and the rest
+    static const size_t BUCKETS = 32;
+
+    /// @brief Figures of the histogram at some point.
+    struct Snapshot {
+        uint64_t count;              ///< number of values
+        uint64_t sum_ns;             ///< sum of values
+        uint64_t max_ns;             ///< largest value
+        uint64_t buckets[BUCKETS];   ///< values per bucket
+
+        /// @brief Returns upper bound of the quantile (microseconds).
+        ///
+        /// @param q quantile (0 to 1)
+        /// @return upper bound of the bucket holding the quantile, the
+        ///         largest value if that is the last bucket, 0 if empty
+        uint64_t quantile(double q) const;
+    };
+
+    /// @brief Constructor (empty histogram)
+    LatencyHistogram();
+
+    /// @brief Records a value.
+    ///
+    /// @param ns value in nanoseconds
+    void record(uint64_t ns);
+
+    /// @brief Returns current figures.
+    Snapshot getSnapshot() const;
+
+    /// @brief Returns upper bound of a bucket in microseconds.
+    static uint64_t getBucketLimit(size_t bucket) {
+        return (static_cast<uint64_t>(1) << bucket);
+    }
+
+private:
+    std::atomic<uint64_t> count_;             ///< number of values
+    std::atomic<uint64_t> sum_ns_;            ///< sum of values
+    std::atomic<uint64_t> max_ns_;            ///< largest value
+    std::atomic<uint64_t> buckets_[BUCKETS];  ///< values per bucket
+};
+
+/// @brief Timers and counters of the apply pipeline.
+///
+/// Every apply (a config-set or a set of targeted commands) is timed
+/// phase by phase with a Trace, which is recorded when the apply
+/// is done. With tracing on, the phases of each apply are logged too.
+class ApplyMetrics {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /// @brief Phases of an apply.
+    ///
+    /// Fetch is the time spent reading Sysrepo during translate, summed
+    /// over translation threads; render is the rest of translate.
+    enum Phase {
+        PHASE_COLLECT,     ///< reading the changes of a commit
+        PHASE_TRANSLATE,   ///< building the configuration or commands
+        PHASE_FETCH,       ///< reading Sysrepo (part of translate)
+        PHASE_RENDER,      ///< generating JSON (part of translate)
+        PHASE_SEND,        ///< connecting to Kea and sending commands
+        PHASE_KEA,         ///< waiting for Kea to answer
+        PHASE_TEST,        ///< waiting for Kea to answer config-test
+        PHASE_ROLLBACK,    ///< rolling Kea back to a configuration snapshot
+        PHASE_TOTAL,       ///< the whole apply
+        PHASE_COUNT
+    };
+
+    /// @brief Counters of the apply pipeline.
+    enum Counter {
+        COUNTER_APPLIES,       ///< applies done
+        COUNTER_FAILURES,      ///< applies that failed
+        COUNTER_RETRIES,       ///< fallbacks from targeted commands to config-set
+        COUNTER_SYSREPO_CALLS, ///< Sysrepo calls made
+        COUNTER_BYTES,         ///< bytes of commands sent to Kea
+        COUNTER_COMMANDS,      ///< commands sent to Kea
+        COUNTER_SKIPPED,       ///< pushes skipped as Kea had the configuration
+        COUNTER_REJECTED,      ///< commits rejected in the verify event
+        COUNTER_ROLLBACKS,     ///< rollbacks to a configuration snapshot
+        COUNTER_COUNT
+    };
+
+    /// @brief Returns name of a phase.
+    static const char* getPhaseName(Phase phase);
+
+    /// @brief Returns name of a counter.
+    static const char* getCounterName(Counter counter);
+
+    /// @brief Phases and counters of a single apply.
+    class Trace {
+    public:
+        /// @brief Constructor (starts the total timer)
+        Trace();
+
+        /// @brief Adds time to a phase.
+        void add(Phase phase, uint64_t ns) {
+            ns_[phase] += ns;
+            used_[phase] = true;
+        }
+
+        /// @brief Adds time since start to a phase.
+        void addSince(Phase phase, const Clock::time_point& start);
+
+        /// @brief Adds to a counter.
+        void count(Counter counter, uint64_t value = 1) {
+            counters_[counter] += value;
+        }
+
+        /// @brief Returns time of a phase (nanoseconds).
+        uint64_t get(Phase phase) const {
+            return (ns_[phase]);
+        }
+
+        /// @brief Returns the phases as text for logging.
+        std::string toText() const;
+
+    private:
+        friend class ApplyMetrics;
+
+        Clock::time_point start_;             ///< start of the apply
+        uint64_t ns_[PHASE_COUNT];            ///< time per phase
+        bool used_[PHASE_COUNT];              ///< phases that happened
+        uint64_t counters_[COUNTER_COUNT];    ///< counters of the apply
+    };
+
+    /// @brief Constructor
+    ///
+    /// @param file Prometheus text file written after each apply
+    ///        (empty for none)
+    ApplyMetrics(const std::string& file = "");
+
+    /// @brief Records an apply.
+    ///
+    /// Ends the total timer of the trace, records all phases that
+    /// happened, logs them if tracing is on and writes the file.
+    ///
+    /// @param trace phases and counters of the apply
+    /// @param ok whether the apply succeeded
+    void record(Trace& trace, bool ok);
+
+    /// @brief Records the verify event of a commit.
+    ///
+    /// Like record(), but the phases of the trace are not an apply and
+    /// the total is left out: the apply that follows has its own.
+    ///
+    /// @param trace phases and counters of the verification
+    /// @param ok false if the commit was rejected
+    void recordVerify(Trace& trace, bool ok);
+
+    /// @brief Records a rollback asked for with the rollback RPC.
+    ///
+    /// Like recordVerify(), the rollback is not an apply. (Rollbacks
+    /// after a failed push are part of the trace of that apply.)
+    ///
+    /// @param trace phases and counters of the rollback
+    /// @param ok whether Kea took the configuration
+    void recordRollback(Trace& trace, bool ok);
+
+    /// @brief Records a phase that is not part of an apply.
+    void record(Phase phase, uint64_t ns) {
+        phases_[phase].record(ns);
+    }
+
+    /// @brief Returns figures of a phase.
+    LatencyHistogram::Snapshot getPhase(Phase phase) const {
+        return (phases_[phase].getSnapshot());
+    }
+
+    /// @brief Returns value of a counter.
+    uint64_t getCounter(Counter counter) const {
+        return (counters_[counter].load(std::memory_order_relaxed));
+    }
+
+    /// @brief Turns logging of every apply on or off.
+    void setTracing(bool tracing) {
+        tracing_.store(tracing, std::memory_order_relaxed);
+    }
+
+    /// @brief Returns whether every apply is logged.
+    bool isTracing() const {
+        return (tracing_.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Returns the metrics in the Prometheus text format.
+    std::string toPrometheus() const;
+
+    /// @brief Writes the Prometheus text file (if there is one).
+    ///
+    /// The file is replaced atomically, so a scraper never reads a
+    /// partial one.
+    ///
+    /// @return false if the file could not be written
+    bool writeFile() const;
+
+private:
+    /// @brief Records the phases and counters of a trace.
+    ///
+    /// @param trace phases and counters
+    /// @param what what is logged if tracing is on
+    void recordTrace(Trace& trace, const std::string& what);
+
+    std::string file_;                          ///< Prometheus file
+    std::atomic<bool> tracing_;                 ///< log every apply
+    LatencyHistogram phases_[PHASE_COUNT];      ///< latency per phase
+    std::atomic<uint64_t> counters_[COUNTER_COUNT]; ///< counters
+};
+
+#endif /* APPLY_METRICS_H */
@@ -0,0 +1,161 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file apply-queue.cc
+
+#include "apply-queue.h"
+
+using namespace std;
+
+ApplyQueue::ApplyQueue(size_t capacity, const ApplyFunction& apply)
+    :capacity_(capacity ? capacity : 1), cells_(new Cell[capacity_]), apply_(apply),
+     tail_(0), head_(0), applied_(0), batches_(0), overflows_(0), max_depth_(0),
+     sleeping_(false), stop_(false) {
+    for (size_t i = 0; i < capacity_; i++) {
+        cells_[i].sequence.store(i, memory_order_relaxed);
+    }
+    thread_ = thread(&ApplyQueue::run, this);
+}
+
+ApplyQueue::~ApplyQueue() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+uint64_t
+ApplyQueue::push() {
+    Clock::time_point now = Clock::now();
+    uint64_t pos = tail_.load(memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos % capacity_];
+        uint64_t sequence = cell->sequence.load(memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(sequence - pos);
+        if (diff == 0) {
+            // Sequentially consistent, as the check of sleeping_ below.
+            if (tail_.compare_exchange_weak(pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The slot still holds the request from a lap before.
+            overflows_.fetch_add(1, memory_order_relaxed);
+            return (0);
+        } else {
+            pos = tail_.load(memory_order_relaxed);
+        }
+    }
+    cell->queued = now;
+    cell->sequence.store(pos + 1, memory_order_release);
+
+    uint64_t head = head_.load(memory_order_relaxed);
+    size_t depth = head <= pos ? pos + 1 - head : 0;
+    size_t max = max_depth_.load(memory_order_relaxed);
+    while (depth > max &&
+           !max_depth_.compare_exchange_weak(max, depth, memory_order_relaxed)) {
+    }
+
+    // Either the worker finds the request before it goes to sleep, or
+    // it is seen sleeping here.
+    if (sleeping_.load()) {
+        lock_guard<mutex> lock(mutex_);
+        cond_.notify_one();
+    }
+    return (pos + 1);
+}
+
+void
+ApplyQueue::drain() {
+    uint64_t target = tail_.load();
+    unique_lock<mutex> lock(mutex_);
+    done_.wait(lock, [this, target] {
+        return (applied_.load() >= target);
+    });
+}
+
+size_t
+ApplyQueue::getDepth() const {
+    // The head first, it never passes the tail.
+    uint64_t head = head_.load(memory_order_relaxed);
+    return (tail_.load(memory_order_relaxed) - head);
+}
+
+bool
+ApplyQueue::pop(uint64_t& number, Clock::time_point& queued) {
+    uint64_t pos = head_.load(memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[pos % capacity_];
+        uint64_t sequence = cell.sequence.load(memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(sequence - (pos + 1));
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                queued = cell.queued;
+                // Free for the push a lap later.
+                cell.sequence.store(pos + capacity_, memory_order_release);
+                number = pos + 1;
+                return (true);
+            }
+        } else if (diff < 0) {
+            // Empty, or the push of the slot is not finished yet.
+            return (false);
+        } else {
+            pos = head_.load(memory_order_relaxed);
+        }
+    }
+}
+
+bool
+ApplyQueue::empty() const {
+    return (head_.load() == tail_.load());
+}
+
+void
+ApplyQueue::run() {
+    while (true) {
+        Batch batch;
+        batch.first = 0;
+        batch.last = 0;
+        batch.count = 0;
+        batch.wait_ns = 0;
+        uint64_t number;
+        Clock::time_point queued;
+        while (pop(number, queued)) {
+            uint64_t wait = chrono::duration_cast<chrono::nanoseconds>(
+                Clock::now() - queued).count();
+            wait_.record(wait);
+            if (!batch.count) {
+                batch.first = number;
+                batch.wait_ns = wait;
+            }
+            batch.last = number;
+            batch.count++;
+        }
+
+        if (batch.count) {
+            apply_(batch);
+            batches_.fetch_add(1, memory_order_relaxed);
+            applied_.fetch_add(batch.count);
+            {
+                // drain() checks applied_ with the mutex held.
+                lock_guard<mutex> lock(mutex_);
+            }
+            done_.notify_all();
+            continue;
+        }
+
+        unique_lock<mutex> lock(mutex_);
+        if (stop_ && empty()) {
+            return;
+        }
+        // A push between the check and the wait sees sleeping_ set.
+        sleeping_.store(true);
+        cond_.wait(lock, [this] { return (stop_ || !empty()); });
+        sleeping_.store(false);
+    }
+}
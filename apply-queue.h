@@ -0,0 +1,157 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file apply-queue.h
+///
+/// Bounded queue of applies, served by a worker thread of its own, so
+/// that the change callback does not wait for Kea.
+
+#ifndef APPLY_QUEUE_H
+#define APPLY_QUEUE_H
+
+#include "apply-metrics.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/// @brief Applies handed over by the change callback to a worker.
+///
+/// push() only claims a slot of a fixed ring with atomic operations
+/// (the bounded queue of Dmitry Vyukov), so it never waits for the
+/// worker and allocates nothing. When the ring is full push() fails
+/// and the caller applies the change itself, which bounds how far Kea
+/// can lag behind the commits.
+///
+/// The worker takes every request waiting at once: an apply pushes the
+/// configuration in Sysrepo as it is then, which covers all of them.
+/// The mutex is only taken to wake the worker up when it sleeps, and
+/// by drain().
+class ApplyQueue {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /// @brief Requests the worker took at once.
+    struct Batch {
+        uint64_t first;     ///< number of the oldest request
+        uint64_t last;      ///< number of the newest request
+        size_t count;       ///< number of requests
+        uint64_t wait_ns;   ///< time the oldest one waited
+    };
+
+    /// Function applying a batch (called from the worker thread)
+    typedef std::function<void (const Batch&)> ApplyFunction;
+
+    /// @brief Constructor
+    ///
+    /// @param capacity number of requests the ring holds (at least 1)
+    /// @param apply function applying the requests
+    ApplyQueue(size_t capacity, const ApplyFunction& apply);
+
+    /// @brief Destructor (applies what is queued and stops the worker)
+    ~ApplyQueue();
+
+    /// @brief Queues a request.
+    ///
+    /// Lock-free; the mutex is taken only when the worker sleeps.
+    ///
+    /// @return number of the request (from 1), 0 if the ring is full
+    uint64_t push();
+
+    /// @brief Waits until the requests queued so far are applied.
+    void drain();
+
+    /// @brief Returns number of requests the ring holds.
+    size_t getCapacity() const {
+        return (capacity_);
+    }
+
+    /// @brief Returns number of requests waiting for the worker.
+    size_t getDepth() const;
+
+    /// @brief Returns largest number of requests waiting at once.
+    size_t getMaxDepth() const {
+        return (max_depth_.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Returns number of requests queued so far.
+    uint64_t getQueued() const {
+        return (tail_.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Returns number of requests applied so far.
+    uint64_t getApplied() const {
+        return (applied_.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Returns number of batches applied so far.
+    uint64_t getBatches() const {
+        return (batches_.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Returns number of requests refused because the ring was
+    ///        full.
+    uint64_t getOverflows() const {
+        return (overflows_.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Returns the time requests waited for the worker.
+    LatencyHistogram::Snapshot getWait() const {
+        return (wait_.getSnapshot());
+    }
+
+private:
+    /// @brief Slot of the ring.
+    ///
+    /// The sequence tells whose turn it is: equal to the position of a
+    /// push when the slot is free for it, one more when the request is
+    /// in, the position plus the capacity once it was taken out.
+    struct Cell {
+        std::atomic<uint64_t> sequence;   ///< turn of the slot
+        Clock::time_point queued;         ///< when the request came
+    };
+
+    /// @brief Takes the oldest request out of the ring.
+    ///
+    /// @param number (out) number of the request
+    /// @param queued (out) when it came
+    /// @return false if there is none
+    bool pop(uint64_t& number, Clock::time_point& queued);
+
+    /// @brief Returns true if no request is waiting.
+    bool empty() const;
+
+    /// @brief Worker thread body.
+    void run();
+
+    const size_t capacity_;              ///< number of slots
+    std::unique_ptr<Cell[]> cells_;      ///< the ring
+    ApplyFunction apply_;                ///< apply function
+
+    std::atomic<uint64_t> tail_;         ///< position of the next push
+    std::atomic<uint64_t> head_;         ///< position of the next pop
+    std::atomic<uint64_t> applied_;      ///< requests applied
+    std::atomic<uint64_t> batches_;      ///< batches applied
+    std::atomic<uint64_t> overflows_;    ///< requests refused
+    std::atomic<size_t> max_depth_;      ///< largest depth
+    LatencyHistogram wait_;              ///< time requests waited
+
+    std::atomic<bool> sleeping_;         ///< worker waits for a push
+    std::mutex mutex_;                   ///< protects stop_ and the waits
+    std::condition_variable cond_;       ///< wakes the worker up
+    std::condition_variable done_;       ///< signals applied batches
+    bool stop_;                          ///< worker should terminate
+
+    std::thread thread_;                 ///< worker thread
+};
+
+#endif /* APPLY_QUEUE_H */
@@ -0,0 +1,352 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file apply_latency.cc
+///
+/// End-to-end latency harness. Commits changes to the running datastore
+/// at a fixed rate and measures the time from sr_commit() until the
+/// configuration containing the change is acknowledged by Kea. Kea is
+/// replaced by the mock server running in this process, on the socket
+/// the plugin (loaded in sysrepo-plugind) sends to.
+///
+/// Every commit sets a global timer to a unique value. When a config-set
+/// arrives, the value it carries tells which commits it covers (pushes
+/// may be coalesced), and all of them are acknowledged at once.
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "plugin-kea.h"
+#include "json-writer.h"
+#include "mock-kea.h"
+
+extern "C" {
+#include "sysrepo.h"
+};
+
+using namespace std;
+
+namespace {
+
+typedef MockKeaServer::Clock Clock;
+
+/// Values written by the harness start here (and must fit uint32).
+const int64_t VALUE_BASE = 1000000;
+
+/// @brief State shared with the mock server observer.
+struct Tracker {
+    Tracker(size_t commits)
+        :started(commits), acked(commits), failed(commits, false), next(0),
+         pushes(0) {
+    }
+
+    mutex lock;                           ///< protects everything
+    condition_variable all_acked;         ///< signalled on progress
+    vector<Clock::time_point> started;    ///< sr_commit() called
+    vector<Clock::time_point> acked;      ///< config-set answered
+    vector<bool> failed;                  ///< config-set returned error
+    size_t next;                          ///< first commit not acked yet
+    size_t pushes;                        ///< config-sets covering commits
+};
+
+/// @brief Returns percentile (nearest rank) of sorted values.
+double
+percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return (0);
+    }
+    size_t rank = static_cast<size_t>(ceil(p * sorted.size()));
+    return (sorted[rank ? rank - 1 : 0]);
+}
+
+void
+usage() {
+    cerr << "usage: apply_latency [-s socket] [-x xpath] [-r rate] [-n commits]" << endl
+         << "                     [-w wait-ms] [-d delay-ms] [-e n] [-o file]" << endl
+         << "  -s  Kea socket the plugin uses (default " << KEA_CONTROL_SOCKET << ")" << endl
+         << "  -x  global leaf to change (default .../serv-attributes/renew-timer)" << endl
+         << "  -r  commits per second (default 10)" << endl
+         << "  -n  number of commits (default 200)" << endl
+         << "  -w  how long to wait for outstanding acks (default 5000)" << endl
+         << "  -d  mock config-set response delay in ms (default 0)" << endl
+         << "  -e  mock fails every n-th config-set (default never)" << endl
+         << "  -o  write results as JSON to the file" << endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    string socket_path = KEA_CONTROL_SOCKET;
+    string xpath = "/ietf-kea-dhcpv6:server/serv-attributes/renew-timer";
+    double rate = 10;
+    size_t commits = 200;
+    int wait_ms = 5000;
+    int delay = 0;
+    size_t fail_every = 0;
+    const char* output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:x:r:n:w:d:e:o:h")) != -1) {
+        switch (opt) {
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'x':
+            xpath = optarg;
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'n':
+            commits = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            wait_ms = atoi(optarg);
+            break;
+        case 'd':
+            delay = atoi(optarg);
+            break;
+        case 'e':
+            fail_every = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage();
+            return (EXIT_FAILURE);
+        }
+    }
+    if (rate <= 0 || !commits) {
+        usage();
+        return (EXIT_FAILURE);
+    }
+
+    // Name of the leaf in the Dhcp6 map (same as in the model).
+    const string leaf = xpath.substr(xpath.rfind('/') + 1);
+
+    Tracker tracker(commits);
+
+    MockKeaServer server(socket_path);
+    server.setDelay("config-set", delay);
+    server.setFailure("config-set", fail_every);
+    server.setObserver([&](const MockKeaServer::Record& r, const JsonValue& args) {
+        if (r.command != "config-set") {
+            return;
+        }
+        const JsonValue* dhcp6 = args.get("Dhcp6");
+        const JsonValue* value = dhcp6 ? dhcp6->get(leaf) : NULL;
+        if (!value || value->getType() != JsonValue::JSON_INT) {
+            return;
+        }
+        int64_t last = value->intValue() - VALUE_BASE;
+        lock_guard<mutex> lock(tracker.lock);
+        if (last < 0 || static_cast<size_t>(last) < tracker.next) {
+            // Initial push or a repeated one
+            return;
+        }
+        for (; tracker.next <= static_cast<size_t>(last) &&
+               tracker.next < commits; tracker.next++) {
+            tracker.acked[tracker.next] = r.answered;
+            tracker.failed[tracker.next] = (r.result != 0);
+        }
+        tracker.pushes++;
+        tracker.all_acked.notify_all();
+    });
+
+    string error;
+    if (!server.start(error)) {
+        cerr << "Failed to start mock Kea: " << error << endl;
+        return (EXIT_FAILURE);
+    }
+
+    sr_conn_ctx_t *conn = NULL;
+    sr_session_ctx_t *sess = NULL;
+    int rc = sr_connect("apply latency", SR_CONN_DEFAULT, &conn);
+    if (rc != SR_ERR_OK) {
+        cerr << "Failed to connect: " << sr_strerror(rc) << endl;
+        return (EXIT_FAILURE);
+    }
+    rc = sr_session_start(conn, SR_DS_RUNNING, SR_SESS_DEFAULT, &sess);
+    if (rc != SR_ERR_OK) {
+        cerr << "Failed to start session: " << sr_strerror(rc) << endl;
+        sr_disconnect(conn);
+        return (EXIT_FAILURE);
+    }
+
+    // Remember the value to put it back when done.
+    sr_val_t* original = NULL;
+    if (sr_get_item(sess, xpath.c_str(), &original) != SR_ERR_OK) {
+        original = NULL;
+    }
+
+    cerr << "committing " << commits << " change(s) of " << xpath << " at "
+         << rate << "/s" << endl;
+
+    vector<double> commit_ms(commits);
+    size_t commit_errors = 0;
+    const Clock::duration period =
+        chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / rate));
+    const Clock::time_point start = Clock::now();
+
+    for (size_t i = 0; i < commits; i++) {
+        // Open loop: commits are due at fixed times, even if the
+        // previous ones took longer.
+        this_thread::sleep_until(start + period * i);
+
+        char value[32];
+        snprintf(value, sizeof(value), "%lld",
+                 static_cast<long long>(VALUE_BASE + i));
+        rc = sr_set_item_str(sess, xpath.c_str(), value, SR_EDIT_DEFAULT);
+
+        Clock::time_point before = Clock::now();
+        {
+            lock_guard<mutex> lock(tracker.lock);
+            tracker.started[i] = before;
+        }
+        if (rc == SR_ERR_OK) {
+            rc = sr_commit(sess);
+        }
+        commit_ms[i] = chrono::duration<double, milli>(Clock::now() - before).count();
+        if (rc != SR_ERR_OK) {
+            cerr << "commit " << i << " failed: " << sr_strerror(rc) << endl;
+            sr_discard_changes(sess);
+            commit_errors++;
+        }
+    }
+    const double elapsed = chrono::duration<double>(Clock::now() - start).count();
+
+    {
+        unique_lock<mutex> lock(tracker.lock);
+        tracker.all_acked.wait_for(lock, chrono::milliseconds(wait_ms),
+                                   [&] { return (tracker.next >= commits); });
+    }
+
+    if (original) {
+        sr_set_item(sess, xpath.c_str(), original, SR_EDIT_DEFAULT);
+        sr_commit(sess);
+        sr_free_val(original);
+    }
+    sr_session_stop(sess);
+    sr_disconnect(conn);
+    server.stop();
+
+    // Everything below works on data the observer no longer touches.
+    vector<double> latency;
+    size_t failed = 0;
+    for (size_t i = 0; i < tracker.next; i++) {
+        latency.push_back(chrono::duration<double, milli>(
+            tracker.acked[i] - tracker.started[i]).count());
+        if (tracker.failed[i]) {
+            failed++;
+        }
+    }
+    vector<double> sorted = latency;
+    sort(sorted.begin(), sorted.end());
+    vector<double> sorted_commit = commit_ms;
+    sort(sorted_commit.begin(), sorted_commit.end());
+    const size_t lost = commits - tracker.next;
+
+    cout << "commits:        " << commits << " in " << elapsed << " s ("
+         << commits / elapsed << "/s), " << commit_errors << " failed" << endl;
+    cout << "config-sets:    " << tracker.pushes << " covering "
+         << tracker.next << " commit(s), " << failed
+         << " commit(s) acked with error, " << lost << " never acked" << endl;
+    cout << "sr_commit ms:   p50 " << percentile(sorted_commit, 0.5)
+         << "  p99 " << percentile(sorted_commit, 0.99)
+         << "  max " << (sorted_commit.empty() ? 0 : sorted_commit.back()) << endl;
+    cout << "commit-to-ack ms: p50 " << percentile(sorted, 0.5)
+         << "  p99 " << percentile(sorted, 0.99)
+         << "  p999 " << percentile(sorted, 0.999)
+         << "  max " << (sorted.empty() ? 0 : sorted.back()) << endl;
+
+    // Histogram with power of two buckets (in milliseconds)
+    vector<size_t> buckets;
+    for (size_t i = 0; i < latency.size(); i++) {
+        size_t b = 0;
+        while (latency[i] >= (1 << b) * 0.125 && b < 30) {
+            b++;
+        }
+        if (buckets.size() <= b) {
+            buckets.resize(b + 1, 0);
+        }
+        buckets[b]++;
+    }
+    for (size_t b = 0; b < buckets.size(); b++) {
+        if (!buckets[b]) {
+            continue;
+        }
+        char line[64];
+        snprintf(line, sizeof(line), "  < %10.3f ms %8zu ", (1 << b) * 0.125,
+                 buckets[b]);
+        cout << line << string(buckets[b] * 50 / latency.size(), '#') << endl;
+    }
+
+    if (output) {
+        string json;
+        JsonWriter w(json, JsonWriter::PRETTY);
+        w.startMap();
+        w.key("commits");
+        w.value(static_cast<uint64_t>(commits));
+        w.key("rate");
+        w.value(rate);
+        w.key("mock-delay-ms");
+        w.value(delay);
+        w.key("mock-fail-every");
+        w.value(static_cast<uint64_t>(fail_every));
+        w.key("commit-errors");
+        w.value(static_cast<uint64_t>(commit_errors));
+        w.key("config-sets");
+        w.value(static_cast<uint64_t>(tracker.pushes));
+        w.key("acked-with-error");
+        w.value(static_cast<uint64_t>(failed));
+        w.key("never-acked");
+        w.value(static_cast<uint64_t>(lost));
+        w.key("commit-to-ack-ms");
+        w.startMap();
+        w.key("p50");
+        w.value(percentile(sorted, 0.5));
+        w.key("p99");
+        w.value(percentile(sorted, 0.99));
+        w.key("p999");
+        w.value(percentile(sorted, 0.999));
+        w.key("max");
+        w.value(sorted.empty() ? 0.0 : sorted.back());
+        w.key("histogram");
+        w.startList();
+        for (size_t b = 0; b < buckets.size(); b++) {
+            w.startMap();
+            w.key("below-ms");
+            w.value((1 << b) * 0.125);
+            w.key("count");
+            w.value(static_cast<uint64_t>(buckets[b]));
+            w.endMap();
+        }
+        w.endList();
+        w.endMap();
+        w.endMap();
+        json += '\n';
+
+        ofstream out(output);
+        out << json;
+        if (!out) {
+            cerr << "Failed to write " << output << endl;
+            return (EXIT_FAILURE);
+        }
+    }
+
+    return (lost || commit_errors ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,368 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file bench_leases.cc
+///
+/// Benchmark of the lease view. A mock Kea with a synthetic lease
+/// database runs in a child process (so it doesn't count toward the
+/// memory figures), and typical gets of the lease6 list are answered
+/// the way the plugin answers them: page by page, converted to Sysrepo
+/// values. For each get the time to the first lease, the total time,
+/// the number of pages and the peak RSS are reported as JSON, and the
+/// number of leases returned is checked.
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "json-writer.h"
+#include "kea-leases.h"
+#include "mock-kea.h"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+/// xpath of the lease list (as in the plugin)
+const char* LIST_XPATH = "/ietf-kea-dhcpv6:server/leases/lease6";
+
+/// @brief A get of the lease list.
+struct Get {
+    string name;          ///< what is measured
+    LeaseQuery query;     ///< leases asked for
+    bool values;          ///< whether Sysrepo values are built
+    size_t expected;      ///< leases matching the query
+};
+
+/// @brief Figures of a single get.
+struct Sample {
+    double first_ms;      ///< time to the first lease
+    double wall_ms;       ///< time to the last lease
+    size_t pages;         ///< commands sent to Kea
+    size_t received;      ///< leases received from Kea
+    size_t leases;        ///< leases returned
+    size_t values;        ///< Sysrepo values built
+    bool truncated;       ///< leases left out because of the limit
+    long peak_rss_kb;     ///< peak resident set size
+};
+
+/// @brief Resets the peak RSS of the process (Linux 4.0 and later).
+///
+/// @return true if the peak was reset
+bool
+resetPeakRss() {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) {
+        return (false);
+    }
+    bool ok = fputs("5", f) >= 0;
+    return (fclose(f) == 0 && ok);
+}
+
+/// @brief Returns peak RSS since the last reset (or process start).
+long
+getPeakRss() {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                kb = strtol(line + 6, NULL, 10);
+                break;
+            }
+        }
+        fclose(f);
+        if (kb >= 0) {
+            return (kb);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_maxrss);
+}
+
+/// @brief Runs the mock Kea in a child process.
+///
+/// @return pid of the child (-1 on failure), once the socket is ready
+pid_t
+startMock(const string& socket_path, size_t subnets, size_t per_subnet,
+          size_t delegated) {
+    int ready[2];
+    if (pipe(ready) < 0) {
+        return (-1);
+    }
+    pid_t pid = fork();
+    if (pid != 0) {
+        close(ready[1]);
+        char c = 0;
+        bool ok = (pid > 0) && (read(ready[0], &c, 1) == 1) && c;
+        close(ready[0]);
+        if (pid > 0 && !ok) {
+            waitpid(pid, NULL, 0);
+            return (-1);
+        }
+        return (pid);
+    }
+
+    close(ready[0]);
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    MockKeaServer server(socket_path);
+    server.setLeases(subnets, per_subnet, delegated);
+    string error;
+    char c = server.start(error) ? 1 : 0;
+    if (!c) {
+        cerr << "Failed to start mock Kea: " << error << endl;
+    }
+    if (write(ready[1], &c, 1) < 0 || !c) {
+        _exit(EXIT_FAILURE);
+    }
+    int sig = 0;
+    sigwait(&signals, &sig);
+    server.stop();
+    _exit(EXIT_SUCCESS);
+}
+
+/// @brief Runs one get and collects its figures.
+Sample
+measure(const string& socket_path, const Get& get, size_t page_size,
+        size_t limit) {
+    Sample sample;
+    sample.first_ms = -1;
+    sample.leases = 0;
+    sample.values = 0;
+    sample.truncated = false;
+
+    resetPeakRss();
+    KeaControlChannel kea(socket_path);
+    KeaLeasePager pager(kea, page_size);
+    sr_val_t* values = NULL;
+    size_t capacity = 0;
+    string error;
+
+    const Clock::time_point start = Clock::now();
+    // Same as getLeaseValues(), but timing the first lease too.
+    pager.forEach(get.query, [&](const JsonValue& lease) {
+        if (sample.first_ms < 0) {
+            sample.first_ms = chrono::duration<double, milli>(Clock::now() - start).count();
+        }
+        if (get.values && limit && sample.leases >= limit) {
+            sample.truncated = true;
+            return (false);
+        }
+        sample.leases++;
+        return (!get.values ||
+                appendLeaseValues(lease, LIST_XPATH, &values, &sample.values,
+                                  &capacity) == SR_ERR_OK);
+    }, error);
+    sample.wall_ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    sample.peak_rss_kb = getPeakRss();
+    sample.pages = pager.getPages();
+    sample.received = pager.getLeases();
+
+    if (!error.empty()) {
+        cerr << get.name << ": " << error << endl;
+    }
+    sr_free_values(values, sample.values);
+    return (sample);
+}
+
+void
+usage() {
+    cerr << "usage: bench_leases [-n leases] [-s subnets] [-d prefixes] [-p page-size]" << endl
+         << "                    [-l limit] [-S socket] [-o file]" << endl
+         << "  -n  leased addresses in the mock lease database (default 1000000)" << endl
+         << "  -s  subnets the leases are spread over (default 100)" << endl
+         << "  -d  delegated prefixes per subnet, outside of the subnet prefix" << endl
+         << "      (default a tenth of the addresses)" << endl
+         << "  -p  leases per lease6-get-page (default "
+         << KeaLeasePager::DEFAULT_PAGE_SIZE << ")" << endl
+         << "  -l  leases returned per get (default 10000, 0 for no limit)" << endl
+         << "  -S  socket of the mock (default /tmp/bench-leases.sock)" << endl
+         << "  -o  output file (default stdout)" << endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    size_t total = 1000000;
+    size_t subnets = 100;
+    long delegated = -1;
+    size_t page_size = KeaLeasePager::DEFAULT_PAGE_SIZE;
+    size_t limit = 10000;
+    string socket_path = "/tmp/bench-leases.sock";
+    const char* output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:d:p:l:S:o:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            total = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            subnets = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            delegated = strtol(optarg, NULL, 10);
+            break;
+        case 'p':
+            page_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            limit = strtoul(optarg, NULL, 10);
+            break;
+        case 'S':
+            socket_path = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage();
+            return (EXIT_FAILURE);
+        }
+    }
+    if (!subnets || total < subnets || !page_size) {
+        usage();
+        return (EXIT_FAILURE);
+    }
+    const size_t per_subnet = total / subnets;
+    const size_t prefixes = delegated < 0 ? per_subnet / 10 : delegated;
+    const size_t leases = subnets * (per_subnet + prefixes);
+
+    pid_t mock = startMock(socket_path, subnets, per_subnet, prefixes);
+    if (mock < 0) {
+        return (EXIT_FAILURE);
+    }
+
+    // Gets a collector or an operator would do
+    const size_t subnet = subnets / 2 + 1;
+    ostringstream prefix;
+    prefix << "2001:db8:" << hex << subnet << "::/48";
+    ostringstream address;
+    address << "2001:db8:" << hex << subnet << "::" << per_subnet / 2 + 1;
+
+    vector<Get> gets;
+    Get get;
+    get.values = true;
+    get.name = "all";
+    get.expected = leases;
+    gets.push_back(get);
+
+    // The plugin scans the subnet prefix only when the subnet delegates
+    // no prefixes.
+    get.name = "subnet";
+    get.query.has_subnet = true;
+    get.query.subnet_id = subnet;
+    if (!prefixes) {
+        get.query.prefix = prefix.str();
+    }
+    get.expected = per_subnet + prefixes;
+    gets.push_back(get);
+
+    get.name = "subnet-without-prefix";
+    get.query.prefix.clear();
+    gets.push_back(get);
+
+    get.name = "address";
+    get.query = LeaseQuery();
+    get.query.address = address.str();
+    get.expected = 1;
+    gets.push_back(get);
+
+    get.name = "walk-all-leases";
+    get.query = LeaseQuery();
+    get.values = false;
+    get.expected = leases;
+    gets.push_back(get);
+
+    string json;
+    JsonWriter w(json, JsonWriter::PRETTY);
+    w.startMap();
+    w.key("leases");
+    w.value(static_cast<uint64_t>(leases));
+    w.key("subnets");
+    w.value(static_cast<uint64_t>(subnets));
+    w.key("delegated-prefixes");
+    w.value(static_cast<uint64_t>(subnets * prefixes));
+    w.key("page-size");
+    w.value(static_cast<uint64_t>(page_size));
+    w.key("limit");
+    w.value(static_cast<uint64_t>(limit));
+    w.key("gets");
+    w.startList();
+    bool missed = false;
+    for (size_t i = 0; i < gets.size(); i++) {
+        Sample s = measure(socket_path, gets[i], page_size, limit);
+        cerr << gets[i].name << ": " << s.leases << " lease(s) from "
+             << s.pages << " command(s), first after " << s.first_ms
+             << " ms, all after " << s.wall_ms << " ms, peak RSS "
+             << s.peak_rss_kb << " kB" << endl;
+
+        size_t expected = gets[i].expected;
+        if (gets[i].values && limit && expected > limit) {
+            expected = limit;
+        }
+        if (s.leases != expected) {
+            cerr << gets[i].name << ": expected " << expected << " lease(s)" << endl;
+            missed = true;
+        }
+
+        w.startMap();
+        w.key("name");
+        w.value(gets[i].name);
+        w.key("first-lease-ms");
+        w.value(s.first_ms);
+        w.key("wall-ms");
+        w.value(s.wall_ms);
+        w.key("commands");
+        w.value(static_cast<uint64_t>(s.pages));
+        w.key("leases-received");
+        w.value(static_cast<uint64_t>(s.received));
+        w.key("leases-returned");
+        w.value(static_cast<uint64_t>(s.leases));
+        w.key("truncated");
+        w.value(s.truncated);
+        w.key("sysrepo-values");
+        w.value(static_cast<uint64_t>(s.values));
+        w.key("peak-rss-kb");
+        w.value(static_cast<int64_t>(s.peak_rss_kb));
+        w.endMap();
+    }
+    w.endList();
+    w.endMap();
+    json += '\n';
+
+    kill(mock, SIGTERM);
+    waitpid(mock, NULL, 0);
+
+    if (output) {
+        ofstream out(output);
+        out << json;
+        if (!out) {
+            cerr << "Failed to write " << output << endl;
+            return (EXIT_FAILURE);
+        }
+    } else {
+        cout << json;
+    }
+    return (missed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
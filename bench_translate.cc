@@ -0,0 +1,450 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file bench_translate.cc
+///
+/// Benchmark of SysrepoKea::getConfig(). For each scale the startup
+/// datastore is filled with a synthetic configuration and translated,
+/// first from scratch and then after a change to a single subnet.
+/// Translation from scratch may also be measured with several threads.
+/// Results are written as JSON.
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "datastore-gen.h"
+#include "json-writer.h"
+#include "yang-kea.h"
+
+using namespace std;
+
+namespace {
+
+/// Heap allocations made while counting is enabled (by any thread)
+std::atomic<size_t> allocs(0);
+
+/// Bytes allocated while counting is enabled
+std::atomic<size_t> alloc_bytes(0);
+
+/// Whether allocations are counted
+bool counting = false;
+
+}
+
+void*
+operator new(size_t size) {
+    if (counting) {
+        allocs.fetch_add(1, std::memory_order_relaxed);
+        alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return (ptr);
+}
+
+void*
+operator new[](size_t size) {
+    return (operator new(size));
+}
+
+void
+operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void
+operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+namespace {
+
+/// @brief Figures of a single translation.
+struct Sample {
+    double wall_ms;       ///< wall time
+    size_t sr_calls;      ///< Sysrepo calls
+    size_t bytes;         ///< size of the generated JSON
+    size_t allocs;        ///< heap allocations
+    size_t alloc_bytes;   ///< bytes allocated on the heap
+    long peak_rss_kb;     ///< peak resident set size
+    size_t rebuilt;       ///< fragments rebuilt
+    size_t reused;        ///< fragments reused
+};
+
+/// @brief Resets the peak RSS of the process (Linux 4.0 and later).
+///
+/// @return true if the peak was reset
+bool
+resetPeakRss() {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) {
+        return (false);
+    }
+    bool ok = fputs("5", f) >= 0;
+    return (fclose(f) == 0 && ok);
+}
+
+/// @brief Returns peak RSS since the last reset (or process start).
+long
+getPeakRss() {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                kb = strtol(line + 6, NULL, 10);
+                break;
+            }
+        }
+        fclose(f);
+        if (kb >= 0) {
+            return (kb);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_maxrss);
+}
+
+/// @brief Runs one getConfig() and collects its figures.
+Sample
+measure(SysrepoKea& translator) {
+    Sample sample;
+
+    resetPeakRss();
+    size_t calls = translator.getSysrepoCalls();
+    allocs = 0;
+    alloc_bytes = 0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    counting = true;
+    string json = translator.getConfig();
+    counting = false;
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    sample.wall_ms = chrono::duration<double, milli>(end - start).count();
+    sample.sr_calls = translator.getSysrepoCalls() - calls;
+    sample.bytes = json.size();
+    sample.allocs = allocs;
+    sample.alloc_bytes = alloc_bytes;
+    sample.peak_rss_kb = getPeakRss();
+    sample.rebuilt = translator.getRebuiltFragments();
+    sample.reused = translator.getReusedFragments();
+    return (sample);
+}
+
+/// @brief Returns median of wall times of repeated runs.
+double
+medianTime(const vector<Sample>& samples) {
+    vector<double> times;
+    for (size_t i = 0; i < samples.size(); i++) {
+        times.push_back(samples[i].wall_ms);
+    }
+    sort(times.begin(), times.end());
+    return (times[times.size() / 2]);
+}
+
+/// @brief Writes figures of repeated runs (times as min and median).
+///
+/// @param w writer to be used
+/// @param samples figures of the runs
+/// @param threads number of translation threads (not written if 0)
+/// @param baseline median time of a single thread (for speedup)
+void
+writeSamples(JsonWriter& w, vector<Sample>& samples, size_t threads = 0,
+             double baseline = 0) {
+    vector<double> times;
+    for (size_t i = 0; i < samples.size(); i++) {
+        times.push_back(samples[i].wall_ms);
+    }
+    sort(times.begin(), times.end());
+
+    // Everything but the time is the same for every run.
+    const Sample& s = samples.back();
+    w.startMap();
+    if (threads) {
+        w.key("threads");
+        w.value(static_cast<uint64_t>(threads));
+        w.key("speedup");
+        w.value(baseline / medianTime(samples));
+    }
+    w.key("runs");
+    w.value(static_cast<uint64_t>(samples.size()));
+    w.key("wall-ms-min");
+    w.value(times.front());
+    w.key("wall-ms-median");
+    w.value(medianTime(samples));
+    w.key("sysrepo-calls");
+    w.value(static_cast<uint64_t>(s.sr_calls));
+    w.key("bytes");
+    w.value(static_cast<uint64_t>(s.bytes));
+    w.key("allocations");
+    w.value(static_cast<uint64_t>(s.allocs));
+    w.key("allocated-bytes");
+    w.value(static_cast<uint64_t>(s.alloc_bytes));
+    w.key("peak-rss-kb");
+    w.value(static_cast<int64_t>(s.peak_rss_kb));
+    w.key("fragments-rebuilt");
+    w.value(static_cast<uint64_t>(s.rebuilt));
+    w.key("fragments-reused");
+    w.value(static_cast<uint64_t>(s.reused));
+    w.endMap();
+}
+
+/// @brief Parses comma separated list of numbers.
+///
+/// @return false if the list is malformed
+bool
+parseSizes(const string& text, vector<size_t>& sizes) {
+    for (const char* p = text.c_str(); *p; ) {
+        char* end = NULL;
+        sizes.push_back(strtoul(p, &end, 10));
+        if (end == p || (*end && *end != ',')) {
+            return (false);
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return (true);
+}
+
+void
+usage() {
+    cerr << "usage: bench_translate [-f] [-s scales] [-p pools] [-r hosts]" << endl
+         << "                       [-O option-sets] [-n runs] [-c batch] [-t threads]" << endl
+         << "                       [-o file]" << endl
+         << "  -f  overwrite existing ietf-kea-dhcpv6 data in the startup datastore" << endl
+         << "  -s  comma separated numbers of subnets (default 1,1000,10000,100000)" << endl
+         << "  -p  pools per subnet (default 2)" << endl
+         << "  -r  reserved hosts per subnet (default 4)" << endl
+         << "  -O  option sets (default 8)" << endl
+         << "  -n  translations per scale (default 3)" << endl
+         << "  -c  edits per commit when generating (default all in one)" << endl
+         << "  -t  comma separated numbers of translation threads to compare" << endl
+         << "      with a single one (default none, e.g. 2,4,8,16,32)" << endl
+         << "  -o  output file (default stdout)" << endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    DatastoreShape shape;
+    shape.pools = 2;
+    shape.hosts = 4;
+    shape.option_sets = 8;
+    string scales = "1,1000,10000,100000";
+    string thread_counts;
+    size_t runs = 3;
+    size_t batch = 0;
+    const char* output = NULL;
+    bool force = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "fs:p:r:O:n:c:t:o:h")) != -1) {
+        switch (opt) {
+        case 'f':
+            force = true;
+            break;
+        case 's':
+            scales = optarg;
+            break;
+        case 'p':
+            shape.pools = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            shape.hosts = strtoul(optarg, NULL, 10);
+            break;
+        case 'O':
+            shape.option_sets = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            runs = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            batch = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            thread_counts = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage();
+            return (EXIT_FAILURE);
+        }
+    }
+    if (!runs) {
+        runs = 1;
+    }
+
+    vector<size_t> subnets;
+    vector<size_t> threads;
+    if (!parseSizes(scales, subnets) || !parseSizes(thread_counts, threads)) {
+        usage();
+        return (EXIT_FAILURE);
+    }
+
+    sr_conn_ctx_t *conn = NULL;
+    sr_session_ctx_t *sess = NULL;
+    int rc = sr_connect("bench translate", SR_CONN_DEFAULT, &conn);
+    if (rc != SR_ERR_OK) {
+        cerr << "Failed to connect: " << sr_strerror(rc) << endl;
+        return (EXIT_FAILURE);
+    }
+    rc = sr_session_start(conn, SR_DS_STARTUP, SR_SESS_DEFAULT, &sess);
+    if (rc != SR_ERR_OK) {
+        cerr << "Failed to start session: " << sr_strerror(rc) << endl;
+        sr_disconnect(conn);
+        return (EXIT_FAILURE);
+    }
+
+    // Don't wipe a real configuration by accident.
+    sr_val_t* values = NULL;
+    size_t cnt = 0;
+    rc = sr_get_items(sess, "/ietf-kea-dhcpv6:server/*", &values, &cnt);
+    sr_free_values(values, cnt);
+    if (rc == SR_ERR_OK && cnt && !force) {
+        cerr << "The startup datastore contains ietf-kea-dhcpv6 data, "
+             << "use -f to overwrite it" << endl;
+        sr_session_stop(sess);
+        sr_disconnect(conn);
+        return (EXIT_FAILURE);
+    }
+
+    string result;
+    JsonWriter w(result, JsonWriter::PRETTY);
+    w.startMap();
+    w.key("benchmark");
+    w.value("translate");
+    w.key("timestamp");
+    w.value(static_cast<int64_t>(time(NULL)));
+    w.key("pools-per-subnet");
+    w.value(static_cast<uint64_t>(shape.pools));
+    w.key("hosts-per-subnet");
+    w.value(static_cast<uint64_t>(shape.hosts));
+    w.key("option-sets");
+    w.value(static_cast<uint64_t>(shape.option_sets));
+    w.key("results");
+    w.startList();
+
+    DatastoreGenerator generator(sess);
+    generator.setCommitBatch(batch);
+    int status = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < subnets.size(); i++) {
+        shape.subnets = subnets[i];
+        cerr << "generating " << shape.subnets << " subnet(s)" << endl;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        rc = generator.generate(shape);
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        if (rc != SR_ERR_OK) {
+            cerr << "Failed to generate datastore: " << generator.getError() << endl;
+            status = EXIT_FAILURE;
+            break;
+        }
+        sr_session_refresh(sess);
+
+        w.startMap();
+        w.key("subnets");
+        w.value(static_cast<uint64_t>(shape.subnets));
+        w.key("items");
+        w.value(static_cast<uint64_t>(generator.getItems()));
+        w.key("generate-ms");
+        w.value(chrono::duration<double, milli>(end - start).count());
+
+        // Translation from scratch
+        vector<Sample> cold;
+        for (size_t r = 0; r < runs; r++) {
+            SysrepoKea translator(sess);
+            cold.push_back(measure(translator));
+        }
+        w.key("full");
+        writeSamples(w, cold);
+
+        // The same with more threads
+        if (!threads.empty()) {
+            w.key("parallel");
+            w.startList();
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            vector<Sample> parallel;
+            for (size_t r = 0; r < runs; r++) {
+                SysrepoKea translator(sess);
+                rc = translator.setThreads(threads[t], conn, SR_DS_STARTUP);
+                if (rc != SR_ERR_OK) {
+                    break;
+                }
+                parallel.push_back(measure(translator));
+            }
+            if (parallel.empty()) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            writeSamples(w, parallel, threads[t], medianTime(cold));
+            cerr << "  full with " << threads[t] << " thread(s) "
+                 << parallel.back().wall_ms << " ms" << endl;
+        }
+        if (!threads.empty()) {
+            w.endList();
+        }
+
+        // Translation after a change to the first subnet's pool
+        SysrepoKea translator(sess);
+        translator.getConfig();
+        char xpath[256];
+        snprintf(xpath, sizeof(xpath), "/ietf-kea-dhcpv6:server/network-ranges/"
+                 "subnet6[subnet='2001:db8:0:0::/64']/pools/"
+                 "address-pool[pool-id='1']/pool-prefix");
+        vector<Sample> incremental;
+        for (size_t r = 0; r < runs; r++) {
+            translator.markChanged(xpath);
+            incremental.push_back(measure(translator));
+        }
+        w.key("incremental");
+        writeSamples(w, incremental);
+
+        w.endMap();
+
+        cerr << "  full " << cold.back().wall_ms << " ms, incremental "
+             << incremental.back().wall_ms << " ms" << endl;
+    }
+
+    w.endList();
+    w.endMap();
+    result += '\n';
+
+    if (output) {
+        ofstream out(output);
+        out << result;
+        if (!out) {
+            cerr << "Failed to write " << output << endl;
+            status = EXIT_FAILURE;
+        }
+    } else {
+        cout << result;
+    }
+
+    generator.clear();
+    sr_session_stop(sess);
+    sr_disconnect(conn);
+
+    return (status);
+}
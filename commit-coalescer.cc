@@ -0,0 +1,104 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file commit-coalescer.cc
+
+#include "commit-coalescer.h"
+
+using namespace std;
+
+CommitCoalescer::CommitCoalescer(int window, int max_latency,
+                                 const FlushFunction& flush)
+    :window_(window), max_latency_(max_latency), flush_(flush), pending_(0),
+     in_flight_(0), stop_(false), pushes_(0), commits_(0),
+     last_batch_(0), max_batch_(0) {
+    thread_ = thread(&CommitCoalescer::run, this);
+}
+
+CommitCoalescer::~CommitCoalescer() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void
+CommitCoalescer::commit() {
+    lock_guard<mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    if (pending_ == in_flight_) {
+        // First commit not covered by a push (in progress or future).
+        first_ = now;
+    }
+    last_ = now;
+    pending_++;
+    commits_++;
+    cond_.notify_all();
+}
+
+size_t
+CommitCoalescer::getPushes() const {
+    lock_guard<mutex> lock(mutex_);
+    return (pushes_);
+}
+
+size_t
+CommitCoalescer::getCommits() const {
+    lock_guard<mutex> lock(mutex_);
+    return (commits_);
+}
+
+size_t
+CommitCoalescer::getLastBatch() const {
+    lock_guard<mutex> lock(mutex_);
+    return (last_batch_);
+}
+
+size_t
+CommitCoalescer::getMaxBatch() const {
+    lock_guard<mutex> lock(mutex_);
+    return (max_batch_);
+}
+
+void
+CommitCoalescer::run() {
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+        if (!pending_) {
+            if (stop_) {
+                return;
+            }
+            cond_.wait(lock);
+            continue;
+        }
+
+        // Push once things calm down, but never delay the oldest commit
+        // by more than the latency bound.
+        Clock::time_point deadline = min(last_ + window_, first_ + max_latency_);
+        if (!stop_ && Clock::now() < deadline) {
+            cond_.wait_until(lock, deadline);
+            continue;
+        }
+
+        size_t batch = pending_;
+        in_flight_ = batch;
+
+        lock.unlock();
+        flush_(batch);
+        lock.lock();
+
+        // Commits that arrived during the push wait for the next one.
+        pending_ -= batch;
+        in_flight_ = 0;
+        pushes_++;
+        last_batch_ = batch;
+        if (batch > max_batch_) {
+            max_batch_ = batch;
+        }
+    }
+}
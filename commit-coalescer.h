@@ -0,0 +1,84 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file commit-coalescer.h
+
+#ifndef COMMIT_COALESCER_H
+#define COMMIT_COALESCER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/// @brief Merges bursts of commits into a single push.
+///
+/// Each commit is reported with commit(). A background thread calls the
+/// flush function once no commit has arrived for the window, or once
+/// the oldest pending commit has waited for the maximum latency,
+/// whichever comes first. The flush function gets the number of commits
+/// it covers. The maximum latency bound makes sure that a steady stream
+/// of commits cannot postpone the push forever.
+class CommitCoalescer {
+public:
+    /// Function called to push pending commits (gets their number)
+    typedef std::function<void (size_t)> FlushFunction;
+
+    /// @brief Constructor
+    ///
+    /// @param window quiet period after the last commit (milliseconds)
+    /// @param max_latency maximum delay of the first pending commit
+    ///        (milliseconds)
+    /// @param flush function pushing the configuration
+    CommitCoalescer(int window, int max_latency, const FlushFunction& flush);
+
+    /// @brief Destructor (flushes pending commits and stops the thread)
+    ~CommitCoalescer();
+
+    /// @brief Records a commit.
+    ///
+    /// Returns immediately; the push happens on the background thread.
+    void commit();
+
+    /// @brief Returns number of pushes done so far.
+    size_t getPushes() const;
+
+    /// @brief Returns number of commits recorded so far.
+    size_t getCommits() const;
+
+    /// @brief Returns number of commits covered by the last push.
+    size_t getLastBatch() const;
+
+    /// @brief Returns the largest number of commits covered by one push.
+    size_t getMaxBatch() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    /// @brief Background thread body.
+    void run();
+
+    const std::chrono::milliseconds window_;      ///< quiet period
+    const std::chrono::milliseconds max_latency_; ///< latency bound
+    FlushFunction flush_;                         ///< push function
+
+    mutable std::mutex mutex_;       ///< protects everything below
+    std::condition_variable cond_;   ///< wakes up the thread
+    size_t pending_;                 ///< commits waiting for a push
+    size_t in_flight_;               ///< commits covered by a running push
+    Clock::time_point first_;        ///< time of the oldest pending commit
+    Clock::time_point last_;         ///< time of the newest pending commit
+    bool stop_;                      ///< thread should terminate
+    size_t pushes_;                  ///< number of pushes
+    size_t commits_;                 ///< number of commits
+    size_t last_batch_;              ///< commits in the last push
+    size_t max_batch_;               ///< commits in the largest push
+
+    std::thread thread_;             ///< background thread
+};
+
+#endif /* COMMIT_COALESCER_H */
@@ -0,0 +1,177 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file config-fingerprint.cc
+
+#include "config-fingerprint.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+/// FNV-1a 64-bit offset basis
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+/// FNV-1a 64-bit prime
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+}
+
+uint64_t
+fingerprintJson(const char* json, size_t size) {
+    JsonFingerprint fingerprint;
+    fingerprint.update(json, size);
+    return (fingerprint.get());
+}
+
+JsonFingerprint::JsonFingerprint()
+    :hash_(FNV_OFFSET), in_string_(false), escaped_(false) {
+}
+
+void
+JsonFingerprint::update(const char* json, size_t size) {
+    uint64_t hash = hash_;
+    bool in_string = in_string_;
+    bool escaped = escaped_;
+
+    for (size_t i = 0; i < size; i++) {
+        const char c = json[i];
+        if (in_string) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                in_string = false;
+            }
+        } else if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+            continue;
+        } else if (c == '"') {
+            in_string = true;
+        }
+        hash ^= static_cast<uint8_t>(c);
+        hash *= FNV_PRIME;
+    }
+
+    hash_ = hash;
+    in_string_ = in_string;
+    escaped_ = escaped;
+}
+
+ConfigFingerprint::ConfigFingerprint(const string& file)
+    :file_(file), known_(false), fingerprint_(0), pending_(NULL), pending_ok_(true) {
+}
+
+bool
+ConfigFingerprint::load() {
+    known_ = false;
+    if (file_.empty()) {
+        return (false);
+    }
+    int fd = open(file_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return (false);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return (false);
+    }
+
+    // Pages are read as they are hashed and dropped afterwards.
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        cerr << "plugin-kea failed to map " << file_ << endl;
+        return (false);
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    // Written with rename(), so the document is complete.
+    fingerprint_ = fingerprintJson(static_cast<const char*>(data), size);
+    known_ = true;
+    munmap(data, size);
+    return (true);
+}
+
+bool
+ConfigFingerprint::set(uint64_t fingerprint, const string& json) {
+    begin();
+    write(json.data(), json.size());
+    return (commit(fingerprint));
+}
+
+void
+ConfigFingerprint::begin() {
+    if (pending_) {
+        fclose(pending_);
+        pending_ = NULL;
+    }
+    pending_ok_ = true;
+    if (!file_.empty()) {
+        // Replaced atomically, a crash leaves either the old or the new one.
+        pending_ = fopen((file_ + ".tmp").c_str(), "w");
+        pending_ok_ = pending_ != NULL;
+    }
+}
+
+void
+ConfigFingerprint::write(const char* data, size_t size) {
+    if (pending_ && pending_ok_ && fwrite(data, 1, size, pending_) != size) {
+        pending_ok_ = false;
+    }
+}
+
+bool
+ConfigFingerprint::commit(uint64_t fingerprint) {
+    known_ = true;
+    fingerprint_ = fingerprint;
+    if (file_.empty()) {
+        return (true);
+    }
+
+    const string tmp = file_ + ".tmp";
+    bool ok = pending_ && pending_ok_;
+    if (pending_ && fclose(pending_) != 0) {
+        ok = false;
+    }
+    pending_ = NULL;
+    if (!ok || rename(tmp.c_str(), file_.c_str()) != 0) {
+        cerr << "plugin-kea failed to write " << file_ << endl;
+        remove(tmp.c_str());
+        // An old configuration must not survive a restart.
+        remove(file_.c_str());
+        return (false);
+    }
+    return (true);
+}
+
+void
+ConfigFingerprint::clear() {
+    known_ = false;
+    if (pending_) {
+        fclose(pending_);
+        pending_ = NULL;
+        remove((file_ + ".tmp").c_str());
+    }
+    if (!file_.empty()) {
+        remove(file_.c_str());
+    }
+}
+
+ConfigFingerprint::~ConfigFingerprint() {
+    if (pending_) {
+        fclose(pending_);
+        remove((file_ + ".tmp").c_str());
+    }
+}
@@ -0,0 +1,143 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file config-fingerprint.h
+///
+/// Fingerprint of the last configuration Kea accepted, so that pushes
+/// that would not change anything can be skipped, and the document
+/// itself on disk, so that a restarted plugin does not push it again.
+
+#ifndef CONFIG_FINGERPRINT_H
+#define CONFIG_FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+/// @brief Returns the fingerprint of a JSON text.
+///
+/// The fingerprint is the 64-bit FNV-1a hash of the canonical form of
+/// the text, which is the text without whitespace outside of strings.
+/// The translator writes members in a fixed order, so two translations
+/// of the same configuration have the same canonical form whatever the
+/// indentation.
+///
+/// @param json JSON text
+/// @param size length of the text
+/// @return fingerprint
+uint64_t fingerprintJson(const char* json, size_t size);
+
+/// @brief Returns the fingerprint of a JSON text.
+inline uint64_t
+fingerprintJson(const std::string& json) {
+    return (fingerprintJson(json.data(), json.size()));
+}
+
+/// @brief Fingerprint of a JSON text read piece by piece.
+///
+/// Gives what fingerprintJson() gives for the whole text, however it
+/// is split.
+class JsonFingerprint {
+public:
+    /// @brief Constructor (fingerprint of an empty text)
+    JsonFingerprint();
+
+    /// @brief Adds the next piece of the text.
+    void update(const char* json, size_t size);
+
+    /// @brief Returns the fingerprint of the text added so far.
+    uint64_t get() const {
+        return (hash_);
+    }
+
+private:
+    uint64_t hash_;     ///< FNV-1a hash so far
+    bool in_string_;    ///< inside a string
+    bool escaped_;      ///< after a backslash in a string
+};
+
+/// @brief Fingerprint of the configuration Kea runs with.
+///
+/// The configuration is kept in a file too. At startup the file is
+/// mapped and fingerprinted in place, so that a restarted plugin does
+/// not push the configuration Kea already has, without reading a large
+/// document into memory. The file should be on storage that is cleared
+/// when Kea restarts (like the control socket), otherwise a Kea started
+/// with another configuration would not get it.
+class ConfigFingerprint {
+public:
+    /// @brief Constructor (unknown fingerprint)
+    ///
+    /// @param file file keeping the configuration (empty for none)
+    ConfigFingerprint(const std::string& file = "");
+
+    /// @brief Destructor (drops a configuration being written)
+    ~ConfigFingerprint();
+
+    /// @brief Fingerprints the configuration kept in the file.
+    ///
+    /// @return true if there was a configuration
+    bool load();
+
+    /// @brief Returns true if the fingerprint is known and equal.
+    bool matches(uint64_t fingerprint) const {
+        return (known_ && fingerprint_ == fingerprint);
+    }
+
+    /// @brief Sets the fingerprint, after Kea accepted a configuration,
+    ///        and keeps the configuration in the file.
+    ///
+    /// @param fingerprint fingerprint of that configuration
+    /// @param json that configuration
+    /// @return false if the file could not be written
+    bool set(uint64_t fingerprint, const std::string& json);
+
+    /// @brief Starts writing a configuration to the file as it is sent.
+    ///
+    /// The configuration given to write() is kept by commit() once Kea
+    /// accepted it. Anything written before is dropped.
+    void begin();
+
+    /// @brief Writes the next piece of the configuration started with
+    ///        begin().
+    void write(const char* data, size_t size);
+
+    /// @brief Sets the fingerprint, after Kea accepted the configuration
+    ///        written since begin(), and keeps that one in the file.
+    ///
+    /// @param fingerprint fingerprint of that configuration
+    /// @return false if the file could not be written
+    bool commit(uint64_t fingerprint);
+
+    /// @brief Forgets the fingerprint (and removes the file), when Kea's
+    ///        configuration was changed in another way (e.g. by targeted
+    ///        commands). A configuration being written is dropped.
+    void clear();
+
+    /// @brief Returns true if the fingerprint is known.
+    bool isKnown() const {
+        return (known_);
+    }
+
+    /// @brief Returns the fingerprint (0 if unknown).
+    uint64_t get() const {
+        return (known_ ? fingerprint_ : 0);
+    }
+
+private:
+    /// Not copyable (holds the file being written).
+    ConfigFingerprint(const ConfigFingerprint&);
+    ConfigFingerprint& operator=(const ConfigFingerprint&);
+
+    std::string file_;        ///< file keeping the configuration
+    bool known_;              ///< whether the fingerprint is known
+    uint64_t fingerprint_;    ///< fingerprint of Kea's configuration
+    FILE* pending_;           ///< configuration being written (or NULL)
+    bool pending_ok_;         ///< no write to it failed
+};
+
+#endif /* CONFIG_FINGERPRINT_H */
@@ -0,0 +1,218 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file config-snapshots.cc
+
+#include "config-snapshots.h"
+
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+ConfigSnapshots::Builder::Builder()
+    :size_(0), ok_(true) {
+    memset(&stream_, 0, sizeof(stream_));
+    // The fastest level, this is on the path of every push.
+    if (deflateInit(&stream_, Z_BEST_SPEED) != Z_OK) {
+        ok_ = false;
+    }
+}
+
+ConfigSnapshots::Builder::~Builder() {
+    deflateEnd(&stream_);
+}
+
+void
+ConfigSnapshots::Builder::write(const char* data, size_t size) {
+    if (!ok_) {
+        return;
+    }
+    size_ += size;
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream_.avail_in = size;
+    while (stream_.avail_in > 0) {
+        // Grows the output like a string would.
+        size_t used = data_.size();
+        data_.resize(used + deflateBound(&stream_, stream_.avail_in) / 2 + 4096);
+        stream_.next_out = reinterpret_cast<Bytef*>(&data_[used]);
+        stream_.avail_out = data_.size() - used;
+        if (deflate(&stream_, Z_NO_FLUSH) != Z_OK) {
+            ok_ = false;
+        }
+        data_.resize(data_.size() - stream_.avail_out);
+        if (!ok_) {
+            return;
+        }
+    }
+}
+
+bool
+ConfigSnapshots::Builder::finish() {
+    int rc = Z_OK;
+    while (ok_ && rc == Z_OK) {
+        size_t used = data_.size();
+        data_.resize(used + 4096);
+        stream_.next_out = reinterpret_cast<Bytef*>(&data_[used]);
+        stream_.avail_out = 4096;
+        rc = deflate(&stream_, Z_FINISH);
+        data_.resize(data_.size() - stream_.avail_out);
+        if (rc != Z_OK && rc != Z_STREAM_END) {
+            ok_ = false;
+        }
+    }
+    if (!ok_) {
+        cerr << "plugin-kea failed to compress configuration snapshot" << endl;
+        data_.clear();
+    }
+    return (ok_);
+}
+
+ConfigSnapshots::Reader::Reader()
+    :open_(false), done_(true), failed_(false) {
+    memset(&stream_, 0, sizeof(stream_));
+}
+
+ConfigSnapshots::Reader::~Reader() {
+    if (open_) {
+        inflateEnd(&stream_);
+    }
+}
+
+bool
+ConfigSnapshots::Reader::next(const char*& data, size_t& size) {
+    if (done_) {
+        return (false);
+    }
+    buffer_.resize(CHUNK_SIZE);
+    stream_.next_out = reinterpret_cast<Bytef*>(&buffer_[0]);
+    stream_.avail_out = buffer_.size();
+    int rc = inflate(&stream_, Z_NO_FLUSH);
+    buffer_.resize(buffer_.size() - stream_.avail_out);
+    if (rc == Z_STREAM_END) {
+        done_ = true;
+    } else if (rc != Z_OK) {
+        cerr << "plugin-kea failed to uncompress configuration snapshot: "
+             << zError(rc) << endl;
+        done_ = true;
+        failed_ = true;
+    }
+    if (buffer_.empty()) {
+        return (false);
+    }
+    data = buffer_.data();
+    size = buffer_.size();
+    return (true);
+}
+
+ConfigSnapshots::ConfigSnapshots(size_t capacity)
+    :capacity_(capacity), next_generation_(1) {
+}
+
+uint64_t
+ConfigSnapshots::add(uint64_t fingerprint, const string& json) {
+    if (!capacity_) {
+        return (0);
+    }
+    {
+        lock_guard<mutex> lock(lock_);
+        if (!ring_.empty() && ring_.back().info.fingerprint == fingerprint &&
+            ring_.back().info.size == json.size()) {
+            return (ring_.back().info.generation);
+        }
+    }
+
+    Builder builder;
+    builder.write(json.data(), json.size());
+    builder.finish();
+    return (add(fingerprint, builder));
+}
+
+uint64_t
+ConfigSnapshots::add(uint64_t fingerprint, Builder& builder) {
+    if (!capacity_ || !builder.ok_) {
+        return (0);
+    }
+    Snapshot snapshot;
+    snapshot.info.fingerprint = fingerprint;
+    snapshot.info.created = time(NULL);
+    snapshot.info.size = builder.size_;
+    snapshot.info.compressed_size = builder.data_.size();
+    builder.data_.shrink_to_fit();
+    snapshot.data = make_shared<const string>(std::move(builder.data_));
+    builder.data_.clear();
+
+    lock_guard<mutex> lock(lock_);
+    if (!ring_.empty() && ring_.back().info.fingerprint == fingerprint &&
+        ring_.back().info.size == snapshot.info.size) {
+        return (ring_.back().info.generation);
+    }
+    snapshot.info.generation = next_generation_++;
+    if (ring_.size() == capacity_) {
+        ring_.pop_front();
+    }
+    ring_.push_back(snapshot);
+    return (snapshot.info.generation);
+}
+
+bool
+ConfigSnapshots::open(uint64_t generation, Info& info, Reader& reader) const {
+    {
+        lock_guard<mutex> lock(lock_);
+        deque<Snapshot>::const_iterator it = ring_.begin();
+        if (!generation && !ring_.empty()) {
+            it = ring_.end() - 1;
+        }
+        while (it != ring_.end() && generation && it->info.generation != generation) {
+            ++it;
+        }
+        if (it == ring_.end()) {
+            return (false);
+        }
+        info = it->info;
+        // The data stays alive if the generation is dropped meanwhile.
+        reader.data_ = it->data;
+    }
+
+    if (reader.open_) {
+        inflateEnd(&reader.stream_);
+        reader.open_ = false;
+    }
+    memset(&reader.stream_, 0, sizeof(reader.stream_));
+    if (inflateInit(&reader.stream_) != Z_OK) {
+        cerr << "plugin-kea failed to uncompress configuration snapshot" << endl;
+        return (false);
+    }
+    reader.open_ = true;
+    reader.stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(reader.data_->data()));
+    reader.stream_.avail_in = reader.data_->size();
+    reader.done_ = false;
+    reader.failed_ = false;
+    return (true);
+}
+
+bool
+ConfigSnapshots::isNewest(uint64_t fingerprint) const {
+    lock_guard<mutex> lock(lock_);
+    return (!ring_.empty() && ring_.back().info.fingerprint == fingerprint);
+}
+
+vector<ConfigSnapshots::Info>
+ConfigSnapshots::list() const {
+    lock_guard<mutex> lock(lock_);
+    vector<Info> infos;
+    infos.reserve(ring_.size());
+    for (deque<Snapshot>::const_iterator it = ring_.begin(); it != ring_.end(); ++it) {
+        infos.push_back(it->info);
+    }
+    return (infos);
+}
+
+size_t
+ConfigSnapshots::size() const {
+    lock_guard<mutex> lock(lock_);
+    return (ring_.size());
+}
@@ -0,0 +1,184 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file config-snapshots.h
+///
+/// The last configurations Kea accepted, kept compressed in memory so
+/// that Kea can be rolled back to one of them without translating.
+
+#ifndef CONFIG_SNAPSHOTS_H
+#define CONFIG_SNAPSHOTS_H
+
+#include "json-writer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <zlib.h>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// @brief Bounded ring of the configurations Kea accepted.
+///
+/// Every configuration Kea accepted with config-set is added as a new
+/// generation, compressed with zlib (a translated configuration shrinks
+/// to a few percent of its size). When the ring is full the oldest
+/// generation is dropped, so memory is bounded by the capacity.
+/// Generations are numbered from 1 and never reused.
+///
+/// The ring is read by the operational data callback while pushes add
+/// to it, so all methods take a lock of its own.
+class ConfigSnapshots {
+public:
+    /// Default number of generations kept
+    static const size_t DEFAULT_CAPACITY = 8;
+
+    /// @brief A generation, without its configuration.
+    struct Info {
+        uint64_t generation;      ///< number of the generation
+        uint64_t fingerprint;     ///< fingerprint of the configuration
+        time_t created;           ///< when Kea accepted it
+        size_t size;              ///< size of the configuration
+        size_t compressed_size;   ///< size kept in memory
+    };
+
+    /// @brief Compresses a configuration as it is written, e.g. while
+    ///        it is sent, so that it is never held uncompressed.
+    class Builder {
+    public:
+        /// @brief Constructor
+        Builder();
+
+        /// @brief Destructor
+        ~Builder();
+
+        /// @brief Compresses the next piece of the configuration.
+        void write(const char* data, size_t size);
+
+        /// @brief Ends the configuration.
+        ///
+        /// @return false if it could not be compressed
+        bool finish();
+
+    private:
+        friend class ConfigSnapshots;
+
+        /// Not copyable (holds the compression state).
+        Builder(const Builder&);
+        Builder& operator=(const Builder&);
+
+        z_stream stream_;    ///< compression state
+        std::string data_;   ///< compressed configuration
+        size_t size_;        ///< size of the configuration
+        bool ok_;            ///< no error so far
+    };
+
+    /// @brief Uncompresses a generation piece by piece.
+    class Reader : public JsonSource {
+    public:
+        /// Size of the pieces returned
+        static const size_t CHUNK_SIZE = 65536;
+
+        /// @brief Constructor (nothing to read until open())
+        Reader();
+
+        /// @brief Destructor
+        virtual ~Reader();
+
+        /// @brief Returns the next piece of the configuration.
+        virtual bool next(const char*& data, size_t& size);
+
+        /// @brief Returns true when the whole configuration was read.
+        virtual bool done() const {
+            return (done_);
+        }
+
+        /// @brief Returns true if the configuration could not be read
+        ///        completely (it is cut short then).
+        bool failed() const {
+            return (failed_);
+        }
+
+    private:
+        friend class ConfigSnapshots;
+
+        /// Not copyable (holds the compression state).
+        Reader(const Reader&);
+        Reader& operator=(const Reader&);
+
+        z_stream stream_;                         ///< uncompression state
+        bool open_;                               ///< stream_ initialized
+        std::shared_ptr<const std::string> data_; ///< compressed generation
+        std::string buffer_;                      ///< piece returned last
+        bool done_;                               ///< nothing left
+        bool failed_;                             ///< data was corrupt
+    };
+
+    /// @brief Constructor
+    ///
+    /// @param capacity number of generations kept (0 keeps none)
+    ConfigSnapshots(size_t capacity = DEFAULT_CAPACITY);
+
+    /// @brief Adds a configuration Kea accepted.
+    ///
+    /// A configuration equal to the newest one (e.g. after a rollback
+    /// to it) is not added again.
+    ///
+    /// @param fingerprint fingerprint of the configuration
+    /// @param json the configuration
+    /// @return its generation, 0 if nothing is kept or it could not be
+    ///         compressed
+    uint64_t add(uint64_t fingerprint, const std::string& json);
+
+    /// @brief Adds a configuration Kea accepted, compressed as it was
+    ///        sent.
+    ///
+    /// @param fingerprint fingerprint of the configuration
+    /// @param builder the configuration (finished, its data is taken)
+    /// @return as for the other add()
+    uint64_t add(uint64_t fingerprint, Builder& builder);
+
+    /// @brief Opens a generation for reading.
+    ///
+    /// @param generation number of the generation (0 for the newest)
+    /// @param info (out) the generation
+    /// @param reader (out) reader of its configuration
+    /// @return false if the generation is not kept (anymore)
+    bool open(uint64_t generation, Info& info, Reader& reader) const;
+
+    /// @brief Returns true if the newest generation has the fingerprint
+    ///        (the configuration need not be added again).
+    bool isNewest(uint64_t fingerprint) const;
+
+    /// @brief Returns the generations kept, oldest first.
+    std::vector<Info> list() const;
+
+    /// @brief Returns number of generations kept.
+    size_t size() const;
+
+    /// @brief Returns the maximum number of generations kept.
+    size_t getCapacity() const {
+        return (capacity_);
+    }
+
+private:
+    /// @brief A generation with its compressed configuration.
+    struct Snapshot {
+        Info info;                ///< the generation
+        /// compressed configuration (shared with readers)
+        std::shared_ptr<const std::string> data;
+    };
+
+    size_t capacity_;             ///< maximum number of generations
+    uint64_t next_generation_;    ///< number of the next generation
+    std::deque<Snapshot> ring_;   ///< generations, oldest first
+    mutable std::mutex lock_;     ///< protects the ring
+};
+
+#endif /* CONFIG_SNAPSHOTS_H */
@@ -0,0 +1,184 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file datastore-gen.cc
+
+#include "datastore-gen.h"
+
+#include <stdio.h>
+
+using namespace std;
+
+namespace {
+
+/// Root of the generated data
+const char* ROOT = "/ietf-kea-dhcpv6:server";
+
+}
+
+DatastoreGenerator::DatastoreGenerator(sr_session_ctx_t* session)
+    :session_(session), commit_batch_(0), pending_(0), items_(0) {
+}
+
+int
+DatastoreGenerator::set(const char* xpath, const char* value) {
+    // Lists are created without a value, leaves with one.
+    int rc = value ? sr_set_item_str(session_, xpath, value, SR_EDIT_DEFAULT) :
+        sr_set_item(session_, xpath, NULL, SR_EDIT_DEFAULT);
+    if (SR_ERR_OK != rc) {
+        error_ = string("failed to set ") + xpath + ": " + sr_strerror(rc);
+        return (rc);
+    }
+    if (value) {
+        items_++;
+    }
+    pending_++;
+    if (commit_batch_ && pending_ >= commit_batch_) {
+        return (commit());
+    }
+    return (SR_ERR_OK);
+}
+
+int
+DatastoreGenerator::commit() {
+    if (!pending_) {
+        return (SR_ERR_OK);
+    }
+    int rc = sr_commit(session_);
+    if (SR_ERR_OK != rc) {
+        error_ = string("failed to commit: ") + sr_strerror(rc);
+        sr_discard_changes(session_);
+        return (rc);
+    }
+    pending_ = 0;
+    return (SR_ERR_OK);
+}
+
+int
+DatastoreGenerator::clear() {
+    int rc = sr_delete_item(session_, ROOT, SR_EDIT_DEFAULT);
+    if (SR_ERR_OK != rc) {
+        error_ = string("failed to delete ") + ROOT + ": " + sr_strerror(rc);
+        return (rc);
+    }
+    pending_++;
+    return (commit());
+}
+
+int
+DatastoreGenerator::generate(const DatastoreShape& shape) {
+    char xpath[512];
+    char value[128];
+    int rc;
+
+    items_ = 0;
+    if (shape.pools > 255 || shape.option_sets > 255) {
+        error_ = "at most 255 pools per subnet and 255 option sets";
+        return (SR_ERR_INVAL_ARG);
+    }
+
+    rc = clear();
+    if (SR_ERR_OK != rc) {
+        return (rc);
+    }
+
+#define GEN_SET(VALUE) do { \
+        rc = set(xpath, (VALUE)); \
+        if (SR_ERR_OK != rc) { \
+            return (rc); \
+        } \
+    } while (0)
+
+    // Global parameters
+    snprintf(xpath, sizeof(xpath), "%s/serv-attributes/control-socket/socket-type", ROOT);
+    GEN_SET("unix");
+    snprintf(xpath, sizeof(xpath), "%s/serv-attributes/control-socket/socket-name", ROOT);
+    GEN_SET("/tmp/kea-dhcp6-ctrl.sock");
+    snprintf(xpath, sizeof(xpath), "%s/serv-attributes/interfaces-config/interfaces", ROOT);
+    GEN_SET("eth0");
+    snprintf(xpath, sizeof(xpath), "%s/serv-attributes/renew-timer", ROOT);
+    GEN_SET("1000");
+    snprintf(xpath, sizeof(xpath), "%s/serv-attributes/rebind-timer", ROOT);
+    GEN_SET("2000");
+    snprintf(xpath, sizeof(xpath), "%s/serv-attributes/preferred-lifetime", ROOT);
+    GEN_SET("3000");
+    snprintf(xpath, sizeof(xpath), "%s/serv-attributes/valid-lifetime", ROOT);
+    GEN_SET("4000");
+
+    // Option sets, each with a DNS servers option
+    for (size_t o = 1; o <= shape.option_sets; o++) {
+        int len = snprintf(xpath, sizeof(xpath),
+                           "%s/option-sets/option-set[option-set-id='%zu']",
+                           ROOT, o);
+        GEN_SET(NULL);
+        snprintf(xpath + len, sizeof(xpath) - len, "/description");
+        snprintf(value, sizeof(value), "option set %zu", o);
+        GEN_SET(value);
+        snprintf(xpath + len, sizeof(xpath) - len,
+                 "/standard-option[option-code='23']/option-name");
+        GEN_SET("dns-servers");
+        snprintf(xpath + len, sizeof(xpath) - len,
+                 "/standard-option[option-code='23']/option-value");
+        snprintf(value, sizeof(value), "2001:db8::%zx", o);
+        GEN_SET(value);
+        snprintf(xpath + len, sizeof(xpath) - len,
+                 "/standard-option[option-code='23']/csv-format");
+        GEN_SET("true");
+    }
+
+    // Subnets with pools and reservations
+    for (size_t i = 0; i < shape.subnets; i++) {
+        unsigned hi = static_cast<unsigned>(i >> 16);
+        unsigned lo = static_cast<unsigned>(i & 0xffff);
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "2001:db8:%x:%x::/64", hi, lo);
+
+        int len = snprintf(xpath, sizeof(xpath),
+                           "%s/network-ranges/subnet6[subnet='%s']", ROOT, prefix);
+        GEN_SET(NULL);
+        snprintf(xpath + len, sizeof(xpath) - len, "/subnet");
+        GEN_SET(prefix);
+        if (shape.subnets <= 255) {
+            snprintf(xpath + len, sizeof(xpath) - len, "/network-range-id");
+            snprintf(value, sizeof(value), "%zu", i + 1);
+            GEN_SET(value);
+        }
+        if (shape.option_sets) {
+            snprintf(xpath + len, sizeof(xpath) - len, "/option-set-id");
+            snprintf(value, sizeof(value), "%zu", i % shape.option_sets + 1);
+            GEN_SET(value);
+        }
+
+        for (size_t p = 1; p <= shape.pools; p++) {
+            snprintf(xpath + len, sizeof(xpath) - len,
+                     "/pools/address-pool[pool-id='%zu']/pool-prefix", p);
+            snprintf(value, sizeof(value), "2001:db8:%x:%x:%zx::/80", hi, lo, p);
+            GEN_SET(value);
+        }
+
+        for (size_t h = 0; h < shape.hosts; h++) {
+            // Unique across all subnets, also used to build the DUID.
+            size_t id = i * shape.hosts + h + 1;
+            int hlen = len + snprintf(xpath + len, sizeof(xpath) - len,
+                                      "/reserved-host[cli-id='%zu']", id);
+            GEN_SET(NULL);
+            snprintf(xpath + hlen, sizeof(xpath) - hlen, "/duid");
+            snprintf(value, sizeof(value), "00:03:00:01:%02x:%02x:%02x:%02x",
+                     static_cast<unsigned>((id >> 24) & 0xff),
+                     static_cast<unsigned>((id >> 16) & 0xff),
+                     static_cast<unsigned>((id >> 8) & 0xff),
+                     static_cast<unsigned>(id & 0xff));
+            GEN_SET(value);
+            snprintf(xpath + hlen, sizeof(xpath) - hlen, "/reserv-addr");
+            snprintf(value, sizeof(value), "2001:db8:%x:%x::%zx", hi, lo, h + 1);
+            GEN_SET(value);
+        }
+    }
+
+#undef GEN_SET
+
+    return (commit());
+}
@@ -0,0 +1,95 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file datastore-gen.h
+///
+/// Generator of synthetic ietf-kea-dhcpv6 configurations, used to
+/// benchmark the translator at various scales.
+
+#ifndef DATASTORE_GEN_H
+#define DATASTORE_GEN_H
+
+extern "C" {
+#include "sysrepo.h"
+};
+
+#include <string>
+
+/// @brief Size of a generated configuration.
+struct DatastoreShape {
+    /// @brief Constructor (a single subnet with a single pool)
+    DatastoreShape()
+        :subnets(1), pools(1), hosts(0), option_sets(0) {
+    }
+
+    size_t subnets;     ///< number of subnet6 entries
+    size_t pools;       ///< address pools per subnet (at most 255)
+    size_t hosts;       ///< reserved hosts per subnet
+    size_t option_sets; ///< number of option sets (at most 255)
+};
+
+/// @brief Fills a Sysrepo datastore with a synthetic configuration.
+///
+/// The configuration replaces whatever is in the ietf-kea-dhcpv6
+/// module of the session's datastore. Subnets are 2001:db8:X:Y::/64
+/// prefixes, each with its pools, reservations and a reference to one
+/// of the option sets. Subnets get a network-range-id as long as there
+/// are at most 255 of them (the type is uint8).
+class DatastoreGenerator {
+public:
+    /// @brief Constructor
+    ///
+    /// @param session session of the datastore to be filled
+    DatastoreGenerator(sr_session_ctx_t* session);
+
+    /// @brief Sets number of edits per commit.
+    ///
+    /// @param edits edits per commit (0 means one commit at the end)
+    void setCommitBatch(size_t edits) {
+        commit_batch_ = edits;
+    }
+
+    /// @brief Removes all ietf-kea-dhcpv6 data and commits.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int clear();
+
+    /// @brief Replaces the configuration with a generated one.
+    ///
+    /// @param shape size of the configuration
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int generate(const DatastoreShape& shape);
+
+    /// @brief Returns number of leaves set by the last generate().
+    size_t getItems() const {
+        return (items_);
+    }
+
+    /// @brief Returns the error of the last failed call.
+    const std::string& getError() const {
+        return (error_);
+    }
+
+private:
+    /// @brief Sets a leaf (committing when the batch is full).
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int set(const char* xpath, const char* value);
+
+    /// @brief Commits pending edits.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int commit();
+
+    sr_session_ctx_t* session_; ///< session of the filled datastore
+    size_t commit_batch_;       ///< edits per commit (0 = all)
+    size_t pending_;            ///< edits not committed yet
+    size_t items_;              ///< leaves set by generate()
+    std::string error_;         ///< error of the last failed call
+};
+
+#endif /* DATASTORE_GEN_H */
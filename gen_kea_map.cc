@@ -0,0 +1,657 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file gen_kea_map.cc
+///
+/// Generates kea-map.h from the YANG model. Every configuration node of
+/// the model gets a numeric id and an entry in a constexpr table telling
+/// where it goes in the Kea configuration, so that the translator can
+/// switch on ids instead of comparing names. Where the model and Kea
+/// names differ is kept in MAPPINGS below; a configuration node missing
+/// there (or a mapping for a node that is not in the model) fails the
+/// build, so no leaf goes untranslated by accident.
+///
+/// usage: gen_kea_map model.yang kea-map.h
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+/// @brief Where a node goes in the Kea configuration.
+enum Scope {
+    NONE,       ///< not translated (e.g. list keys)
+    MEMBER,     ///< member of the enclosing Kea map
+    INLINE,     ///< container whose members go to the enclosing map
+    CONTEXT,    ///< member of the user-context of the enclosing map
+    CODE        ///< translated by SysrepoKea itself
+};
+
+/// @brief JSON type of a node in the Kea configuration.
+enum Type {
+    AUTO,       ///< derived from the YANG type
+    STRING,
+    NUMBER,
+    BOOL,
+    MAP,
+    LIST
+};
+
+/// @brief How a node of the model is translated.
+struct Mapping {
+    const char* path;   ///< schema path below the top container
+    Scope scope;        ///< where it goes
+    const char* key;    ///< Kea name (NULL for the node name, or for none
+                        ///< when the node is not translated by the table)
+    Type type;          ///< JSON type in Kea
+};
+
+/// Translation of every configuration node. Kea 1.4 has no server name,
+/// enable flag or stateless mode, those go to user-context. The model
+/// has no delegated length, so prefix pools delegate the whole prefix.
+const Mapping MAPPINGS[] = {
+    { "", CODE, "Dhcp6", MAP },
+    { "serv-attributes", INLINE, NULL, AUTO },
+    { "serv-attributes/name", CONTEXT, NULL, AUTO },
+    { "serv-attributes/duid", CODE, "server-id", MAP },
+    { "serv-attributes/enable", CONTEXT, NULL, AUTO },
+    { "serv-attributes/lease-database", MEMBER, NULL, AUTO },
+    { "serv-attributes/lease-database/type", MEMBER, NULL, AUTO },
+    { "serv-attributes/control-socket", MEMBER, NULL, AUTO },
+    { "serv-attributes/control-socket/socket-type", MEMBER, NULL, AUTO },
+    { "serv-attributes/control-socket/socket-name", MEMBER, NULL, AUTO },
+    { "serv-attributes/interfaces-config", MEMBER, NULL, AUTO },
+    { "serv-attributes/interfaces-config/interfaces", MEMBER, NULL, AUTO },
+    { "serv-attributes/description", CONTEXT, NULL, AUTO },
+    { "serv-attributes/stateless-service", CONTEXT, NULL, AUTO },
+    { "serv-attributes/renew-timer", MEMBER, NULL, AUTO },
+    { "serv-attributes/rebind-timer", MEMBER, NULL, AUTO },
+    { "serv-attributes/preferred-lifetime", MEMBER, NULL, AUTO },
+    { "serv-attributes/valid-lifetime", MEMBER, NULL, AUTO },
+    { "custom-options", INLINE, NULL, AUTO },
+    { "custom-options/custon-option", MEMBER, "option-def", AUTO },
+    { "custom-options/custon-option/option-code", MEMBER, "code", AUTO },
+    { "custom-options/custon-option/option-name", MEMBER, "name", AUTO },
+    { "custom-options/custon-option/option-type", MEMBER, "type", AUTO },
+    { "option-sets", CODE, NULL, AUTO },
+    { "option-sets/option-set", CODE, NULL, AUTO },
+    { "option-sets/option-set/option-set-id", NONE, NULL, AUTO },
+    { "option-sets/option-set/description", NONE, NULL, AUTO },
+    { "option-sets/option-set/standard-option", CODE, "option-data", AUTO },
+    { "option-sets/option-set/standard-option/option-code", MEMBER, "code", AUTO },
+    { "option-sets/option-set/standard-option/option-name", MEMBER, "name", AUTO },
+    { "option-sets/option-set/standard-option/option-value", MEMBER, "data", AUTO },
+    { "option-sets/option-set/standard-option/csv-format", MEMBER, NULL, AUTO },
+    { "network-ranges", CODE, NULL, AUTO },
+    { "network-ranges/option-set-id", CODE, "option-data", LIST },
+    { "network-ranges/rapid-commit", CODE, "rapid-commit", AUTO },
+    { "network-ranges/subnet6", CODE, "subnet6", AUTO },
+    { "network-ranges/subnet6/network-range-id", MEMBER, "id", AUTO },
+    { "network-ranges/subnet6/network-description", CONTEXT, "description", AUTO },
+    { "network-ranges/subnet6/subnet", MEMBER, NULL, AUTO },
+    { "network-ranges/subnet6/option-set-id", CODE, "option-data", LIST },
+    { "network-ranges/subnet6/rapid-commit", MEMBER, NULL, AUTO },
+    { "network-ranges/subnet6/interface", MEMBER, NULL, AUTO },
+    { "network-ranges/subnet6/interface-id", MEMBER, NULL, AUTO },
+    { "network-ranges/subnet6/relay-address", CODE, "relay", MAP },
+    { "network-ranges/subnet6/pools", INLINE, NULL, AUTO },
+    { "network-ranges/subnet6/pools/address-pool", CODE, "pools", AUTO },
+    { "network-ranges/subnet6/pools/address-pool/pool-id", NONE, NULL, AUTO },
+    { "network-ranges/subnet6/pools/address-pool/pool-prefix", CODE, "pool", AUTO },
+    { "network-ranges/subnet6/pools/address-pool/start-address", CODE, "pool", AUTO },
+    { "network-ranges/subnet6/pools/address-pool/end-address", CODE, "pool", AUTO },
+    { "network-ranges/subnet6/prefix-pools", INLINE, NULL, AUTO },
+    { "network-ranges/subnet6/prefix-pools/prefix-pool", CODE, "pd-pools", AUTO },
+    { "network-ranges/subnet6/prefix-pools/prefix-pool/pool-id", NONE, NULL, AUTO },
+    { "network-ranges/subnet6/prefix-pools/prefix-pool/pool-prefix", CODE, "prefix", AUTO },
+    { "network-ranges/subnet6/reserved-host", CODE, "reservations", AUTO },
+    { "network-ranges/subnet6/reserved-host/cli-id", NONE, NULL, AUTO },
+    { "network-ranges/subnet6/reserved-host/duid", CODE, "duid", AUTO },
+    { "network-ranges/subnet6/reserved-host/hardware-addr", CODE, "hw-address", AUTO },
+    { "network-ranges/subnet6/reserved-host/reserv-addr", MEMBER, "ip-addresses", AUTO },
+    { "rsoo-enabled-options", INLINE, NULL, AUTO },
+    { "rsoo-enabled-options/rsoo-enabled-option", CODE, "relay-supplied-options", LIST },
+    { "rsoo-enabled-options/rsoo-enabled-option/option-code", CODE, NULL, STRING },
+    { "rsoo-enabled-options/rsoo-enabled-option/description", NONE, NULL, AUTO }
+};
+
+/// @brief YANG statement.
+struct Statement {
+    string keyword;                 ///< e.g. "leaf"
+    string argument;                ///< e.g. "renew-timer" (may be empty)
+    vector<Statement> children;     ///< substatements
+};
+
+/// @brief Splits YANG text into tokens (RFC 7950, section 6).
+class Tokenizer {
+public:
+    Tokenizer(const string& text)
+        :text_(text), pos_(0), line_(1) {
+    }
+
+    /// @brief Returns the next token, empty at the end.
+    ///
+    /// Quoted strings (and their concatenations) are returned unquoted;
+    /// quoted is set for them, so that e.g. "{" is not taken for a brace.
+    string next(bool& quoted) {
+        quoted = false;
+        skipBlanks();
+        if (pos_ >= text_.size()) {
+            return ("");
+        }
+        char c = text_[pos_];
+        if (c == '{' || c == '}' || c == ';') {
+            pos_++;
+            return (string(1, c));
+        }
+        if (c != '"' && c != '\'') {
+            size_t begin = pos_;
+            while (pos_ < text_.size() && !isspace(text_[pos_]) &&
+                   text_[pos_] != '{' && text_[pos_] != '}' && text_[pos_] != ';') {
+                pos_++;
+            }
+            return (text_.substr(begin, pos_ - begin));
+        }
+
+        quoted = true;
+        string result = quotedString();
+        while (true) {
+            size_t save = pos_;
+            size_t line = line_;
+            skipBlanks();
+            if (pos_ < text_.size() && text_[pos_] == '+') {
+                pos_++;
+                skipBlanks();
+                result += quotedString();
+            } else {
+                pos_ = save;
+                line_ = line;
+                return (result);
+            }
+        }
+    }
+
+    /// @brief Returns line of the current position.
+    int getLine() const {
+        return (line_);
+    }
+
+private:
+    /// @brief Skips white space and comments.
+    void skipBlanks() {
+        while (pos_ < text_.size()) {
+            if (text_[pos_] == '\n') {
+                line_++;
+                pos_++;
+            } else if (isspace(text_[pos_])) {
+                pos_++;
+            } else if (text_.compare(pos_, 2, "//") == 0) {
+                pos_ = text_.find('\n', pos_);
+                if (pos_ == string::npos) {
+                    pos_ = text_.size();
+                }
+            } else if (text_.compare(pos_, 2, "/*") == 0) {
+                size_t end = text_.find("*/", pos_ + 2);
+                end = (end == string::npos) ? text_.size() : end + 2;
+                for (; pos_ < end; pos_++) {
+                    if (text_[pos_] == '\n') {
+                        line_++;
+                    }
+                }
+            } else {
+                break;
+            }
+        }
+    }
+
+    /// @brief Reads a single quoted string (pos_ at the opening quote).
+    string quotedString() {
+        if (pos_ >= text_.size() || (text_[pos_] != '"' && text_[pos_] != '\'')) {
+            throw runtime_error("quoted string expected");
+        }
+        const char quote = text_[pos_++];
+        string result;
+        while (pos_ < text_.size() && text_[pos_] != quote) {
+            char c = text_[pos_++];
+            if (c == '\n') {
+                line_++;
+            } else if (c == '\\' && quote == '"' && pos_ < text_.size()) {
+                c = text_[pos_++];
+                c = (c == 'n') ? '\n' : (c == 't') ? '\t' : c;
+            }
+            result += c;
+        }
+        if (pos_ >= text_.size()) {
+            throw runtime_error("unterminated string");
+        }
+        pos_++;
+        return (result);
+    }
+
+    const string& text_;    ///< YANG text
+    size_t pos_;            ///< current position
+    int line_;              ///< current line
+};
+
+/// @brief Parses substatements up to the closing brace (or the end).
+///
+/// @param tokens tokenizer
+/// @param children (out) parsed statements
+/// @param nested true if inside braces
+void
+parseStatements(Tokenizer& tokens, vector<Statement>& children, bool nested) {
+    while (true) {
+        bool quoted;
+        string token = tokens.next(quoted);
+        if (token.empty() && !quoted) {
+            if (nested) {
+                throw runtime_error("missing }");
+            }
+            return;
+        }
+        if (token == "}" && !quoted) {
+            if (!nested) {
+                throw runtime_error("unexpected }");
+            }
+            return;
+        }
+
+        Statement statement;
+        statement.keyword = token;
+        token = tokens.next(quoted);
+        if (quoted || (token != ";" && token != "{")) {
+            statement.argument = token;
+            token = tokens.next(quoted);
+        }
+        if (token == "{" && !quoted) {
+            parseStatements(tokens, statement.children, true);
+        } else if (token != ";" || quoted) {
+            throw runtime_error("; or { expected after " + statement.keyword);
+        }
+        children.push_back(statement);
+    }
+}
+
+/// @brief Returns the first substatement with the keyword (or NULL).
+const Statement*
+findStatement(const Statement& parent, const string& keyword) {
+    for (size_t i = 0; i < parent.children.size(); i++) {
+        if (parent.children[i].keyword == keyword) {
+            return (&parent.children[i]);
+        }
+    }
+    return (NULL);
+}
+
+/// Parent index of the top container
+const size_t NO_PARENT = static_cast<size_t>(-1);
+
+/// @brief Schema node of the model.
+struct Node {
+    string path;        ///< schema path below the top container
+    string name;        ///< node name
+    string keyword;     ///< container, list, leaf or leaf-list
+    size_t parent;      ///< index of the parent (NO_PARENT for the top)
+    Type type;          ///< JSON type derived from the model
+    const Mapping* mapping; ///< how the node is translated
+};
+
+/// @brief Model being generated from.
+class Model {
+public:
+    /// @brief Reads the module.
+    void load(const Statement& module) {
+        for (size_t i = 0; i < module.children.size(); i++) {
+            const Statement& s = module.children[i];
+            if (s.keyword == "typedef") {
+                typedefs_[s.argument] = &s;
+            }
+        }
+        for (size_t i = 0; i < module.children.size(); i++) {
+            const Statement& s = module.children[i];
+            if (s.keyword == "container") {
+                if (!nodes_.empty()) {
+                    throw runtime_error("more than one top container");
+                }
+                top_ = s.argument;
+                addNode(s, "", NO_PARENT);
+            } else if (s.keyword == "list" || s.keyword == "leaf" ||
+                       s.keyword == "leaf-list" || s.keyword == "choice" ||
+                       s.keyword == "uses" || s.keyword == "augment") {
+                throw runtime_error(s.keyword + " " + s.argument +
+                                    " at the top level is not supported");
+            }
+        }
+        if (nodes_.empty()) {
+            throw runtime_error("no top container");
+        }
+    }
+
+    /// @brief Matches nodes and mappings, returns number of problems.
+    int map() {
+        int problems = 0;
+        std::map<string, const Mapping*> mappings;
+        for (size_t i = 0; i < sizeof(MAPPINGS) / sizeof(MAPPINGS[0]); i++) {
+            mappings[MAPPINGS[i].path] = &MAPPINGS[i];
+        }
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            std::map<string, const Mapping*>::iterator it = mappings.find(nodes_[i].path);
+            if (it == mappings.end()) {
+                cerr << "gen_kea_map: no mapping for " << top_ << "/" << nodes_[i].path << endl;
+                problems++;
+                continue;
+            }
+            nodes_[i].mapping = it->second;
+            mappings.erase(it);
+        }
+        for (std::map<string, const Mapping*>::iterator it = mappings.begin();
+             it != mappings.end(); ++it) {
+            cerr << "gen_kea_map: mapping for " << top_ << "/" << it->first
+                 << " not in the model" << endl;
+            problems++;
+        }
+        return (problems);
+    }
+
+    /// @brief Writes the header.
+    void write(ostream& out, const string& source) const;
+
+private:
+    /// @brief Adds a configuration node and its descendants.
+    void addNode(const Statement& s, const string& path, size_t parent) {
+        const Statement* config = findStatement(s, "config");
+        if (config && config->argument == "false") {
+            // State data is never translated.
+            return;
+        }
+
+        Node node;
+        node.path = path;
+        node.name = s.argument;
+        node.keyword = s.keyword;
+        node.parent = parent;
+        node.mapping = NULL;
+        if (s.keyword == "container") {
+            node.type = MAP;
+        } else if (s.keyword == "list" || s.keyword == "leaf-list") {
+            node.type = LIST;
+        } else {
+            const Statement* type = findStatement(s, "type");
+            if (!type) {
+                throw runtime_error("leaf " + s.argument + " has no type");
+            }
+            node.type = resolveType(*type);
+        }
+        const size_t index = nodes_.size();
+        nodes_.push_back(node);
+
+        for (size_t i = 0; i < s.children.size(); i++) {
+            const Statement& child = s.children[i];
+            if (child.keyword == "container" || child.keyword == "list" ||
+                child.keyword == "leaf" || child.keyword == "leaf-list") {
+                addNode(child, (path.empty() ? "" : path + "/") + child.argument, index);
+            } else if (child.keyword == "choice" || child.keyword == "uses" ||
+                       child.keyword == "anydata" || child.keyword == "anyxml") {
+                // The translator would not know about what is in there.
+                throw runtime_error(child.keyword + " " + child.argument +
+                                    " in " + s.argument + " is not supported");
+            }
+        }
+    }
+
+    /// @brief Returns JSON type of a YANG type.
+    Type resolveType(const Statement& type) const {
+        string name = type.argument;
+        if (name == "union") {
+            // Numbers only if every member is a number.
+            for (size_t i = 0; i < type.children.size(); i++) {
+                if (type.children[i].keyword == "type" &&
+                    resolveType(type.children[i]) != NUMBER) {
+                    return (STRING);
+                }
+            }
+            return (NUMBER);
+        }
+        if (name == "boolean" || name == "empty") {
+            return (BOOL);
+        }
+        if (name.compare(0, 3, "int") == 0 || name.compare(0, 4, "uint") == 0 ||
+            name == "decimal64" || name == "yang:timeticks" ||
+            name == "yang:timestamp" || name.compare(0, 12, "yang:counter") == 0 ||
+            name.compare(0, 10, "yang:gauge") == 0 || name.compare(0, 14, "yang:zero-based") == 0) {
+            return (NUMBER);
+        }
+        std::map<string, const Statement*>::const_iterator def = typedefs_.find(name);
+        if (def != typedefs_.end()) {
+            const Statement* base = findStatement(*def->second, "type");
+            if (!base) {
+                throw runtime_error("typedef " + name + " has no type");
+            }
+            return (resolveType(*base));
+        }
+        // string, enumeration, inet:*, yang:mac-address and the like
+        return (STRING);
+    }
+
+    string top_;                    ///< name of the top container
+    vector<Node> nodes_;            ///< nodes in schema order
+    std::map<string, const Statement*> typedefs_; ///< typedefs by name
+};
+
+/// @brief Returns C identifier of a node id.
+string
+nodeId(const string& top, const string& path) {
+    string id = "KEA_NODE_" + (path.empty() ? top : path);
+    for (size_t i = 9; i < id.size(); i++) {
+        id[i] = isalnum(id[i]) ? toupper(id[i]) : '_';
+    }
+    return (id);
+}
+
+const char* const SCOPE_NAMES[] = {
+    "KEA_SCOPE_NONE", "KEA_SCOPE_MEMBER", "KEA_SCOPE_INLINE",
+    "KEA_SCOPE_CONTEXT", "KEA_SCOPE_CODE"
+};
+
+const char* const TYPE_NAMES[] = {
+    "KEA_TYPE_NONE", "KEA_TYPE_STRING", "KEA_TYPE_NUMBER",
+    "KEA_TYPE_BOOL", "KEA_TYPE_MAP", "KEA_TYPE_LIST"
+};
+
+/// Fixed part of the header
+const char* const PREAMBLE = R"(
+#ifndef KEA_MAP_H
+#define KEA_MAP_H
+
+#include <stdint.h>
+#include <string.h>
+
+/// @brief Kind of a schema node.
+enum KeaNodeKind {
+    KEA_KIND_CONTAINER,
+    KEA_KIND_LIST,
+    KEA_KIND_LEAF,
+    KEA_KIND_LEAF_LIST
+};
+
+/// @brief Where a node goes in the Kea configuration.
+enum KeaScope {
+    KEA_SCOPE_NONE,     ///< not translated (e.g. list keys)
+    KEA_SCOPE_MEMBER,   ///< member of the enclosing Kea map (containers
+                        ///< become maps, lists and leaf-lists lists)
+    KEA_SCOPE_INLINE,   ///< container whose members go to the enclosing map
+    KEA_SCOPE_CONTEXT,  ///< member of the user-context of the enclosing map
+    KEA_SCOPE_CODE      ///< translated by SysrepoKea itself
+};
+
+/// @brief JSON type of a node in the Kea configuration.
+enum KeaType {
+    KEA_TYPE_NONE,
+    KEA_TYPE_STRING,
+    KEA_TYPE_NUMBER,
+    KEA_TYPE_BOOL,
+    KEA_TYPE_MAP,
+    KEA_TYPE_LIST
+};
+
+/// @brief Translation of a schema node.
+struct KeaNodeInfo {
+    const char* name;   ///< YANG node name
+    uint16_t parent;    ///< id of the parent node
+    KeaNodeKind kind;   ///< kind of the node
+    KeaScope scope;     ///< where it goes
+    const char* key;    ///< Kea name (NULL when not translated)
+    KeaType type;       ///< JSON type in Kea
+};
+)";
+
+void
+Model::write(ostream& out, const string& source) const {
+    out << "// Generated by gen_kea_map from " << source << ", do not edit.\n"
+        << "//\n"
+        << "/// @file kea-map.h\n"
+        << "///\n"
+        << "/// Configuration nodes of the YANG model and their translation to\n"
+        << "/// Kea, indexed by node id.\n"
+        << PREAMBLE << "\n"
+        << "/// @brief Configuration nodes of the model.\n"
+        << "enum KeaNodeId {\n"
+        << "    KEA_NODE_NONE,  ///< not a configuration node of the model\n";
+    for (size_t i = 0; i < nodes_.size(); i++) {
+        out << "    " << nodeId(top_, nodes_[i].path) << ",  ///< "
+            << nodes_[i].keyword << " " << (nodes_[i].path.empty() ? top_ : nodes_[i].path)
+            << "\n";
+    }
+    out << "    KEA_NODE_COUNT\n"
+        << "};\n\n";
+
+    out << "/// @brief Translation of every node, indexed by KeaNodeId.\n"
+        << "constexpr KeaNodeInfo KEA_NODES[KEA_NODE_COUNT] = {\n"
+        << "    { \"\", KEA_NODE_NONE, KEA_KIND_CONTAINER, KEA_SCOPE_NONE, NULL, KEA_TYPE_NONE },\n";
+    for (size_t i = 0; i < nodes_.size(); i++) {
+        const Node& node = nodes_[i];
+        const Mapping& mapping = *node.mapping;
+        const char* kind = node.keyword == "container" ? "KEA_KIND_CONTAINER" :
+                           node.keyword == "list" ? "KEA_KIND_LIST" :
+                           node.keyword == "leaf" ? "KEA_KIND_LEAF" : "KEA_KIND_LEAF_LIST";
+        // Names default to the node name where the table handles them.
+        string key = mapping.key ? "\"" + string(mapping.key) + "\"" :
+            (mapping.scope == MEMBER || mapping.scope == CONTEXT) ? "\"" + node.name + "\"" : "NULL";
+        Type type = mapping.type == AUTO ? node.type : mapping.type;
+        out << "    { \"" << node.name << "\", "
+            << (node.parent == NO_PARENT ? "KEA_NODE_NONE" : nodeId(top_, nodes_[node.parent].path))
+            << ", "
+            << kind << ", " << SCOPE_NAMES[mapping.scope] << ", "
+            << key
+            << ", " << TYPE_NAMES[mapping.scope == NONE ? 0 : type] << " },\n";
+    }
+    out << "};\n\n";
+
+    out << "/// @brief Returns translation of a node.\n"
+        << "constexpr const KeaNodeInfo&\n"
+        << "keaNodeInfo(uint16_t id) {\n"
+        << "    return (KEA_NODES[id < KEA_NODE_COUNT ? id : static_cast<uint16_t>(KEA_NODE_NONE)]);\n"
+        << "}\n\n";
+
+    // Names are only compared for children of the same parent, and
+    // only when the length matches.
+    out << "/// @brief Returns id of a child node.\n"
+        << "///\n"
+        << "/// @param parent id of the parent (KEA_NODE_NONE for the top)\n"
+        << "/// @param name name of the child (not necessarily terminated)\n"
+        << "/// @param len length of the name\n"
+        << "/// @return id of the child, KEA_NODE_NONE if not in the model\n"
+        << "inline uint16_t\n"
+        << "keaNodeChild(uint16_t parent, const char* name, size_t len) {\n"
+        << "    switch (parent) {\n";
+    for (size_t p = 0; p <= nodes_.size(); p++) {
+        // The top container first, as the child of no node.
+        const size_t parent = p ? p - 1 : NO_PARENT;
+        vector<size_t> children;
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            if (nodes_[i].parent == parent) {
+                children.push_back(i);
+            }
+        }
+        if (children.empty()) {
+            continue;
+        }
+        out << "    case " << (p ? nodeId(top_, nodes_[parent].path) : "KEA_NODE_NONE") << ":\n";
+        for (size_t c = 0; c < children.size(); c++) {
+            const Node& child = nodes_[children[c]];
+            out << "        if (len == " << child.name.size() << " && memcmp(name, \""
+                << child.name << "\", " << child.name.size() << ") == 0) {\n"
+                << "            return (" << nodeId(top_, child.path) << ");\n"
+                << "        }\n";
+        }
+        out << "        break;\n";
+    }
+    out << "    default:\n"
+        << "        break;\n"
+        << "    }\n"
+        << "    return (KEA_NODE_NONE);\n"
+        << "}\n\n"
+        << "#endif /* KEA_MAP_H */\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cerr << "usage: gen_kea_map model.yang kea-map.h" << endl;
+        return (EXIT_FAILURE);
+    }
+
+    ifstream in(argv[1]);
+    if (!in) {
+        cerr << "gen_kea_map: can't open " << argv[1] << endl;
+        return (EXIT_FAILURE);
+    }
+    stringstream buffer;
+    buffer << in.rdbuf();
+    const string text = buffer.str();
+
+    Model model;
+    Tokenizer tokens(text);
+    try {
+        vector<Statement> statements;
+        parseStatements(tokens, statements, false);
+        if (statements.size() != 1 || statements[0].keyword != "module") {
+            throw runtime_error("a single module expected");
+        }
+        model.load(statements[0]);
+    } catch (const exception& ex) {
+        cerr << "gen_kea_map: " << argv[1] << ":" << tokens.getLine() << ": "
+             << ex.what() << endl;
+        return (EXIT_FAILURE);
+    }
+    if (model.map() != 0) {
+        return (EXIT_FAILURE);
+    }
+
+    string source = argv[1];
+    source = source.substr(source.rfind('/') + 1);
+    stringstream header;
+    model.write(header, source);
+
+    ofstream out(argv[2]);
+    if (!out || !(out << header.str()) || !(out.close(), out)) {
+        cerr << "gen_kea_map: can't write " << argv[2] << endl;
+        remove(argv[2]);
+        return (EXIT_FAILURE);
+    }
+    return (EXIT_SUCCESS);
+}
@@ -23,14 +23,27 @@ int main(int argc, const char *argv[]) {
     }
 
     SysrepoKea yang(sess);
-
-    std::string json = yang.getConfig();
-
-    cout << "Received JSON config is " << json.length() << " bytes long."
-         << endl;
-    cout << json;
+    yang.setStyle(JsonWriter::PRETTY);
 
     int status = EXIT_SUCCESS;
+    rc = yang.updateConfig();
+    if (rc != SR_ERR_OK) {
+        cerr << "Failed to translate config" << endl;
+        status = EXIT_FAILURE;
+    } else {
+        // Written as it is assembled, however large it is.
+        SysrepoKea::ConfigStream stream(yang);
+        const char* data;
+        size_t size;
+        size_t length = 0;
+        while (stream.next(data, size)) {
+            cout.write(data, size);
+            length += size;
+        }
+        cout.flush();
+        cerr << "Received JSON config is " << length << " bytes long." << endl;
+    }
+
     rc = sr_session_stop(sess);
     if (rc != SR_ERR_OK) {
         cerr << "Failed to stop session" << endl;
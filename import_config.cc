@@ -0,0 +1,131 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file import_config.cc
+///
+/// Imports a Kea DHCPv6 configuration file into the ietf-kea-dhcpv6
+/// module of a Sysrepo datastore.
+
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include "kea-import.h"
+
+using namespace std;
+
+namespace {
+
+void
+usage() {
+    cerr << "usage: import_config [-d datastore] [-b edits] [-r] [-n] file" << endl
+         << "  -d  startup (default) or running" << endl
+         << "  -b  edits per commit (default " << KeaImporter::DEFAULT_BATCH
+         << ", 0 for a single commit)" << endl
+         << "  -r  replace the ietf-kea-dhcpv6 data (default is to add to it)" << endl
+         << "  -n  print the edits instead of making them" << endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    sr_datastore_t datastore = SR_DS_STARTUP;
+    size_t batch = KeaImporter::DEFAULT_BATCH;
+    bool replace = false;
+    bool dry_run = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:b:rnh")) != -1) {
+        switch (opt) {
+        case 'd':
+            if (strcmp(optarg, "startup") == 0) {
+                datastore = SR_DS_STARTUP;
+            } else if (strcmp(optarg, "running") == 0) {
+                datastore = SR_DS_RUNNING;
+            } else {
+                usage();
+                return (EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            batch = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            replace = true;
+            break;
+        case 'n':
+            dry_run = true;
+            break;
+        default:
+            usage();
+            return (EXIT_FAILURE);
+        }
+    }
+    if (optind + 1 != argc) {
+        usage();
+        return (EXIT_FAILURE);
+    }
+
+    ifstream file(argv[optind]);
+    if (!file) {
+        cerr << "Failed to open " << argv[optind] << endl;
+        return (EXIT_FAILURE);
+    }
+
+    sr_conn_ctx_t *conn = NULL;
+    sr_session_ctx_t *sess = NULL;
+    if (!dry_run) {
+        int rc = sr_connect("import config", SR_CONN_DEFAULT, &conn);
+        if (rc != SR_ERR_OK) {
+            cerr << "Failed to connect: " << sr_strerror(rc) << endl;
+            return (EXIT_FAILURE);
+        }
+        rc = sr_session_start(conn, datastore, SR_SESS_DEFAULT, &sess);
+        if (rc != SR_ERR_OK) {
+            cerr << "Failed to start session: " << sr_strerror(rc) << endl;
+            sr_disconnect(conn);
+            return (EXIT_FAILURE);
+        }
+    }
+
+    KeaImporter importer(sess);
+    importer.setCommitBatch(batch);
+    importer.setReplace(replace);
+    if (dry_run) {
+        importer.setOutput(&cout);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int rc = importer.import(file);
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    const map<string, size_t>& skipped = importer.getSkipped();
+    for (map<string, size_t>::const_iterator it = skipped.begin();
+         it != skipped.end(); ++it) {
+        cerr << "not imported: " << it->first << " (" << it->second << "x)" << endl;
+    }
+    if (rc != SR_ERR_OK) {
+        cerr << "Import failed: " << importer.getError() << endl;
+        if (importer.getCommits()) {
+            cerr << importer.getCommits() << " batch(es) had been committed" << endl;
+        }
+    } else {
+        cerr << "Imported " << importer.getItems() << " leaves in "
+             << importer.getCommits() << " commit(s), " << secs << " s" << endl;
+    }
+
+    if (sess) {
+        sr_session_stop(sess);
+    }
+    if (conn) {
+        sr_disconnect(conn);
+    }
+    return (rc == SR_ERR_OK ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,299 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file json-writer.cc
+
+#include "json-writer.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+/// Four spaces per level, enough for any sane nesting in one append.
+const char SPACES[] =
+    "                                                                "
+    "                                                                ";
+
+}
+
+JsonWriter::JsonWriter(string& out, Style style, int level)
+    :out_(out), style_(style), level_(level), depth_(0), after_key_(false) {
+}
+
+void
+JsonWriter::newLine(int level) {
+    out_ += '\n';
+    size_t len = static_cast<size_t>(level) * 4;
+    while (len > 0) {
+        size_t chunk = len < sizeof(SPACES) - 1 ? len : sizeof(SPACES) - 1;
+        out_.append(SPACES, chunk);
+        len -= chunk;
+    }
+}
+
+void
+JsonWriter::beginElement() {
+    if (after_key_) {
+        // The value of a map member goes right after its key.
+        after_key_ = false;
+        return;
+    }
+    if (depth_ == 0) {
+        return;
+    }
+    Frame& frame = frames_[depth_ - 1];
+    if (!frame.empty) {
+        out_ += ',';
+    }
+    frame.empty = false;
+    if (style_ == PRETTY) {
+        newLine(level_ + depth_);
+    }
+}
+
+void
+JsonWriter::open(char bracket, bool list) {
+    assert(depth_ < MAX_DEPTH);
+    beginElement();
+    out_ += bracket;
+    frames_[depth_].list = list;
+    frames_[depth_].empty = true;
+    depth_++;
+}
+
+void
+JsonWriter::close(char bracket) {
+    assert(depth_ > 0);
+    depth_--;
+    if (style_ == PRETTY && !frames_[depth_].empty) {
+        newLine(level_ + depth_);
+    }
+    out_ += bracket;
+}
+
+void
+JsonWriter::startMap() {
+    open('{', false);
+}
+
+void
+JsonWriter::endMap() {
+    close('}');
+}
+
+void
+JsonWriter::startList() {
+    open('[', true);
+}
+
+void
+JsonWriter::endList() {
+    close(']');
+}
+
+void
+JsonWriter::startMembers() {
+    assert(depth_ < MAX_DEPTH);
+    frames_[depth_].list = false;
+    frames_[depth_].empty = true;
+    depth_++;
+}
+
+void
+JsonWriter::endMembers() {
+    assert(depth_ > 0);
+    depth_--;
+}
+
+void
+JsonWriter::key(const char* name) {
+    key(name, strlen(name));
+}
+
+void
+JsonWriter::key(const char* name, size_t len) {
+    beginElement();
+    appendString(out_, name, len);
+    if (style_ == PRETTY) {
+        out_.append(": ", 2);
+    } else {
+        out_ += ':';
+    }
+    after_key_ = true;
+}
+
+void
+JsonWriter::value(const char* text) {
+    value(text, strlen(text));
+}
+
+void
+JsonWriter::value(const char* text, size_t len) {
+    beginElement();
+    appendString(out_, text, len);
+}
+
+void
+JsonWriter::value(int64_t number) {
+    beginElement();
+    appendNumber(out_, number);
+}
+
+void
+JsonWriter::value(uint64_t number) {
+    beginElement();
+    appendNumber(out_, number);
+}
+
+void
+JsonWriter::value(double number) {
+    beginElement();
+    appendNumber(out_, number);
+}
+
+void
+JsonWriter::value(bool flag) {
+    beginElement();
+    if (flag) {
+        out_.append("true", 4);
+    } else {
+        out_.append("false", 5);
+    }
+}
+
+void
+JsonWriter::null() {
+    beginElement();
+    out_.append("null", 4);
+}
+
+void
+JsonWriter::raw(const string& json) {
+    beginElement();
+    out_ += json;
+}
+
+void
+JsonWriter::rawMembers(const string& json) {
+    assert(depth_ > 0 && !frames_[depth_ - 1].list);
+    if (json.empty()) {
+        return;
+    }
+    beginRawMembers();
+    out_ += json;
+}
+
+void
+JsonWriter::beginRawMembers() {
+    assert(depth_ > 0 && !frames_[depth_ - 1].list);
+    // The fragment starts with its own new line and indentation, only
+    // the separator is up to us.
+    Frame& frame = frames_[depth_ - 1];
+    if (!frame.empty) {
+        out_ += ',';
+    }
+    frame.empty = false;
+}
+
+void
+JsonWriter::appendString(string& out, const char* text, size_t len) {
+    static const char HEX[] = "0123456789abcdef";
+
+    out += '"';
+    // Copy runs of characters that need no escaping in one go.
+    size_t run = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(text + run, i - run);
+        run = i + 1;
+        out += '\\';
+        switch (c) {
+        case '"':
+            out += '"';
+            break;
+        case '\\':
+            out += '\\';
+            break;
+        case '\b':
+            out += 'b';
+            break;
+        case '\f':
+            out += 'f';
+            break;
+        case '\n':
+            out += 'n';
+            break;
+        case '\r':
+            out += 'r';
+            break;
+        case '\t':
+            out += 't';
+            break;
+        default:
+            out.append("u00", 3);
+            out += HEX[c >> 4];
+            out += HEX[c & 0xf];
+        }
+    }
+    out.append(text + run, len - run);
+    out += '"';
+}
+
+void
+JsonWriter::appendNumber(string& out, uint64_t number) {
+    char buf[20];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    do {
+        *--p = static_cast<char>('0' + number % 10);
+        number /= 10;
+    } while (number);
+    out.append(p, end - p);
+}
+
+void
+JsonWriter::appendNumber(string& out, int64_t number) {
+    if (number < 0) {
+        out += '-';
+        // Negate in unsigned arithmetic so that INT64_MIN works too.
+        appendNumber(out, static_cast<uint64_t>(0) - static_cast<uint64_t>(number));
+    } else {
+        appendNumber(out, static_cast<uint64_t>(number));
+    }
+}
+
+void
+JsonWriter::appendNumber(string& out, double number) {
+    // JSON has no representation for these.
+    if (std::isnan(number) || std::isinf(number)) {
+        out.append("null", 4);
+        return;
+    }
+
+    // Whole numbers (the common case) don't need printf.
+    if (number == std::floor(number) && std::fabs(number) < 9007199254740992.0) {
+        appendNumber(out, static_cast<int64_t>(number));
+        return;
+    }
+
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.15g", number);
+    for (int i = 0; i < len; i++) {
+        // The decimal separator depends on LC_NUMERIC, JSON wants a dot.
+        if (buf[i] == ',') {
+            buf[i] = '.';
+        }
+    }
+    out.append(buf, len);
+}
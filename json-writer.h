@@ -0,0 +1,245 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file json-writer.h
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/// @brief JSON text produced piece by piece.
+///
+/// Lets a large document be sent or written as it is produced, without
+/// ever holding all of it in one buffer.
+class JsonSource {
+public:
+    /// @brief Destructor
+    virtual ~JsonSource() {
+    }
+
+    /// @brief Returns the next piece of the text.
+    ///
+    /// @param data (out) start of the piece, valid until the next call
+    /// @param size (out) length of the piece (not 0)
+    /// @return false when all of the text has been returned
+    virtual bool next(const char*& data, size_t& size) = 0;
+
+    /// @brief Returns true when next() has nothing more to return.
+    virtual bool done() const = 0;
+};
+
+/// @brief JSON text held in a string, returned as a single piece.
+class JsonStringSource : public JsonSource {
+public:
+    /// @brief Constructor
+    ///
+    /// @param json the text (must outlive the source)
+    JsonStringSource(const std::string& json)
+        :json_(json), done_(json.empty()) {
+    }
+
+    /// @brief Returns the text.
+    virtual bool next(const char*& data, size_t& size) {
+        if (done_) {
+            return (false);
+        }
+        data = json_.data();
+        size = json_.size();
+        done_ = true;
+        return (true);
+    }
+
+    /// @brief Returns true once the text has been returned.
+    virtual bool done() const {
+        return (done_);
+    }
+
+private:
+    const std::string& json_;  ///< the text
+    bool done_;                ///< whether it was returned
+};
+
+/// @brief Writes JSON text into a caller-provided buffer.
+///
+/// Everything is appended to a single string, so a whole document is
+/// produced without intermediate strings or streams. Commas, new lines
+/// and indentation are inserted by the writer.
+///
+/// Parts of a document can be rendered separately and inserted later
+/// with raw() (a single value) or rawMembers() (map members). Such a
+/// fragment must be rendered with the same style and with the level
+/// (number of enclosing maps and lists) it will end up at, for example:
+///
+/// @code
+///     std::string subnet;
+///     JsonWriter(subnet, JsonWriter::PRETTY, 3).startMap()...
+///
+///     std::string doc;
+///     JsonWriter w(doc, JsonWriter::PRETTY);
+///     w.startMap();             // level 1
+///     w.key("Dhcp6");
+///     w.startMap();             // level 2
+///     w.key("subnet6");
+///     w.startList();            // level 3
+///     w.raw(subnet);
+/// @endcode
+class JsonWriter {
+public:
+    /// Output style
+    enum Style {
+        COMPACT, ///< no white space at all (what Kea gets)
+        PRETTY   ///< one element per line, indented by four spaces
+    };
+
+    /// Maximum nesting of maps and lists
+    static const int MAX_DEPTH = 64;
+
+    /// @brief Constructor
+    ///
+    /// @param out buffer the text is appended to
+    /// @param style output style
+    /// @param level number of maps and lists enclosing the text
+    ///        (only affects indentation of fragments)
+    JsonWriter(std::string& out, Style style = COMPACT, int level = 0);
+
+    /// @brief Returns the output buffer.
+    std::string& getOutput() {
+        return (out_);
+    }
+
+    /// @brief Returns the output style.
+    Style getStyle() const {
+        return (style_);
+    }
+
+    /// @brief Opens a map.
+    void startMap();
+
+    /// @brief Closes the innermost map.
+    void endMap();
+
+    /// @brief Opens a list.
+    void startList();
+
+    /// @brief Closes the innermost list.
+    void endList();
+
+    /// @brief Starts map members without writing the brace.
+    ///
+    /// Used to render a fragment that is later inserted into a map
+    /// with rawMembers().
+    void startMembers();
+
+    /// @brief Ends members started by startMembers().
+    void endMembers();
+
+    /// @brief Writes a map key (the value must follow).
+    void key(const char* name);
+
+    /// @brief Writes a map key (the value must follow).
+    void key(const std::string& name) {
+        key(name.data(), name.size());
+    }
+
+    /// @brief Writes a map key of given length (the value must follow).
+    void key(const char* name, size_t len);
+
+    /// @brief Writes a string value.
+    void value(const char* text);
+
+    /// @brief Writes a string value.
+    void value(const std::string& text) {
+        value(text.data(), text.size());
+    }
+
+    /// @brief Writes a string value of given length.
+    void value(const char* text, size_t len);
+
+    /// @brief Writes a signed integer value.
+    void value(int64_t number);
+
+    /// @brief Writes an unsigned integer value.
+    void value(uint64_t number);
+
+    /// @brief Writes a signed integer value.
+    void value(int number) {
+        value(static_cast<int64_t>(number));
+    }
+
+    /// @brief Writes an unsigned integer value.
+    void value(unsigned number) {
+        value(static_cast<uint64_t>(number));
+    }
+
+    /// @brief Writes a floating point value.
+    void value(double number);
+
+    /// @brief Writes a boolean value.
+    void value(bool flag);
+
+    /// @brief Writes null.
+    void null();
+
+    /// @brief Inserts an already rendered value.
+    ///
+    /// @param json value rendered at the level it is inserted at
+    void raw(const std::string& json);
+
+    /// @brief Inserts already rendered map members.
+    ///
+    /// @param json members rendered with startMembers() at the level
+    ///        they are inserted at (may be empty)
+    void rawMembers(const std::string& json);
+
+    /// @brief Writes what comes before map members the caller outputs
+    ///        itself (e.g. sends from the fragment's own buffer).
+    ///
+    /// Like rawMembers() of a non-empty fragment, without the fragment.
+    void beginRawMembers();
+
+    /// @brief Appends a string as JSON string (quoted and escaped).
+    static void appendString(std::string& out, const char* text, size_t len);
+
+    /// @brief Appends an unsigned integer in decimal.
+    static void appendNumber(std::string& out, uint64_t number);
+
+    /// @brief Appends a signed integer in decimal.
+    static void appendNumber(std::string& out, int64_t number);
+
+    /// @brief Appends a floating point number (independent of locale).
+    static void appendNumber(std::string& out, double number);
+
+private:
+    /// @brief Writes separator and indentation before a new element.
+    void beginElement();
+
+    /// @brief Writes new line and indentation for the level.
+    void newLine(int level);
+
+    /// @brief Opens a map or a list.
+    void open(char bracket, bool list);
+
+    /// @brief Closes a map or a list.
+    void close(char bracket);
+
+    /// State of an open map or list
+    struct Frame {
+        bool list;  ///< list (or map)
+        bool empty; ///< nothing written yet
+    };
+
+    std::string& out_;       ///< output buffer
+    Style style_;            ///< output style
+    int level_;              ///< levels enclosing the writer
+    int depth_;              ///< number of open frames
+    bool after_key_;         ///< a key has been written, value follows
+    Frame frames_[MAX_DEPTH]; ///< open maps and lists
+};
+
+#endif /* JSON_WRITER_H */
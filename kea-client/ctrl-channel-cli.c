@@ -3,97 +3,474 @@
 // This Source Code Form is subject to the terms of the Mozilla Public
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#define _GNU_SOURCE
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-/// Attempts to load a file into buffer and wrap it with
-/// config-set JSON syntax.
-/// @return 0 on failure, 1 on success
-int loadConfig(char* buf, size_t buflen, const char* filename) {
-
-    const char* COMMAND_PREFIX =
-        "{\n"
-        "    \"command\": \"config-set\",\n"
-        "    \"arguments\": \n";
-    const char* COMMAND_SUFFIX =
-        "    \n"
-        "}\n";
-
-    FILE* f = NULL;
-    f = fopen(filename, "r");
-    if (!f) {
+/// Framing added around the config file to make it a config-set command.
+static const char* COMMAND_PREFIX =
+    "{\n"
+    "    \"command\": \"config-set\",\n"
+    "    \"arguments\": \n";
+static const char* COMMAND_SUFFIX =
+    "    \n"
+    "}\n";
+
+/// Growable buffer for responses.
+typedef struct {
+    char* data;
+    size_t len;
+    size_t size;
+} buffer_t;
+
+/// Tracks nesting of a JSON document to detect where it ends.
+typedef struct {
+    int depth;
+    int started;
+    int in_string;
+    int escape;
+    int complete;
+} json_scanner_t;
+
+/// @return current monotonic time in microseconds
+static long long nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/// Scans a chunk of data, returns 1 when the document is complete.
+static int scanJson(json_scanner_t* s, const char* data, size_t len) {
+    size_t i;
+    for (i = 0; i < len && !s->complete; i++) {
+        char c = data[i];
+        if (s->in_string) {
+            if (s->escape) {
+                s->escape = 0;
+            } else if (c == '\\') {
+                s->escape = 1;
+            } else if (c == '"') {
+                s->in_string = 0;
+            }
+            continue;
+        }
+        if (c == '"') {
+            s->in_string = 1;
+        } else if (c == '{' || c == '[') {
+            s->depth++;
+            s->started = 1;
+        } else if ((c == '}' || c == ']') && --s->depth <= 0 && s->started) {
+            s->complete = 1;
+        }
+    }
+    return (s->complete);
+}
+
+/// Connects to the UNIX socket.
+/// @return socket descriptor or -1 on failure
+static int connectSocket(const char* path) {
+    struct sockaddr_un srv_addr;
+    int socket_fd;
+
+    if (strlen(path) >= sizeof(srv_addr.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return (-1);
+    }
+
+    // Create UNIX stream socket.
+    if ((socket_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        perror("Failed to create UNIX stream");
+        return (-1);
+    }
+    // Specify the address to connect to (unix path)
+    memset(&srv_addr, 0, sizeof(struct sockaddr_un));
+    srv_addr.sun_family = AF_UNIX;
+    strcpy(srv_addr.sun_path, path);
+    // Try to connect.
+    if (connect(socket_fd, (struct sockaddr*) &srv_addr, sizeof(srv_addr)) == -1) {
+        perror("Failed to connect");
+        close(socket_fd);
+        return (-1);
+    }
+    return (socket_fd);
+}
+
+/// Returns 1 if the error means the server closed the connection.
+static int closedByPeer(int error) {
+    return (error == EPIPE || error == ECONNRESET);
+}
+
+/// Writes all iovecs, handling partial writes.
+/// @return 1 on success, 0 on failure, -1 if the server closed the
+///         connection (reported by the caller)
+static int writeAll(int fd, struct iovec* iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t sent = writev(fd, iov, cnt);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (closedByPeer(errno)) {
+                return (-1);
+            }
+            perror("Failed to send");
+            return (0);
+        }
+        while (cnt > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return (1);
+}
+
+/// Copies the file to the socket. Uses sendfile() so the data does not
+/// pass through user space, and falls back to read/write if the kernel
+/// does not support sendfile() to this kind of socket.
+/// @return number of bytes sent or -1 on failure
+static long long sendFile(int socket_fd, int file_fd, off_t size) {
+    off_t offset = 0;
+    char buf[65536];
+
+    while (offset < size) {
+        ssize_t sent = sendfile(socket_fd, file_fd, &offset, size - offset);
+        if (sent > 0) {
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            break;
+        }
+        if (sent == 0) {
+            // File got shorter in the meantime.
+            return (offset);
+        }
+        if (closedByPeer(errno)) {
+            printf("Connection closed by the server\n");
+        } else {
+            perror("sendfile failed");
+        }
+        return (-1);
+    }
+
+    while (offset < size) {
+        ssize_t got = pread(file_fd, buf, sizeof(buf), offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            if (got < 0) {
+                perror("Failed to read config file");
+            }
+            return (got < 0 ? -1 : offset);
+        }
+        struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = got;
+        int rc = writeAll(socket_fd, &iov, 1);
+        if (rc <= 0) {
+            if (rc < 0) {
+                printf("Connection closed by the server\n");
+            }
+            return (-1);
+        }
+        offset += got;
+    }
+
+    return (offset);
+}
+
+/// Sends the file wrapped with config-set JSON syntax.
+/// @return number of bytes sent or -1 on failure
+static long long sendConfig(int socket_fd, const char* filename) {
+    struct stat st;
+    struct iovec iov;
+    long long sent;
+
+    int file_fd = open(filename, O_RDONLY);
+    if (file_fd < 0) {
         printf("Failed to open file %s\n", filename);
-        return (0);
+        return (-1);
+    }
+    if (fstat(file_fd, &st) < 0) {
+        perror("Failed to stat config file");
+        close(file_fd);
+        return (-1);
     }
 
-    sprintf(buf, "%s", COMMAND_PREFIX);
-    size_t offset = strlen(buf);
+    iov.iov_base = (void*)COMMAND_PREFIX;
+    iov.iov_len = strlen(COMMAND_PREFIX);
+    if (writeAll(socket_fd, &iov, 1) <= 0) {
+        close(file_fd);
+        return (-1);
+    }
 
-    size_t len = fread(buf + offset, sizeof(char), buflen - offset, f);
+    sent = sendFile(socket_fd, file_fd, st.st_size);
+    close(file_fd);
+    if (sent < 0) {
+        return (-1);
+    }
 
-    fclose(f);
+    iov.iov_base = (void*)COMMAND_SUFFIX;
+    iov.iov_len = strlen(COMMAND_SUFFIX);
+    if (writeAll(socket_fd, &iov, 1) <= 0) {
+        return (-1);
+    }
+
+    return (sent + strlen(COMMAND_PREFIX) + strlen(COMMAND_SUFFIX));
+}
 
-    sprintf(buf + strlen(buf), "%s", COMMAND_SUFFIX);
+/// Reads the response until the JSON document is complete.
+/// @return 1 on success, 0 on failure, -1 if the server closed the
+///         connection before sending anything (reported by the caller)
+static int readResponse(int socket_fd, buffer_t* buf) {
+    json_scanner_t scanner;
+    memset(&scanner, 0, sizeof(scanner));
+    buf->len = 0;
 
+    while (!scanner.complete) {
+        if (buf->size - buf->len < 65536) {
+            size_t size = buf->size ? buf->size * 2 : 131072;
+            char* data = realloc(buf->data, size + 1);
+            if (!data) {
+                printf("Out of memory\n");
+                return (0);
+            }
+            buf->data = data;
+            buf->size = size;
+        }
+        ssize_t got = recv(socket_fd, buf->data + buf->len, buf->size - buf->len, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if ((got == 0 || (got < 0 && closedByPeer(errno))) && buf->len == 0) {
+            buf->data[0] = 0;
+            return (-1);
+        }
+        if (got < 0) {
+            perror("Failed to receive");
+            return (0);
+        }
+        if (got == 0) {
+            break;
+        }
+        scanJson(&scanner, buf->data + buf->len, got);
+        buf->len += got;
+    }
+    buf->data[buf->len] = 0;
+
+    if (!scanner.complete) {
+        printf("Connection closed before the response was complete\n");
+        return (0);
+    }
     return (1);
-};
+}
+
+/// Returns 1 if the peer closed the connection (or sent unexpected data).
+/// The server may still close it right after the check, see runBatch().
+static int peerClosed(int socket_fd) {
+    char c;
+    ssize_t got = recv(socket_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return (got >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+}
+
+/// Sends commands from a file (one JSON command per line; empty lines and
+/// lines starting with # are skipped) reusing the connection as long as
+/// the server keeps it open and prints the latency of each command.
+/// @return 0 on success, 1 if any command failed
+static int runBatch(const char* socket_path, const char* filename) {
+    FILE* f = fopen(filename, "r");
+    if (!f) {
+        printf("Failed to open file %s\n", filename);
+        return (1);
+    }
+
+    buffer_t response;
+    memset(&response, 0, sizeof(response));
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    int socket_fd = -1;
+    int failures = 0;
+    long cnt = 0;
+    long reconnects = 0;
+    long long total = 0, min = -1, max = 0;
+
+    printf("#cmd latency-us sent rcvd reconnect response\n");
+    while ((len = getline(&line, &line_size, f)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = 0;
+        }
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+
+        // Kea closes the connection after each response, so a new one
+        // is made whenever the server has closed the previous one.
+        int reconnected = 0;
+        if (socket_fd >= 0 && peerClosed(socket_fd)) {
+            close(socket_fd);
+            socket_fd = -1;
+        }
+        long long start = nowUs();
+        int rc = 0;
+        int unreachable = 0;
+        while (1) {
+            int reused = socket_fd >= 0;
+            if (!reused) {
+                reconnected = cnt > 0 || reconnected;
+                socket_fd = connectSocket(socket_path);
+                if (socket_fd < 0) {
+                    unreachable = 1;
+                    break;
+                }
+            }
+
+            struct iovec iov;
+            iov.iov_base = line;
+            iov.iov_len = len;
+            rc = writeAll(socket_fd, &iov, 1);
+            if (rc > 0) {
+                rc = readResponse(socket_fd, &response);
+            }
+            if (rc > 0) {
+                break;
+            }
+            close(socket_fd);
+            socket_fd = -1;
+            // The server may close the connection just after the check
+            // above. Nothing was answered, so the command was not taken:
+            // it is sent again, once, over a new connection.
+            if (rc == 0 || !reused) {
+                break;
+            }
+        }
+        reconnects += reconnected;
+        if (unreachable) {
+            failures++;
+            break;
+        }
+        if (rc <= 0) {
+            if (rc < 0) {
+                printf("Connection closed by the server\n");
+            }
+            failures++;
+            continue;
+        }
+        long long latency = nowUs() - start;
+
+        total += latency;
+        if (min < 0 || latency < min) {
+            min = latency;
+        }
+        if (latency > max) {
+            max = latency;
+        }
+        printf("%ld %lld %zd %zu %d %.60s\n", cnt, latency, len, response.len,
+               reconnected, response.data);
+        cnt++;
+    }
+
+    if (cnt) {
+        printf("# %ld commands, %ld reconnects, %d failures, latency-us "
+               "min/avg/max %lld/%lld/%lld\n", cnt, reconnects, failures,
+               min, total / cnt, max);
+    }
+
+    if (socket_fd >= 0) {
+        close(socket_fd);
+    }
+    free(line);
+    free(response.data);
+    fclose(f);
+    return (failures ? 1 : 0);
+}
 
 int main(int argc, const char* argv[]) {
     if (argc < 2) {
         printf("Usage: %s socket_path [config-file]\n", argv[0]);
+        printf("       %s socket_path -b commands-file\n", argv[0]);
         printf("socket_path is mandatory\n");
         printf("If optional config-file is specified, its content is sent to Kea\n");
         printf("If not, list-commands command is sent that will ask Kea to list\n");
         printf("all supported commands.\n");
+        printf("With -b, commands (one JSON command per line) are read from\n");
+        printf("commands-file and sent one after another over as few connections\n");
+        printf("as the server allows. Latency of each command is printed.\n");
         return (1);
     }
 
-    // Create UNIX stream socket.
-    int socket_fd;
-    if ((socket_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
-    {
-        perror("Failed to create UNIX stream");
-        return (1);
+    // Kea may close the connection while a command is being written;
+    // the write then fails with EPIPE instead of killing the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    if (argc == 4 && strcmp(argv[2], "-b") == 0) {
+        return (runBatch(argv[1], argv[3]));
     }
-    // Specify the address to connect to (unix path)
-    struct sockaddr_un srv_addr;
-    memset(&srv_addr, 0, sizeof(struct sockaddr_un));
-    srv_addr.sun_family = AF_UNIX;
-    strcpy(srv_addr.sun_path, argv[1]);
-    socklen_t len = sizeof(srv_addr);
-    // Try to connect.
-    if (connect(socket_fd, (struct sockaddr*) &srv_addr, len) == -1) {
-        perror("Failed to connect");
+
+    int socket_fd = connectSocket(argv[1]);
+    if (socket_fd < 0) {
         return (1);
     }
-    // Prepare input buffer.
-    char buf[10240];
-    memset(buf, 0, sizeof(buf));
 
+    long long bytes_sent;
+    long long start = nowUs();
     if (argc == 3) {
-        if (!loadConfig(buf, sizeof(buf), argv[2])) {
-            printf("Failed to load specified config file: %s", argv[2]);
+        printf("Sending config file: %s\n", argv[2]);
+        bytes_sent = sendConfig(socket_fd, argv[2]);
+        if (bytes_sent < 0) {
+            printf("Failed to send specified config file: %s\n", argv[2]);
+            close(socket_fd);
             return (1);
         }
     } else {
         // Send a command to list all available commands.
-        sprintf(buf, "{ \"command\": \"list-commands\" }");
+        char cmd[] = "{ \"command\": \"list-commands\" }";
+        struct iovec iov;
+        iov.iov_base = cmd;
+        iov.iov_len = strlen(cmd);
+        printf("Buffer to be sent: %s\n", cmd);
+        int rc = writeAll(socket_fd, &iov, 1);
+        if (rc <= 0) {
+            if (rc < 0) {
+                printf("Connection closed by the server\n");
+            }
+            close(socket_fd);
+            return (1);
+        }
+        bytes_sent = strlen(cmd);
     }
-
-    printf("Buffer to be sent: %s\n", buf);
-
-    int bytes_sent = send(socket_fd, buf, strlen(buf), 0);
-    printf("%d bytes sent\n", bytes_sent);
+    printf("%lld bytes sent\n", bytes_sent);
 
     // Receive a response (should be JSON formatted list of commands)
-    memset(buf, 0, sizeof(buf));
-    int bytes_rcvd = recv(socket_fd, buf, sizeof(buf), 0);
-    printf("%d bytes received: [%s]\n", bytes_rcvd, buf);
+    buffer_t response;
+    memset(&response, 0, sizeof(response));
+    int ok = readResponse(socket_fd, &response);
+    if (ok < 0) {
+        printf("Connection closed by the server\n");
+    }
+    printf("%zu bytes received in %lld us: [%s]\n", response.len,
+           nowUs() - start, response.data ? response.data : "");
+    free(response.data);
     // Close the socket
     close(socket_fd);
-    return 0;
+    return (ok > 0 ? 0 : 1);
 }
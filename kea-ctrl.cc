@@ -0,0 +1,317 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-ctrl.cc
+
+#include "kea-ctrl.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <chrono>
+
+using namespace std;
+
+namespace {
+
+/// @brief Returns current monotonic time in milliseconds.
+int64_t
+nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000);
+}
+
+/// @brief Waits until the socket is ready or the deadline passes.
+///
+/// @return true if ready, false on timeout or error (errno is set)
+bool
+waitFor(int fd, short events, int64_t deadline) {
+    while (true) {
+        int64_t left = deadline - nowMs();
+        if (left < 0) {
+            left = 0;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        int n = poll(&pfd, 1, static_cast<int>(left));
+        if (n > 0) {
+            return (true);
+        }
+        if (n == 0) {
+            errno = ETIMEDOUT;
+            return (false);
+        }
+        if (errno != EINTR) {
+            return (false);
+        }
+    }
+}
+
+}
+
+const char* KeaControlChannel::COMMAND_TAIL = " }";
+
+KeaControlChannel::KeaControlChannel(const string& socket_path)
+    :socket_path_(socket_path), fd_(-1), timeout_(DEFAULT_TIMEOUT),
+     connects_(0), retries_(0) {
+}
+
+KeaControlChannel::~KeaControlChannel() {
+    disconnect();
+}
+
+void
+KeaControlChannel::disconnect() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+int
+KeaControlChannel::connectSocket(const string& socket_path, string& error) {
+    struct sockaddr_un addr;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        error = "control socket path too long: " + socket_path;
+        return (-1);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        error = string("failed to create UNIX socket: ") + strerror(errno);
+        return (-1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path.c_str());
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                  sizeof(addr)) == -1) {
+        error = "failed to connect to " + socket_path + ": " +
+            strerror(errno);
+        close(fd);
+        return (-1);
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return (fd);
+}
+
+bool
+KeaControlChannel::connect(string& error) {
+    if (fd_ >= 0) {
+        return (true);
+    }
+
+    fd_ = connectSocket(socket_path_, error);
+    if (fd_ < 0) {
+        return (false);
+    }
+    connects_++;
+    return (true);
+}
+
+void
+KeaControlChannel::checkConnection() {
+    if (fd_ < 0) {
+        return;
+    }
+
+    // An idle connection must not be readable: either Kea closed it or
+    // there is a stray response we don't want mixed with the next one.
+    struct pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) != 0) {
+        disconnect();
+    }
+}
+
+string
+KeaControlChannel::getCommandHead(const string& command, bool arguments) {
+    string head = "{ \"command\": \"" + command + "\"";
+    if (arguments) {
+        head += ", \"arguments\": ";
+    }
+    return (head);
+}
+
+bool
+KeaControlChannel::writeCommand(const string& command,
+                                const string& arguments, string& error) {
+    string head = getCommandHead(command, !arguments.empty());
+    const char* tail = COMMAND_TAIL;
+
+    // The arguments (usually the whole configuration) are sent from the
+    // caller's buffer as they are; only the framing is added around them.
+    struct iovec iov[3];
+    iov[0].iov_base = const_cast<char*>(head.data());
+    iov[0].iov_len = head.size();
+    iov[1].iov_base = const_cast<char*>(arguments.data());
+    iov[1].iov_len = arguments.size();
+    iov[2].iov_base = const_cast<char*>(tail);
+    iov[2].iov_len = strlen(tail);
+
+    struct iovec* cur = iov;
+    int cnt = 3;
+    int64_t deadline = nowMs() + timeout_;
+
+    while (cnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = cur;
+        msg.msg_iovlen = cnt;
+
+        ssize_t sent = sendmsg(fd_, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (waitFor(fd_, POLLOUT, deadline)) {
+                    continue;
+                }
+            }
+            error = string("failed to send command: ") + strerror(errno);
+            return (false);
+        }
+
+        // Skip over what has been written (partial writes are normal
+        // for large configurations).
+        size_t left = static_cast<size_t>(sent);
+        while (cnt > 0 && left >= cur->iov_len) {
+            left -= cur->iov_len;
+            cur++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            cur->iov_base = static_cast<char*>(cur->iov_base) + left;
+            cur->iov_len -= left;
+        }
+    }
+
+    return (true);
+}
+
+bool
+KeaControlChannel::readResponse(string& response, string& error) {
+    JsonScanner scanner;
+    char buf[65536];
+    int64_t deadline = nowMs() + timeout_;
+
+    response.clear();
+    while (!scanner.complete()) {
+        ssize_t got = recv(fd_, buf, sizeof(buf), 0);
+        if (got > 0) {
+            size_t used = scanner.feed(buf, static_cast<size_t>(got));
+            response.append(buf, used);
+            continue;
+        }
+        if (got == 0) {
+            error = "connection closed before the response was complete";
+            return (false);
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+            waitFor(fd_, POLLIN, deadline)) {
+            continue;
+        }
+        error = string("failed to receive response: ") + strerror(errno);
+        return (false);
+    }
+
+    return (true);
+}
+
+int
+KeaControlChannel::parseResponse(KeaResponse& response) {
+    JsonValue json;
+    string error;
+    if (!parseJson(response.raw, json, error)) {
+        response.text = "failed to parse response: " + error;
+        return (response.result);
+    }
+
+    // Kea Control Agent wraps the responses in a list (one per server).
+    const JsonValue* answer = &json;
+    if (json.getType() == JsonValue::JSON_LIST && !json.listValue().empty()) {
+        answer = &json.listValue()[0];
+    }
+
+    const JsonValue* result = answer->get("result");
+    if (!result || result->getType() != JsonValue::JSON_INT) {
+        response.text = "response does not contain result";
+        return (response.result);
+    }
+    response.result = static_cast<int>(result->intValue());
+
+    const JsonValue* text = answer->get("text");
+    if (text) {
+        response.text = text->stringValue();
+    }
+    const JsonValue* arguments = answer->get("arguments");
+    if (arguments) {
+        response.arguments = *arguments;
+    }
+
+    return (response.result);
+}
+
+int
+KeaControlChannel::sendCommand(const string& command, const string& arguments,
+                               KeaResponse& response) {
+    typedef chrono::steady_clock Clock;
+    string error;
+    response = KeaResponse();
+    const Clock::time_point start = Clock::now();
+    Clock::time_point sent = start;
+
+    checkConnection();
+
+    // Kea closes the connection after each response, possibly just after
+    // we checked it. A command that failed on a kept-alive connection
+    // before any response arrived was not processed, so it is retried
+    // once on a fresh connection.
+    bool reused = isConnected();
+    while (true) {
+        if (!connect(error)) {
+            response.text = error;
+            return (response.result);
+        }
+        if (writeCommand(command, arguments, error)) {
+            sent = Clock::now();
+            if (readResponse(response.raw, error)) {
+                break;
+            }
+        }
+        disconnect();
+        if (!reused || !response.raw.empty()) {
+            response.text = error;
+            return (response.result);
+        }
+        reused = false;
+        retries_++;
+    }
+    response.send_ns = chrono::duration_cast<chrono::nanoseconds>(sent - start).count();
+    response.wait_ns = chrono::duration_cast<chrono::nanoseconds>(
+        Clock::now() - sent).count();
+
+    checkConnection();
+
+    return (parseResponse(response));
+}
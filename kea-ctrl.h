@@ -0,0 +1,197 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-ctrl.h
+///
+/// Client side of the Kea control channel (UNIX stream socket).
+
+#ifndef KEA_CTRL_H
+#define KEA_CTRL_H
+
+#include "kea-json.h"
+
+#include <stdint.h>
+
+#include <string>
+
+/// @brief Response received from Kea.
+struct KeaResponse {
+    /// Result code returned when no valid response was received
+    static const int RESULT_NO_RESPONSE = -1;
+
+    /// @brief Constructor
+    KeaResponse()
+        :result(RESULT_NO_RESPONSE), send_ns(0), wait_ns(0) {
+    }
+
+    /// Kea result code (0 means success) or RESULT_NO_RESPONSE
+    int result;
+
+    /// Kea result text or description of the local problem
+    std::string text;
+
+    /// Arguments returned by Kea (null if there were none)
+    JsonValue arguments;
+
+    /// Response as received over the socket
+    std::string raw;
+
+    /// Time spent connecting and sending the command (nanoseconds)
+    uint64_t send_ns;
+
+    /// Time from the command being sent to the response being read
+    uint64_t wait_ns;
+};
+
+/// @brief Connection to the Kea control socket.
+///
+/// The connection is opened on first use and kept open for subsequent
+/// commands. If Kea closed it in the meantime (Kea closes the socket
+/// after each response), it is transparently reopened. Commands are
+/// sent straight from memory and the response is read until the JSON
+/// document is complete.
+class KeaControlChannel {
+public:
+    /// Default time to wait for a response (in milliseconds)
+    static const int DEFAULT_TIMEOUT = 30000;
+
+    /// @brief Constructor
+    ///
+    /// @param socket_path path to the Kea UNIX control socket
+    KeaControlChannel(const std::string& socket_path);
+
+    /// @brief Destructor (closes the connection)
+    ~KeaControlChannel();
+
+    /// @brief Returns path to the control socket.
+    const std::string& getSocketPath() const {
+        return (socket_path_);
+    }
+
+    /// @brief Sets the time to wait for a response.
+    ///
+    /// @param timeout timeout in milliseconds
+    void setTimeout(int timeout) {
+        timeout_ = timeout;
+    }
+
+    /// @brief Returns true if the connection is open.
+    bool isConnected() const {
+        return (fd_ >= 0);
+    }
+
+    /// @brief Returns number of connections made so far.
+    size_t getConnectCount() const {
+        return (connects_);
+    }
+
+    /// @brief Returns number of commands resent on a fresh connection.
+    size_t getRetryCount() const {
+        return (retries_);
+    }
+
+    /// @brief Sends a command to Kea and waits for the response.
+    ///
+    /// @param command name of the command, e.g. "config-set"
+    /// @param arguments JSON text of the arguments (may be empty)
+    /// @param response (out) response received from Kea
+    ///
+    /// @return Kea result code (0 on success) or
+    ///         KeaResponse::RESULT_NO_RESPONSE if the command could not be
+    ///         sent or the response could not be read.
+    int sendCommand(const std::string& command, const std::string& arguments,
+                    KeaResponse& response);
+
+    /// @brief Sends config-set with the specified configuration.
+    ///
+    /// @param config Kea configuration (JSON text with Dhcp6 map)
+    /// @param response (out) response received from Kea
+    ///
+    /// @return same as sendCommand()
+    int configSet(const std::string& config, KeaResponse& response) {
+        return (sendCommand("config-set", config, response));
+    }
+
+    /// @brief Sends config-test with the specified configuration.
+    ///
+    /// Kea checks the configuration without applying it.
+    ///
+    /// @param config Kea configuration (JSON text with Dhcp6 map)
+    /// @param response (out) response received from Kea
+    ///
+    /// @return same as sendCommand()
+    int configTest(const std::string& config, KeaResponse& response) {
+        return (sendCommand("config-test", config, response));
+    }
+
+    /// @brief Closes the connection.
+    void disconnect();
+
+    /// @brief Connects to a control socket.
+    ///
+    /// @param socket_path path to the control socket
+    /// @param error (out) error description on failure
+    /// @return non-blocking socket descriptor, -1 on failure
+    static int connectSocket(const std::string& socket_path, std::string& error);
+
+    /// @brief Returns what is sent before the arguments of a command.
+    ///
+    /// The arguments are sent as they are, between this and
+    /// COMMAND_TAIL, so they are never copied.
+    ///
+    /// @param command command name
+    /// @param arguments whether arguments follow
+    static std::string getCommandHead(const std::string& command, bool arguments);
+
+    /// What is sent after the arguments of a command
+    static const char* COMMAND_TAIL;
+
+    /// @brief Parses the response and fills the response structure.
+    ///
+    /// @param response response to be filled (raw must be set)
+    /// @return result code
+    static int parseResponse(KeaResponse& response);
+
+private:
+    /// @brief Opens the connection (if not open already).
+    ///
+    /// @param error (out) error description on failure
+    /// @return true on success
+    bool connect(std::string& error);
+
+    /// @brief Checks whether Kea closed the connection meanwhile.
+    ///
+    /// The connection is closed if so.
+    void checkConnection();
+
+    /// @brief Writes the whole command.
+    ///
+    /// @param command command name
+    /// @param arguments JSON text of the arguments (may be empty)
+    /// @param error (out) error description on failure
+    /// @return true on success
+    bool writeCommand(const std::string& command,
+                      const std::string& arguments, std::string& error);
+
+    /// @brief Reads a complete JSON response.
+    ///
+    /// @param response (out) response text
+    /// @param error (out) error description on failure
+    /// @return true on success
+    bool readResponse(std::string& response, std::string& error);
+
+    /// Connections are not copyable.
+    KeaControlChannel(const KeaControlChannel&);
+    KeaControlChannel& operator=(const KeaControlChannel&);
+
+    std::string socket_path_; ///< path to the control socket
+    int fd_;                  ///< socket descriptor (-1 when closed)
+    int timeout_;             ///< response timeout in milliseconds
+    size_t connects_;         ///< number of connections made
+    size_t retries_;          ///< number of commands resent
+};
+
+#endif /* KEA_CTRL_H */
@@ -0,0 +1,404 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-fanout.cc
+
+#include "kea-fanout.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+/// @brief Command in flight to one instance.
+///
+/// The command is sent in rounds: the head with the first piece of the
+/// arguments, the following pieces, the last one with the tail. All
+/// instances write a round before the next one is started.
+struct Exchange {
+    /// @brief States of the exchange
+    enum State {
+        WRITING,    ///< sending the current round
+        WAITING,    ///< round sent, waiting for the others
+        READING,    ///< waiting for the response
+        DONE        ///< response read, or failed
+    };
+
+    int fd;                   ///< connection (-1 when closed)
+    State state;              ///< where the exchange is
+    struct iovec iov[3];      ///< the current round
+    int iov_pos;              ///< first entry of iov not sent yet
+    int iov_cnt;              ///< number of entries in iov
+    JsonScanner scanner;      ///< tells when the response is complete
+    Clock::time_point sent;   ///< when the command was sent
+};
+
+/// @brief Returns nanoseconds between two points.
+uint64_t
+nsBetween(const Clock::time_point& from, const Clock::time_point& to) {
+    return (chrono::duration_cast<chrono::nanoseconds>(to - from).count());
+}
+
+/// @brief Writes as much of the round as the socket takes.
+///
+/// @return false on error (errno is set)
+bool
+writeSome(Exchange& ex) {
+    while (ex.iov_pos < ex.iov_cnt) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = ex.iov + ex.iov_pos;
+        msg.msg_iovlen = ex.iov_cnt - ex.iov_pos;
+
+        ssize_t sent = sendmsg(ex.fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+
+        size_t left = static_cast<size_t>(sent);
+        while (ex.iov_pos < ex.iov_cnt && left >= ex.iov[ex.iov_pos].iov_len) {
+            left -= ex.iov[ex.iov_pos].iov_len;
+            ex.iov_pos++;
+        }
+        if (ex.iov_pos < ex.iov_cnt) {
+            struct iovec* cur = ex.iov + ex.iov_pos;
+            cur->iov_base = static_cast<char*>(cur->iov_base) + left;
+            cur->iov_len -= left;
+        }
+    }
+    return (true);
+}
+
+/// @brief Changes the events an exchange is polled for.
+void
+setEvents(int epfd, Exchange& ex, size_t i, uint32_t events) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u64 = i;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, ex.fd, &event);
+}
+
+/// @brief Reads what has arrived of the response.
+///
+/// @return false on error or if the connection was closed early
+bool
+readSome(Exchange& ex, string& raw, string& error) {
+    char buf[65536];
+    while (!ex.scanner.complete()) {
+        ssize_t got = recv(ex.fd, buf, sizeof(buf), 0);
+        if (got > 0) {
+            raw.append(buf, ex.scanner.feed(buf, static_cast<size_t>(got)));
+            continue;
+        }
+        if (got == 0) {
+            error = "connection closed before the response was complete";
+            return (false);
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return (true);
+        }
+        error = string("failed to receive response: ") + strerror(errno);
+        return (false);
+    }
+    return (true);
+}
+
+}
+
+KeaFanout::KeaFanout(const vector<string>& socket_paths, Policy policy)
+    :socket_paths_(socket_paths), policy_(policy),
+     timeout_(KeaControlChannel::DEFAULT_TIMEOUT) {
+    for (size_t i = 0; i < socket_paths_.size(); i++) {
+        TargetStatus status;
+        status.socket_path = socket_paths_[i];
+        status.result = KeaResponse::RESULT_NO_RESPONSE;
+        status.latency_us = 0;
+        status.successes = 0;
+        status.failures = 0;
+        status_.push_back(status);
+    }
+}
+
+vector<string>
+KeaFanout::parseTargets(const string& text) {
+    vector<string> targets;
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t comma = text.find(',', pos);
+        if (comma == string::npos) {
+            comma = text.size();
+        }
+        string target = text.substr(pos, comma - pos);
+        size_t begin = target.find_first_not_of(" \t");
+        if (begin != string::npos) {
+            size_t end = target.find_last_not_of(" \t");
+            targets.push_back(target.substr(begin, end - begin + 1));
+        }
+        pos = comma + 1;
+    }
+    return (targets);
+}
+
+bool
+KeaFanout::parsePolicy(const string& text, Policy& policy) {
+    if (text == "all") {
+        policy = POLICY_ALL;
+    } else if (text == "quorum") {
+        policy = POLICY_QUORUM;
+    } else {
+        return (false);
+    }
+    return (true);
+}
+
+bool
+KeaFanout::isAccepted(size_t succeeded) const {
+    if (policy_ == POLICY_ALL) {
+        return (succeeded == socket_paths_.size());
+    }
+    return (succeeded * 2 > socket_paths_.size());
+}
+
+string
+KeaFanout::getFailures(const vector<KeaResponse>& responses) const {
+    string text;
+    for (size_t i = 0; i < responses.size() && i < socket_paths_.size(); i++) {
+        if (responses[i].result == 0) {
+            continue;
+        }
+        if (!text.empty()) {
+            text += "; ";
+        }
+        text += socket_paths_[i] + ": " + responses[i].text;
+    }
+    return (text);
+}
+
+size_t
+KeaFanout::sendCommand(const string& command, const string& arguments,
+                       vector<KeaResponse>& responses) {
+    if (arguments.empty()) {
+        return (send(command, NULL, responses));
+    }
+    JsonStringSource source(arguments);
+    return (send(command, &source, responses));
+}
+
+size_t
+KeaFanout::sendCommand(const string& command, JsonSource& arguments,
+                       vector<KeaResponse>& responses) {
+    return (send(command, &arguments, responses));
+}
+
+size_t
+KeaFanout::send(const string& command, JsonSource* arguments,
+                vector<KeaResponse>& responses) {
+    const size_t count = socket_paths_.size();
+    const string head = KeaControlChannel::getCommandHead(command, arguments != NULL);
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point deadline = start + chrono::milliseconds(timeout_);
+
+    responses.assign(count, KeaResponse());
+    vector<Exchange> exchanges(count);
+
+    // The first round: the head, the first piece and, if that is all,
+    // the tail (so a small command goes out in a single write).
+    struct iovec round[3];
+    int round_cnt = 0;
+    bool last_round = false;
+    round[round_cnt].iov_base = const_cast<char*>(head.data());
+    round[round_cnt++].iov_len = head.size();
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    size_t active = 0;
+    for (size_t i = 0; i < count; i++) {
+        Exchange& ex = exchanges[i];
+        ex.state = Exchange::DONE;
+        ex.fd = -1;
+        if (epfd < 0) {
+            responses[i].text = string("epoll_create1 failed: ") + strerror(errno);
+            continue;
+        }
+        ex.fd = KeaControlChannel::connectSocket(socket_paths_[i], responses[i].text);
+        if (ex.fd < 0) {
+            continue;
+        }
+        ex.state = Exchange::WAITING;
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.data.u64 = i;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, ex.fd, &event) < 0) {
+            responses[i].text = string("epoll_ctl failed: ") + strerror(errno);
+            close(ex.fd);
+            ex.fd = -1;
+            ex.state = Exchange::DONE;
+            continue;
+        }
+        active++;
+    }
+
+    struct epoll_event events[16];
+    size_t writing = 0;
+    while (active > 0) {
+        // Everyone still there sent the round, on to the next one.
+        if (!writing && !last_round) {
+            const char* data;
+            size_t size;
+            bool more = arguments && arguments->next(data, size);
+            if (more) {
+                round[round_cnt].iov_base = const_cast<char*>(data);
+                round[round_cnt++].iov_len = size;
+            }
+            if (!more || arguments->done()) {
+                round[round_cnt].iov_base = const_cast<char*>(KeaControlChannel::COMMAND_TAIL);
+                round[round_cnt++].iov_len = strlen(KeaControlChannel::COMMAND_TAIL);
+                last_round = true;
+            }
+            for (size_t i = 0; i < count; i++) {
+                Exchange& ex = exchanges[i];
+                if (ex.state != Exchange::WAITING) {
+                    continue;
+                }
+                memcpy(ex.iov, round, sizeof(round));
+                ex.iov_pos = 0;
+                ex.iov_cnt = round_cnt;
+                ex.state = Exchange::WRITING;
+                setEvents(epfd, ex, i, EPOLLOUT);
+                writing++;
+            }
+            round_cnt = 0;
+        }
+
+        int64_t left = chrono::duration_cast<chrono::milliseconds>(
+            deadline - Clock::now()).count();
+        int n = 0;
+        if (left > 0) {
+            n = epoll_wait(epfd, events, 16, static_cast<int>(left));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+        }
+        if (n <= 0) {
+            // Out of time (or epoll failed): whoever did not answer failed.
+            const char* reason = (n < 0) ? strerror(errno) : "timed out";
+            const Clock::time_point now = Clock::now();
+            for (size_t i = 0; i < count; i++) {
+                if (exchanges[i].state == Exchange::READING) {
+                    responses[i].wait_ns = nsBetween(exchanges[i].sent, now);
+                } else if (exchanges[i].state != Exchange::DONE) {
+                    responses[i].send_ns = nsBetween(start, now);
+                }
+                if (exchanges[i].state != Exchange::DONE) {
+                    responses[i].text = string("no response from ") +
+                        socket_paths_[i] + ": " + reason;
+                    exchanges[i].state = Exchange::DONE;
+                }
+            }
+            break;
+        }
+
+        for (int e = 0; e < n; e++) {
+            const size_t i = static_cast<size_t>(events[e].data.u64);
+            Exchange& ex = exchanges[i];
+            KeaResponse& response = responses[i];
+            bool failed = false;
+            string error;
+
+            if (ex.state == Exchange::WAITING) {
+                // Only errors are reported while not polled.
+                error = "connection closed while sending the command";
+                failed = true;
+            } else if (ex.state == Exchange::WRITING) {
+                if (!writeSome(ex)) {
+                    error = string("failed to send command: ") + strerror(errno);
+                    failed = true;
+                    writing--;
+                } else if (ex.iov_pos == ex.iov_cnt) {
+                    writing--;
+                    if (!last_round) {
+                        // Not polled until the next round starts.
+                        ex.state = Exchange::WAITING;
+                        setEvents(epfd, ex, i, 0);
+                    } else {
+                        ex.sent = Clock::now();
+                        response.send_ns = nsBetween(start, ex.sent);
+                        ex.state = Exchange::READING;
+                        setEvents(epfd, ex, i, EPOLLIN);
+                    }
+                }
+            } else if (ex.state == Exchange::READING) {
+                if (!readSome(ex, response.raw, error)) {
+                    failed = true;
+                } else if (ex.scanner.complete()) {
+                    response.wait_ns = nsBetween(ex.sent, Clock::now());
+                    KeaControlChannel::parseResponse(response);
+                    ex.state = Exchange::DONE;
+                    active--;
+                }
+            }
+            if (failed) {
+                response.text = error;
+                ex.state = Exchange::DONE;
+                active--;
+            }
+            if (ex.state == Exchange::DONE) {
+                // Closing also takes the socket out of the epoll set.
+                close(ex.fd);
+                ex.fd = -1;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (exchanges[i].fd >= 0) {
+            close(exchanges[i].fd);
+        }
+    }
+    if (epfd >= 0) {
+        close(epfd);
+    }
+
+    size_t succeeded = 0;
+    lock_guard<mutex> lock(status_lock_);
+    for (size_t i = 0; i < count; i++) {
+        TargetStatus& status = status_[i];
+        status.command = command;
+        status.result = responses[i].result;
+        status.text = responses[i].text;
+        status.latency_us = (responses[i].send_ns + responses[i].wait_ns) / 1000;
+        if (responses[i].result == 0) {
+            status.successes++;
+            succeeded++;
+        } else {
+            status.failures++;
+        }
+    }
+    return (succeeded);
+}
+
+vector<KeaFanout::TargetStatus>
+KeaFanout::getStatus() const {
+    lock_guard<mutex> lock(status_lock_);
+    return (status_);
+}
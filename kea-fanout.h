@@ -0,0 +1,153 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-fanout.h
+///
+/// Sends the same command to several Kea instances at once (e.g. both
+/// servers of an HA pair).
+
+#ifndef KEA_FANOUT_H
+#define KEA_FANOUT_H
+
+#include "json-writer.h"
+#include "kea-ctrl.h"
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// @brief Sends commands to several Kea control sockets concurrently.
+///
+/// A command is written to all sockets and the responses are read as
+/// they come, all from the calling thread with epoll, so a push takes
+/// as long as the slowest instance rather than the sum of all of them.
+/// Every instance has its own deadline; one that does not answer in
+/// time counts as failed. Kea closes the connection after each
+/// response, so a connection is made per command.
+class KeaFanout {
+public:
+    /// @brief When a command counts as accepted.
+    enum Policy {
+        POLICY_ALL,      ///< every instance must succeed
+        POLICY_QUORUM    ///< more than half of them must succeed
+    };
+
+    /// @brief Last result of an instance, for reporting.
+    struct TargetStatus {
+        std::string socket_path;  ///< control socket of the instance
+        std::string command;      ///< last command sent
+        int result;               ///< its result (or RESULT_NO_RESPONSE)
+        std::string text;         ///< its result text
+        uint64_t latency_us;      ///< time to its response
+        uint64_t successes;       ///< commands that succeeded
+        uint64_t failures;        ///< commands that failed
+    };
+
+    /// @brief Constructor
+    ///
+    /// @param socket_paths control sockets of the instances (not empty)
+    /// @param policy when a command counts as accepted
+    KeaFanout(const std::vector<std::string>& socket_paths,
+              Policy policy = POLICY_ALL);
+
+    /// @brief Parses a comma separated list of control sockets.
+    ///
+    /// @param text list of socket paths
+    /// @return socket paths (empty ones left out)
+    static std::vector<std::string> parseTargets(const std::string& text);
+
+    /// @brief Parses a policy name ("all" or "quorum").
+    ///
+    /// @param text policy name
+    /// @param policy (out) policy
+    /// @return false if the name is not known
+    static bool parsePolicy(const std::string& text, Policy& policy);
+
+    /// @brief Returns name of the policy.
+    const char* getPolicyName() const {
+        return (policy_ == POLICY_ALL ? "all" : "quorum");
+    }
+
+    /// @brief Sets the time each instance has to answer.
+    ///
+    /// @param timeout timeout in milliseconds
+    void setTimeout(int timeout) {
+        timeout_ = timeout;
+    }
+
+    /// @brief Returns number of instances.
+    size_t getTargetCount() const {
+        return (socket_paths_.size());
+    }
+
+    /// @brief Returns control socket of an instance.
+    const std::string& getSocketPath(size_t target) const {
+        return (socket_paths_[target]);
+    }
+
+    /// @brief Sends a command to all instances.
+    ///
+    /// @param command name of the command, e.g. "config-set"
+    /// @param arguments JSON text of the arguments (may be empty)
+    /// @param responses (out) response of each instance, in the order of
+    ///        the sockets; send_ns and wait_ns are per instance
+    ///
+    /// @return number of instances that succeeded (result 0)
+    size_t sendCommand(const std::string& command, const std::string& arguments,
+                       std::vector<KeaResponse>& responses);
+
+    /// @brief Sends a command whose arguments are produced as they are
+    ///        sent.
+    ///
+    /// A piece of the arguments is written to all instances before the
+    /// next one is asked for, so only one piece is held at a time,
+    /// whatever the size of the arguments. The slowest instance sets
+    /// the pace.
+    ///
+    /// @param command name of the command, e.g. "config-set"
+    /// @param arguments JSON text of the arguments (not empty)
+    /// @param responses (out) as for the other sendCommand()
+    ///
+    /// @return number of instances that succeeded (result 0)
+    size_t sendCommand(const std::string& command, JsonSource& arguments,
+                       std::vector<KeaResponse>& responses);
+
+    /// @brief Returns true if the policy is met.
+    ///
+    /// @param succeeded number of instances that succeeded
+    bool isAccepted(size_t succeeded) const;
+
+    /// @brief Describes the instances that failed.
+    ///
+    /// @param responses responses as returned by sendCommand()
+    /// @return "socket: text" of each failed instance, separated by "; "
+    std::string getFailures(const std::vector<KeaResponse>& responses) const;
+
+    /// @brief Returns the last result of every instance.
+    ///
+    /// May be called from any thread.
+    std::vector<TargetStatus> getStatus() const;
+
+private:
+    /// @brief Sends a command to all instances.
+    ///
+    /// @param command name of the command
+    /// @param arguments the arguments (NULL for none)
+    /// @param responses (out) response of each instance
+    ///
+    /// @return number of instances that succeeded
+    size_t send(const std::string& command, JsonSource* arguments,
+                std::vector<KeaResponse>& responses);
+
+    std::vector<std::string> socket_paths_;  ///< control sockets
+    Policy policy_;                          ///< acceptance policy
+    int timeout_;                            ///< per instance (ms)
+    mutable std::mutex status_lock_;         ///< protects status_
+    std::vector<TargetStatus> status_;       ///< last result per instance
+};
+
+#endif /* KEA_FANOUT_H */
@@ -0,0 +1,879 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-import.cc
+
+#include "kea-import.h"
+
+#include <stdio.h>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+/// Root of the imported data
+const char* ROOT = "/ietf-kea-dhcpv6:server";
+
+/// Highest value of the uint8 ids of the model
+const uint32_t MAX_UINT8_ID = 255;
+
+/// Standard DHCPv6 options Kea knows by name (option space dhcp6)
+const struct {
+    const char* name;
+    uint32_t code;
+} STD_OPTIONS[] = {
+    { "preference", 7 },
+    { "unicast", 12 },
+    { "vendor-opts", 17 },
+    { "sip-server-dns", 21 },
+    { "sip-server-addr", 22 },
+    { "dns-servers", 23 },
+    { "domain-search", 24 },
+    { "nis-servers", 27 },
+    { "nisp-servers", 28 },
+    { "nis-domain-name", 29 },
+    { "nisp-domain-name", 30 },
+    { "sntp-servers", 31 },
+    { "information-refresh-time", 32 },
+    { "bcmcs-server-dns", 33 },
+    { "bcmcs-server-addr", 34 },
+    { "geoconf-civic", 36 },
+    { "remote-id", 37 },
+    { "subscriber-id", 38 },
+    { "client-fqdn", 39 },
+    { "pana-agent", 40 },
+    { "new-posix-timezone", 41 },
+    { "new-tzdb-timezone", 42 },
+    { "ero", 43 },
+    { "lq-query", 44 },
+    { "client-data", 45 },
+    { "clt-time", 46 },
+    { "lq-relay-data", 47 },
+    { "lq-client-link", 48 },
+    { "bootfile-url", 59 },
+    { "bootfile-param", 60 },
+    { "client-arch-type", 61 },
+    { "nii", 62 },
+    { "aftr-name", 64 },
+    { "erp-local-domain-name", 65 },
+    { "rsoo", 66 },
+    { "pd-exclude", 67 },
+    { "rdnss-selection", 74 },
+    { "client-linklayer-addr", 79 },
+    { "link-address", 80 },
+    { "solmax-rt", 82 },
+    { "inf-max-rt", 83 },
+    { "dhcpv4-o-dhcpv6-server", 88 },
+    { "s46-rule", 89 },
+    { "s46-br", 90 },
+    { "s46-dmr", 91 },
+    { "s46-v4v6bind", 92 },
+    { "s46-portparams", 93 },
+    { "s46-cont-mape", 94 },
+    { "s46-cont-mapt", 95 },
+    { "s46-cont-lw", 96 }
+};
+
+/// @brief Returns true if a value would change Kea's behavior.
+///
+/// Parameters the model has no node for are only reported when they
+/// are set to something (e.g. "array": false is not).
+bool
+isSet(const JsonValue& value) {
+    switch (value.getType()) {
+    case JsonValue::JSON_NULL:
+        return (false);
+    case JsonValue::JSON_BOOL:
+        return (value.boolValue());
+    case JsonValue::JSON_STRING:
+        return (!value.stringValue().empty());
+    case JsonValue::JSON_LIST:
+        return (!value.listValue().empty());
+    case JsonValue::JSON_MAP:
+        return (!value.mapValue().empty());
+    default:
+        return (true);
+    }
+}
+
+/// @brief Returns value of a string member ("" if not a string).
+string
+getString(const JsonValue& map, const char* key) {
+    const JsonValue* value = map.get(key);
+    return (value && value->getType() == JsonValue::JSON_STRING ?
+            value->stringValue() : string());
+}
+
+/// @brief Returns text without colons (DUIDs are plain hex in the model).
+string
+stripColons(const string& text) {
+    string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != ':') {
+            out += text[i];
+        }
+    }
+    return (out);
+}
+
+/// @brief Returns text without leading and trailing space.
+string
+trim(const string& text) {
+    size_t begin = text.find_first_not_of(" \t");
+    if (begin == string::npos) {
+        return (string());
+    }
+    size_t end = text.find_last_not_of(" \t");
+    return (text.substr(begin, end - begin + 1));
+}
+
+/// @brief Returns number as decimal text.
+string
+toText(uint64_t number) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(number));
+    return (buf);
+}
+
+}
+
+KeaImporter::KeaImporter(sr_session_ctx_t* session)
+    :session_(session), reader_(NULL), out_(NULL), commit_batch_(DEFAULT_BATCH),
+     replace_(false), pending_(0), items_(0), commits_(0), next_host_(0) {
+}
+
+int
+KeaImporter::set(const string& xpath, const char* value) {
+    if (out_) {
+        *out_ << xpath;
+        if (value) {
+            *out_ << " = " << value;
+        }
+        *out_ << "\n";
+    }
+    if (session_) {
+        // Lists are created without a value, leaves with one.
+        int rc = value ?
+            sr_set_item_str(session_, xpath.c_str(), value, SR_EDIT_DEFAULT) :
+            sr_set_item(session_, xpath.c_str(), NULL, SR_EDIT_DEFAULT);
+        if (SR_ERR_OK != rc) {
+            error_ = "failed to set " + xpath + ": " + sr_strerror(rc);
+            return (rc);
+        }
+    }
+    if (value) {
+        items_++;
+    }
+    pending_++;
+    if (commit_batch_ && pending_ >= commit_batch_) {
+        return (commit());
+    }
+    return (SR_ERR_OK);
+}
+
+int
+KeaImporter::setValue(const string& xpath, const JsonValue& value,
+                      const string& path) {
+    switch (value.getType()) {
+    case JsonValue::JSON_STRING:
+        return (set(xpath, value.stringValue().c_str()));
+    case JsonValue::JSON_INT:
+        if (value.intValue() < 0) {
+            return (invalid(path, "a non-negative number"));
+        }
+        return (set(xpath, toText(value.intValue()).c_str()));
+    case JsonValue::JSON_BOOL:
+        return (set(xpath, value.boolValue() ? "true" : "false"));
+    default:
+        return (invalid(path, "a string, number or boolean"));
+    }
+}
+
+int
+KeaImporter::commit() {
+    if (!pending_) {
+        return (SR_ERR_OK);
+    }
+    if (session_) {
+        int rc = sr_commit(session_);
+        if (SR_ERR_OK != rc) {
+            error_ = string("failed to commit: ") + sr_strerror(rc);
+            sr_discard_changes(session_);
+            return (rc);
+        }
+    }
+    pending_ = 0;
+    commits_++;
+    return (SR_ERR_OK);
+}
+
+int
+KeaImporter::invalid(const string& path, const char* expected) {
+    error_ = path + " is not " + expected;
+    return (SR_ERR_INVAL_ARG);
+}
+
+int
+KeaImporter::readError() {
+    error_ = "invalid JSON: " + reader_->getError();
+    return (SR_ERR_INVAL_ARG);
+}
+
+int
+KeaImporter::import(istream& in) {
+    JsonReader reader(in);
+    reader_ = &reader;
+    pending_ = 0;
+    items_ = 0;
+    commits_ = 0;
+    next_host_ = 0;
+    option_defs_.clear();
+    option_sets_.clear();
+    skipped_.clear();
+    error_.clear();
+
+    int rc = SR_ERR_OK;
+    if (replace_) {
+        if (out_) {
+            *out_ << "delete " << ROOT << "\n";
+        }
+        if (session_) {
+            rc = sr_delete_item(session_, ROOT, SR_EDIT_DEFAULT);
+            if (SR_ERR_OK != rc) {
+                error_ = string("failed to delete ") + ROOT + ": " + sr_strerror(rc);
+            }
+        }
+        pending_++;
+    }
+
+    string key;
+    if (SR_ERR_OK == rc && !reader_->enterMap()) {
+        rc = readError();
+    }
+    while (SR_ERR_OK == rc && reader_->nextKey(key)) {
+        if (key == "Dhcp6") {
+            rc = importDhcp6();
+            continue;
+        }
+        // Logging, Dhcp4, DhcpDdns...
+        JsonValue ignored;
+        if (!reader_->readValue(ignored)) {
+            rc = readError();
+        }
+        skip(key);
+    }
+    if (SR_ERR_OK == rc && !reader_->getError().empty()) {
+        rc = readError();
+    }
+    if (SR_ERR_OK == rc && !reader_->atEnd()) {
+        // Everything of the configuration has been read already.
+        cerr << "kea-import: data after the configuration ignored" << endl;
+    }
+    reader_ = NULL;
+
+    if (SR_ERR_OK != rc) {
+        if (session_) {
+            sr_discard_changes(session_);
+        }
+        return (rc);
+    }
+    return (commit());
+}
+
+int
+KeaImporter::importDhcp6() {
+    if (!reader_->enterMap()) {
+        return (readError());
+    }
+    string key;
+    while (reader_->nextKey(key)) {
+        int rc;
+        if (key == "subnet6") {
+            // Subnets (and their reservations) are imported as they are read.
+            if (!reader_->enterList()) {
+                return (readError());
+            }
+            while (reader_->nextElement()) {
+                rc = importSubnet();
+                if (SR_ERR_OK != rc) {
+                    return (rc);
+                }
+            }
+            if (!reader_->getError().empty()) {
+                return (readError());
+            }
+            continue;
+        }
+        JsonValue value;
+        if (!reader_->readValue(value)) {
+            return (readError());
+        }
+        rc = importGlobal(key, value);
+        if (SR_ERR_OK != rc) {
+            return (rc);
+        }
+    }
+    if (!reader_->getError().empty()) {
+        return (readError());
+    }
+    return (SR_ERR_OK);
+}
+
+int
+KeaImporter::importGlobal(const string& key, const JsonValue& value) {
+    const string serv = string(ROOT) + "/serv-attributes";
+    const string path = "Dhcp6/" + key;
+    int rc = SR_ERR_OK;
+
+    if (key == "renew-timer" || key == "rebind-timer" ||
+        key == "preferred-lifetime" || key == "valid-lifetime") {
+        return (setValue(serv + "/" + key, value, path));
+    }
+
+    if (key == "interfaces-config" || key == "control-socket" ||
+        key == "lease-database") {
+        if (value.getType() != JsonValue::JSON_MAP) {
+            return (invalid(path, "a map"));
+        }
+        const JsonValue::MapType& params = value.mapValue();
+        for (size_t i = 0; i < params.size() && SR_ERR_OK == rc; i++) {
+            const string& name = params[i].first;
+            const JsonValue& param = params[i].second;
+            const string xpath = serv + "/" + key + "/" + name;
+            if (key == "interfaces-config" && name == "interfaces") {
+                if (param.getType() != JsonValue::JSON_LIST) {
+                    return (invalid(path + "/" + name, "a list"));
+                }
+                const vector<JsonValue>& names = param.listValue();
+                for (size_t n = 0; n < names.size() && SR_ERR_OK == rc; n++) {
+                    rc = setValue(xpath, names[n], path + "/" + name);
+                }
+            } else if ((key == "control-socket" &&
+                        (name == "socket-type" || name == "socket-name")) ||
+                       (key == "lease-database" && name == "type")) {
+                rc = setValue(xpath, param, path + "/" + name);
+            } else if (isSet(param)) {
+                skip(path + "/" + name);
+            }
+        }
+        return (rc);
+    }
+
+    if (key == "user-context") {
+        // What the translator puts there
+        if (value.getType() != JsonValue::JSON_MAP) {
+            return (invalid(path, "a map"));
+        }
+        const JsonValue::MapType& params = value.mapValue();
+        for (size_t i = 0; i < params.size() && SR_ERR_OK == rc; i++) {
+            const string& name = params[i].first;
+            if (name == "name" || name == "description" || name == "enable" ||
+                name == "stateless-service") {
+                rc = setValue(serv + "/" + name, params[i].second, path + "/" + name);
+            } else {
+                skip(path + "/" + name);
+            }
+        }
+        return (rc);
+    }
+
+    if (key == "server-id") {
+        return (importServerId(value));
+    }
+    if (key == "option-def") {
+        return (importOptionDefs(value));
+    }
+    if (key == "option-data") {
+        return (importOptionData(string(ROOT) + "/network-ranges/option-set-id",
+                                 value, path));
+    }
+    if (key == "relay-supplied-options") {
+        return (importRsoo(value));
+    }
+
+    if (isSet(value)) {
+        skip(path);
+    }
+    return (SR_ERR_OK);
+}
+
+int
+KeaImporter::importServerId(const JsonValue& server_id) {
+    const string path = "Dhcp6/server-id";
+    if (server_id.getType() != JsonValue::JSON_MAP) {
+        return (invalid(path, "a map"));
+    }
+    const string type = getString(server_id, "type");
+    const string identifier = stripColons(getString(server_id, "identifier"));
+    const JsonValue* htype = server_id.get("htype");
+    const JsonValue* time = server_id.get("time");
+    const JsonValue* enterprise = server_id.get("enterprise-id");
+
+    // The model has either the DUID type, or the whole DUID.
+    char duid[32];
+    const char* type_code;
+    if (type == "LLT" || type.empty()) {
+        type_code = "1";
+        snprintf(duid, sizeof(duid), "0001%04x%08x",
+                 htype ? static_cast<unsigned>(htype->intValue()) : 1u,
+                 time ? static_cast<unsigned>(time->intValue()) : 0u);
+    } else if (type == "EN") {
+        type_code = "2";
+        snprintf(duid, sizeof(duid), "0002%08x",
+                 enterprise ? static_cast<unsigned>(enterprise->intValue()) : 0u);
+    } else if (type == "LL") {
+        type_code = "3";
+        snprintf(duid, sizeof(duid), "0003%04x",
+                 htype ? static_cast<unsigned>(htype->intValue()) : 1u);
+    } else {
+        return (invalid(path + "/type", "LLT, EN or LL"));
+    }
+
+    const JsonValue::MapType& params = server_id.mapValue();
+    for (size_t i = 0; i < params.size(); i++) {
+        const string& name = params[i].first;
+        if (name != "type" && name != "identifier" && name != "htype" &&
+            name != "time" && name != "enterprise-id" && isSet(params[i].second)) {
+            skip(path + "/" + name);
+        }
+    }
+
+    const string xpath = string(ROOT) + "/serv-attributes/duid";
+    if (identifier.empty()) {
+        // Kea generates the rest.
+        return (set(xpath, type_code));
+    }
+    return (set(xpath, (duid + identifier).c_str()));
+}
+
+int
+KeaImporter::importOptionDefs(const JsonValue& defs) {
+    const string path = "Dhcp6/option-def";
+    if (defs.getType() != JsonValue::JSON_LIST) {
+        return (invalid(path, "a list"));
+    }
+    int rc = SR_ERR_OK;
+    const vector<JsonValue>& list = defs.listValue();
+    for (size_t i = 0; i < list.size() && SR_ERR_OK == rc; i++) {
+        const JsonValue& def = list[i];
+        const JsonValue* code = def.get("code");
+        if (def.getType() != JsonValue::JSON_MAP || !code ||
+            code->getType() != JsonValue::JSON_INT) {
+            return (invalid(path, "a list of maps with code"));
+        }
+        const string space = getString(def, "space");
+        if (!space.empty() && space != "dhcp6") {
+            // Only standard options are in the model.
+            skip(path + "/space");
+            continue;
+        }
+
+        const string xpath = string(ROOT) + "/custom-options/custon-option[option-code='" +
+            toText(code->intValue()) + "']";
+        const JsonValue::MapType& params = def.mapValue();
+        for (size_t p = 0; p < params.size() && SR_ERR_OK == rc; p++) {
+            const string& name = params[p].first;
+            const JsonValue& param = params[p].second;
+            if (name == "name") {
+                rc = setValue(xpath + "/option-name", param, path + "/" + name);
+                option_defs_[param.stringValue()] = code->intValue();
+            } else if (name == "type") {
+                rc = setValue(xpath + "/option-type", param, path + "/" + name);
+            } else if (name != "code" && name != "space" && isSet(param)) {
+                skip(path + "/" + name);
+            }
+        }
+    }
+    return (rc);
+}
+
+int
+KeaImporter::importRsoo(const JsonValue& options) {
+    const string path = "Dhcp6/relay-supplied-options";
+    if (options.getType() != JsonValue::JSON_LIST) {
+        return (invalid(path, "a list"));
+    }
+    int rc = SR_ERR_OK;
+    const vector<JsonValue>& list = options.listValue();
+    for (size_t i = 0; i < list.size() && SR_ERR_OK == rc; i++) {
+        uint32_t code;
+        if (!getOptionCode(list[i], code)) {
+            skip(path + " (unknown option)");
+            continue;
+        }
+        rc = set(string(ROOT) + "/rsoo-enabled-options/rsoo-enabled-option[option-code='" +
+                 toText(code) + "']", NULL);
+    }
+    return (rc);
+}
+
+int
+KeaImporter::importSubnet() {
+    // Parameters read before the subnet prefix (usually none)
+    vector<pair<string, JsonValue> > early;
+    string xpath;
+    string key;
+    int rc;
+
+    if (!reader_->enterMap()) {
+        return (readError());
+    }
+    while (reader_->nextKey(key)) {
+        if (key == "reservations" && !xpath.empty()) {
+            if (!reader_->enterList()) {
+                return (readError());
+            }
+            while (reader_->nextElement()) {
+                JsonValue host;
+                if (!reader_->readValue(host)) {
+                    return (readError());
+                }
+                rc = importReservation(xpath, host);
+                if (SR_ERR_OK != rc) {
+                    return (rc);
+                }
+            }
+            if (!reader_->getError().empty()) {
+                return (readError());
+            }
+            continue;
+        }
+
+        JsonValue value;
+        if (!reader_->readValue(value)) {
+            return (readError());
+        }
+        if (key == "subnet" && xpath.empty()) {
+            if (value.getType() != JsonValue::JSON_STRING) {
+                return (invalid("Dhcp6/subnet6/subnet", "a string"));
+            }
+            xpath = string(ROOT) + "/network-ranges/subnet6[subnet='" +
+                value.stringValue() + "']";
+            rc = set(xpath, NULL);
+            for (size_t i = 0; i < early.size() && SR_ERR_OK == rc; i++) {
+                rc = importSubnetParam(xpath, early[i].first, early[i].second);
+            }
+            early.clear();
+        } else if (xpath.empty()) {
+            early.push_back(make_pair(key, value));
+            continue;
+        } else {
+            rc = importSubnetParam(xpath, key, value);
+        }
+        if (SR_ERR_OK != rc) {
+            return (rc);
+        }
+    }
+    if (!reader_->getError().empty()) {
+        return (readError());
+    }
+    if (xpath.empty()) {
+        return (invalid("Dhcp6/subnet6", "a list of maps with subnet"));
+    }
+    return (SR_ERR_OK);
+}
+
+int
+KeaImporter::importSubnetParam(const string& xpath, const string& key,
+                               const JsonValue& value) {
+    const string path = "Dhcp6/subnet6/" + key;
+    int rc = SR_ERR_OK;
+
+    if (key == "subnet") {
+        // The key of the entry
+        return (SR_ERR_OK);
+    }
+    if (key == "interface" || key == "interface-id" || key == "rapid-commit") {
+        return (setValue(xpath + "/" + key, value, path));
+    }
+
+    if (key == "id") {
+        if (value.getType() != JsonValue::JSON_INT) {
+            return (invalid(path, "a number"));
+        }
+        if (value.intValue() < 1 || value.intValue() > MAX_UINT8_ID) {
+            // network-range-id is uint8, Kea assigns the id then.
+            skip(path + " (over 255)");
+            return (SR_ERR_OK);
+        }
+        return (setValue(xpath + "/network-range-id", value, path));
+    }
+
+    if (key == "relay") {
+        const JsonValue* address = value.get("ip-address");
+        if (!address) {
+            return (invalid(path, "a map with ip-address"));
+        }
+        return (setValue(xpath + "/relay-address", *address, path + "/ip-address"));
+    }
+
+    if (key == "user-context") {
+        if (value.getType() != JsonValue::JSON_MAP) {
+            return (invalid(path, "a map"));
+        }
+        const JsonValue::MapType& params = value.mapValue();
+        for (size_t i = 0; i < params.size() && SR_ERR_OK == rc; i++) {
+            if (params[i].first == "description") {
+                rc = setValue(xpath + "/network-description", params[i].second,
+                              path + "/description");
+            } else {
+                skip(path + "/" + params[i].first);
+            }
+        }
+        return (rc);
+    }
+
+    if (key == "option-data") {
+        return (importOptionData(xpath + "/option-set-id", value, path));
+    }
+
+    if (key == "pools" || key == "pd-pools" || key == "reservations") {
+        if (value.getType() != JsonValue::JSON_LIST) {
+            return (invalid(path, "a list"));
+        }
+        const vector<JsonValue>& list = value.listValue();
+        for (size_t i = 0; i < list.size() && SR_ERR_OK == rc; i++) {
+            const JsonValue& entry = list[i];
+            if (key == "reservations") {
+                rc = importReservation(xpath, entry);
+                continue;
+            }
+            if (entry.getType() != JsonValue::JSON_MAP) {
+                return (invalid(path, "a list of maps"));
+            }
+            if (i >= MAX_UINT8_ID) {
+                // pool-id is uint8.
+                skip(path + " (over 255)");
+                break;
+            }
+            const JsonValue::MapType& params = entry.mapValue();
+            for (size_t p = 0; p < params.size(); p++) {
+                const string& name = params[p].first;
+                if (name != "pool" && name != "prefix" && name != "prefix-len" &&
+                    name != "delegated-len" && isSet(params[p].second)) {
+                    skip(path + "/" + name);
+                }
+            }
+
+            if (key == "pools") {
+                const string pool = getString(entry, "pool");
+                const string pool_xpath = xpath + "/pools/address-pool[pool-id='" +
+                    toText(i + 1) + "']";
+                const size_t dash = pool.find('-');
+                if (dash == string::npos) {
+                    rc = set(pool_xpath + "/pool-prefix", trim(pool).c_str());
+                } else {
+                    rc = set(pool_xpath + "/start-address",
+                             trim(pool.substr(0, dash)).c_str());
+                    if (SR_ERR_OK == rc) {
+                        rc = set(pool_xpath + "/end-address",
+                                 trim(pool.substr(dash + 1)).c_str());
+                    }
+                }
+                continue;
+            }
+
+            const string prefix = getString(entry, "prefix");
+            const JsonValue* len = entry.get("prefix-len");
+            const JsonValue* delegated = entry.get("delegated-len");
+            if (prefix.empty() || !len || len->getType() != JsonValue::JSON_INT) {
+                return (invalid(path, "a list of maps with prefix and prefix-len"));
+            }
+            if (delegated && delegated->intValue() != len->intValue()) {
+                // The model delegates whole prefixes.
+                skip(path + "/delegated-len");
+            }
+            rc = set(xpath + "/prefix-pools/prefix-pool[pool-id='" + toText(i + 1) +
+                     "']/pool-prefix", (prefix + "/" + toText(len->intValue())).c_str());
+        }
+        return (rc);
+    }
+
+    if (isSet(value)) {
+        skip(path);
+    }
+    return (SR_ERR_OK);
+}
+
+int
+KeaImporter::importReservation(const string& subnet, const JsonValue& host) {
+    const string path = "Dhcp6/subnet6/reservations";
+    if (host.getType() != JsonValue::JSON_MAP) {
+        return (invalid(path, "a list of maps"));
+    }
+    const JsonValue* duid = host.get("duid");
+    const JsonValue* hw = host.get("hw-address");
+    if (!duid && !hw) {
+        // e.g. flex-id, the model has DUIDs and hardware addresses only
+        skip(path + " (no duid or hw-address)");
+        return (SR_ERR_OK);
+    }
+
+    const string xpath = subnet + "/reserved-host[cli-id='" + toText(++next_host_) + "']";
+    int rc = SR_ERR_OK;
+    const JsonValue::MapType& params = host.mapValue();
+    for (size_t i = 0; i < params.size() && SR_ERR_OK == rc; i++) {
+        const string& name = params[i].first;
+        const JsonValue& param = params[i].second;
+        if (name == "duid") {
+            if (param.getType() != JsonValue::JSON_STRING) {
+                return (invalid(path + "/duid", "a string"));
+            }
+            rc = set(xpath + "/duid", stripColons(param.stringValue()).c_str());
+        } else if (name == "hw-address") {
+            rc = setValue(xpath + "/hardware-addr", param, path + "/hw-address");
+        } else if (name == "ip-addresses") {
+            if (param.getType() != JsonValue::JSON_LIST) {
+                return (invalid(path + "/ip-addresses", "a list"));
+            }
+            const vector<JsonValue>& addresses = param.listValue();
+            for (size_t a = 0; a < addresses.size() && SR_ERR_OK == rc; a++) {
+                rc = setValue(xpath + "/reserv-addr", addresses[a], path + "/ip-addresses");
+            }
+        } else if (isSet(param)) {
+            skip(path + "/" + name);
+        }
+    }
+    return (rc);
+}
+
+int
+KeaImporter::importOptionData(const string& xpath, const JsonValue& options,
+                              const string& path) {
+    if (options.getType() != JsonValue::JSON_LIST) {
+        return (invalid(path, "a list"));
+    }
+
+    // Options that fit the model, and their text that tells equal
+    // option data lists apart
+    vector<pair<uint32_t, const JsonValue*> > found;
+    string text;
+    const vector<JsonValue>& list = options.listValue();
+    for (size_t i = 0; i < list.size(); i++) {
+        const JsonValue& option = list[i];
+        if (option.getType() != JsonValue::JSON_MAP) {
+            return (invalid(path, "a list of maps"));
+        }
+        const string space = getString(option, "space");
+        uint32_t code;
+        if (!space.empty() && space != "dhcp6") {
+            skip(path + " (space " + space + ")");
+            continue;
+        }
+        if (!getOptionCode(option, code)) {
+            skip(path + " (unknown option)");
+            continue;
+        }
+        const JsonValue::MapType& params = option.mapValue();
+        for (size_t p = 0; p < params.size(); p++) {
+            const string& name = params[p].first;
+            if (name != "code" && name != "name" && name != "data" &&
+                name != "csv-format" && name != "space" && isSet(params[p].second)) {
+                skip(path + "/" + name);
+            }
+        }
+        found.push_back(make_pair(code, &option));
+
+        const JsonValue* csv = option.get("csv-format");
+        stringstream tmp;
+        tmp << code << '|' << getString(option, "name") << '|'
+            << getString(option, "data") << '|'
+            << (csv ? (csv->boolValue() ? "true" : "false") : "") << '\n';
+        text += tmp.str();
+    }
+    if (found.empty()) {
+        return (SR_ERR_OK);
+    }
+
+    int rc = SR_ERR_OK;
+    map<string, uint32_t>::const_iterator set_it = option_sets_.find(text);
+    uint32_t id;
+    if (set_it != option_sets_.end()) {
+        id = set_it->second;
+    } else {
+        id = option_sets_.size() + 1;
+        if (id > MAX_UINT8_ID) {
+            // option-set-id is uint8.
+            skip(path + " (over 255 option sets)");
+            return (SR_ERR_OK);
+        }
+        option_sets_[text] = id;
+
+        const string set_xpath = string(ROOT) + "/option-sets/option-set[option-set-id='" +
+            toText(id) + "']";
+        rc = set(set_xpath, NULL);
+        for (size_t i = 0; i < found.size() && SR_ERR_OK == rc; i++) {
+            const JsonValue& option = *found[i].second;
+            const string opt_xpath = set_xpath + "/standard-option[option-code='" +
+                toText(found[i].first) + "']";
+            const JsonValue* name = option.get("name");
+            const JsonValue* data = option.get("data");
+            const JsonValue* csv = option.get("csv-format");
+            if (!name && !data && !csv) {
+                rc = set(opt_xpath, NULL);
+                continue;
+            }
+            if (name) {
+                rc = setValue(opt_xpath + "/option-name", *name, path + "/name");
+            }
+            if (data && SR_ERR_OK == rc) {
+                rc = setValue(opt_xpath + "/option-value", *data, path + "/data");
+            }
+            if (csv && SR_ERR_OK == rc) {
+                rc = setValue(opt_xpath + "/csv-format", *csv, path + "/csv-format");
+            }
+        }
+    }
+    if (SR_ERR_OK == rc) {
+        rc = set(xpath, toText(id).c_str());
+    }
+    return (rc);
+}
+
+bool
+KeaImporter::getOptionCode(const JsonValue& option, uint32_t& code) const {
+    string name;
+    if (option.getType() == JsonValue::JSON_MAP) {
+        const JsonValue* number = option.get("code");
+        if (number && number->getType() == JsonValue::JSON_INT) {
+            code = number->intValue();
+            return (true);
+        }
+        name = getString(option, "name");
+    } else if (option.getType() == JsonValue::JSON_INT) {
+        code = option.intValue();
+        return (true);
+    } else {
+        name = option.stringValue();
+    }
+    if (name.empty()) {
+        return (false);
+    }
+
+    // relay-supplied-options has codes as strings.
+    char* end = NULL;
+    unsigned long number = strtoul(name.c_str(), &end, 10);
+    if (end && *end == '\0') {
+        code = number;
+        return (true);
+    }
+    map<string, uint32_t>::const_iterator def = option_defs_.find(name);
+    if (def != option_defs_.end()) {
+        code = def->second;
+        return (true);
+    }
+    for (size_t i = 0; i < sizeof(STD_OPTIONS) / sizeof(STD_OPTIONS[0]); i++) {
+        if (name == STD_OPTIONS[i].name) {
+            code = STD_OPTIONS[i].code;
+            return (true);
+        }
+    }
+    return (false);
+}
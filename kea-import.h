@@ -0,0 +1,246 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-import.h
+///
+/// Import of Kea DHCPv6 configuration files into ietf-kea-dhcpv6.
+
+#ifndef KEA_IMPORT_H
+#define KEA_IMPORT_H
+
+extern "C" {
+#include "sysrepo.h"
+};
+
+#include "kea-json.h"
+
+#include <stdint.h>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// @brief Imports a Kea configuration file into a Sysrepo datastore.
+///
+/// The file is read with JsonReader, so subnets and reservations are
+/// processed one by one and memory does not grow with the file. Every
+/// node is set as soon as it is read and edits are committed in
+/// batches, so a configuration with 100k reservations does not need
+/// 100k commits nor a single huge one.
+///
+/// This is the reverse of the translation done by SysrepoKea: subnets
+/// with their pools, prefix pools, reservations and relay, option data
+/// (put in option sets, equal ones shared), option definitions, relay
+/// supplied options, timers, interfaces, the control socket, the lease
+/// database type and the server id. Kea parameters the model has no
+/// node for are skipped and counted (see getSkipped()).
+class KeaImporter {
+public:
+    /// Default number of edits per commit
+    static const size_t DEFAULT_BATCH = 10000;
+
+    /// @brief Constructor
+    ///
+    /// @param session session of the datastore to be filled, NULL to
+    ///        only print the edits (see setOutput())
+    KeaImporter(sr_session_ctx_t* session);
+
+    /// @brief Sets number of edits per commit.
+    ///
+    /// @param edits edits per commit (0 means one commit at the end)
+    void setCommitBatch(size_t edits) {
+        commit_batch_ = edits;
+    }
+
+    /// @brief Sets a stream every edit is printed to ("xpath = value").
+    ///
+    /// @param out stream (NULL to print nothing)
+    void setOutput(std::ostream* out) {
+        out_ = out;
+    }
+
+    /// @brief Removes all ietf-kea-dhcpv6 data before importing.
+    ///
+    /// The removal is committed with the first batch.
+    ///
+    /// @param replace whether the existing data is removed
+    void setReplace(bool replace) {
+        replace_ = replace;
+    }
+
+    /// @brief Imports a configuration file.
+    ///
+    /// Only the Dhcp6 map is imported. Batches committed before an
+    /// error are not rolled back.
+    ///
+    /// @param in Kea configuration (JSON with comments)
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int import(std::istream& in);
+
+    /// @brief Returns number of leaves set.
+    size_t getItems() const {
+        return (items_);
+    }
+
+    /// @brief Returns number of commits made.
+    size_t getCommits() const {
+        return (commits_);
+    }
+
+    /// @brief Returns counts of the Kea parameters not imported, keyed
+    ///        by their path (e.g. "Dhcp6/subnet6/reservations/hostname").
+    const std::map<std::string, size_t>& getSkipped() const {
+        return (skipped_);
+    }
+
+    /// @brief Returns the error of the last failed call.
+    const std::string& getError() const {
+        return (error_);
+    }
+
+private:
+    /// @brief Sets a leaf (committing when the batch is full).
+    ///
+    /// @param xpath xpath of the node
+    /// @param value value as text (NULL to create a list entry)
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int set(const std::string& xpath, const char* value);
+
+    /// @brief Sets a leaf from a JSON scalar.
+    ///
+    /// @param xpath xpath of the leaf
+    /// @param value string, number or boolean
+    /// @param path Kea path of the value (for errors)
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int setValue(const std::string& xpath, const JsonValue& value,
+                 const std::string& path);
+
+    /// @brief Commits pending edits.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int commit();
+
+    /// @brief Counts a Kea parameter that has no place in the model.
+    ///
+    /// @param path Kea path of the parameter
+    void skip(const std::string& path) {
+        skipped_[path]++;
+    }
+
+    /// @brief Reports a value of an unexpected type.
+    ///
+    /// @param path Kea path of the value
+    /// @param expected what was expected, e.g. "a list"
+    ///
+    /// @return SR_ERR_INVAL_ARG
+    int invalid(const std::string& path, const char* expected);
+
+    /// @brief Reports an error of the reader.
+    ///
+    /// @return SR_ERR_INVAL_ARG
+    int readError();
+
+    /// @brief Imports the Dhcp6 map.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importDhcp6();
+
+    /// @brief Imports a global parameter (other than subnet6).
+    ///
+    /// @param key name of the parameter
+    /// @param value its value
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importGlobal(const std::string& key, const JsonValue& value);
+
+    /// @brief Imports option-def entries into custom-options.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importOptionDefs(const JsonValue& defs);
+
+    /// @brief Imports relay-supplied-options.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importRsoo(const JsonValue& options);
+
+    /// @brief Imports the server-id map into serv-attributes/duid.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importServerId(const JsonValue& server_id);
+
+    /// @brief Imports a subnet6 entry (read from the reader).
+    ///
+    /// Reservations are imported as they are read when the subnet
+    /// prefix came before them, which is how Kea files are written.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importSubnet();
+
+    /// @brief Imports a subnet parameter (other than reservations).
+    ///
+    /// @param xpath xpath of the subnet6 entry
+    /// @param key name of the parameter
+    /// @param value its value
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importSubnetParam(const std::string& xpath, const std::string& key,
+                          const JsonValue& value);
+
+    /// @brief Imports a reservation.
+    ///
+    /// @param subnet xpath of the subnet6 entry
+    /// @param host the reservation map
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importReservation(const std::string& subnet, const JsonValue& host);
+
+    /// @brief Imports option data and sets the option-set-id leaf.
+    ///
+    /// Equal option data lists share an option set.
+    ///
+    /// @param xpath xpath of the option-set-id leaf
+    /// @param options the option-data list
+    /// @param path Kea path of the list
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int importOptionData(const std::string& xpath, const JsonValue& options,
+                         const std::string& path);
+
+    /// @brief Returns the code of a DHCPv6 option.
+    ///
+    /// @param option option map (with code or name) or name as string
+    /// @param code (out) option code
+    ///
+    /// @return false if the option is not known
+    bool getOptionCode(const JsonValue& option, uint32_t& code) const;
+
+    sr_session_ctx_t* session_;  ///< session of the filled datastore
+    JsonReader* reader_;         ///< reader of the file being imported
+    std::ostream* out_;          ///< where edits are printed (may be NULL)
+    size_t commit_batch_;        ///< edits per commit (0 = all)
+    bool replace_;               ///< whether existing data is removed
+    size_t pending_;             ///< edits not committed yet
+    size_t items_;               ///< leaves set
+    size_t commits_;             ///< commits made
+    uint32_t next_host_;         ///< cli-id of the next reservation
+
+    /// Codes of the options defined in option-def, keyed by name
+    std::map<std::string, uint32_t> option_defs_;
+
+    /// Option sets created, keyed by their option data
+    std::map<std::string, uint32_t> option_sets_;
+
+    /// Kea parameters not imported, with their counts
+    std::map<std::string, size_t> skipped_;
+
+    std::string error_;          ///< error of the last failed call
+};
+
+#endif /* KEA_IMPORT_H */
@@ -0,0 +1,564 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-json.cc
+
+#include "kea-json.h"
+
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+
+JsonScanner::JsonScanner() {
+    reset();
+}
+
+void
+JsonScanner::reset() {
+    depth_ = 0;
+    started_ = false;
+    in_string_ = false;
+    escape_ = false;
+    complete_ = false;
+}
+
+size_t
+JsonScanner::feed(const char* data, size_t len) {
+    for (size_t i = 0; i < len && !complete_; i++) {
+        char c = data[i];
+        if (in_string_) {
+            if (escape_) {
+                escape_ = false;
+            } else if (c == '\\') {
+                escape_ = true;
+            } else if (c == '"') {
+                in_string_ = false;
+            }
+            continue;
+        }
+        switch (c) {
+        case '"':
+            in_string_ = true;
+            break;
+        case '{':
+        case '[':
+            depth_++;
+            started_ = true;
+            break;
+        case '}':
+        case ']':
+            depth_--;
+            if (started_ && depth_ <= 0) {
+                complete_ = true;
+                return (i + 1);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return (len);
+}
+
+JsonValue::JsonValue()
+    :type_(JSON_NULL), bool_(false), int_(0), real_(0) {
+}
+
+const JsonValue*
+JsonValue::get(const string& key) const {
+    for (size_t i = 0; i < map_.size(); i++) {
+        if (map_[i].first == key) {
+            return (&map_[i].second);
+        }
+    }
+    return (NULL);
+}
+
+/// @brief Recursive descent JSON parser.
+///
+/// Parses either a whole text, or a stream that is read into a buffer
+/// as the parser needs more. Only the JsonReader methods discard what
+/// has been parsed from the buffer, so a value being parsed stays in it.
+class JsonParser {
+public:
+    /// @brief Constructor
+    ///
+    /// @param text text to be parsed
+    JsonParser(const string& text)
+        :text_(text), in_(NULL), buffer_(NULL), pos_(0), base_(0), line_(1),
+         comments_(false) {
+    }
+
+    /// @brief Constructor (streaming)
+    ///
+    /// @param in stream to be parsed
+    /// @param buffer buffer for the data read from the stream
+    /// @param comments whether comments are allowed
+    JsonParser(istream& in, string& buffer, bool comments)
+        :text_(buffer), in_(&in), buffer_(&buffer), pos_(0), base_(0), line_(1),
+         comments_(comments) {
+    }
+
+    /// @brief Parses the whole text.
+    ///
+    /// @param value (out) parsed value
+    /// @param error (out) error description
+    /// @return true on success
+    bool parse(JsonValue& value, string& error) {
+        if (!parseValue(value, 0)) {
+            error = error_;
+            return (false);
+        }
+        skipSpace();
+        if (more()) {
+            fail("unexpected data after the document");
+            error = error_;
+            return (false);
+        }
+        return (true);
+    }
+
+    /// @brief Expects the start of a map or list (see JsonReader).
+    ///
+    /// @param open '{' or '['
+    /// @return true on success
+    bool enter(char open) {
+        compact();
+        skipSpace();
+        if (!more() || text_[pos_] != open) {
+            return (fail(open == '{' ? "expected '{'" : "expected '['"));
+        }
+        pos_++;
+        first_.push_back(true);
+        return (true);
+    }
+
+    /// @brief Moves to the next element of the map or list entered last.
+    ///
+    /// @param close '}' or ']'
+    /// @param key (out) key of the map entry (NULL for a list)
+    /// @return false at the end of the map or list, or on error
+    bool next(char close, string* key) {
+        compact();
+        skipSpace();
+        if (first_.empty() || !more()) {
+            return (fail("unexpected end of document"));
+        }
+        if (text_[pos_] == close) {
+            pos_++;
+            first_.pop_back();
+            return (false);
+        }
+        if (!first_.back()) {
+            if (text_[pos_] != ',') {
+                return (fail(close == '}' ? "expected ',' or '}'" : "expected ',' or ']'"));
+            }
+            pos_++;
+            skipSpace();
+        }
+        first_.back() = false;
+        if (key) {
+            key->clear();
+            if (!more() || text_[pos_] != '"') {
+                return (fail("expected map key"));
+            }
+            if (!parseString(*key)) {
+                return (false);
+            }
+            skipSpace();
+            if (!more() || text_[pos_] != ':') {
+                return (fail("expected ':'"));
+            }
+            pos_++;
+        }
+        return (true);
+    }
+
+    /// @brief Parses the value at the current position.
+    ///
+    /// @param value (out) parsed value
+    /// @return true on success
+    bool value(JsonValue& value) {
+        value = JsonValue();
+        return (parseValue(value, static_cast<int>(first_.size())));
+    }
+
+    /// @brief Returns true if there is nothing but space left.
+    bool atEnd() {
+        skipSpace();
+        return (!more());
+    }
+
+    /// @brief Returns the first error encountered.
+    const string& getError() const {
+        return (error_);
+    }
+
+private:
+    /// Maximum nesting level accepted
+    static const int MAX_DEPTH = 256;
+
+    /// Bytes read from the stream at once
+    static const size_t CHUNK = 65536;
+
+    bool fail(const string& msg) {
+        if (error_.empty()) {
+            stringstream tmp;
+            if (in_) {
+                tmp << msg << " at line " << line_;
+            } else {
+                tmp << msg << " at offset " << base_ + pos_;
+            }
+            error_ = tmp.str();
+        }
+        return (false);
+    }
+
+    /// @brief Makes sure at least len bytes are available.
+    ///
+    /// @return false if the text (or the stream) ends before
+    bool more(size_t len = 1) {
+        while (pos_ + len > text_.size()) {
+            if (!in_ || !*in_) {
+                return (false);
+            }
+            char chunk[CHUNK];
+            in_->read(chunk, CHUNK);
+            if (in_->gcount() <= 0) {
+                return (false);
+            }
+            buffer_->append(chunk, static_cast<size_t>(in_->gcount()));
+        }
+        return (true);
+    }
+
+    /// @brief Discards what has been parsed from the stream buffer.
+    void compact() {
+        if (buffer_ && pos_ >= CHUNK) {
+            buffer_->erase(0, pos_);
+            base_ += pos_;
+            pos_ = 0;
+        }
+    }
+
+    /// @brief Skips space (and comments, if allowed).
+    ///
+    /// Kea configuration files may have comments in shell, C and C++
+    /// style.
+    void skipSpace() {
+        while (more()) {
+            char c = text_[pos_];
+            if (c == '\n') {
+                line_++;
+            } else if (comments_ && (c == '#' ||
+                                     (c == '/' && more(2) && text_[pos_ + 1] == '/'))) {
+                while (more() && text_[pos_] != '\n') {
+                    pos_++;
+                }
+                continue;
+            } else if (comments_ && c == '/' && more(2) && text_[pos_ + 1] == '*') {
+                pos_ += 2;
+                while (more(2) && (text_[pos_] != '*' || text_[pos_ + 1] != '/')) {
+                    if (text_[pos_] == '\n') {
+                        line_++;
+                    }
+                    pos_++;
+                }
+                if (!more(2)) {
+                    fail("unterminated comment");
+                    pos_ = text_.size();
+                    return;
+                }
+                pos_ += 2;
+                continue;
+            } else if (c != ' ' && c != '\t' && c != '\r') {
+                break;
+            }
+            pos_++;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t len = string(word).size();
+        more(len);
+        if (text_.compare(pos_, len, word) != 0) {
+            return (fail("invalid literal"));
+        }
+        pos_ += len;
+        return (true);
+    }
+
+    static void appendUtf8(string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xc0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xe0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+    }
+
+    bool hex4(uint32_t& cp) {
+        if (!more(4)) {
+            return (fail("truncated unicode escape"));
+        }
+        cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text_[pos_++];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') {
+                cp |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                cp |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                cp |= c - 'A' + 10;
+            } else {
+                return (fail("invalid unicode escape"));
+            }
+        }
+        return (true);
+    }
+
+    bool parseString(string& out) {
+        // Opening quote has been checked by the caller.
+        pos_++;
+        while (more()) {
+            char c = text_[pos_++];
+            if (c == '"') {
+                return (true);
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (!more()) {
+                break;
+            }
+            c = text_[pos_++];
+            switch (c) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!hex4(cp)) {
+                    return (false);
+                }
+                if (cp >= 0xd800 && cp < 0xdc00 && more(2) &&
+                    text_.compare(pos_, 2, "\\u") == 0) {
+                    uint32_t low;
+                    pos_ += 2;
+                    if (!hex4(low)) {
+                        return (false);
+                    }
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                }
+                appendUtf8(out, cp);
+                break;
+            }
+            default:
+                return (fail("invalid escape sequence"));
+            }
+        }
+        return (fail("unterminated string"));
+    }
+
+    bool parseNumber(JsonValue& value) {
+        size_t start = pos_;
+        bool real = false;
+        if (text_[pos_] == '-') {
+            pos_++;
+        }
+        while (more()) {
+            char c = text_[pos_];
+            if (c == '.' || c == 'e' || c == 'E' || c == '+' ||
+                (c == '-' && pos_ > start)) {
+                real = true;
+            } else if (c < '0' || c > '9') {
+                break;
+            }
+            pos_++;
+        }
+        string num = text_.substr(start, pos_ - start);
+        if (num.empty() || num == "-") {
+            return (fail("invalid number"));
+        }
+        if (real) {
+            value.type_ = JsonValue::JSON_REAL;
+            value.real_ = strtod(num.c_str(), NULL);
+        } else {
+            value.type_ = JsonValue::JSON_INT;
+            value.int_ = strtoll(num.c_str(), NULL, 10);
+        }
+        return (true);
+    }
+
+    bool parseValue(JsonValue& value, int depth) {
+        if (depth > MAX_DEPTH) {
+            return (fail("document nested too deeply"));
+        }
+        skipSpace();
+        if (!more()) {
+            return (fail("unexpected end of document"));
+        }
+        char c = text_[pos_];
+        switch (c) {
+        case '{':
+            value.type_ = JsonValue::JSON_MAP;
+            pos_++;
+            skipSpace();
+            if (more() && text_[pos_] == '}') {
+                pos_++;
+                return (true);
+            }
+            while (true) {
+                skipSpace();
+                if (!more() || text_[pos_] != '"') {
+                    return (fail("expected map key"));
+                }
+                value.map_.push_back(make_pair(string(), JsonValue()));
+                if (!parseString(value.map_.back().first)) {
+                    return (false);
+                }
+                skipSpace();
+                if (!more() || text_[pos_] != ':') {
+                    return (fail("expected ':'"));
+                }
+                pos_++;
+                if (!parseValue(value.map_.back().second, depth + 1)) {
+                    return (false);
+                }
+                skipSpace();
+                if (more() && text_[pos_] == ',') {
+                    pos_++;
+                    continue;
+                }
+                if (more() && text_[pos_] == '}') {
+                    pos_++;
+                    return (true);
+                }
+                return (fail("expected ',' or '}'"));
+            }
+        case '[':
+            value.type_ = JsonValue::JSON_LIST;
+            pos_++;
+            skipSpace();
+            if (more() && text_[pos_] == ']') {
+                pos_++;
+                return (true);
+            }
+            while (true) {
+                value.list_.push_back(JsonValue());
+                if (!parseValue(value.list_.back(), depth + 1)) {
+                    return (false);
+                }
+                skipSpace();
+                if (more() && text_[pos_] == ',') {
+                    pos_++;
+                    continue;
+                }
+                if (more() && text_[pos_] == ']') {
+                    pos_++;
+                    return (true);
+                }
+                return (fail("expected ',' or ']'"));
+            }
+        case '"':
+            value.type_ = JsonValue::JSON_STRING;
+            return (parseString(value.string_));
+        case 't':
+            value.type_ = JsonValue::JSON_BOOL;
+            value.bool_ = true;
+            return (literal("true"));
+        case 'f':
+            value.type_ = JsonValue::JSON_BOOL;
+            value.bool_ = false;
+            return (literal("false"));
+        case 'n':
+            value.type_ = JsonValue::JSON_NULL;
+            return (literal("null"));
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                return (parseNumber(value));
+            }
+            return (fail("unexpected character"));
+        }
+    }
+
+    const string& text_;  ///< text being parsed
+    istream* in_;         ///< stream being parsed (NULL for a text)
+    string* buffer_;      ///< buffer the stream is read into (is text_)
+    size_t pos_;          ///< current position
+    size_t base_;         ///< stream offset of the buffer start
+    size_t line_;         ///< current line (counted in space only)
+    bool comments_;       ///< whether comments are allowed
+    vector<bool> first_;  ///< per entered map or list: no element yet
+    string error_;        ///< first error encountered
+};
+
+bool
+parseJson(const string& text, JsonValue& value, string& error) {
+    value = JsonValue();
+    JsonParser parser(text);
+    return (parser.parse(value, error));
+}
+
+JsonReader::JsonReader(istream& in, bool comments)
+    :parser_(new JsonParser(in, buffer_, comments)) {
+}
+
+JsonReader::~JsonReader() {
+    delete parser_;
+}
+
+bool
+JsonReader::enterMap() {
+    return (parser_->enter('{'));
+}
+
+bool
+JsonReader::nextKey(string& key) {
+    return (parser_->next('}', &key));
+}
+
+bool
+JsonReader::enterList() {
+    return (parser_->enter('['));
+}
+
+bool
+JsonReader::nextElement() {
+    return (parser_->next(']', NULL));
+}
+
+bool
+JsonReader::readValue(JsonValue& value) {
+    return (parser_->value(value));
+}
+
+bool
+JsonReader::atEnd() {
+    return (parser_->atEnd());
+}
+
+const string&
+JsonReader::getError() const {
+    return (parser_->getError());
+}
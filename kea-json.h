@@ -0,0 +1,202 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-json.h
+///
+/// Minimal JSON support needed to talk to Kea: a scanner that detects
+/// where a JSON document ends in a byte stream, a small parser for the
+/// responses Kea sends over its control channel and a reader that walks
+/// Kea configuration files without loading them whole.
+
+#ifndef KEA_JSON_H
+#define KEA_JSON_H
+
+#include <stdint.h>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief Detects the end of a JSON document in a stream of bytes.
+///
+/// Kea does not frame its responses, so the only way to know that the
+/// whole response has arrived is to track nesting of braces and
+/// brackets (ignoring those within strings). Data can be fed in chunks
+/// of any size.
+class JsonScanner {
+public:
+    /// @brief Constructor
+    JsonScanner();
+
+    /// @brief Resets the scanner to its initial state.
+    void reset();
+
+    /// @brief Scans the next chunk of data.
+    ///
+    /// @param data pointer to the data
+    /// @param len length of the data
+    ///
+    /// @return number of bytes consumed up to and including the end of
+    ///         the document, or len if the document is not complete yet.
+    size_t feed(const char* data, size_t len);
+
+    /// @brief Returns true if a complete document has been scanned.
+    bool complete() const {
+        return (complete_);
+    }
+
+private:
+    int depth_;          ///< current nesting level
+    bool started_;       ///< whether the top level object/array started
+    bool in_string_;     ///< inside a string
+    bool escape_;        ///< previous character was a backslash
+    bool complete_;      ///< document is complete
+};
+
+/// @brief A parsed JSON value.
+class JsonValue {
+public:
+    /// @brief JSON value types
+    enum Type {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_INT,
+        JSON_REAL,
+        JSON_STRING,
+        JSON_LIST,
+        JSON_MAP
+    };
+
+    /// Map entries in the order they appear in the document
+    typedef std::vector<std::pair<std::string, JsonValue> > MapType;
+
+    /// @brief Constructor (creates null value)
+    JsonValue();
+
+    /// @brief Returns type of the value.
+    Type getType() const {
+        return (type_);
+    }
+
+    /// @brief Returns boolean value (false if not a boolean).
+    bool boolValue() const {
+        return (bool_);
+    }
+
+    /// @brief Returns integer value (truncated for reals).
+    int64_t intValue() const {
+        return (type_ == JSON_REAL ? static_cast<int64_t>(real_) : int_);
+    }
+
+    /// @brief Returns real value (converted for integers).
+    double realValue() const {
+        return (type_ == JSON_INT ? static_cast<double>(int_) : real_);
+    }
+
+    /// @brief Returns string value (empty if not a string).
+    const std::string& stringValue() const {
+        return (string_);
+    }
+
+    /// @brief Returns list elements (empty if not a list).
+    const std::vector<JsonValue>& listValue() const {
+        return (list_);
+    }
+
+    /// @brief Returns map entries (empty if not a map).
+    const MapType& mapValue() const {
+        return (map_);
+    }
+
+    /// @brief Returns map entry with specified key.
+    ///
+    /// @param key name of the entry
+    /// @return pointer to the value or NULL if not a map or no such key
+    const JsonValue* get(const std::string& key) const;
+
+private:
+    friend class JsonParser;
+
+    Type type_;                    ///< value type
+    bool bool_;                    ///< boolean value
+    int64_t int_;                  ///< integer value
+    double real_;                  ///< real value
+    std::string string_;           ///< string value
+    std::vector<JsonValue> list_;  ///< list elements
+    MapType map_;                  ///< map entries
+};
+
+/// @brief Parses JSON text.
+///
+/// @param text JSON text to be parsed
+/// @param value (out) parsed value
+/// @param error (out) description of the problem if parsing failed
+///
+/// @return true if the text was parsed successfully
+bool parseJson(const std::string& text, JsonValue& value, std::string& error);
+
+class JsonParser;
+
+/// @brief Reads a JSON document from a stream piece by piece.
+///
+/// Maps and lists are entered and walked element by element, and only
+/// the elements read with readValue() are parsed into memory, so a
+/// configuration with a huge list can be processed one entry at a time.
+/// The stream is read in chunks as needed. Comments are allowed as in
+/// Kea configuration files (#, // and C style ones).
+///
+/// Methods return false on error; nextKey() and nextElement() also
+/// return false at the end of the map or list, which tells the two
+/// apart by an empty getError().
+class JsonReader {
+public:
+    /// @brief Constructor
+    ///
+    /// @param in stream to be read
+    /// @param comments whether comments are allowed
+    JsonReader(std::istream& in, bool comments = true);
+
+    /// @brief Destructor
+    ~JsonReader();
+
+    /// @brief Enters the map at the current position.
+    bool enterMap();
+
+    /// @brief Moves to the next entry of the map entered last.
+    ///
+    /// @param key (out) key of the entry, its value is next
+    /// @return false at the end of the map (which is left) or on error
+    bool nextKey(std::string& key);
+
+    /// @brief Enters the list at the current position.
+    bool enterList();
+
+    /// @brief Moves to the next element of the list entered last.
+    ///
+    /// @return false at the end of the list (which is left) or on error
+    bool nextElement();
+
+    /// @brief Parses the value at the current position.
+    ///
+    /// @param value (out) parsed value
+    bool readValue(JsonValue& value);
+
+    /// @brief Returns true if nothing but space follows.
+    bool atEnd();
+
+    /// @brief Returns the first error (with its line), empty if none.
+    const std::string& getError() const;
+
+private:
+    /// Readers refer to their own buffer, so they are not copyable.
+    JsonReader(const JsonReader&);
+    JsonReader& operator=(const JsonReader&);
+
+    std::string buffer_;  ///< data read but not parsed yet
+    JsonParser* parser_;  ///< parser working on the buffer
+};
+
+#endif /* KEA_JSON_H */
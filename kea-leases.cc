@@ -0,0 +1,345 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-leases.cc
+
+#include "kea-leases.h"
+#include "json-writer.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+/// Result code of Kea commands that found nothing
+const int RESULT_EMPTY = 3;
+
+/// @brief Lease parameter shown as a leaf of the lease6 list entry.
+struct LeaseLeaf {
+    const char* name;    ///< name in Kea and in the model
+    sr_type_t type;      ///< type of the leaf
+};
+
+/// Leaves of a lease6 entry (the key first)
+const LeaseLeaf LEASE_LEAVES[] = {
+    { "ip-address", SR_STRING_T },
+    { "type", SR_STRING_T },
+    { "prefix-len", SR_UINT8_T },
+    { "subnet-id", SR_UINT32_T },
+    { "duid", SR_STRING_T },
+    { "iaid", SR_UINT32_T },
+    { "hw-address", SR_STRING_T },
+    { "valid-lft", SR_UINT32_T },
+    { "preferred-lft", SR_UINT32_T },
+    { "cltt", SR_UINT64_T },
+    { "hostname", SR_STRING_T },
+    { "state", SR_UINT32_T }
+};
+
+const size_t LEASE_LEAVES_CNT = sizeof(LEASE_LEAVES) / sizeof(LEASE_LEAVES[0]);
+
+/// @brief IPv6 prefix, to tell which leases are in a subnet.
+struct Prefix {
+    uint8_t bytes[16];   ///< prefix address
+    int len;             ///< prefix length
+
+    /// @brief Parses "address/length".
+    bool parse(const string& text) {
+        size_t slash = text.find('/');
+        if (slash == string::npos) {
+            return (false);
+        }
+        len = atoi(text.c_str() + slash + 1);
+        return (len >= 0 && len <= 128 &&
+                inet_pton(AF_INET6, text.substr(0, slash).c_str(), bytes) == 1);
+    }
+
+    /// @brief Returns true if the address is in the prefix.
+    bool contains(const uint8_t* address) const {
+        int full = len / 8;
+        if (memcmp(address, bytes, full)) {
+            return (false);
+        }
+        int rest = len % 8;
+        if (!rest) {
+            return (true);
+        }
+        uint8_t mask = static_cast<uint8_t>(0xff << (8 - rest));
+        return ((address[full] & mask) == (bytes[full] & mask));
+    }
+
+    /// @brief Returns the address just before the prefix ("start" if
+    ///        there is none), lease6-get-page returns leases after it.
+    string before() const {
+        uint8_t address[16];
+        memcpy(address, bytes, sizeof(address));
+        int i = 15;
+        for (; i >= 0; i--) {
+            if (address[i]--) {
+                break;
+            }
+        }
+        if (i < 0) {
+            return ("start");
+        }
+        char text[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, address, text, sizeof(text));
+        return (text);
+    }
+};
+
+/// @brief Returns true if the lease belongs to the subnet of the query.
+bool
+inSubnet(const LeaseQuery& query, const JsonValue& lease) {
+    if (!query.has_subnet) {
+        return (true);
+    }
+    const JsonValue* id = lease.get("subnet-id");
+    return (id && id->getType() == JsonValue::JSON_INT &&
+            id->intValue() == query.subnet_id);
+}
+
+/// @brief Returns address of the lease (empty if missing).
+const string&
+leaseAddress(const JsonValue& lease) {
+    static const string none;
+    const JsonValue* address = lease.get("ip-address");
+    return (address ? address->stringValue() : none);
+}
+
+}
+
+void
+LeaseQuery::parse(const string& xpath) {
+    size_t pos = xpath.find("/lease6[");
+    if (pos == string::npos) {
+        return;
+    }
+    pos += 7;
+
+    // [name='value'] or [name="value"] or [name=value]
+    while (pos < xpath.size() && xpath[pos] == '[') {
+        size_t eq = xpath.find('=', pos);
+        if (eq == string::npos) {
+            return;
+        }
+        string name = xpath.substr(pos + 1, eq - pos - 1);
+        name.erase(remove(name.begin(), name.end(), ' '), name.end());
+
+        size_t begin = xpath.find_first_not_of(' ', eq + 1);
+        if (begin == string::npos) {
+            return;
+        }
+        size_t end;
+        if (xpath[begin] == '\'' || xpath[begin] == '"') {
+            char quote = xpath[begin++];
+            end = xpath.find(quote, begin);
+        } else {
+            end = xpath.find_first_of(" ]", begin);
+        }
+        size_t close = (end == string::npos) ? end : xpath.find(']', end);
+        if (close == string::npos) {
+            return;
+        }
+        string value = xpath.substr(begin, end - begin);
+
+        if (name == "ip-address") {
+            address = value;
+        } else if (name == "subnet-id") {
+            has_subnet = true;
+            subnet_id = static_cast<uint32_t>(strtoul(value.c_str(), NULL, 10));
+        }
+        pos = close + 1;
+    }
+}
+
+KeaLeasePager::KeaLeasePager(KeaControlChannel& kea, size_t page_size)
+    :kea_(kea), page_size_(page_size ? page_size : DEFAULT_PAGE_SIZE),
+     pages_(0), leases_(0) {
+}
+
+bool
+KeaLeasePager::forEach(const LeaseQuery& query, const LeaseHandler& handler,
+                       string& error) {
+    string arguments;
+
+    if (!query.address.empty()) {
+        JsonWriter w(arguments);
+        w.startMap();
+        w.key("ip-address");
+        w.value(query.address);
+        w.endMap();
+
+        KeaResponse response;
+        int result = kea_.sendCommand("lease6-get", arguments, response);
+        pages_++;
+        if (result == RESULT_EMPTY) {
+            return (true);
+        }
+        if (result != 0) {
+            error = "lease6-get failed: " + response.text;
+            return (false);
+        }
+        leases_++;
+        if (inSubnet(query, response.arguments)) {
+            handler(response.arguments);
+        }
+        return (true);
+    }
+
+    Prefix prefix;
+    bool ranged = query.has_subnet && prefix.parse(query.prefix);
+    string from = ranged ? prefix.before() : "start";
+
+    while (true) {
+        arguments.clear();
+        JsonWriter w(arguments);
+        w.startMap();
+        w.key("from");
+        w.value(from);
+        w.key("limit");
+        w.value(static_cast<uint64_t>(page_size_));
+        w.endMap();
+
+        // The response (one page) is released before the next one.
+        KeaResponse response;
+        int result = kea_.sendCommand("lease6-get-page", arguments, response);
+        pages_++;
+        if (result == RESULT_EMPTY) {
+            return (true);
+        }
+        if (result != 0) {
+            error = "lease6-get-page failed: " + response.text;
+            return (false);
+        }
+
+        const JsonValue* page = response.arguments.get("leases");
+        if (!page || page->listValue().empty()) {
+            return (true);
+        }
+        const vector<JsonValue>& leases = page->listValue();
+        leases_ += leases.size();
+        for (size_t i = 0; i < leases.size(); i++) {
+            if (ranged) {
+                uint8_t address[16];
+                if (inet_pton(AF_INET6, leaseAddress(leases[i]).c_str(), address) == 1 &&
+                    !prefix.contains(address)) {
+                    // Past the end of the subnet
+                    return (true);
+                }
+            }
+            if (inSubnet(query, leases[i]) && !handler(leases[i])) {
+                return (true);
+            }
+        }
+
+        if (leases.size() < page_size_) {
+            return (true);
+        }
+        from = leaseAddress(leases.back());
+        if (from.empty()) {
+            error = "lease6-get-page returned a lease without ip-address";
+            return (false);
+        }
+    }
+}
+
+int
+appendLeaseValues(const JsonValue& lease, const string& list_xpath,
+                  sr_val_t** values, size_t* count, size_t* capacity) {
+    const string& address = leaseAddress(lease);
+    if (address.empty()) {
+        return (SR_ERR_OK);
+    }
+
+    if (*count + LEASE_LEAVES_CNT > *capacity) {
+        size_t grown = max(*capacity * 2, *count + LEASE_LEAVES_CNT);
+        int rc = *values ? sr_realloc_values(*capacity, grown, values) :
+            sr_new_values(grown, values);
+        if (rc != SR_ERR_OK) {
+            return (rc);
+        }
+        *capacity = grown;
+    }
+
+    const string entry = list_xpath + "[ip-address='" + address + "']/";
+    for (size_t i = 0; i < LEASE_LEAVES_CNT; i++) {
+        const JsonValue* param = lease.get(LEASE_LEAVES[i].name);
+        if (!param) {
+            continue;
+        }
+
+        sr_val_t* value = &(*values)[*count];
+        int rc = SR_ERR_OK;
+        switch (LEASE_LEAVES[i].type) {
+        case SR_STRING_T:
+            if (param->getType() != JsonValue::JSON_STRING ||
+                param->stringValue().empty()) {
+                continue;
+            }
+            rc = sr_val_set_str_data(value, SR_STRING_T, param->stringValue().c_str());
+            break;
+        case SR_UINT8_T:
+            value->type = SR_UINT8_T;
+            value->data.uint8_val = static_cast<uint8_t>(param->intValue());
+            break;
+        case SR_UINT32_T:
+            value->type = SR_UINT32_T;
+            value->data.uint32_val = static_cast<uint32_t>(param->intValue());
+            break;
+        default:
+            value->type = SR_UINT64_T;
+            value->data.uint64_val = static_cast<uint64_t>(param->intValue());
+            break;
+        }
+        if (rc == SR_ERR_OK) {
+            rc = sr_val_set_xpath(value, (entry + LEASE_LEAVES[i].name).c_str());
+        }
+        if (rc != SR_ERR_OK) {
+            return (rc);
+        }
+        (*count)++;
+    }
+    return (SR_ERR_OK);
+}
+
+int
+getLeaseValues(KeaLeasePager& pager, const LeaseQuery& query,
+               const string& list_xpath, size_t limit, sr_val_t** values,
+               size_t* count, bool& truncated, string& error) {
+    size_t capacity = 0;
+    size_t leases = 0;
+    int rc = SR_ERR_OK;
+
+    *values = NULL;
+    *count = 0;
+    truncated = false;
+    bool answered = pager.forEach(query, [&](const JsonValue& lease) {
+        if (limit && leases >= limit) {
+            truncated = true;
+            return (false);
+        }
+        rc = appendLeaseValues(lease, list_xpath, values, count, &capacity);
+        leases++;
+        return (rc == SR_ERR_OK);
+    }, error);
+
+    // Part of the leases is no answer (the limit stops the walk without
+    // an error).
+    if (!answered && rc == SR_ERR_OK) {
+        rc = SR_ERR_OPERATION_FAILED;
+    }
+    if (rc != SR_ERR_OK) {
+        sr_free_values(*values, *count);
+        *values = NULL;
+        *count = 0;
+    }
+    return (rc);
+}
@@ -0,0 +1,127 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-leases.h
+///
+/// Reads DHCPv6 leases from Kea page by page, so that the lease view
+/// costs the same memory whatever the size of the lease database.
+
+#ifndef KEA_LEASES_H
+#define KEA_LEASES_H
+
+#include "kea-ctrl.h"
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+extern "C" {
+#include "sysrepo.h"
+};
+
+/// @brief Leases asked for.
+///
+/// Filled from the predicates of the requested xpath, so that only the
+/// pages holding matching leases are read from Kea.
+struct LeaseQuery {
+    /// @brief Constructor (all leases)
+    LeaseQuery()
+        :has_subnet(false), subnet_id(0) {
+    }
+
+    /// @brief Takes the ip-address and subnet-id predicates of the
+    ///        lease6 step of the xpath (other predicates are ignored).
+    ///
+    /// @param xpath requested xpath
+    void parse(const std::string& xpath);
+
+    std::string address;   ///< only this lease (empty for any)
+    bool has_subnet;       ///< only leases of subnet_id
+    uint32_t subnet_id;    ///< subnet id (when has_subnet)
+    std::string prefix;    ///< subnet prefix to scan (empty for all leases,
+                           ///< which subnets with prefix pools need)
+};
+
+/// @brief Walks leases with lease6-get-page.
+///
+/// Only one page is held in memory at a time. A query for an address
+/// is a single lease6-get. A query for a subnet with a prefix starts at
+/// the prefix and stops after its last address, as Kea returns leases
+/// in address order; without the prefix all leases are read and
+/// filtered. Delegated prefixes are usually outside the subnet prefix,
+/// so the prefix must only be given for subnets without prefix pools.
+class KeaLeasePager {
+public:
+    /// Called for every matching lease, returns false to stop.
+    typedef std::function<bool (const JsonValue&)> LeaseHandler;
+
+    /// Default number of leases asked for per lease6-get-page
+    static const size_t DEFAULT_PAGE_SIZE = 1000;
+
+    /// @brief Constructor
+    ///
+    /// @param kea connection to Kea
+    /// @param page_size leases asked for per lease6-get-page
+    KeaLeasePager(KeaControlChannel& kea, size_t page_size = DEFAULT_PAGE_SIZE);
+
+    /// @brief Calls the handler for every lease matching the query.
+    ///
+    /// @param query leases asked for
+    /// @param handler function called for each lease (in address order)
+    /// @param error (out) error description on failure
+    ///
+    /// @return true on success (including when there are no leases)
+    bool forEach(const LeaseQuery& query, const LeaseHandler& handler,
+                 std::string& error);
+
+    /// @brief Returns number of commands sent so far.
+    size_t getPages() const {
+        return (pages_);
+    }
+
+    /// @brief Returns number of leases received so far (matching or not).
+    size_t getLeases() const {
+        return (leases_);
+    }
+
+private:
+    KeaControlChannel& kea_;   ///< connection to Kea
+    size_t page_size_;         ///< leases per page
+    size_t pages_;             ///< commands sent
+    size_t leases_;            ///< leases received
+};
+
+/// @brief Appends a lease as values of its lease6 list entry.
+///
+/// @param lease lease as returned by Kea
+/// @param list_xpath xpath of the lease6 list
+/// @param values (in/out) values, grown with sr_realloc_values()
+/// @param count (in/out) number of values used
+/// @param capacity (in/out) number of values allocated
+///
+/// @return Sysrepo error code (SR_ERR_OK on success)
+int appendLeaseValues(const JsonValue& lease, const std::string& list_xpath,
+                      sr_val_t** values, size_t* count, size_t* capacity);
+
+/// @brief Gets leases matching the query as Sysrepo values.
+///
+/// @param pager lease pager
+/// @param query leases asked for
+/// @param list_xpath xpath of the lease6 list
+/// @param limit maximum number of leases (0 for no limit)
+/// @param values (out) values (to be freed by the caller)
+/// @param count (out) number of values
+/// @param truncated (out) whether leases were left out because of the limit
+/// @param error (out) error description if Kea could not be asked
+///
+/// @return Sysrepo error code (SR_ERR_OPERATION_FAILED, and no values,
+///         when a command failed before all matching leases were read)
+int getLeaseValues(KeaLeasePager& pager, const LeaseQuery& query,
+                   const std::string& list_xpath, size_t limit,
+                   sr_val_t** values, size_t* count, bool& truncated,
+                   std::string& error);
+
+#endif /* KEA_LEASES_H */
@@ -0,0 +1,248 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-stats.cc
+
+#include "kea-stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+/// Server wide statistics that have a leaf in the model
+const char* GLOBAL_STATS[] = {
+    "pkt6-received", "pkt6-receive-drop", "pkt6-parse-failed", "pkt6-sent",
+    "declined-addresses", "reclaimed-declined-addresses", "reclaimed-leases"
+};
+
+/// Subnet statistics that have a leaf in the model
+const char* SUBNET_STATS[] = {
+    "total-nas", "assigned-nas", "declined-addresses",
+    "reclaimed-declined-addresses", "reclaimed-leases",
+    "total-pds", "assigned-pds"
+};
+
+/// @brief Returns true if the name is in the table.
+template<size_t N>
+bool
+isKnown(const char* (&table)[N], const char* name) {
+    for (size_t i = 0; i < N; i++) {
+        if (!strcmp(table[i], name)) {
+            return (true);
+        }
+    }
+    return (false);
+}
+
+/// @brief Gets the latest sample of a statistic.
+///
+/// @param samples list of [value, timestamp] pairs
+/// @param value (out) value of the first sample
+/// @return false if there is no numeric sample
+bool
+latestSample(const JsonValue& samples, int64_t& value) {
+    if (samples.listValue().empty()) {
+        return (false);
+    }
+    const JsonValue& sample = samples.listValue()[0];
+    if (sample.listValue().empty()) {
+        return (false);
+    }
+    const JsonValue& number = sample.listValue()[0];
+    if (number.getType() != JsonValue::JSON_INT &&
+        number.getType() != JsonValue::JSON_REAL) {
+        return (false);
+    }
+    value = number.intValue();
+    return (true);
+}
+
+}
+
+bool
+KeaStats::parse(const JsonValue& arguments) {
+    if (arguments.getType() != JsonValue::JSON_MAP) {
+        return (false);
+    }
+
+    const JsonValue::MapType& entries = arguments.mapValue();
+    for (size_t i = 0; i < entries.size(); i++) {
+        const char* name = entries[i].first.c_str();
+        int64_t value;
+        if (!latestSample(entries[i].second, value)) {
+            continue;
+        }
+
+        if (strncmp(name, "subnet[", 7)) {
+            if (isKnown(GLOBAL_STATS, name)) {
+                global[name] = value;
+            }
+            continue;
+        }
+
+        // subnet[id].name (pool statistics have another bracket after
+        // the dot and are not in the table)
+        char* end = NULL;
+        unsigned long id = strtoul(name + 7, &end, 10);
+        if (end == name + 7 || end[0] != ']' || end[1] != '.') {
+            continue;
+        }
+        if (isKnown(SUBNET_STATS, end + 2)) {
+            subnets[static_cast<uint32_t>(id)][end + 2] = value;
+        }
+    }
+    return (true);
+}
+
+KeaStatsCache::KeaStatsCache(const string& socket_path, int ttl, int timeout)
+    :kea_(socket_path), ttl_(ttl), timeout_(timeout), demand_(false),
+     fetching_(false), stop_(false), completed_(0), requests_(0), hits_(0),
+     failures_(0) {
+    kea_.setTimeout(timeout);
+    thread_ = thread(&KeaStatsCache::run, this);
+}
+
+KeaStatsCache::~KeaStatsCache() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+shared_ptr<const KeaStats>
+KeaStatsCache::get() {
+    unique_lock<mutex> lock(mutex_);
+    requests_++;
+    demand_ = true;
+
+    Clock::time_point now = Clock::now();
+    if (stats_ && now < stats_->fetched + ttl_) {
+        hits_++;
+        return (stats_);
+    }
+
+    // Kea did not answer the last fetch, don't ask again before the TTL
+    // expires (the old statistics are better than none).
+    if (!fetching_ && now < attempted_ + ttl_) {
+        hits_++;
+        return (stats_);
+    }
+
+    size_t seen = completed_;
+    cond_.notify_all();
+    done_.wait_for(lock, timeout_, [this, seen] {
+        return (completed_ > seen || stop_);
+    });
+    return (stats_);
+}
+
+void
+KeaStatsCache::setSubnets(const map<uint32_t, string>& subnets,
+                          const set<uint32_t>& delegating) {
+    lock_guard<mutex> lock(mutex_);
+    subnets_ = subnets;
+    delegating_ = delegating;
+}
+
+string
+KeaStatsCache::getSubnet(uint32_t id) const {
+    lock_guard<mutex> lock(mutex_);
+    map<uint32_t, string>::const_iterator it = subnets_.find(id);
+    return (it != subnets_.end() ? it->second : string());
+}
+
+bool
+KeaStatsCache::isDelegating(uint32_t id) const {
+    lock_guard<mutex> lock(mutex_);
+    return (delegating_.count(id) > 0);
+}
+
+size_t
+KeaStatsCache::getRequests() const {
+    lock_guard<mutex> lock(mutex_);
+    return (requests_);
+}
+
+size_t
+KeaStatsCache::getHits() const {
+    lock_guard<mutex> lock(mutex_);
+    return (hits_);
+}
+
+size_t
+KeaStatsCache::getFetches() const {
+    lock_guard<mutex> lock(mutex_);
+    return (completed_);
+}
+
+size_t
+KeaStatsCache::getFailures() const {
+    lock_guard<mutex> lock(mutex_);
+    return (failures_);
+}
+
+shared_ptr<const KeaStats>
+KeaStatsCache::fetch() {
+    KeaResponse response;
+    int result = kea_.sendCommand("statistic-get-all", "", response);
+    if (result != 0) {
+        cerr << "plugin-kea statistic-get-all failed: " << response.text << endl;
+        return (shared_ptr<const KeaStats>());
+    }
+
+    shared_ptr<KeaStats> stats(new KeaStats());
+    stats->fetched = Clock::now();
+    if (!stats->parse(response.arguments)) {
+        cerr << "plugin-kea statistic-get-all returned no statistics" << endl;
+        return (shared_ptr<const KeaStats>());
+    }
+    return (stats);
+}
+
+void
+KeaStatsCache::run() {
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+        if (stop_) {
+            return;
+        }
+        if (!demand_) {
+            cond_.wait(lock);
+            continue;
+        }
+
+        // Somebody wants statistics; fetch as soon as the TTL allows.
+        Clock::time_point due = attempted_ + ttl_;
+        if (Clock::now() < due) {
+            cond_.wait_until(lock, due);
+            continue;
+        }
+
+        // Gets arriving from now on ask for the next fetch.
+        demand_ = false;
+        fetching_ = true;
+        attempted_ = Clock::now();
+
+        lock.unlock();
+        shared_ptr<const KeaStats> stats = fetch();
+        lock.lock();
+
+        if (stats) {
+            stats_ = stats;
+        } else {
+            failures_++;
+        }
+        fetching_ = false;
+        completed_++;
+        done_.notify_all();
+    }
+}
@@ -0,0 +1,140 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file kea-stats.h
+///
+/// Cache of the statistics Kea reports with statistic-get-all, used to
+/// serve operational data without asking Kea on every get.
+
+#ifndef KEA_STATS_H
+#define KEA_STATS_H
+
+#include "kea-ctrl.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+/// @brief Statistics returned by one statistic-get-all.
+///
+/// Only statistics that have a leaf in the model are kept; their names
+/// are the leaf names (which are the same as in Kea).
+struct KeaStats {
+    typedef std::chrono::steady_clock Clock;
+
+    /// Statistic name -> latest value
+    typedef std::map<std::string, int64_t> Values;
+
+    /// @brief Fills the statistics from the statistic-get-all arguments.
+    ///
+    /// Kea reports each statistic as a list of [value, timestamp]
+    /// samples, the latest first. Subnet statistics are named
+    /// "subnet[id].name".
+    ///
+    /// @param arguments arguments of the response
+    /// @return false if the arguments are not a map
+    bool parse(const JsonValue& arguments);
+
+    Clock::time_point fetched;               ///< when Kea answered
+    Values global;                           ///< server wide statistics
+    std::map<uint32_t, Values> subnets;      ///< statistics per subnet id
+};
+
+/// @brief Keeps the latest Kea statistics for a configurable time.
+///
+/// A get() within the TTL of the last fetch is served from memory.
+/// Otherwise it waits for a fetch, which is shared with every get that
+/// arrives meanwhile, so a burst of gets costs a single statistic-get-all.
+/// While gets keep coming, a background thread fetches again as soon as
+/// the TTL expires, so periodic collectors find fresh data without
+/// waiting. Kea is never asked more than once per TTL, even when it does
+/// not answer; the last good statistics are served until it does.
+class KeaStatsCache {
+public:
+    typedef KeaStats::Clock Clock;
+
+    /// @brief Constructor (starts the background thread)
+    ///
+    /// The cache opens its own connection to Kea, so fetching does not
+    /// have to wait for configuration pushes.
+    ///
+    /// @param socket_path path to the Kea UNIX control socket
+    /// @param ttl how long fetched statistics are served (milliseconds)
+    /// @param timeout how long a get waits for a fetch (milliseconds)
+    KeaStatsCache(const std::string& socket_path, int ttl, int timeout);
+
+    /// @brief Destructor (stops the background thread)
+    ~KeaStatsCache();
+
+    /// @brief Returns the latest statistics.
+    ///
+    /// @return statistics (null if Kea has never answered)
+    std::shared_ptr<const KeaStats> get();
+
+    /// @brief Sets prefixes of the configured subnets (by Kea subnet id).
+    ///
+    /// @param subnets Kea subnet id -> subnet prefix
+    /// @param delegating ids of the subnets with prefix pools
+    void setSubnets(const std::map<uint32_t, std::string>& subnets,
+                    const std::set<uint32_t>& delegating);
+
+    /// @brief Returns prefix of a subnet (empty if not known).
+    std::string getSubnet(uint32_t id) const;
+
+    /// @brief Returns true if the subnet has prefix pools, i.e. some
+    ///        of its leases may be outside of its prefix.
+    bool isDelegating(uint32_t id) const;
+
+    /// @brief Returns number of gets.
+    size_t getRequests() const;
+
+    /// @brief Returns number of gets served without waiting for a fetch.
+    size_t getHits() const;
+
+    /// @brief Returns number of statistic-get-all commands sent.
+    size_t getFetches() const;
+
+    /// @brief Returns number of statistic-get-all commands that failed.
+    size_t getFailures() const;
+
+private:
+    /// @brief Background thread body.
+    void run();
+
+    /// @brief Sends statistic-get-all (without holding the mutex).
+    ///
+    /// @return statistics (null on failure)
+    std::shared_ptr<const KeaStats> fetch();
+
+    KeaControlChannel kea_;                   ///< used by the thread only
+    const std::chrono::milliseconds ttl_;     ///< how long data is served
+    const std::chrono::milliseconds timeout_; ///< how long a get waits
+
+    mutable std::mutex mutex_;           ///< protects everything below
+    std::condition_variable cond_;       ///< wakes up the thread
+    std::condition_variable done_;       ///< signals finished fetches
+    std::shared_ptr<const KeaStats> stats_; ///< latest good statistics
+    std::map<uint32_t, std::string> subnets_; ///< subnet id -> prefix
+    std::set<uint32_t> delegating_;      ///< subnets with prefix pools
+    Clock::time_point attempted_;        ///< start of the last fetch
+    bool demand_;                        ///< got a get since the last fetch
+    bool fetching_;                      ///< a fetch is running
+    bool stop_;                          ///< thread should terminate
+    size_t completed_;                   ///< number of finished fetches
+    size_t requests_;                    ///< number of gets
+    size_t hits_;                        ///< gets served from memory
+    size_t failures_;                    ///< failed fetches
+
+    std::thread thread_;                 ///< background thread
+};
+
+#endif /* KEA_STATS_H */
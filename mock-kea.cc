@@ -0,0 +1,616 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file mock-kea.cc
+
+#include "mock-kea.h"
+#include "json-writer.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+/// Commands the mock answers with success
+const char* SUPPORTED[] = {
+    "config-set", "config-test", "list-commands",
+    "subnet6-add", "subnet6-del", "reservation-add", "reservation-del",
+    "statistic-get-all", "lease6-get", "lease6-get-page"
+};
+
+/// @brief Writes a statistic the way Kea does (list of samples).
+void
+writeStatistic(JsonWriter& w, const string& name, int64_t value) {
+    w.key(name);
+    w.startList();
+    w.startList();
+    w.value(value);
+    w.value("2018-01-01 00:00:00.000000");
+    w.endList();
+    w.endList();
+}
+
+/// @brief Returns true if the command is supported.
+bool
+isSupported(const string& command) {
+    for (size_t i = 0; i < sizeof(SUPPORTED) / sizeof(SUPPORTED[0]); i++) {
+        if (command == SUPPORTED[i]) {
+            return (true);
+        }
+    }
+    return (false);
+}
+
+/// @brief Writes the whole buffer (the socket is blocking).
+void
+writeAll(int fd, const string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t sent = send(fd, data.data() + done, data.size() - done,
+                            MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        done += sent;
+    }
+}
+
+}
+
+MockKeaServer::MockKeaServer(const string& socket_path)
+    :socket_path_(socket_path), listen_fd_(-1), lease_subnets_(0),
+     leases_per_subnet_(0), prefixes_per_subnet_(0) {
+    stop_pipe_[0] = stop_pipe_[1] = -1;
+}
+
+MockKeaServer::~MockKeaServer() {
+    stop();
+}
+
+bool
+MockKeaServer::start(string& error) {
+    struct sockaddr_un addr;
+    if (socket_path_.size() >= sizeof(addr.sun_path)) {
+        error = "socket path too long: " + socket_path_;
+        return (false);
+    }
+
+    unlink(socket_path_.c_str());
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        error = string("failed to create UNIX socket: ") + strerror(errno);
+        return (false);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) < 0 || listen(listen_fd_, 16) < 0) {
+        error = "failed to listen on " + socket_path_ + ": " + strerror(errno);
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return (false);
+    }
+
+    if (pipe(stop_pipe_) < 0) {
+        error = string("failed to create pipe: ") + strerror(errno);
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return (false);
+    }
+
+    thread_ = thread(&MockKeaServer::run, this);
+    return (true);
+}
+
+void
+MockKeaServer::stop() {
+    if (thread_.joinable()) {
+        char c = 0;
+        if (write(stop_pipe_[1], &c, 1) < 0) {
+            // Nothing else to wake the thread up with.
+        }
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        unlink(socket_path_.c_str());
+    }
+    for (int i = 0; i < 2; i++) {
+        if (stop_pipe_[i] >= 0) {
+            close(stop_pipe_[i]);
+            stop_pipe_[i] = -1;
+        }
+    }
+}
+
+void
+MockKeaServer::setDelay(const string& command, int delay) {
+    lock_guard<mutex> lock(mutex_);
+    delays_[command] = delay;
+}
+
+void
+MockKeaServer::setFailure(const string& command, size_t every, int result,
+                          const string& text) {
+    lock_guard<mutex> lock(mutex_);
+    Failure failure;
+    failure.every = every;
+    failure.result = result;
+    failure.text = text;
+    failures_[command] = failure;
+}
+
+void
+MockKeaServer::setObserver(const Observer& observer) {
+    lock_guard<mutex> lock(mutex_);
+    observer_ = observer;
+}
+
+vector<MockKeaServer::Record>
+MockKeaServer::getRecords() const {
+    lock_guard<mutex> lock(mutex_);
+    return (records_);
+}
+
+size_t
+MockKeaServer::getCommandCount() const {
+    lock_guard<mutex> lock(mutex_);
+    return (records_.size());
+}
+
+void
+MockKeaServer::run() {
+    while (true) {
+        struct pollfd pfd[2];
+        pfd[0].fd = listen_fd_;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = stop_pipe_[0];
+        pfd[1].events = POLLIN;
+        pfd[0].revents = pfd[1].revents = 0;
+
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (pfd[1].revents) {
+            return;
+        }
+        if (!pfd[0].revents) {
+            continue;
+        }
+
+        int fd = accept(listen_fd_, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        // Kea serves connections one by one, so does the mock.
+        handle(fd, Clock::now());
+        close(fd);
+    }
+}
+
+bool
+MockKeaServer::readCommand(int fd, string& text) {
+    JsonScanner scanner;
+    char buf[65536];
+
+    while (!scanner.complete()) {
+        struct pollfd pfd[2];
+        pfd[0].fd = fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = stop_pipe_[0];
+        pfd[1].events = POLLIN;
+        pfd[0].revents = pfd[1].revents = 0;
+
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (false);
+        }
+        if (pfd[1].revents) {
+            return (false);
+        }
+
+        ssize_t got = recv(fd, buf, sizeof(buf), 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return (false);
+        }
+        size_t used = scanner.feed(buf, static_cast<size_t>(got));
+        text.append(buf, used);
+    }
+    return (true);
+}
+
+string
+MockKeaServer::answer(const string& command, const JsonValue& arguments,
+                      int& result, int& delay) {
+    string text;
+    bool list = false;
+    string json;
+
+    if (command.empty()) {
+        result = 1;
+        text = "invalid command";
+    } else if (!isSupported(command)) {
+        result = 2;
+        text = "'" + command + "' command not supported.";
+    } else if (command == "list-commands") {
+        result = 0;
+        list = true;
+    } else if (command == "config-set" || command == "config-test") {
+        const JsonValue* dhcp6 = arguments.get("Dhcp6");
+        if (!dhcp6 || dhcp6->getType() != JsonValue::JSON_MAP) {
+            result = 1;
+            text = "Missing mandatory 'Dhcp6' parameter.";
+        } else {
+            result = 0;
+            text = (command == "config-set") ? "Configuration successful." :
+                "Configuration seems sane.";
+        }
+        if (command == "config-set" && result == 0) {
+            setSubnets(*dhcp6);
+        }
+    } else if (command == "statistic-get-all") {
+        result = 0;
+        JsonWriter args(json);
+        args.startMap();
+        writeStatistics(args);
+        args.endMap();
+    } else if (command == "lease6-get" || command == "lease6-get-page") {
+        getLeases(command, arguments, result, text, json);
+    } else {
+        result = 0;
+        text = command + " done (mock)";
+    }
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        size_t count = ++counts_[command];
+        map<string, int>::const_iterator d = delays_.find(command);
+        delay = (d != delays_.end()) ? d->second : 0;
+        map<string, Failure>::const_iterator f = failures_.find(command);
+        if (f != failures_.end() && f->second.every &&
+            count % f->second.every == 0) {
+            result = f->second.result;
+            text = f->second.text;
+            list = false;
+            json.clear();
+        }
+    }
+
+    string response;
+    JsonWriter w(response);
+    w.startMap();
+    w.key("result");
+    w.value(result);
+    if (!text.empty()) {
+        w.key("text");
+        w.value(text);
+    }
+    if (list) {
+        w.key("arguments");
+        w.startList();
+        for (size_t i = 0; i < sizeof(SUPPORTED) / sizeof(SUPPORTED[0]); i++) {
+            w.value(SUPPORTED[i]);
+        }
+        w.endList();
+    }
+    if (!json.empty()) {
+        w.key("arguments");
+        w.raw(json);
+    }
+    w.endMap();
+    return (response);
+}
+
+void
+MockKeaServer::setSubnets(const JsonValue& dhcp6) {
+    vector<uint32_t> subnets;
+    const JsonValue* list = dhcp6.get("subnet6");
+    if (list) {
+        // Subnets without an id get the next free one, as in Kea.
+        uint32_t next = 1;
+        for (size_t i = 0; i < list->listValue().size(); i++) {
+            const JsonValue* id = list->listValue()[i].get("id");
+            if (id && id->getType() == JsonValue::JSON_INT) {
+                subnets.push_back(static_cast<uint32_t>(id->intValue()));
+            } else {
+                subnets.push_back(next);
+            }
+            next = max(next, subnets.back() + 1);
+        }
+    }
+    lock_guard<mutex> lock(mutex_);
+    subnets_.swap(subnets);
+}
+
+void
+MockKeaServer::writeStatistics(JsonWriter& w) {
+    lock_guard<mutex> lock(mutex_);
+    size_t received = 0;
+    for (map<string, size_t>::const_iterator it = counts_.begin();
+         it != counts_.end(); ++it) {
+        received += it->second;
+    }
+    writeStatistic(w, "pkt6-received", static_cast<int64_t>(received));
+    writeStatistic(w, "pkt6-sent", static_cast<int64_t>(received));
+    for (size_t i = 0; i < subnets_.size(); i++) {
+        ostringstream prefix;
+        prefix << "subnet[" << subnets_[i] << "].";
+        writeStatistic(w, prefix.str() + "total-nas", 65536);
+        writeStatistic(w, prefix.str() + "assigned-nas", subnets_[i] % 100);
+        // Kea reports pool statistics too.
+        writeStatistic(w, prefix.str() + "pool[0].total-nas", 65536);
+    }
+}
+
+void
+MockKeaServer::setLeases(size_t subnets, size_t per_subnet, size_t delegated) {
+    lock_guard<mutex> lock(mutex_);
+    lease_subnets_ = subnets;
+    leases_per_subnet_ = per_subnet;
+    prefixes_per_subnet_ = delegated;
+}
+
+void
+MockKeaServer::leaseAddress(size_t subnet, uint64_t index, bool pd, uint8_t* bytes) {
+    memset(bytes, 0, 16);
+    bytes[0] = 0x20;
+    bytes[1] = 0x01;
+    bytes[2] = 0x0d;
+    bytes[3] = pd ? 0xb9 : 0xb8;
+    bytes[4] = static_cast<uint8_t>(subnet >> 8);
+    bytes[5] = static_cast<uint8_t>(subnet);
+    if (pd) {
+        // /120 prefixes
+        index <<= 8;
+    }
+    for (int i = 15; i >= 8; i--, index >>= 8) {
+        bytes[i] = static_cast<uint8_t>(index);
+    }
+}
+
+void
+MockKeaServer::writeLease(JsonWriter& w, size_t subnet, uint64_t index, bool pd) {
+    uint8_t bytes[16];
+    char address[INET6_ADDRSTRLEN];
+    leaseAddress(subnet, index, pd, bytes);
+    inet_ntop(AF_INET6, bytes, address, sizeof(address));
+
+    char duid[32];
+    snprintf(duid, sizeof(duid), "00:03:00:01:%02x:%02x:%02x:%02x",
+             static_cast<unsigned>(subnet & 0xff),
+             static_cast<unsigned>((index >> 16) & 0xff),
+             static_cast<unsigned>((index >> 8) & 0xff),
+             static_cast<unsigned>(index & 0xff));
+
+    w.startMap();
+    w.key("cltt");
+    w.value(static_cast<int64_t>(1514764800 + index));
+    w.key("duid");
+    w.value(duid);
+    w.key("fqdn-fwd");
+    w.value(false);
+    w.key("fqdn-rev");
+    w.value(false);
+    w.key("hostname");
+    w.value("");
+    w.key("hw-address");
+    w.value("");
+    w.key("iaid");
+    w.value(static_cast<uint64_t>(index));
+    w.key("ip-address");
+    w.value(address);
+    w.key("preferred-lft");
+    w.value(3000);
+    w.key("prefix-len");
+    w.value(pd ? 120 : 128);
+    w.key("state");
+    w.value(0);
+    w.key("subnet-id");
+    w.value(static_cast<uint64_t>(subnet));
+    w.key("type");
+    w.value(pd ? "IA_PD" : "IA_NA");
+    w.key("valid-lft");
+    w.value(4000);
+    w.endMap();
+}
+
+void
+MockKeaServer::getLeases(const string& command, const JsonValue& arguments,
+                         int& result, string& text, string& json) {
+    size_t subnets;
+    size_t counts[2];
+    {
+        lock_guard<mutex> lock(mutex_);
+        subnets = lease_subnets_;
+        counts[0] = leases_per_subnet_;
+        counts[1] = prefixes_per_subnet_;
+    }
+
+    // Subnet s (1..subnets) holds addresses 2001:db8:s::1 to
+    // 2001:db8:s::<counts[0]>, in this order, then the same goes for the
+    // prefixes 2001:db9:s::100/120 to 2001:db9:s::<counts[1]>00/120.
+    const char* param = (command == "lease6-get") ? "ip-address" : "from";
+    const JsonValue* from = arguments.get(param);
+    uint8_t bytes[16];
+    if (!from || from->getType() != JsonValue::JSON_STRING ||
+        (from->stringValue() != "start" &&
+         inet_pton(AF_INET6, from->stringValue().c_str(), bytes) != 1)) {
+        result = 1;
+        text = string("missing or invalid '") + param + "' parameter";
+        return;
+    }
+
+    // Position of the address (or the first one after it for paging):
+    // area 0 holds the addresses, area 1 the prefixes, 2 is the end.
+    size_t area = 0;
+    size_t subnet = 1;
+    uint64_t index = 1;
+    bool exact = false;
+    if (from->stringValue() != "start") {
+        static const uint8_t PREFIX[3] = { 0x20, 0x01, 0x0d };
+        int cmp = memcmp(bytes, PREFIX, 3);
+        if (cmp < 0 || (cmp == 0 && bytes[3] < 0xb8)) {
+            // Before all leases
+        } else if (cmp > 0 || bytes[3] > 0xb9) {
+            area = 2;
+        } else {
+            area = bytes[3] - 0xb8;
+            const int shift = area ? 8 : 0;
+            subnet = static_cast<size_t>(bytes[4]) << 8 | bytes[5];
+            uint64_t low = 0;
+            for (int i = 8; i < 16; i++) {
+                low = (low << 8) | bytes[i];
+            }
+            const uint64_t number = low >> shift;
+            const bool aligned = !(low & ((1u << shift) - 1));
+            bool high = bytes[6] || bytes[7];
+            if (subnet < 1) {
+                subnet = 1;
+                index = 1;
+            } else if (subnet > subnets) {
+                area++;
+                subnet = 1;
+                index = 1;
+            } else if (high || number >= counts[area]) {
+                exact = !high && number && number == counts[area] && aligned;
+                subnet++;
+                index = 1;
+            } else {
+                exact = number && aligned;
+                index = number + 1;
+            }
+        }
+    }
+
+    if (command == "lease6-get") {
+        // The address itself is the one before the position.
+        JsonWriter w(json);
+        if (exact) {
+            if (index > 1) {
+                writeLease(w, subnet, index - 1, area == 1);
+            } else {
+                writeLease(w, subnet - 1, counts[area], area == 1);
+            }
+            result = 0;
+            text = "IPv6 lease found.";
+        } else {
+            json.clear();
+            result = 3;
+            text = "Lease not found.";
+        }
+        return;
+    }
+
+    const JsonValue* limit = arguments.get("limit");
+    if (!limit || limit->getType() != JsonValue::JSON_INT || limit->intValue() <= 0) {
+        result = 1;
+        text = "missing or invalid 'limit' parameter";
+        return;
+    }
+
+    JsonWriter w(json);
+    w.startMap();
+    w.key("leases");
+    w.startList();
+    int64_t count = 0;
+    while (count < limit->intValue()) {
+        // Past the last lease of the area, on to the next one
+        while (area < 2 && (subnet > subnets || !counts[area])) {
+            area++;
+            subnet = 1;
+            index = 1;
+        }
+        if (area == 2) {
+            break;
+        }
+        writeLease(w, subnet, index, area == 1);
+        count++;
+        if (++index > counts[area]) {
+            subnet++;
+            index = 1;
+        }
+    }
+    w.endList();
+    w.key("count");
+    w.value(count);
+    w.endMap();
+
+    result = count ? 0 : 3;
+    ostringstream found;
+    found << count << " IPv6 lease(s) found.";
+    text = found.str();
+}
+
+void
+MockKeaServer::handle(int fd, const Clock::time_point& accepted) {
+    string text;
+    if (!readCommand(fd, text)) {
+        return;
+    }
+
+    Record record;
+    record.accepted = accepted;
+    record.received = Clock::now();
+    record.bytes = text.size();
+    record.result = 1;
+
+    JsonValue json;
+    JsonValue null;
+    string error;
+    const JsonValue* arguments = &null;
+    if (parseJson(text, json, error)) {
+        const JsonValue* command = json.get("command");
+        if (command && command->getType() == JsonValue::JSON_STRING) {
+            record.command = command->stringValue();
+        }
+        if (json.get("arguments")) {
+            arguments = json.get("arguments");
+        }
+    }
+
+    int delay = 0;
+    string response = answer(record.command, *arguments, record.result, delay);
+    if (delay > 0) {
+        this_thread::sleep_for(chrono::milliseconds(delay));
+    }
+    writeAll(fd, response);
+    record.answered = Clock::now();
+
+    Observer observer;
+    {
+        lock_guard<mutex> lock(mutex_);
+        records_.push_back(record);
+        observer = observer_;
+    }
+    if (observer) {
+        observer(record, *arguments);
+    }
+}
@@ -0,0 +1,193 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file mock-kea.h
+///
+/// Stand-in for the Kea control socket, used to test and load test the
+/// plugin without a running Kea.
+
+#ifndef MOCK_KEA_H
+#define MOCK_KEA_H
+
+#include "kea-json.h"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class JsonWriter;
+
+/// @brief Mock Kea control socket server.
+///
+/// Listens on a UNIX socket and, like Kea, handles one connection at a
+/// time: reads a command, answers it and closes the connection. It
+/// accepts config-set, config-test and list-commands (plus the
+/// subnet_cmds and host_cmds commands used for incremental updates).
+/// statistic-get-all reports made up statistics for the subnets of the
+/// last configuration set, lease6-get and lease6-get-page serve
+/// synthetic leases (see setLeases()). Other commands get result 2
+/// (not supported).
+///
+/// Delays and error responses can be injected per command, and the
+/// arrival and answer time of every command is recorded.
+class MockKeaServer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /// @brief A handled command.
+    struct Record {
+        std::string command;         ///< command name (empty if invalid)
+        size_t bytes;                ///< size of the command
+        Clock::time_point accepted;  ///< connection accepted
+        Clock::time_point received;  ///< command completely received
+        Clock::time_point answered;  ///< response sent
+        int result;                  ///< result code sent
+    };
+
+    /// @brief Function called for every handled command.
+    ///
+    /// Gets the record and the command arguments. It is called on the
+    /// server thread after the response has been sent.
+    typedef std::function<void (const Record&, const JsonValue&)> Observer;
+
+    /// @brief Constructor
+    ///
+    /// @param socket_path path of the UNIX socket to listen on
+    MockKeaServer(const std::string& socket_path);
+
+    /// @brief Destructor (stops the server)
+    ~MockKeaServer();
+
+    /// @brief Creates the socket and starts the server thread.
+    ///
+    /// An existing socket file is removed first.
+    ///
+    /// @param error (out) error description on failure
+    /// @return true on success
+    bool start(std::string& error);
+
+    /// @brief Stops the server thread and removes the socket.
+    void stop();
+
+    /// @brief Delays responses to a command.
+    ///
+    /// @param command command name
+    /// @param delay delay in milliseconds (0 disables)
+    void setDelay(const std::string& command, int delay);
+
+    /// @brief Makes a command fail periodically.
+    ///
+    /// @param command command name
+    /// @param every every n-th command fails (0 disables, 1 fails all)
+    /// @param result result code to be returned
+    /// @param text text to be returned
+    void setFailure(const std::string& command, size_t every, int result = 1,
+                    const std::string& text = "injected failure");
+
+    /// @brief Sets the synthetic lease database.
+    ///
+    /// Leases are generated when asked for, so millions of them cost no
+    /// memory. Subnet s (with id s, from 1) holds the addresses
+    /// 2001:db8:s::1 to 2001:db8:s::per_subnet (IA_NA) and the
+    /// delegated prefixes 2001:db9:s::100/120 to 2001:db9:s::<n>00/120
+    /// (IA_PD), which are outside of the subnet prefix as prefixes from
+    /// prefix pools usually are. All addresses come before all prefixes.
+    ///
+    /// @param subnets number of subnets with leases
+    /// @param per_subnet number of addresses leased in each subnet
+    /// @param delegated number of prefixes delegated in each subnet
+    void setLeases(size_t subnets, size_t per_subnet, size_t delegated = 0);
+
+    /// @brief Sets function called for every handled command.
+    void setObserver(const Observer& observer);
+
+    /// @brief Returns records of all handled commands.
+    std::vector<Record> getRecords() const;
+
+    /// @brief Returns number of handled commands.
+    size_t getCommandCount() const;
+
+private:
+    /// @brief Injected failure of a command
+    struct Failure {
+        size_t every;      ///< every n-th command fails
+        int result;        ///< result code
+        std::string text;  ///< result text
+    };
+
+    /// @brief Server thread body.
+    void run();
+
+    /// @brief Handles a single connection.
+    void handle(int fd, const Clock::time_point& accepted);
+
+    /// @brief Reads a complete command.
+    ///
+    /// @return false if the peer closed or the server is stopping
+    bool readCommand(int fd, std::string& text);
+
+    /// @brief Builds the response to a command.
+    ///
+    /// @param command command name
+    /// @param arguments command arguments
+    /// @param result (out) result code
+    /// @param delay (out) delay before the response is sent
+    ///
+    /// @return response text
+    std::string answer(const std::string& command, const JsonValue& arguments,
+                       int& result, int& delay);
+
+    /// @brief Remembers subnet ids of a configuration that was set.
+    ///
+    /// @param dhcp6 the Dhcp6 map
+    void setSubnets(const JsonValue& dhcp6);
+
+    /// @brief Writes statistics of the current configuration.
+    void writeStatistics(JsonWriter& w);
+
+    /// @brief Answers lease6-get and lease6-get-page.
+    ///
+    /// @param command command name
+    /// @param arguments command arguments
+    /// @param result (out) result code
+    /// @param text (out) result text
+    /// @param json (out) arguments of the response
+    void getLeases(const std::string& command, const JsonValue& arguments,
+                   int& result, std::string& text, std::string& json);
+
+    /// @brief Returns address of a synthetic lease.
+    ///
+    /// @param subnet subnet id
+    /// @param index index of the lease in the subnet (from 1)
+    /// @param pd whether the lease is a delegated prefix
+    /// @param bytes (out) 16 bytes of the address
+    static void leaseAddress(size_t subnet, uint64_t index, bool pd, uint8_t* bytes);
+
+    /// @brief Writes a synthetic lease the way Kea does.
+    static void writeLease(JsonWriter& w, size_t subnet, uint64_t index, bool pd);
+
+    std::string socket_path_;   ///< socket to listen on
+    int listen_fd_;             ///< listening socket
+    int stop_pipe_[2];          ///< wakes up the thread when stopping
+    std::thread thread_;        ///< server thread
+
+    mutable std::mutex mutex_;                  ///< protects everything below
+    std::map<std::string, int> delays_;         ///< delays per command
+    std::map<std::string, Failure> failures_;   ///< failures per command
+    std::map<std::string, size_t> counts_;      ///< commands seen per name
+    std::vector<Record> records_;               ///< handled commands
+    std::vector<uint32_t> subnets_;             ///< ids of configured subnets
+    size_t lease_subnets_;                      ///< subnets with leases
+    size_t leases_per_subnet_;                  ///< addresses in each of them
+    size_t prefixes_per_subnet_;                ///< prefixes in each of them
+    Observer observer_;                         ///< called for each command
+};
+
+#endif /* MOCK_KEA_H */
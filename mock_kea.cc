@@ -0,0 +1,170 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file mock_kea.cc
+///
+/// Runs the mock Kea control socket server until interrupted, so the
+/// plugin can be exercised without Kea.
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "plugin-kea.h"
+#include "mock-kea.h"
+
+using namespace std;
+
+namespace {
+
+void
+usage() {
+    cerr << "usage: mock_kea [-s socket] [-d [command=]ms] [-e [command=]n[:result]]" << endl
+         << "                [-L leases[:subnets]] [-l log-file] [-q]" << endl
+         << "  -s  socket path (default " << KEA_CONTROL_SOCKET << ")" << endl
+         << "  -d  delay responses to a command (default config-set)" << endl
+         << "  -e  make every n-th command fail (default config-set, result 1)" << endl
+         << "  -L  serve synthetic leases spread over subnets 1.. (default 1)" << endl
+         << "  -l  write a line per command to the file (CSV)" << endl
+         << "  -q  don't print commands as they arrive" << endl
+         << "Options -d and -e may be repeated for different commands." << endl;
+}
+
+/// @brief Splits "command=value" (the command defaults to config-set).
+string
+splitCommand(const string& arg, string& value) {
+    size_t eq = arg.find('=');
+    if (eq == string::npos) {
+        value = arg;
+        return ("config-set");
+    }
+    value = arg.substr(eq + 1);
+    return (arg.substr(0, eq));
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    string socket_path = KEA_CONTROL_SOCKET;
+    const char* log_file = NULL;
+    bool quiet = false;
+    size_t leases = 0;
+    size_t lease_subnets = 1;
+    vector<pair<string, int> > delays;
+    vector<pair<string, pair<size_t, int> > > failures;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:e:L:l:qh")) != -1) {
+        string value;
+        string command;
+        switch (opt) {
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'd':
+            command = splitCommand(optarg, value);
+            delays.push_back(make_pair(command, atoi(value.c_str())));
+            break;
+        case 'e': {
+            command = splitCommand(optarg, value);
+            size_t colon = value.find(':');
+            int result = (colon == string::npos) ? 1 :
+                atoi(value.c_str() + colon + 1);
+            failures.push_back(make_pair(command,
+                make_pair(static_cast<size_t>(atol(value.c_str())), result)));
+            break;
+        }
+        case 'L': {
+            const char* colon = strchr(optarg, ':');
+            leases = strtoul(optarg, NULL, 10);
+            lease_subnets = colon ? strtoul(colon + 1, NULL, 10) : 1;
+            if (!lease_subnets) {
+                usage();
+                return (EXIT_FAILURE);
+            }
+            break;
+        }
+        case 'l':
+            log_file = optarg;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            usage();
+            return (EXIT_FAILURE);
+        }
+    }
+
+    ofstream log;
+    if (log_file) {
+        log.open(log_file);
+        if (!log) {
+            cerr << "Failed to open " << log_file << endl;
+            return (EXIT_FAILURE);
+        }
+        log << "received-us,command,bytes,result,wait-us,service-us" << endl;
+    }
+
+    // Signals are taken with sigwait() below, not by the server thread.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    MockKeaServer server(socket_path);
+    for (size_t i = 0; i < delays.size(); i++) {
+        server.setDelay(delays[i].first, delays[i].second);
+    }
+    for (size_t i = 0; i < failures.size(); i++) {
+        server.setFailure(failures[i].first, failures[i].second.first,
+                          failures[i].second.second);
+    }
+
+    if (leases) {
+        server.setLeases(lease_subnets, leases / lease_subnets);
+    }
+
+    const MockKeaServer::Clock::time_point start = MockKeaServer::Clock::now();
+    server.setObserver([&](const MockKeaServer::Record& r, const JsonValue&) {
+        typedef chrono::microseconds us;
+        long long received = chrono::duration_cast<us>(r.received - start).count();
+        long long wait = chrono::duration_cast<us>(r.received - r.accepted).count();
+        long long service = chrono::duration_cast<us>(r.answered - r.received).count();
+        if (!quiet) {
+            cout << received / 1000.0 << " ms: " << (r.command.empty() ? "?" : r.command)
+                 << " (" << r.bytes << " bytes) result " << r.result
+                 << " after " << service / 1000.0 << " ms" << endl;
+        }
+        if (log.is_open()) {
+            log << received << "," << r.command << "," << r.bytes << ","
+                << r.result << "," << wait << "," << service << endl;
+        }
+    });
+
+    string error;
+    if (!server.start(error)) {
+        cerr << "Failed to start: " << error << endl;
+        return (EXIT_FAILURE);
+    }
+    cerr << "mock Kea listening on " << socket_path << endl;
+
+    int sig = 0;
+    sigwait(&signals, &sig);
+
+    server.stop();
+    cerr << "handled " << server.getCommandCount() << " command(s)" << endl;
+
+    return (EXIT_SUCCESS);
+}
@@ -11,12 +11,29 @@
 
 #include <cstdio>
 #include <stdio.h>
+#include <stdlib.h>
 #include <syslog.h>
 #include <string.h>
-#include <fstream>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
+#include <vector>
 #include "plugin-kea.h"
+#include "apply-metrics.h"
+#include "apply-queue.h"
+#include "commit-coalescer.h"
+#include "config-fingerprint.h"
+#include "config-snapshots.h"
+#include "kea-ctrl.h"
+#include "kea-fanout.h"
+#include "kea-leases.h"
+#include "kea-stats.h"
 #include "yang-kea.h"
 
 extern "C" {
@@ -24,77 +41,1551 @@ extern "C" {
 
 using namespace std;
 
-const string KEA_CONTROL_SOCKET = "/tmp/kea-dhcp6-ctrl.sock";
-const string KEA_CONTROL_CLIENT = CLIENT_DIR "/ctrl-channel-cli";
-const string CFG_TEMP_FILE = "/tmp/kea-plugin-gen-cfg.json";
+/* Plugin settings, taken from the environment of sysrepo-plugind */
 
-/* retrieves & prints current Kea configuration */
+/* Commits arriving within this many ms of each other are pushed
+ * together (0 disables coalescing, every commit is pushed right away) */
+const char *ENV_COALESCE_WINDOW = "KEA_PLUGIN_COALESCE_MS";
+const long DEFAULT_COALESCE_WINDOW = 0;
+
+/* Upper bound on how long a commit may wait for a coalesced push */
+const char *ENV_COALESCE_MAX_LATENCY = "KEA_PLUGIN_COALESCE_MAX_MS";
+const long DEFAULT_COALESCE_MAX_LATENCY = 1000;
+
+/* Commits are applied by a worker thread through a queue of this many
+ * requests, so that the change callback returns before Kea answers;
+ * the results are sent as apply-done notifications (0, the default,
+ * applies them in the callback, and a full queue does as well) */
+const char *ENV_APPLY_QUEUE = "KEA_PLUGIN_APPLY_QUEUE";
+const long DEFAULT_APPLY_QUEUE = 0;
+
+/* How changes are applied: "full" pushes the whole configuration with
+ * config-set, "diff" sends subnet and reservation commands when possible
+ * (needs the subnet_cmds and host_cmds hooks loaded in Kea) */
+const char *ENV_APPLY_MODE = "KEA_PLUGIN_APPLY_MODE";
+
+/* 0 renders subnets as the configuration is sent instead of keeping
+ * their fragments, so that memory does not grow with the configuration
+ * (default 1, keeps them; diff mode needs them) */
+const char *ENV_SUBNET_CACHE = "KEA_PLUGIN_SUBNET_CACHE";
+
+/* Number of threads translating subnets when the whole configuration
+ * is translated (each but the first has its own Sysrepo session) */
+const char *ENV_THREADS = "KEA_PLUGIN_THREADS";
+const long DEFAULT_THREADS = 1;
+
+/* Kea statistics are served from memory for this many ms, so that
+ * many gets of operational data cost one statistic-get-all */
+const char *ENV_STATS_TTL = "KEA_PLUGIN_STATS_TTL_MS";
+const long DEFAULT_STATS_TTL = 1000;
+
+/* how long a get of operational data waits for Kea (ms) */
+const int STATS_TIMEOUT = 2000;
+
+/* Leases are read from Kea in pages of this many leases */
+const char *ENV_LEASE_PAGE = "KEA_PLUGIN_LEASE_PAGE";
+
+/* At most this many leases are returned by a get (0 for no limit),
+ * which bounds the memory used by the lease view */
+const char *ENV_LEASE_LIMIT = "KEA_PLUGIN_LEASE_LIMIT";
+const long DEFAULT_LEASE_LIMIT = 10000;
+
+/* Prometheus text file with the apply metrics, rewritten after every
+ * apply (not written when unset) */
+const char *ENV_METRICS_FILE = "KEA_PLUGIN_METRICS_FILE";
+
+/* 1 logs the phases of every apply from the start (the set-tracing
+ * RPC turns it on and off at runtime) */
+const char *ENV_TRACE = "KEA_PLUGIN_TRACE";
+
+/* File keeping the configuration Kea accepted last, so that a restarted
+ * plugin does not push it again (empty for none) */
+const char *ENV_LAST_CONFIG_FILE = "KEA_PLUGIN_LAST_CONFIG_FILE";
+
+/* 1 (default) has Kea test the configuration of a commit with
+ * config-test in the verify event, and rejects the commit if Kea does */
+const char *ENV_VERIFY = "KEA_PLUGIN_VERIFY";
+
+/* Comma separated control sockets of the Kea instances configurations
+ * are pushed to, e.g. both servers of an HA pair (statistics and leases
+ * are read from the first one) */
+const char *ENV_SOCKETS = "KEA_PLUGIN_SOCKETS";
+
+/* "all" (default) accepts a push only when every instance took it,
+ * "quorum" when more than half of them did */
+const char *ENV_POLICY = "KEA_PLUGIN_POLICY";
+
+/* how long each instance has to answer a push (ms) */
+const char *ENV_TIMEOUT = "KEA_PLUGIN_TIMEOUT_MS";
+
+/* Number of configurations Kea accepted that are kept (compressed) in
+ * memory, to roll Kea back to after a failed push or with the rollback
+ * RPC (0 keeps none) */
+const char *ENV_SNAPSHOTS = "KEA_PLUGIN_SNAPSHOTS";
+
+/* 1 prints every configuration pushed to Kea to standard output */
+const char *ENV_DUMP = "KEA_PLUGIN_DUMP";
+
+/* how long pushes wait for the apply or abort event of a verified
+ * commit (ms), after that its translation is dropped */
+const int VERIFY_TIMEOUT = 10000;
+
+/* every section of the model has a change subscription of its own,
+ * called before the one of the whole module (higher priorities come
+ * first), which assembles the sections and pushes once per commit
+ * however many sections it touched; all of them share a subscription
+ * context, so they are also called one after the other */
+const uint32_t SECTION_PRIORITY = 10;
+const uint32_t ASSEMBLER_PRIORITY = 0;
+
+/* operational data provided by the plugin */
+const char *STATS_XPATH = "/ietf-kea-dhcpv6:server/statistics";
+const char *STATS_SUBNET_XPATH = "/ietf-kea-dhcpv6:server/statistics/subnet6";
+const char *LEASES_XPATH = "/ietf-kea-dhcpv6:server/leases";
+const char *LEASES_LIST_XPATH = "/ietf-kea-dhcpv6:server/leases/lease6";
+const char *METRICS_XPATH = "/ietf-kea-dhcpv6:server/apply-metrics";
+const char *METRICS_PHASE_XPATH = "/ietf-kea-dhcpv6:server/apply-metrics/phase";
+const char *METRICS_TARGET_XPATH = "/ietf-kea-dhcpv6:server/apply-metrics/target";
+const char *METRICS_SNAPSHOT_XPATH = "/ietf-kea-dhcpv6:server/apply-metrics/snapshot";
+const char *METRICS_QUEUE_XPATH = "/ietf-kea-dhcpv6:server/apply-metrics/apply-queue";
+const char *METRICS_COALESCER_XPATH = "/ietf-kea-dhcpv6:server/apply-metrics/coalescer";
+const char *TRACING_RPC_XPATH = "/ietf-kea-dhcpv6:set-tracing";
+const char *ROLLBACK_RPC_XPATH = "/ietf-kea-dhcpv6:rollback";
+const char *APPLY_DONE_XPATH = "/ietf-kea-dhcpv6:apply-done";
+
+/* configuration (or changes) translated for Kea, kept from the verify
+ * event of a commit to its apply event */
+typedef struct {
+    bool valid;             /* made for a commit not applied yet */
+    uint64_t changes;       /* digest of the changes of that commit */
+    bool targeted;          /* commands apply the changes (diff mode) */
+    vector<KeaCommand> commands; /* targeted commands */
+    bool full;              /* the fragments hold the whole configuration */
+    uint64_t fingerprint;   /* of that configuration */
+} translation_t;
+
+/* what the verify events of commits left to a background push made:
+ * their changes are not marked anymore, so the push could not make
+ * it again */
+typedef struct {
+    vector<KeaCommand> commands; /* targeted commands, in commit order */
+    bool full;              /* some commit needs the whole configuration */
+} deferred_t;
+
+/* translator figures, to tell what some work took */
+typedef struct {
+    size_t calls;           /* Sysrepo calls */
+    uint64_t sysrepo_ns;    /* time spent reading Sysrepo */
+} usage_t;
+
+/* what the section callbacks did for the event being processed, until
+ * the module callback takes it over */
+typedef struct {
+    unsigned sections;      /* bit per section whose callback ran */
+    usage_t usage;          /* figures before the first of them */
+    uint64_t collect_ns;    /* time spent collecting their changes */
+    uint64_t translate_ns;  /* time spent regenerating their fragments */
+} section_work_t;
+
+struct plugin_ctx;
+
+/* private context of a section subscription */
+typedef struct {
+    struct plugin_ctx *plugin;
+    SysrepoKea::Section section;
+} section_ctx_t;
+
+/* plugin state kept between callbacks */
+typedef struct plugin_ctx {
+    sr_session_ctx_t *session;   /* plugin session, used for coalesced pushes */
+    sr_conn_ctx_t *connection;   /* for sessions of translation threads */
+    sr_subscription_ctx_t *subscription;
+    SysrepoKea *translator; /* keeps JSON fragments between commits */
+    KeaFanout *targets;     /* all Kea instances, configurations go to */
+    CommitCoalescer *coalescer; /* NULL when coalescing is disabled */
+    ApplyQueue *queue;      /* NULL when commits are applied in the callback */
+    KeaStatsCache *stats;   /* Kea statistics for operational gets */
+    size_t lease_page;      /* leases per lease6-get-page */
+    size_t lease_limit;     /* leases per get (0 for no limit) */
+    ApplyMetrics *metrics;  /* timers and counters of applies */
+    ConfigFingerprint *fingerprint; /* of the configuration Kea runs with */
+    ConfigSnapshots *snapshots; /* configurations Kea accepted last */
+    bool rolled_back;       /* Kea runs an older configuration than Sysrepo's */
+    std::thread startup;    /* first push, done in the background */
+    bool diff;              /* apply changes with targeted commands */
+    bool verify;            /* config-test commits in the verify event */
+    bool dump;              /* print pushed configurations to stdout */
+    translation_t verified; /* translation of the commit being verified */
+    deferred_t deferred;    /* verified commits not pushed yet */
+    section_ctx_t sections[SysrepoKea::SECTION_COUNT]; /* section subscriptions */
+    section_work_t pending; /* work of the section callbacks */
+    std::condition_variable committed; /* verified commit applied or aborted */
+    std::mutex lock;        /* serializes translator and Kea access */
+} plugin_ctx_t;
+
+/* returns numeric setting from the environment */
+static long
+env_long(const char *name, long dflt)
+{
+    const char *value = getenv(name);
+    if (!value || !*value) {
+        return dflt;
+    }
+    char *end = NULL;
+    long result = strtol(value, &end, 10);
+    if (*end || result < 0) {
+        cerr << "plugin-kea ignoring invalid " << name << "=" << value << endl;
+        return dflt;
+    }
+    return result;
+}
+
+/* tells the statistics cache which subnet the Kea subnet ids stand for
+ * (must be called with ctx->lock held, after a successful push) */
+static void
+update_stats_subnets(plugin_ctx_t *ctx)
+{
+    map<uint32_t, string> subnets;
+    set<uint32_t> delegating;
+    ctx->translator->getSubnetIds(subnets, delegating);
+    ctx->stats->setSubnets(subnets, delegating);
+}
+
+/* sends a command to every Kea instance and logs how each one took it;
+ * the time of the slowest instance is added to the trace, split into
+ * send and kea phases, or all of it to phase when that is another one
+ * returns the number of instances that succeeded */
+static size_t
+send_to_targets(plugin_ctx_t *ctx, const string &command, JsonSource &arguments,
+                vector<KeaResponse> &responses, ApplyMetrics::Trace &trace,
+                ApplyMetrics::Phase phase)
+{
+    size_t succeeded = ctx->targets->sendCommand(command, arguments, responses);
+
+    /* the instances are served at the same time */
+    uint64_t send_ns = 0;
+    uint64_t total_ns = 0;
+    for (size_t i = 0; i < responses.size(); i++) {
+        send_ns = max(send_ns, responses[i].send_ns);
+        total_ns = max(total_ns, responses[i].send_ns + responses[i].wait_ns);
+        cerr << "plugin-kea " << command
+             << (0 == responses[i].result ? " succeeded at " : " failed at ")
+             << ctx->targets->getSocketPath(i) << ": " << responses[i].text << endl;
+    }
+    if (ApplyMetrics::PHASE_KEA == phase) {
+        trace.add(ApplyMetrics::PHASE_SEND, send_ns);
+        trace.add(ApplyMetrics::PHASE_KEA, total_ns - send_ns);
+    } else {
+        trace.add(phase, total_ns);
+    }
+    return succeeded;
+}
+
+/* sends targeted commands
+ * returns false when the full configuration must be pushed instead
+ * (must be called with ctx->lock held) */
+static bool
+send_changes(plugin_ctx_t *ctx, const vector<KeaCommand> &commands,
+             ApplyMetrics::Trace &trace)
+{
+    if (commands.empty()) {
+        cerr << "plugin-kea no changes to push" << endl;
+        return true;
+    }
+
+    /* Kea's configuration is no longer the one last pushed in full */
+    ctx->fingerprint->clear();
+
+    for (size_t i = 0; i < commands.size(); i++) {
+        vector<KeaResponse> responses;
+        JsonStringSource arguments(commands[i].arguments);
+        size_t succeeded = send_to_targets(ctx, commands[i].command, arguments,
+                                           responses, trace, ApplyMetrics::PHASE_KEA);
+        trace.count(ApplyMetrics::COUNTER_COMMANDS, responses.size());
+        trace.count(ApplyMetrics::COUNTER_BYTES, commands[i].arguments.size() * responses.size());
+        /* a quorum is not enough, the instances would drift apart */
+        if (succeeded != responses.size()) {
+            /* Kea is now somewhere between the old and the new config */
+            cerr << "plugin-kea " << commands[i].command
+                 << " failed, falling back to config-set" << endl;
+            trace.count(ApplyMetrics::COUNTER_RETRIES);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* brings the fragments of the whole configuration up to date and
+ * fingerprints it; the document itself is only assembled as it is sent
+ * (must be called with ctx->lock held) */
+static int
+translate_full(plugin_ctx_t *ctx, translation_t &tr, string &error,
+               ApplyMetrics::Trace &trace)
+{
+    ApplyMetrics::Clock::time_point start = ApplyMetrics::Clock::now();
+    int rc = ctx->translator->updateConfig();
+    if (SR_ERR_OK == rc) {
+        SysrepoKea::ConfigStream stream(*ctx->translator);
+        JsonFingerprint fingerprint;
+        const char *data;
+        size_t size;
+        while (stream.next(data, size)) {
+            fingerprint.update(data, size);
+        }
+        tr.fingerprint = fingerprint.get();
+        rc = stream.getError();
+    }
+    trace.addSince(ApplyMetrics::PHASE_TRANSLATE, start);
+
+    cerr << "plugin-kea fragments: " << ctx->translator->getReusedFragments()
+         << " reused, " << ctx->translator->getRebuiltFragments()
+         << " rebuilt" << endl;
+
+    if (SR_ERR_OK != rc) {
+        error = "failed to translate ietf-kea-dhcpv6 configuration";
+        return SR_ERR_OPERATION_FAILED;
+    }
+    tr.full = true;
+    return SR_ERR_OK;
+}
+
+/* configuration on its way to Kea: passes the pieces of another source
+ * on and, as they go by, writes them to the last config file, to a
+ * snapshot (when given) and to stdout (when dumping) */
+class PushSource : public JsonSource {
+public:
+    PushSource(plugin_ctx_t *ctx, JsonSource &source, ConfigSnapshots::Builder *snapshot)
+        :ctx_(ctx), source_(source), snapshot_(snapshot), size_(0) {
+        ctx_->fingerprint->begin();
+    }
+
+    virtual bool next(const char *&data, size_t &size) {
+        if (!source_.next(data, size)) {
+            return false;
+        }
+        size_ += size;
+        ctx_->fingerprint->write(data, size);
+        if (snapshot_) {
+            snapshot_->write(data, size);
+        }
+        if (ctx_->dump) {
+            cout.write(data, size);
+            if (source_.done()) {
+                cout << endl;
+            }
+        }
+        return true;
+    }
+
+    virtual bool done() const {
+        return source_.done();
+    }
+
+    /* returns the number of bytes passed on so far */
+    size_t getSize() const {
+        return size_;
+    }
+
+private:
+    plugin_ctx_t *ctx_;
+    JsonSource &source_;
+    ConfigSnapshots::Builder *snapshot_;
+    size_t size_;
+};
+
+/* translates the configuration, or the changes in diff mode (full gets
+ * the whole configuration then too) (must be called with ctx->lock held) */
+static int
+translate_config(plugin_ctx_t *ctx, sr_session_ctx_t *session, translation_t &tr,
+                 bool full, string &error, ApplyMetrics::Trace &trace)
+{
+    ctx->translator->setSession(session);
+    tr.targeted = false;
+    tr.commands.clear();
+    tr.full = false;
+    tr.fingerprint = 0;
+
+    if (ctx->diff) {
+        ApplyMetrics::Clock::time_point start = ApplyMetrics::Clock::now();
+        tr.targeted = ctx->translator->getCommands(tr.commands);
+        trace.addSince(ApplyMetrics::PHASE_TRANSLATE, start);
+    }
+    if (tr.targeted && !full) {
+        return SR_ERR_OK;
+    }
+    return translate_full(ctx, tr, error, trace);
+}
+
+/* rolls Kea back to a configuration it accepted before (generation 0
+ * for the last one), without translating anything or touching Sysrepo
+ * (must be called with ctx->lock held) */
+static int
+rollback_config(plugin_ctx_t *ctx, uint64_t generation, ConfigSnapshots::Info &info,
+                string &error, ApplyMetrics::Trace &trace)
+{
+    ApplyMetrics::Clock::time_point start = ApplyMetrics::Clock::now();
+    ConfigSnapshots::Reader reader;
+    if (!ctx->snapshots->open(generation, info, reader)) {
+        error = generation ? "configuration generation " + to_string(generation) +
+            " is not kept" : "no configuration to roll back to";
+        cerr << "plugin-kea " << error << endl;
+        return SR_ERR_NOT_FOUND;
+    }
+    trace.addSince(ApplyMetrics::PHASE_ROLLBACK, start);
+
+    /* uncompressed as it is sent, it is in the ring already */
+    vector<KeaResponse> responses;
+    PushSource source(ctx, reader, NULL);
+    size_t succeeded = send_to_targets(ctx, "config-set", source, responses, trace,
+                                       ApplyMetrics::PHASE_ROLLBACK);
+    trace.count(ApplyMetrics::COUNTER_COMMANDS, responses.size());
+    trace.count(ApplyMetrics::COUNTER_BYTES, source.getSize() * responses.size());
+    trace.count(ApplyMetrics::COUNTER_ROLLBACKS);
+
+    /* targeted commands are made for Sysrepo's configuration, until it
+     * is pushed in full again they would not apply */
+    ctx->rolled_back = true;
+    if (reader.failed()) {
+        /* Kea got a truncated document, which it cannot have accepted */
+        ctx->fingerprint->clear();
+        error = "configuration generation " + to_string(info.generation) + " is corrupt";
+        cerr << "plugin-kea " << error << endl;
+        return SR_ERR_OPERATION_FAILED;
+    }
+    if (!ctx->targets->isAccepted(succeeded)) {
+        ctx->fingerprint->clear();
+        error = "rollback to generation " + to_string(info.generation) + " failed at " +
+                to_string(responses.size() - succeeded) + " of " +
+                to_string(responses.size()) + " instance(s): " +
+                ctx->targets->getFailures(responses);
+        cerr << "plugin-kea " << error << endl;
+        return SR_ERR_OPERATION_FAILED;
+    }
+    if (succeeded == responses.size()) {
+        ctx->fingerprint->commit(info.fingerprint);
+    } else {
+        ctx->fingerprint->clear();
+    }
+    cerr << "plugin-kea rolled back to configuration generation " << info.generation
+         << " in " << trace.get(ApplyMetrics::PHASE_ROLLBACK) / 1000 << " us" << endl;
+    return SR_ERR_OK;
+}
+
+/* sends a translation to Kea (must be called with ctx->lock held) */
+static int
+send_config(plugin_ctx_t *ctx, translation_t &tr, string &error,
+            ApplyMetrics::Trace &trace)
+{
+    /* after a rollback Kea needs the whole configuration again */
+    if (tr.targeted && !ctx->rolled_back && send_changes(ctx, tr.commands, trace)) {
+        update_stats_subnets(ctx);
+        return SR_ERR_OK;
+    }
+
+    /* the commands failed, the fragments are up to date already */
+    if (!tr.full) {
+        int rc = translate_full(ctx, tr, error, trace);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+    }
+
+    /* e.g. only untranslated leaves changed, or the same values were
+     * written back: Kea would reload for nothing */
+    if (ctx->fingerprint->matches(tr.fingerprint)) {
+        cerr << "plugin-kea configuration unchanged, config-set skipped" << endl;
+        trace.count(ApplyMetrics::COUNTER_SKIPPED);
+        ctx->rolled_back = false;
+        /* after a restart the statistics still need the subnet ids and
+         * the ring a configuration to roll back to */
+        update_stats_subnets(ctx);
+        if (ctx->snapshots->getCapacity() && !ctx->snapshots->isNewest(tr.fingerprint)) {
+            ConfigSnapshots::Builder snapshot;
+            SysrepoKea::ConfigStream stream(*ctx->translator);
+            const char *data;
+            size_t size;
+            while (stream.next(data, size)) {
+                snapshot.write(data, size);
+            }
+            if (stream.getError() == SR_ERR_OK && snapshot.finish()) {
+                ctx->snapshots->add(tr.fingerprint, snapshot);
+            }
+        }
+        return SR_ERR_OK;
+    }
+
+    /* assembled from the fragments as it is sent, the document is never
+     * held in memory as a whole, nor is its snapshot uncompressed */
+    vector<KeaResponse> responses;
+    SysrepoKea::ConfigStream stream(*ctx->translator);
+    ConfigSnapshots::Builder snapshot;
+    PushSource source(ctx, stream, ctx->snapshots->getCapacity() ? &snapshot : NULL);
+    size_t succeeded = send_to_targets(ctx, "config-set", source, responses, trace,
+                                       ApplyMetrics::PHASE_KEA);
+    trace.count(ApplyMetrics::COUNTER_COMMANDS, responses.size());
+    trace.count(ApplyMetrics::COUNTER_BYTES, source.getSize() * responses.size());
+    if (!ctx->targets->isAccepted(succeeded)) {
+        /* Kea may or may not have taken it when it did not answer */
+        ctx->fingerprint->clear();
+        error = "Kea config-set failed at " + to_string(responses.size() - succeeded) +
+                " of " + to_string(responses.size()) + " instance(s): " +
+                ctx->targets->getFailures(responses);
+        cerr << "plugin-kea " << error << endl;
+
+        /* instances that took it, or may have, are rolled back so that
+         * all run the last configuration accepted; when all of them
+         * rejected it they still do */
+        bool taken = succeeded > 0;
+        for (size_t i = 0; i < responses.size(); i++) {
+            if (KeaResponse::RESULT_NO_RESPONSE == responses[i].result) {
+                taken = true;
+            }
+        }
+        if (taken) {
+            ConfigSnapshots::Info info;
+            string rollback_error;
+            if (SR_ERR_OK == rollback_config(ctx, 0, info, rollback_error, trace)) {
+                error += "; rolled back to generation " + to_string(info.generation);
+            } else {
+                error += "; " + rollback_error;
+            }
+        }
+        return SR_ERR_OPERATION_FAILED;
+    }
+
+    ctx->rolled_back = false;
+    if (ctx->snapshots->getCapacity() && snapshot.finish()) {
+        ctx->snapshots->add(tr.fingerprint, snapshot);
+    }
+    if (succeeded == responses.size()) {
+        ctx->fingerprint->commit(tr.fingerprint);
+    } else {
+        /* the next push must reach the instances that missed this one */
+        cerr << "plugin-kea config-set accepted by a quorum of "
+             << succeeded << " of " << responses.size() << " instance(s)" << endl;
+        ctx->fingerprint->clear();
+    }
+    update_stats_subnets(ctx);
+    return SR_ERR_OK;
+}
+
+/* takes translator figures before some work */
+static void
+start_usage(plugin_ctx_t *ctx, usage_t &usage)
+{
+    usage.calls = ctx->translator->getSysrepoCalls();
+    usage.sysrepo_ns = ctx->translator->getSysrepoTime();
+}
+
+/* adds what the work since start_usage() took to the trace */
+static void
+add_usage(plugin_ctx_t *ctx, const usage_t &usage, ApplyMetrics::Trace &trace)
+{
+    trace.add(ApplyMetrics::PHASE_FETCH, ctx->translator->getSysrepoTime() - usage.sysrepo_ns);
+    trace.count(ApplyMetrics::COUNTER_SYSREPO_CALLS,
+                ctx->translator->getSysrepoCalls() - usage.calls);
+}
+
+/* forgets what the section callbacks did for an event */
+static void
+drop_sections(plugin_ctx_t *ctx)
+{
+    ctx->pending.sections = 0;
+    ctx->pending.collect_ns = 0;
+    ctx->pending.translate_ns = 0;
+}
+
+/* adds what the section callbacks did for the event to the trace
+ * returns false when none of them ran */
+static bool
+take_sections(plugin_ctx_t *ctx, ApplyMetrics::Trace &trace)
+{
+    section_work_t &work = ctx->pending;
+    if (!work.sections) {
+        return false;
+    }
+
+    string names;
+    for (size_t i = 0; i < SysrepoKea::SECTION_COUNT; i++) {
+        if (work.sections & (1u << i)) {
+            names += names.empty() ? "" : ", ";
+            names += SysrepoKea::getSectionName(static_cast<SysrepoKea::Section>(i));
+        }
+    }
+    cerr << "plugin-kea sections changed: " << names << endl;
+
+    add_usage(ctx, work.usage, trace);
+    trace.add(ApplyMetrics::PHASE_COLLECT, work.collect_ns);
+    if (work.translate_ns) {
+        trace.add(ApplyMetrics::PHASE_TRANSLATE, work.translate_ns);
+    }
+    drop_sections(ctx);
+    return true;
+}
+
+/* adds what the verify events of commits pushed in the background made
+ * to a translation, their commands go first (must be called with
+ * ctx->lock held) */
+static void
+take_deferred(plugin_ctx_t *ctx, translation_t &tr)
+{
+    deferred_t &deferred = ctx->deferred;
+    if (deferred.full) {
+        cerr << "plugin-kea verified commits need the whole configuration" << endl;
+        tr.targeted = false;
+    } else if (tr.targeted && !deferred.commands.empty()) {
+        tr.commands.insert(tr.commands.begin(), deferred.commands.begin(),
+                           deferred.commands.end());
+    }
+    deferred.commands.clear();
+    deferred.full = false;
+}
+
+/* retrieves current Kea configuration and sends it to Kea, recording
+ * the phases of the apply; a translation made by the verify event is
+ * sent as is (must be called with ctx->lock held) */
+static int
+retrieve_current_config(plugin_ctx_t *ctx, sr_session_ctx_t *session, string &error,
+                        ApplyMetrics::Trace &trace, translation_t *verified = NULL)
+{
+    usage_t usage;
+    translation_t tr;
+    int rc = SR_ERR_OK;
+
+    start_usage(ctx, usage);
+    if (!verified) {
+        verified = &tr;
+        rc = translate_config(ctx, session, tr, false, error, trace);
+    }
+    if (SR_ERR_OK == rc) {
+        take_deferred(ctx, *verified);
+        rc = send_config(ctx, *verified, error, trace);
+    }
+    add_usage(ctx, usage, trace);
+    ctx->metrics->record(trace, SR_ERR_OK == rc);
+    return rc;
+}
+
+/* forgets the translation of a verified commit, its fragments are the
+ * committed data now, or are dropped when it was aborted
+ * (must be called with ctx->lock held) */
+static void
+end_commit(plugin_ctx_t *ctx, bool aborted)
+{
+    if (!ctx->verified.valid) {
+        return;
+    }
+    if (aborted) {
+        ctx->translator->invalidate();
+    }
+    ctx->verified.valid = false;
+    ctx->verified.full = false;
+    ctx->verified.commands.clear();
+    ctx->committed.notify_all();
+}
+
+/* waits until no commit is between its verify and apply events, so
+ * that changes that may still be aborted are never pushed */
+static void
+wait_for_commit(plugin_ctx_t *ctx, std::unique_lock<std::mutex> &lock)
+{
+    if (!ctx->committed.wait_for(lock, chrono::milliseconds(VERIFY_TIMEOUT),
+                                 [ctx] { return !ctx->verified.valid; })) {
+        cerr << "plugin-kea verified commit neither applied nor aborted" << endl;
+        end_commit(ctx, true);
+    }
+}
+
+/* returns true when commits are applied by a background thread, the
+ * change callbacks then only mark what changed */
+static bool
+applies_later(plugin_ctx_t *ctx)
+{
+    return ctx->coalescer || ctx->queue;
+}
+
+/* leaves the apply of a commit to a background push, keeping what the
+ * verify event translated for it (must be called with ctx->lock held) */
+static void
+defer_apply(plugin_ctx_t *ctx, const ApplyMetrics::Trace &trace)
+{
+    translation_t &tr = ctx->verified;
+    if (tr.valid && ctx->diff) {
+        if (tr.targeted) {
+            ctx->deferred.commands.insert(ctx->deferred.commands.end(),
+                                          tr.commands.begin(), tr.commands.end());
+        } else {
+            ctx->deferred.full = true;
+        }
+    }
+    end_commit(ctx, false);
+    ctx->metrics->record(ApplyMetrics::PHASE_COLLECT, trace.get(ApplyMetrics::PHASE_COLLECT));
+}
+
+/* reports how an apply made in the background went, there is no change
+ * callback to return the error to (must be called with ctx->lock held,
+ * which keeps the plugin session to one thread) */
+static void
+notify_apply(plugin_ctx_t *ctx, int result, size_t commits, const string &error,
+             const ApplyMetrics::Trace &trace, const uint64_t *wait_ns = NULL)
+{
+    const size_t count = 5;
+    sr_val_t *v = NULL;
+    size_t i = 0;
+
+    int rc = sr_new_values(count, &v);
+    if (SR_ERR_OK == rc) {
+        string leaf = string(APPLY_DONE_XPATH) + "/";
+        sr_val_set_xpath(&v[i], (leaf + "result").c_str());
+        sr_val_set_str_data(&v[i++], SR_ENUM_T, SR_ERR_OK == result ? "success" : "failure");
+        sr_val_set_xpath(&v[i], (leaf + "commits").c_str());
+        v[i].type = SR_UINT32_T;
+        v[i++].data.uint32_val = commits;
+        /* coalesced commits wait for the window, not for a queue */
+        if (wait_ns) {
+            sr_val_set_xpath(&v[i], (leaf + "wait-us").c_str());
+            v[i].type = SR_UINT64_T;
+            v[i++].data.uint64_val = *wait_ns / 1000;
+        }
+        sr_val_set_xpath(&v[i], (leaf + "duration-us").c_str());
+        v[i].type = SR_UINT64_T;
+        v[i++].data.uint64_val = trace.get(ApplyMetrics::PHASE_TOTAL) / 1000;
+        if (SR_ERR_OK != result) {
+            sr_val_set_xpath(&v[i], (leaf + "error-message").c_str());
+            sr_val_set_str_data(&v[i++], SR_STRING_T, error.c_str());
+        }
+        rc = sr_event_notif_send(ctx->session, APPLY_DONE_XPATH, v, i, SR_EV_NOTIF_DEFAULT);
+        sr_free_values(v, count);
+    }
+    if (SR_ERR_OK != rc) {
+        cerr << "plugin-kea failed to send apply-done notification: " << sr_strerror(rc) << endl;
+    }
+}
+
+/* pushes the configuration on behalf of several coalesced commits
+ * (called from the coalescer thread) */
 static void
-retrieve_current_config(sr_session_ctx_t *session)
+coalesced_push(plugin_ctx_t *ctx, size_t commits)
 {
-    SysrepoKea interface(session);
+    std::unique_lock<std::mutex> lock(ctx->lock);
+    ApplyMetrics::Trace trace;
+    string error;
 
-    string json = interface.getConfig();
+    wait_for_commit(ctx, lock);
+    cerr << "plugin-kea push #" << ctx->coalescer->getPushes() + 1
+         << " covers " << commits << " commit(s), "
+         << ctx->coalescer->getCommits() << " commit(s) in total" << endl;
 
-    std::ofstream fs;
-    fs.open(CFG_TEMP_FILE.c_str(), std::ofstream::out);
-    fs << json;
-    fs.close();
+    int rc = retrieve_current_config(ctx, ctx->session, error, trace);
+    if (SR_ERR_OK != rc) {
+        cerr << "plugin-kea coalesced push failed: " << error << endl;
+    }
+    notify_apply(ctx, rc, commits, error, trace);
+}
+
+/* pushes the configuration on behalf of the commits queued since the
+ * last push (called from the queue worker) */
+static void
+queued_push(plugin_ctx_t *ctx, const ApplyQueue::Batch &batch)
+{
+    std::unique_lock<std::mutex> lock(ctx->lock);
+    ApplyMetrics::Trace trace;
+    string error;
 
-    string cmd = KEA_CONTROL_CLIENT + " " + KEA_CONTROL_SOCKET + " " + CFG_TEMP_FILE;
+    wait_for_commit(ctx, lock);
+    if (batch.count > 1) {
+        cerr << "plugin-kea push covers queued commits #" << batch.first
+             << " to #" << batch.last << endl;
+    }
+
+    int rc = retrieve_current_config(ctx, ctx->session, error, trace);
+    if (SR_ERR_OK != rc) {
+        cerr << "plugin-kea queued push failed: " << error << endl;
+    }
+    notify_apply(ctx, rc, batch.count, error, trace, &batch.wait_ns);
+}
+
+/* pushes the configuration when the plugin starts, unless Kea already
+ * has it (called from the startup thread) */
+static void
+startup_push(plugin_ctx_t *ctx)
+{
+    std::unique_lock<std::mutex> lock(ctx->lock);
+    ApplyMetrics::Trace trace;
+    string error;
+
+    wait_for_commit(ctx, lock);
+    /* a commit may have been pushed meanwhile, then the file holds it */
+    if (ctx->fingerprint->load()) {
+        cerr << "plugin-kea fingerprint of the configuration Kea accepted last: "
+             << hex << ctx->fingerprint->get() << dec << endl;
+    }
+
+    /* Kea may not be running yet, the next commit will push the config */
+    if (SR_ERR_OK != retrieve_current_config(ctx, ctx->session, error, trace)) {
+        cerr << "plugin-kea startup push failed: " << error << endl;
+        return;
+    }
+    cerr << "plugin-kea startup push done in "
+         << trace.get(ApplyMetrics::PHASE_TOTAL) / 1000000 << " ms" << endl;
+}
+
+/* translates the changes of a commit and has Kea test the result, so
+ * that configurations Kea rejects are not committed; the translation is
+ * kept for the apply event (must be called with ctx->lock held) */
+static int
+verify_config(plugin_ctx_t *ctx, sr_session_ctx_t *session, string &error)
+{
+    translation_t &tr = ctx->verified;
+    ApplyMetrics::Trace trace;
+    usage_t usage;
+    bool sections = take_sections(ctx, trace);
 
-    system (cmd.c_str());
+    /* the apply or abort of the previous commit never came (checked by
+     * the section callbacks already, when some ran) */
+    if (!sections) {
+        end_commit(ctx, true);
+    }
 
-    // remove(CFG_TEMP_FILE.c_str());
+    ApplyMetrics::Clock::time_point start = ApplyMetrics::Clock::now();
+    int rc;
+    if (sections) {
+        /* they marked (and regenerated) what the commit changes */
+        rc = ctx->translator->getChangesDigest(session, tr.changes);
+    } else {
+        rc = ctx->translator->collectChanges(session, &tr.changes);
+    }
+    trace.addSince(ApplyMetrics::PHASE_COLLECT, start);
+    start_usage(ctx, usage);
+    if (SR_ERR_OK == rc) {
+        /* the threads' sessions don't see the changes yet */
+        ctx->translator->setThreadsEnabled(false);
+        rc = translate_config(ctx, session, tr, true, error, trace);
+        ctx->translator->setThreadsEnabled(true);
+    }
+    if (SR_ERR_OK != rc) {
+        add_usage(ctx, usage, trace);
+        ctx->metrics->recordVerify(trace, false);
+        end_commit(ctx, true);
+        ctx->translator->invalidate();
+        return rc;
+    }
+    tr.valid = true;
 
-    std::cout << json << std::endl;
+    /* nothing for Kea to check */
+    if ((tr.targeted && tr.commands.empty()) || ctx->fingerprint->matches(tr.fingerprint)) {
+        add_usage(ctx, usage, trace);
+        ctx->metrics->recordVerify(trace, true);
+        return SR_ERR_OK;
+    }
 
+    vector<KeaResponse> responses;
+    SysrepoKea::ConfigStream stream(*ctx->translator);
+    size_t succeeded = send_to_targets(ctx, "config-test", stream, responses, trace,
+                                       ApplyMetrics::PHASE_TEST);
+    add_usage(ctx, usage, trace);
+    /* instances that may not be running do not hold the commit up */
+    size_t unanswered = 0;
+    for (size_t i = 0; i < responses.size(); i++) {
+        if (KeaResponse::RESULT_NO_RESPONSE == responses[i].result) {
+            unanswered++;
+        }
+    }
+    if (unanswered) {
+        cerr << "plugin-kea config-test not answered by " << unanswered << " of "
+             << responses.size() << " instance(s), not checked there" << endl;
+    }
+    if (!ctx->targets->isAccepted(succeeded + unanswered)) {
+        error = "Kea config-test failed: " + ctx->targets->getFailures(responses);
+        cerr << "plugin-kea " << error << endl;
+        ctx->metrics->recordVerify(trace, false);
+        end_commit(ctx, true);
+        return SR_ERR_VALIDATION_FAILED;
+    }
+    ctx->metrics->recordVerify(trace, true);
+    return SR_ERR_OK;
+}
+
+/* recomputes the section of the model a subscription is for: marks
+ * the fragments its changes affect and regenerates them, leaving the
+ * other sections alone; module_change_cb, called after the callbacks of
+ * all sections a commit touches, assembles and pushes the result */
+static int
+section_change_cb(sr_session_ctx_t *session, const char *xpath, sr_notif_event_t event,
+                  void *private_ctx)
+{
+    section_ctx_t *section = (section_ctx_t *) private_ctx;
+    plugin_ctx_t *ctx = section->plugin;
+
+    std::lock_guard<std::mutex> lock(ctx->lock);
+
+    if (SR_EV_ABORT == event) {
+        end_commit(ctx, true);
+        drop_sections(ctx);
+        return SR_ERR_OK;
+    }
+
+    /* the fragment cache must only ever see committed data, or data of
+     * a commit being verified (dropped if it is aborted) */
+    if (SR_EV_VERIFY == event ? !ctx->verify : SR_EV_APPLY != event) {
+        return SR_ERR_OK;
+    }
+    /* the verify event made the translation of the commit already, the
+     * module callback checks that it is the same commit */
+    if (SR_EV_APPLY == event && ctx->verified.valid) {
+        return SR_ERR_OK;
+    }
+
+    if (!ctx->pending.sections) {
+        if (SR_EV_VERIFY == event) {
+            /* the apply or abort of the previous commit never came */
+            end_commit(ctx, true);
+            /* pushes wait until the commit is applied or aborted */
+            ctx->verified.valid = true;
+        }
+        start_usage(ctx, ctx->pending.usage);
+    }
+    ctx->pending.sections |= 1u << section->section;
+    ctx->translator->setSession(session);
+
+    ApplyMetrics::Clock::time_point start = ApplyMetrics::Clock::now();
+    int rc = ctx->translator->collectChanges(session, section->section);
+    ctx->pending.collect_ns += chrono::duration_cast<chrono::nanoseconds>(
+        ApplyMetrics::Clock::now() - start).count();
+
+    /* targeted commands are made from the fragments Kea has, and
+     * commits applied in the background are translated there */
+    if (SR_ERR_OK == rc && !ctx->diff && (SR_EV_VERIFY == event || !applies_later(ctx))) {
+        start = ApplyMetrics::Clock::now();
+        rc = ctx->translator->updateSection(section->section);
+        ctx->pending.translate_ns += chrono::duration_cast<chrono::nanoseconds>(
+            ApplyMetrics::Clock::now() - start).count();
+    }
+    if (SR_ERR_OK != rc) {
+        /* the module callback translates the whole model then */
+        cerr << "plugin-kea failed to translate " << xpath << endl;
+    }
+    return SR_ERR_OK;
 }
 
 static int
 module_change_cb(sr_session_ctx_t *session, const char *module_name, sr_notif_event_t event,
                  void *private_ctx)
 {
+    plugin_ctx_t *ctx = (plugin_ctx_t *) private_ctx;
+    string error;
+    int rc = SR_ERR_OK;
+
+    std::lock_guard<std::mutex> lock(ctx->lock);
+
+    if (SR_EV_VERIFY == event) {
+        if (ctx->verify) {
+            rc = verify_config(ctx, session, error);
+        }
+        if (SR_ERR_OK != rc) {
+            sr_set_error(session, error.c_str(), NULL);
+        }
+        return rc;
+    }
+
+    if (SR_EV_ABORT == event) {
+        if (ctx->verified.valid) {
+            cerr << "plugin-kea commit aborted, dropping its translation" << endl;
+        }
+        end_commit(ctx, true);
+        drop_sections(ctx);
+        return SR_ERR_OK;
+    }
+
+    /* the fragment cache must only ever see committed data */
+    if (SR_EV_APPLY != event) {
+        return SR_ERR_OK;
+    }
+
     cerr << "plugin-kea configuration has changed" << endl;
-    retrieve_current_config(session);
 
+    ApplyMetrics::Trace trace;
+    bool sections = take_sections(ctx, trace);
+    ApplyMetrics::Clock::time_point start = ApplyMetrics::Clock::now();
+    if (ctx->verified.valid) {
+        /* the translation was made for this commit, unless some
+         * verify event did not reach the plugin */
+        uint64_t changes = 0;
+        rc = ctx->translator->getChangesDigest(session, changes);
+        if (SR_ERR_OK != rc || changes != ctx->verified.changes) {
+            cerr << "plugin-kea changes differ from the verified ones" << endl;
+            end_commit(ctx, true);
+        }
+    }
+    if (!ctx->verified.valid && !sections) {
+        /* no section callback saw the changes */
+        ctx->translator->collectChanges(session);
+    }
+    trace.addSince(ApplyMetrics::PHASE_COLLECT, start);
+
+    if (ctx->coalescer) {
+        /* the apply comes later and covers other commits as well, the
+         * fragments of a verified commit are up to date already */
+        defer_apply(ctx, trace);
+        ctx->coalescer->commit();
+        return SR_ERR_OK;
+    }
+
+    if (ctx->queue) {
+        /* the worker pushes what Sysrepo has by then, unless Kea lags
+         * so far behind that the queue is full */
+        if (ctx->queue->push()) {
+            defer_apply(ctx, trace);
+            return SR_ERR_OK;
+        }
+        cerr << "plugin-kea apply queue full, pushing from the callback" << endl;
+    }
+
+    rc = retrieve_current_config(ctx, session, error, trace,
+                                 ctx->verified.valid ? &ctx->verified : NULL);
+    end_commit(ctx, false);
+    if (SR_ERR_OK != rc) {
+        sr_set_error(session, error.c_str(), NULL);
+    }
+    return rc;
+}
+
+/* sets a statistics leaf */
+static void
+set_stat_value(sr_val_t *value, const string &xpath, int64_t number)
+{
+    sr_val_set_xpath(value, xpath.c_str());
+    value->type = SR_UINT64_T;
+    value->data.uint64_val = number < 0 ? 0 : number;
+}
+
+/* provides the statistics container and the subnet6 list in it */
+static int
+stats_get_items_cb(const char *xpath, sr_val_t **values, size_t *values_cnt,
+                   uint64_t request_id, const char *original_xpath, void *private_ctx)
+{
+    plugin_ctx_t *ctx = (plugin_ctx_t *) private_ctx;
+    std::shared_ptr<const KeaStats> stats = ctx->stats->get();
+    sr_val_t *v = NULL;
+    size_t count = 0;
+    size_t i = 0;
+    int rc;
+
+    *values = NULL;
+    *values_cnt = 0;
+    if (!stats) {
+        /* Kea has not answered yet, there is nothing to show */
+        return SR_ERR_OK;
+    }
+
+    if (!strcmp(xpath, STATS_XPATH)) {
+        count = stats->global.size();
+        if (!count) {
+            return SR_ERR_OK;
+        }
+        rc = sr_new_values(count, &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        for (KeaStats::Values::const_iterator it = stats->global.begin();
+             it != stats->global.end(); ++it) {
+            set_stat_value(&v[i++], string(STATS_XPATH) + "/" + it->first, it->second);
+        }
+
+    } else if (!strcmp(xpath, STATS_SUBNET_XPATH)) {
+        /* subnet-id, the prefix (if known) and the statistics */
+        vector<string> prefixes;
+        for (map<uint32_t, KeaStats::Values>::const_iterator s = stats->subnets.begin();
+             s != stats->subnets.end(); ++s) {
+            prefixes.push_back(ctx->stats->getSubnet(s->first));
+            count += 1 + (prefixes.back().empty() ? 0 : 1) + s->second.size();
+        }
+        if (!count) {
+            return SR_ERR_OK;
+        }
+        rc = sr_new_values(count, &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        size_t subnet = 0;
+        for (map<uint32_t, KeaStats::Values>::const_iterator s = stats->subnets.begin();
+             s != stats->subnets.end(); ++s, ++subnet) {
+            ostringstream entry;
+            entry << STATS_SUBNET_XPATH << "[subnet-id='" << s->first << "']";
+            sr_val_set_xpath(&v[i], (entry.str() + "/subnet-id").c_str());
+            v[i].type = SR_UINT32_T;
+            v[i++].data.uint32_val = s->first;
+            if (!prefixes[subnet].empty()) {
+                sr_val_set_xpath(&v[i], (entry.str() + "/subnet").c_str());
+                sr_val_set_str_data(&v[i++], SR_STRING_T, prefixes[subnet].c_str());
+            }
+            for (KeaStats::Values::const_iterator it = s->second.begin();
+                 it != s->second.end(); ++it) {
+                set_stat_value(&v[i++], entry.str() + "/" + it->first, it->second);
+            }
+        }
+    }
+
+    *values = v;
+    *values_cnt = count;
+    return SR_ERR_OK;
+}
+
+/* provides the lease6 list, asking Kea only for the leases the
+ * predicates of the requested xpath select */
+static int
+leases_get_items_cb(const char *xpath, sr_val_t **values, size_t *values_cnt,
+                    uint64_t request_id, const char *original_xpath, void *private_ctx)
+{
+    plugin_ctx_t *ctx = (plugin_ctx_t *) private_ctx;
+
+    *values = NULL;
+    *values_cnt = 0;
+    if (strcmp(xpath, LEASES_LIST_XPATH)) {
+        /* the leases container has no leaves of its own */
+        return SR_ERR_OK;
+    }
+
+    LeaseQuery query;
+    query.parse(original_xpath ? original_xpath : xpath);
+    if (query.has_subnet && !ctx->stats->isDelegating(query.subnet_id)) {
+        /* the subnet's address range is all that needs reading; delegated
+         * prefixes come from prefix pools outside of it, so subnets with
+         * prefix pools are filtered from all leases */
+        query.prefix = ctx->stats->getSubnet(query.subnet_id);
+    }
+
+    /* the first instance, as for the statistics; a connection of its own,
+     * gets may run in parallel with pushes */
+    KeaControlChannel kea(ctx->targets->getSocketPath(0));
+    kea.setTimeout(STATS_TIMEOUT);
+    KeaLeasePager pager(kea, ctx->lease_page);
+    bool truncated = false;
+    string error;
+    int rc = getLeaseValues(pager, query, LEASES_LIST_XPATH, ctx->lease_limit,
+                            values, values_cnt, truncated, error);
+    if (!error.empty()) {
+        cerr << "plugin-kea " << error << endl;
+    }
+    if (truncated) {
+        cerr << "plugin-kea lease view limited to " << ctx->lease_limit
+             << " leases (" << ENV_LEASE_LIMIT << ")" << endl;
+    }
+    return rc;
+}
+
+/* provides the apply-metrics container and the lists in it */
+static int
+metrics_get_items_cb(const char *xpath, sr_val_t **values, size_t *values_cnt,
+                     uint64_t request_id, const char *original_xpath, void *private_ctx)
+{
+    plugin_ctx_t *ctx = (plugin_ctx_t *) private_ctx;
+    const ApplyMetrics *metrics = ctx->metrics;
+    sr_val_t *v = NULL;
+    size_t i = 0;
+    int rc;
+
+    *values = NULL;
+    *values_cnt = 0;
+
+    /* no locking, the metrics are read with atomic loads and the
+     * instances' results are copied under their own lock */
+    if (!strcmp(xpath, METRICS_XPATH)) {
+        rc = sr_new_values(1 + ApplyMetrics::COUNTER_COUNT, &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        sr_val_set_xpath(&v[i], (string(METRICS_XPATH) + "/tracing").c_str());
+        v[i].type = SR_BOOL_T;
+        v[i++].data.bool_val = metrics->isTracing();
+        for (int c = 0; c < ApplyMetrics::COUNTER_COUNT; c++) {
+            ApplyMetrics::Counter counter = static_cast<ApplyMetrics::Counter>(c);
+            set_stat_value(&v[i++], string(METRICS_XPATH) + "/" +
+                           ApplyMetrics::getCounterName(counter),
+                           metrics->getCounter(counter));
+        }
+
+    } else if (!strcmp(xpath, METRICS_PHASE_XPATH)) {
+        rc = sr_new_values(6 * ApplyMetrics::PHASE_COUNT, &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        for (int p = 0; p < ApplyMetrics::PHASE_COUNT; p++) {
+            ApplyMetrics::Phase phase = static_cast<ApplyMetrics::Phase>(p);
+            LatencyHistogram::Snapshot s = metrics->getPhase(phase);
+            string entry = string(METRICS_PHASE_XPATH) + "[name='" +
+                ApplyMetrics::getPhaseName(phase) + "']/";
+            sr_val_set_xpath(&v[i], (entry + "name").c_str());
+            sr_val_set_str_data(&v[i++], SR_STRING_T, ApplyMetrics::getPhaseName(phase));
+            set_stat_value(&v[i++], entry + "count", s.count);
+            set_stat_value(&v[i++], entry + "total-us", s.sum_ns / 1000);
+            set_stat_value(&v[i++], entry + "max-us", s.max_ns / 1000);
+            set_stat_value(&v[i++], entry + "p50-us", s.quantile(0.5));
+            set_stat_value(&v[i++], entry + "p99-us", s.quantile(0.99));
+        }
+
+    } else if (!strcmp(xpath, METRICS_TARGET_XPATH)) {
+        vector<KeaFanout::TargetStatus> targets = ctx->targets->getStatus();
+        rc = sr_new_values(7 * targets.size(), &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        for (size_t t = 0; t < targets.size(); t++) {
+            const KeaFanout::TargetStatus &target = targets[t];
+            string entry = string(METRICS_TARGET_XPATH) + "[socket='" +
+                target.socket_path + "']/";
+            sr_val_set_xpath(&v[i], (entry + "socket").c_str());
+            sr_val_set_str_data(&v[i++], SR_STRING_T, target.socket_path.c_str());
+            /* nothing was sent there yet */
+            if (!target.command.empty()) {
+                sr_val_set_xpath(&v[i], (entry + "command").c_str());
+                sr_val_set_str_data(&v[i++], SR_STRING_T, target.command.c_str());
+                sr_val_set_xpath(&v[i], (entry + "result").c_str());
+                v[i].type = SR_INT32_T;
+                v[i++].data.int32_val = target.result;
+                sr_val_set_xpath(&v[i], (entry + "text").c_str());
+                sr_val_set_str_data(&v[i++], SR_STRING_T, target.text.c_str());
+            }
+            set_stat_value(&v[i++], entry + "latency-us", target.latency_us);
+            set_stat_value(&v[i++], entry + "successes", target.successes);
+            set_stat_value(&v[i++], entry + "failures", target.failures);
+        }
+
+    } else if (!strcmp(xpath, METRICS_QUEUE_XPATH)) {
+        const ApplyQueue *queue = ctx->queue;
+        if (!queue) {
+            return SR_ERR_OK;
+        }
+        rc = sr_new_values(11, &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        string leaf = string(METRICS_QUEUE_XPATH) + "/";
+        LatencyHistogram::Snapshot wait = queue->getWait();
+        set_stat_value(&v[i++], leaf + "capacity", queue->getCapacity());
+        set_stat_value(&v[i++], leaf + "depth", queue->getDepth());
+        set_stat_value(&v[i++], leaf + "max-depth", queue->getMaxDepth());
+        set_stat_value(&v[i++], leaf + "queued", queue->getQueued());
+        set_stat_value(&v[i++], leaf + "applied", queue->getApplied());
+        set_stat_value(&v[i++], leaf + "pushes", queue->getBatches());
+        set_stat_value(&v[i++], leaf + "overflows", queue->getOverflows());
+        set_stat_value(&v[i++], leaf + "wait-total-us", wait.sum_ns / 1000);
+        set_stat_value(&v[i++], leaf + "wait-max-us", wait.max_ns / 1000);
+        set_stat_value(&v[i++], leaf + "wait-p50-us", wait.quantile(0.5));
+        set_stat_value(&v[i++], leaf + "wait-p99-us", wait.quantile(0.99));
+
+    } else if (!strcmp(xpath, METRICS_COALESCER_XPATH)) {
+        const CommitCoalescer *coalescer = ctx->coalescer;
+        if (!coalescer) {
+            return SR_ERR_OK;
+        }
+        rc = sr_new_values(4, &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        string leaf = string(METRICS_COALESCER_XPATH) + "/";
+        set_stat_value(&v[i++], leaf + "commits", coalescer->getCommits());
+        set_stat_value(&v[i++], leaf + "pushes", coalescer->getPushes());
+        set_stat_value(&v[i++], leaf + "last-batch", coalescer->getLastBatch());
+        set_stat_value(&v[i++], leaf + "max-batch", coalescer->getMaxBatch());
+
+    } else if (!strcmp(xpath, METRICS_SNAPSHOT_XPATH)) {
+        vector<ConfigSnapshots::Info> snapshots = ctx->snapshots->list();
+        if (snapshots.empty()) {
+            return SR_ERR_OK;
+        }
+        rc = sr_new_values(5 * snapshots.size(), &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        for (size_t n = 0; n < snapshots.size(); n++) {
+            const ConfigSnapshots::Info &snapshot = snapshots[n];
+            string entry = string(METRICS_SNAPSHOT_XPATH) + "[generation='" +
+                to_string(snapshot.generation) + "']/";
+            set_stat_value(&v[i++], entry + "generation", snapshot.generation);
+            char text[32];
+            snprintf(text, sizeof(text), "%016llx",
+                     static_cast<unsigned long long>(snapshot.fingerprint));
+            sr_val_set_xpath(&v[i], (entry + "fingerprint").c_str());
+            sr_val_set_str_data(&v[i++], SR_STRING_T, text);
+            struct tm created;
+            gmtime_r(&snapshot.created, &created);
+            strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &created);
+            sr_val_set_xpath(&v[i], (entry + "created").c_str());
+            sr_val_set_str_data(&v[i++], SR_STRING_T, text);
+            set_stat_value(&v[i++], entry + "size", snapshot.size);
+            set_stat_value(&v[i++], entry + "compressed-size", snapshot.compressed_size);
+        }
+
+    } else {
+        return SR_ERR_OK;
+    }
+
+    *values = v;
+    *values_cnt = i;
+    return SR_ERR_OK;
+}
+
+/* turns logging of every apply on or off */
+static int
+tracing_rpc_cb(const char *xpath, const sr_val_t *input, const size_t input_cnt,
+               sr_val_t **output, size_t *output_cnt, void *private_ctx)
+{
+    plugin_ctx_t *ctx = (plugin_ctx_t *) private_ctx;
+    string enabled = string(TRACING_RPC_XPATH) + "/enabled";
+
+    *output = NULL;
+    *output_cnt = 0;
+    for (size_t i = 0; i < input_cnt; i++) {
+        if (SR_BOOL_T == input[i].type && enabled == input[i].xpath) {
+            ctx->metrics->setTracing(input[i].data.bool_val);
+            ctx->metrics->writeFile();
+            cerr << "plugin-kea tracing " << (input[i].data.bool_val ? "on" : "off") << endl;
+            return SR_ERR_OK;
+        }
+    }
+    return SR_ERR_INVAL_ARG;
+}
+
+/* rolls Kea back to a configuration it accepted before, the last one
+ * unless a generation is given */
+static int
+rollback_rpc_cb(const char *xpath, const sr_val_t *input, const size_t input_cnt,
+                sr_val_t **output, size_t *output_cnt, void *private_ctx)
+{
+    plugin_ctx_t *ctx = (plugin_ctx_t *) private_ctx;
+    string generation_xpath = string(ROLLBACK_RPC_XPATH) + "/generation";
+    uint64_t generation = 0;
+
+    *output = NULL;
+    *output_cnt = 0;
+    for (size_t i = 0; i < input_cnt; i++) {
+        if (SR_UINT64_T == input[i].type && generation_xpath == input[i].xpath) {
+            generation = input[i].data.uint64_val;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(ctx->lock);
+    ApplyMetrics::Trace trace;
+    ConfigSnapshots::Info info;
+    string error;
+
+    wait_for_commit(ctx, lock);
+    int rc = rollback_config(ctx, generation, info, error, trace);
+    ctx->metrics->recordRollback(trace, SR_ERR_OK == rc);
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+
+    rc = sr_new_values(1, output);
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+    sr_val_set_xpath(*output, (string(ROLLBACK_RPC_XPATH) + "/generation").c_str());
+    (*output)->type = SR_UINT64_T;
+    (*output)->data.uint64_val = info.generation;
+    *output_cnt = 1;
     return SR_ERR_OK;
 }
 
 int
 sr_plugin_init_cb(sr_session_ctx_t *session, void **private_ctx)
 {
-    sr_subscription_ctx_t *subscription = NULL;
+    plugin_ctx_t *ctx = new plugin_ctx_t();
     int rc = SR_ERR_OK;
+    long window = env_long(ENV_COALESCE_WINDOW, DEFAULT_COALESCE_WINDOW);
+    long max_latency = env_long(ENV_COALESCE_MAX_LATENCY, DEFAULT_COALESCE_MAX_LATENCY);
+    long threads = env_long(ENV_THREADS, DEFAULT_THREADS);
+    long stats_ttl = env_long(ENV_STATS_TTL, DEFAULT_STATS_TTL);
+    const char *mode = getenv(ENV_APPLY_MODE);
+    const char *last_config = getenv(ENV_LAST_CONFIG_FILE);
+    const char *sockets = getenv(ENV_SOCKETS);
+    const char *policy_name = getenv(ENV_POLICY);
+    long timeout = env_long(ENV_TIMEOUT, KeaControlChannel::DEFAULT_TIMEOUT);
+    long snapshots = env_long(ENV_SNAPSHOTS, ConfigSnapshots::DEFAULT_CAPACITY);
+    long queue = env_long(ENV_APPLY_QUEUE, DEFAULT_APPLY_QUEUE);
+    bool subnet_cache = env_long(ENV_SUBNET_CACHE, 1) > 0;
+    KeaFanout::Policy policy = KeaFanout::POLICY_ALL;
+    vector<string> targets;
+
+    ctx->session = session;
+    ctx->connection = NULL;
+    ctx->subscription = NULL;
+    ctx->translator = new SysrepoKea(session);
+    if (sockets) {
+        targets = KeaFanout::parseTargets(sockets);
+    }
+    if (targets.empty()) {
+        targets.push_back(KEA_CONTROL_SOCKET);
+    }
+    if (policy_name && *policy_name && !KeaFanout::parsePolicy(policy_name, policy)) {
+        cerr << "plugin-kea ignoring invalid " << ENV_POLICY << "=" << policy_name << endl;
+    }
+    ctx->targets = new KeaFanout(targets, policy);
+    ctx->targets->setTimeout(timeout);
+    if (targets.size() > 1) {
+        cerr << "plugin-kea pushing to " << targets.size() << " Kea instances, policy "
+             << ctx->targets->getPolicyName() << endl;
+    }
+    ctx->coalescer = NULL;
+    ctx->queue = NULL;
+    ctx->stats = new KeaStatsCache(targets[0], stats_ttl, STATS_TIMEOUT);
+    ctx->lease_page = env_long(ENV_LEASE_PAGE, KeaLeasePager::DEFAULT_PAGE_SIZE);
+    ctx->lease_limit = env_long(ENV_LEASE_LIMIT, DEFAULT_LEASE_LIMIT);
+    ctx->metrics = new ApplyMetrics(getenv(ENV_METRICS_FILE) ? getenv(ENV_METRICS_FILE) : "");
+    ctx->metrics->setTracing(env_long(ENV_TRACE, 0) > 0);
+    ctx->fingerprint = new ConfigFingerprint(last_config ? last_config : KEA_LAST_CONFIG_FILE);
+    ctx->snapshots = new ConfigSnapshots(snapshots);
+    ctx->rolled_back = false;
+    ctx->diff = false;
+    ctx->verify = env_long(ENV_VERIFY, 1) > 0;
+    ctx->dump = env_long(ENV_DUMP, 0) > 0;
+    ctx->verified.valid = false;
+    ctx->verified.full = false;
+    ctx->deferred.full = false;
+    drop_sections(ctx);
+    if (mode && !strcmp(mode, "diff")) {
+        cerr << "plugin-kea applying changes with subnet and reservation commands" << endl;
+        ctx->diff = true;
+        ctx->translator->setTargeted(true);
+    } else if (mode && *mode && strcmp(mode, "full")) {
+        cerr << "plugin-kea ignoring invalid " << ENV_APPLY_MODE << "=" << mode << endl;
+    }
+    if (!subnet_cache && ctx->diff) {
+        cerr << "plugin-kea ignoring " << ENV_SUBNET_CACHE
+             << "=0, subnet and reservation commands need the subnet cache" << endl;
+    } else if (!subnet_cache) {
+        cerr << "plugin-kea rendering subnets as the configuration is sent" << endl;
+        ctx->translator->setSubnetCache(false);
+    }
+    if (window > 0) {
+        cerr << "plugin-kea coalescing commits within " << window
+             << " ms (at most " << max_latency << " ms)" << endl;
+        ctx->coalescer = new CommitCoalescer(window, max_latency,
+            [ctx](size_t commits) { coalesced_push(ctx, commits); });
+    }
+    if (queue > 0 && ctx->coalescer) {
+        cerr << "plugin-kea ignoring " << ENV_APPLY_QUEUE
+             << ", coalesced commits are pushed in the background already" << endl;
+    } else if (queue > 0) {
+        cerr << "plugin-kea pushing commits from a queue of " << queue << endl;
+        ctx->queue = new ApplyQueue(queue,
+            [ctx](const ApplyQueue::Batch &batch) { queued_push(ctx, batch); });
+    }
+    if (threads > 1) {
+        /* the translator reads what Kea should run */
+        rc = sr_connect("plugin-kea", SR_CONN_DEFAULT, &ctx->connection);
+        if (SR_ERR_OK == rc) {
+            rc = ctx->translator->setThreads(threads, ctx->connection, SR_DS_RUNNING);
+        }
+        if (SR_ERR_OK != rc) {
+            goto error;
+        }
+        cerr << "plugin-kea translating subnets with " << threads << " threads" << endl;
+    }
+
+    rc = sr_module_change_subscribe(session, "ietf-kea-dhcpv6", module_change_cb, ctx,
+                                    ASSEMBLER_PRIORITY, SR_SUBSCR_DEFAULT, &ctx->subscription);
+    if (SR_ERR_OK != rc) {
+        goto error;
+    }
+
+    for (size_t i = 0; i < SysrepoKea::SECTION_COUNT; i++) {
+        section_ctx_t *section = &ctx->sections[i];
+        section->plugin = ctx;
+        section->section = static_cast<SysrepoKea::Section>(i);
+        rc = sr_subtree_change_subscribe(session,
+                                         ctx->translator->getSectionXPath(section->section).c_str(),
+                                         section_change_cb, section, SECTION_PRIORITY,
+                                         SR_SUBSCR_CTX_REUSE, &ctx->subscription);
+        if (SR_ERR_OK != rc) {
+            goto error;
+        }
+    }
 
-    rc = sr_module_change_subscribe(session, "ietf-kea-dhcpv6", module_change_cb, NULL,
-                                  0, SR_SUBSCR_DEFAULT, &subscription);
-    //rc = sr_subtree_change_subscribe(session, "/ietf-kea-dhcpv6:server/*", module_change_cb, NULL,
-    //                            0, SR_SUBSCR_DEFAULT, &subscription);
+    rc = sr_dp_get_items_subscribe(session, STATS_XPATH, stats_get_items_cb, ctx,
+                                   SR_SUBSCR_CTX_REUSE, &ctx->subscription);
+    if (SR_ERR_OK != rc) {
+        goto error;
+    }
+
+    rc = sr_dp_get_items_subscribe(session, LEASES_XPATH, leases_get_items_cb, ctx,
+                                   SR_SUBSCR_CTX_REUSE, &ctx->subscription);
+    if (SR_ERR_OK != rc) {
+        goto error;
+    }
+
+    rc = sr_dp_get_items_subscribe(session, METRICS_XPATH, metrics_get_items_cb, ctx,
+                                   SR_SUBSCR_CTX_REUSE, &ctx->subscription);
+    if (SR_ERR_OK != rc) {
+        goto error;
+    }
+
+    rc = sr_rpc_subscribe(session, TRACING_RPC_XPATH, tracing_rpc_cb, ctx,
+                          SR_SUBSCR_CTX_REUSE, &ctx->subscription);
+    if (SR_ERR_OK != rc) {
+        goto error;
+    }
+
+    rc = sr_rpc_subscribe(session, ROLLBACK_RPC_XPATH, rollback_rpc_cb, ctx,
+                          SR_SUBSCR_CTX_REUSE, &ctx->subscription);
     if (SR_ERR_OK != rc) {
         goto error;
     }
 
     cerr << "plugin-kea initialized successfully" << endl;
 
-    retrieve_current_config(session);
+    /* sysrepo-plugind goes on with other plugins meanwhile */
+    ctx->startup = std::thread(startup_push, ctx);
 
-    /* set subscription as our private context */
-    *private_ctx = subscription;
+    /* set plugin state as our private context */
+    *private_ctx = ctx;
 
     return SR_ERR_OK;
 
 error:
     cerr << "plugin-kea initialization failed: " << sr_strerror(rc) << endl;
-    sr_unsubscribe(session, subscription);
+    sr_unsubscribe(session, ctx->subscription);
+    delete ctx->coalescer;
+    delete ctx->queue;
+    delete ctx->stats;
+    delete ctx->targets;
+    delete ctx->metrics;
+    delete ctx->fingerprint;
+    delete ctx->snapshots;
+    delete ctx->translator;
+    if (ctx->connection) {
+        sr_disconnect(ctx->connection);
+    }
+    delete ctx;
     return rc;
 }
 
 void
-sr_plugin_cleanup_cb(sr_session_ctx_t *session, sr_subscription_ctx_t *private_ctx)
+sr_plugin_cleanup_cb(sr_session_ctx_t *session, void *private_ctx)
 {
-    /* subscription was set as our private context */
-    sr_unsubscribe(session, private_ctx);
+    plugin_ctx_t *ctx = (plugin_ctx_t *) private_ctx;
+
+    /* plugin state was set as our private context */
+    sr_unsubscribe(session, ctx->subscription);
+    ctx->startup.join();
+    /* pushes whatever is still pending, no commit gets queued any more */
+    if (ctx->queue) {
+        ctx->queue->drain();
+    }
+    delete ctx->coalescer;
+    delete ctx->queue;
+    delete ctx->stats;
+    delete ctx->targets;
+    delete ctx->metrics;
+    delete ctx->fingerprint;
+    delete ctx->snapshots;
+    delete ctx->translator;
+    if (ctx->connection) {
+        sr_disconnect(ctx->connection);
+    }
+    delete ctx;
 
     cout << "pluging-kea plugin cleanup finished" << endl;
 }
@@ -11,26 +11,191 @@
 /// Sysrepo implementation.
 
 #include "yang-kea.h"
+#include "kea-map.h"
 
-#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <thread>
 
 const char* SysrepoKea::DEFAULT_MODEL_NAME = "/ietf-kea-dhcpv6:server/";
 
 using namespace std;
 
-string
-tabs(int level) {
-    stringstream tmp;
-    const string indent("    ");
-    for (int i=0; i < level; i++) {
-        tmp << indent;
+namespace {
+
+/// Number of reserved hosts read from Sysrepo at once
+const size_t RESERVATION_BATCH = 1024;
+
+/// Number of subnets a translation thread takes at once
+const size_t SUBNET_CHUNK = 16;
+
+/// Number of subnets read from Sysrepo at once without the cache
+const size_t SUBNET_BATCH = 64;
+
+/// FNV-1a 64-bit offset basis
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+/// FNV-1a 64-bit prime
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+/// Kea names of DUID types 1 to 3
+const char* DUID_TYPES[] = { NULL, "LLT", "EN", "LL" };
+
+/// Names of the sections (in SysrepoKea::Section order)
+const char* SECTION_NAMES[] = {
+    "serv-attributes", "custom-options", "option-sets", "network-ranges",
+    "rsoo-enabled-options"
+};
+
+/// Schema nodes of the sections (in SysrepoKea::Section order)
+const uint16_t SECTION_NODES[] = {
+    KEA_NODE_SERV_ATTRIBUTES, KEA_NODE_CUSTOM_OPTIONS, KEA_NODE_OPTION_SETS,
+    KEA_NODE_NETWORK_RANGES, KEA_NODE_RSOO_ENABLED_OPTIONS
+};
+
+/// @brief Adds time the calling thread spends reading Sysrepo to a
+///        total, until the end of the scope.
+class SysrepoTimeCollector {
+public:
+    SysrepoTimeCollector(uint64_t& total)
+        :total_(total), start_(SysrepoTimer::getThreadTotal()) {
+    }
+
+    ~SysrepoTimeCollector() {
+        total_ += SysrepoTimer::getThreadTotal() - start_;
+    }
+
+private:
+    uint64_t& total_;   ///< total to add to
+    uint64_t start_;    ///< thread total at the start
+};
+
+/// @brief Returns hash of a host identifier.
+///
+/// Kea accepts DUIDs and hardware addresses with or without colons and
+/// in either case, so only the hex digits count (lowercased). This is
+/// 64-bit FNV-1a.
+uint64_t
+identifierHash(const string& id) {
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < id.size(); i++) {
+        if (id[i] == ':' || id[i] == '-') {
+            continue;
+        }
+        hash ^= static_cast<unsigned char>(tolower(id[i]));
+        hash *= FNV_PRIME;
+    }
+    return (hash);
+}
+
+/// @brief Returns the next hex digit of a host identifier (lowercased).
+///
+/// @param id identifier
+/// @param pos (in/out) where to look, set past the digit
+/// @return the digit, 0 at the end
+char
+identifierDigit(const string& id, size_t& pos) {
+    while (pos < id.size() && (id[pos] == ':' || id[pos] == '-')) {
+        pos++;
+    }
+    if (pos == id.size()) {
+        return (0);
+    }
+    return (tolower(id[pos++]));
+}
+
+/// @brief Returns the prefix of a subnet, the key of its subnet6 entry.
+///
+/// @param xpath xpath of the entry or of a node inside it
+/// @param prefix (out) the prefix
+/// @return false if the xpath has no subnet6 key
+bool
+subnetPrefix(const string& xpath, string& prefix) {
+    size_t begin = xpath.rfind("[subnet=");
+    if (begin == string::npos || begin + 9 >= xpath.size()) {
+        return (false);
+    }
+    begin += 9;
+    size_t end = xpath.find(xpath[begin - 1], begin);
+    if (end == string::npos) {
+        return (false);
+    }
+    prefix = xpath.substr(begin, end - begin);
+    return (true);
+}
+
+/// @brief Adds a text and a terminating zero to a FNV-1a hash.
+void
+hashAppend(uint64_t& hash, const string& text) {
+    for (size_t i = 0; i <= text.size(); i++) {
+        hash ^= static_cast<unsigned char>(text.c_str()[i]);
+        hash *= FNV_PRIME;
+    }
+}
+
+}
+
+size_t
+SysrepoKea::IdentifierHash::operator()(const string& id) const {
+    return (static_cast<size_t>(identifierHash(id)));
+}
+
+bool
+SysrepoKea::IdentifierEqual::operator()(const string& a, const string& b) const {
+    size_t i = 0, j = 0;
+    while (true) {
+        char c = identifierDigit(a, i);
+        if (c != identifierDigit(b, j)) {
+            return (false);
+        }
+        if (!c) {
+            return (true);
+        }
     }
-    return (tmp.str());
 }
 
 SysrepoKea::SysrepoKea(sr_session_ctx_t* session)
-    :model_name_(DEFAULT_MODEL_NAME), session_(session) {
+    :model_name_(DEFAULT_MODEL_NAME), session_(session), cache_valid_(false),
+     global_option_set_(-1), default_rapid_commit_(-1),
+     style_(JsonWriter::COMPACT), threads_enabled_(true), targeted_(false),
+     subnet_cache_(true),
+     reused_(0),
+     rebuilt_(0), sr_calls_(0), sr_ns_(0), duplicates_(0), counted_(true) {
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        globals_changed_[s] = false;
+    }
+}
+
+SysrepoKea::~SysrepoKea() {
+    for (size_t i = 0; i < workers_.size(); i++) {
+        sr_session_stop(workers_[i].session);
+    }
+}
+
+int
+SysrepoKea::setThreads(size_t threads, sr_conn_ctx_t* connection,
+                       sr_datastore_t datastore) {
+    for (size_t i = 0; i < workers_.size(); i++) {
+        sr_session_stop(workers_[i].session);
+    }
+    workers_.clear();
+
+    for (size_t i = 1; i < threads; i++) {
+        sr_session_ctx_t* session = NULL;
+        int rc = sr_session_start(connection, datastore, SR_SESS_DEFAULT, &session);
+        if (rc != SR_ERR_OK) {
+            cerr << "Failed to start session for translation thread: "
+                 << sr_strerror(rc) << endl;
+            return (rc);
+        }
+        workers_.push_back(RenderContext());
+        workers_.back().session = session;
+    }
+    return (SR_ERR_OK);
 }
 
 string
@@ -80,252 +245,1669 @@ SysrepoKea::srTypeToText(sr_type_t type)
     return "unknown";
 }
 
-string
-SysrepoKea::valueToText(sr_val_t *value, bool xpath, bool type)
+void
+SysrepoKea::writeValue(JsonWriter& w, const sr_val_t* value)
 {
-    stringstream tmp;
-
-    if (xpath) {
-        tmp << value->xpath;
-    }
-    if (type) {
-        tmp << ",type=" << srTypeToText(value->type) << ":";
-    }
-
-    if (xpath || type) {
-        tmp <<  ":";
-    }
     switch (value->type) {
         case SR_CONTAINER_T:
         case SR_CONTAINER_PRESENCE_T:
         case SR_LIST_T:
             /* do not print */
             break;
+        case SR_LEAF_EMPTY_T:
+            // RFC 7951 encoding of the empty type
+            w.startList();
+            w.null();
+            w.endList();
+            break;
         case SR_STRING_T:
-            tmp << "\"" << value->data.string_val << "\"";
+            w.value(value->data.string_val);
+            break;
+        case SR_BINARY_T:
+            w.value(value->data.binary_val);
+            break;
+        case SR_BITS_T:
+            w.value(value->data.bits_val);
+            break;
+        case SR_ENUM_T:
+            w.value(value->data.enum_val);
+            break;
+        case SR_IDENTITYREF_T:
+            w.value(value->data.identityref_val);
+            break;
+        case SR_INSTANCEID_T:
+            w.value(value->data.instanceid_val);
             break;
         case SR_BOOL_T:
-            tmp << (value->data.bool_val ? "true" : "false");
+            w.value(static_cast<bool>(value->data.bool_val));
+            break;
+        case SR_DECIMAL64_T:
+            w.value(value->data.decimal64_val);
+            break;
+        case SR_INT8_T:
+            w.value(static_cast<int64_t>(value->data.int8_val));
+            break;
+        case SR_INT16_T:
+            w.value(static_cast<int64_t>(value->data.int16_val));
+            break;
+        case SR_INT32_T:
+            w.value(static_cast<int64_t>(value->data.int32_val));
+            break;
+        case SR_INT64_T:
+            w.value(static_cast<int64_t>(value->data.int64_val));
             break;
         case SR_UINT8_T:
-            // Converted to uint16, because otherwise it will be printed as
-            // a single character.
-            tmp << static_cast<uint16_t>(value->data.uint8_val);
+            w.value(static_cast<uint64_t>(value->data.uint8_val));
             break;
         case SR_UINT16_T:
-            tmp << static_cast<uint16_t>(value->data.uint16_val);
+            w.value(static_cast<uint64_t>(value->data.uint16_val));
             break;
         case SR_UINT32_T:
-            tmp << static_cast<uint32_t>(value->data.uint16_val);
+            w.value(static_cast<uint64_t>(value->data.uint32_val));
             break;
-        case SR_IDENTITYREF_T:
-            tmp << value->data.identityref_val;
-            break;
-        case SR_ENUM_T:
-            tmp << value->data.enum_val;
+        case SR_UINT64_T:
+            w.value(static_cast<uint64_t>(value->data.uint64_val));
             break;
         default:
-            if (!xpath) {
-                // We need to print it only if xpath was not printed
-                // already.
-                tmp << "xpath=" << value->xpath;
-            }
-            tmp << "(unprintable)";
+            // anyxml, anydata and whatever comes in the future
+            w.null();
     }
-
-    return (tmp.str());
 }
 
 string
-SysrepoKea::getPool(const char *xpath,int indent) {
-    stringstream tmp;
-    int rc = SR_ERR_OK;
-    sr_val_t* value = NULL;
+SysrepoKea::valueToText(sr_val_t *value, bool xpath, bool type)
+{
+    string tmp;
 
-    string name = string(xpath) + "/pool-prefix";
+    if (xpath) {
+        tmp += value->xpath;
+    }
+    if (type) {
+        tmp += ",type=" + srTypeToText(value->type) + ":";
+    }
+
+    if (xpath || type) {
+        tmp += ":";
+    }
+
+    JsonWriter w(tmp);
+    writeValue(w, value);
+
+    return (tmp);
+}
+
+bool
+SysrepoKea::getUint(const sr_val_t* value, uint32_t& number) {
+    switch (value->type) {
+    case SR_UINT8_T:
+        number = value->data.uint8_val;
+        return (true);
+    case SR_UINT16_T:
+        number = value->data.uint16_val;
+        return (true);
+    case SR_UINT32_T:
+        number = value->data.uint32_val;
+        return (true);
+    case SR_STRING_T:
+        number = strtoul(value->data.string_val, NULL, 10);
+        return (true);
+    default:
+        return (false);
+    }
+}
 
-    rc = sr_get_item(session_, name.c_str(), &value);
-    if (rc == SR_ERR_OK) {
-        tmp << tabs(indent) << "{ \"pool\": \""
-            << value->data.string_val << "\" }" << endl;
-        sr_free_values(value, 1);
+void
+SysrepoKea::renderOptionData(const YangNode* set, string& json, int level) {
+    json.clear();
+    JsonWriter w(json, style_, level);
+    w.startList();
+    const vector<const YangNode*>& options = set->getChildren();
+    for (size_t i = 0; i < options.size(); i++) {
+        if (options[i]->getSchemaId() != KEA_NODE_OPTION_SETS_OPTION_SET_STANDARD_OPTION) {
+            continue;
+        }
+        w.startMap();
+        writeMembers(w, options[i]);
+        w.endMap();
+    }
+    w.endList();
+}
+
+void
+SysrepoKea::renderOptionSet(const YangNode* set) {
+    const YangNode* id = set->getChildById(KEA_NODE_OPTION_SETS_OPTION_SET_OPTION_SET_ID);
+    uint32_t number;
+    if (!id || !id->getValue() || !getUint(id->getValue(), number)) {
+        cerr << "no option-set-id for " << set->getXPath() << endl;
+        return;
     }
+    option_set_ids_[set->getXPath()] = number;
 
-    return tmp.str();
+    OptionData& data = option_sets_[number];
+    renderOptionData(set, data.subnet, 4);
+    if (style_ == JsonWriter::COMPACT) {
+        // Indentation is all that differs.
+        data.global = data.subnet;
+    } else {
+        renderOptionData(set, data.global, 2);
+    }
 }
 
+void
+SysrepoKea::writeOptionData(JsonWriter& w, uint32_t id, bool global) const {
+    map<uint32_t, OptionData>::const_iterator set = option_sets_.find(id);
+    if (set == option_sets_.end()) {
+        cerr << "option set " << id << " is used but not defined" << endl;
+        return;
+    }
+    w.key("option-data");
+    w.raw(global ? set->second.global : set->second.subnet);
+}
+
+namespace {
+
+/// @brief Returns value as text without JSON quoting.
 string
-SysrepoKea::getPools(const char *xpath, int indent) {
-    stringstream tmp;
-    int rc = SR_ERR_OK;
-    sr_val_t* pools;
-    size_t pools_cnt = 32;
+rawValue(const sr_val_t* value) {
+    switch (value->type) {
+    case SR_STRING_T:
+        return (value->data.string_val);
+    case SR_BINARY_T:
+        return (value->data.binary_val);
+    case SR_ENUM_T:
+        return (value->data.enum_val);
+    default:
+        return (SysrepoKea::valueToText(const_cast<sr_val_t*>(value)));
+    }
+}
 
-    string name = string(xpath) + "/pools/*";
-    cout << "Retrieving pools for subnet " << xpath << ", xpath="
-         << name << endl;
+}
 
-    rc = sr_get_items(session_, name.c_str(), &pools, &pools_cnt);
-    if (rc == SR_ERR_OK) {
-        cout << "Retrieved " << pools_cnt << " pools." << endl;
+void
+SysrepoKea::writePool(JsonWriter& w, const YangNode* pool) {
+    const YangNode* prefix =
+        pool->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_POOLS_ADDRESS_POOL_POOL_PREFIX);
+    const YangNode* start =
+        pool->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_POOLS_ADDRESS_POOL_START_ADDRESS);
+    const YangNode* end =
+        pool->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_POOLS_ADDRESS_POOL_END_ADDRESS);
+    if (prefix && prefix->getValue()) {
+        w.startMap();
+        w.key("pool");
+        writeValue(w, prefix->getValue());
+        w.endMap();
+    } else if (start && start->getValue() && end && end->getValue()) {
+        w.startMap();
+        w.key("pool");
+        w.value(rawValue(start->getValue()) + " - " + rawValue(end->getValue()));
+        w.endMap();
+    } else {
+        cerr << "no pool-prefix nor addresses for " << pool->getXPath()
+             << ", pool skipped" << endl;
+    }
+}
 
-        tmp << tabs(indent) << "\"pools\": [ " << endl;
+void
+SysrepoKea::writePdPool(JsonWriter& w, const YangNode* pool) {
+    const YangNode* prefix =
+        pool->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_PREFIX_POOLS_PREFIX_POOL_POOL_PREFIX);
+    const string text = prefix && prefix->getValue() ? rawValue(prefix->getValue()) : "";
+    const size_t slash = text.find('/');
+    if (slash == string::npos) {
+        cerr << "no pool-prefix for " << pool->getXPath() << ", pool skipped" << endl;
+        return;
+    }
+    // The model has no delegated length, the whole prefix is delegated.
+    const uint64_t len = strtoul(text.c_str() + slash + 1, NULL, 10);
+    w.startMap();
+    w.key("prefix");
+    w.value(text.substr(0, slash));
+    w.key("prefix-len");
+    w.value(len);
+    w.key("delegated-len");
+    w.value(len);
+    w.endMap();
+}
+
+void
+SysrepoKea::writeServerId(JsonWriter& w, const YangNode* duid) {
+    // Either the DUID type (a number) or the whole DUID in hex
+    const sr_val_t* value = duid->getValue();
+    string hex;
+    uint32_t type = 0;
+    if (value->type == SR_STRING_T) {
+        hex = value->data.string_val;
+        type = strtoul(hex.substr(0, 4).c_str(), NULL, 16);
+    } else {
+        getUint(value, type);
+    }
+    // Offsets of the fields (in hex digits) after the type
+    const size_t min_size[] = { 0, 18, 14, 10 };
+    if (type < 1 || type > 3 || (!hex.empty() && hex.size() < min_size[type])) {
+        cerr << "unsupported DUID " << valueToText(const_cast<sr_val_t*>(value))
+             << " for " << duid->getXPath() << ", server-id skipped" << endl;
+        return;
+    }
 
-        for (int i = 0; i < pools_cnt; i++) {
-            if (i) {
-                tmp << tabs(indent) << ",";
+    w.key("server-id");
+    w.startMap();
+    w.key("type");
+    w.value(DUID_TYPES[type]);
+    if (!hex.empty()) {
+        if (type == 2) {
+            w.key("enterprise-id");
+            w.value(static_cast<uint64_t>(strtoul(hex.substr(4, 8).c_str(), NULL, 16)));
+            w.key("identifier");
+            w.value(hex.substr(12));
+        } else {
+            w.key("htype");
+            w.value(static_cast<uint64_t>(strtoul(hex.substr(4, 4).c_str(), NULL, 16)));
+            if (type == 1) {
+                w.key("time");
+                w.value(static_cast<uint64_t>(strtoul(hex.substr(8, 8).c_str(), NULL, 16)));
             }
-            tmp << getPool(pools[i].xpath, indent + 1);
+            w.key("identifier");
+            w.value(hex.substr(type == 1 ? 16 : 8));
         }
+    }
+    w.endMap();
+}
 
-        tmp << tabs(indent) << "]" << endl;
-        sr_free_values(pools, pools_cnt);
+void
+SysrepoKea::writeKeaValue(JsonWriter& w, const YangNode* leaf) {
+    const sr_val_t* value = leaf->getValue();
+    if (keaNodeInfo(leaf->getSchemaId()).type == KEA_TYPE_STRING &&
+        value->type != SR_STRING_T) {
+        // e.g. a DUID that looks like a number
+        w.value(rawValue(value));
+    } else {
+        writeValue(w, value);
     }
+}
 
-    return tmp.str();
+void
+SysrepoKea::writeUserContext(JsonWriter& w, const vector<const YangNode*>& context) {
+    if (context.empty()) {
+        return;
+    }
+    w.key("user-context");
+    w.startMap();
+    for (size_t i = 0; i < context.size(); i++) {
+        w.key(keaNodeInfo(context[i]->getSchemaId()).key);
+        writeKeaValue(w, context[i]);
+    }
+    w.endMap();
 }
 
+void
+SysrepoKea::writeNodes(JsonWriter& w, const YangNode* parent,
+                       const vector<const YangNode*>& nodes,
+                       vector<const YangNode*>& context) {
+    size_t i = 0;
+    while (i < nodes.size()) {
+        const YangNode* node = nodes[i];
+        const uint16_t id = node->getSchemaId();
+        const KeaNodeInfo& info = keaNodeInfo(id);
 
-string
-SysrepoKea::getSubnet(const char *xpath, int indent) {
-    stringstream tmp;
-    int rc = SR_ERR_OK;
-    sr_val_t* value = NULL;
+        // Entries of a list (and instances of a leaf-list) come one
+        // after another, they make a single JSON list.
+        size_t end = i + 1;
+        if (info.kind == KEA_KIND_LIST || info.kind == KEA_KIND_LEAF_LIST) {
+            while (end < nodes.size() && nodes[end]->getSchemaId() == id) {
+                end++;
+            }
+        }
+        if (info.kind != KEA_KIND_CONTAINER && info.kind != KEA_KIND_LIST &&
+            !node->getValue()) {
+            i = end;
+            continue;
+        }
 
-    cout << "Retrieving data for subnet " << xpath << endl;
+        switch (id) {
+        case KEA_NODE_SERV_ATTRIBUTES_DUID:
+            writeServerId(w, node);
+            break;
 
-    string name = string(xpath) + "/subnet";
+        case KEA_NODE_NETWORK_RANGES_SUBNET6_RELAY_ADDRESS:
+            w.key(info.key);
+            w.startMap();
+            w.key("ip-address");
+            writeValue(w, node->getValue());
+            w.endMap();
+            break;
 
-    tmp << tabs(indent) << "{" << endl;
+        case KEA_NODE_NETWORK_RANGES_SUBNET6_POOLS_ADDRESS_POOL:
+            w.key(info.key);
+            w.startList();
+            for (; i < end; i++) {
+                writePool(w, nodes[i]);
+            }
+            w.endList();
+            break;
+
+        case KEA_NODE_NETWORK_RANGES_SUBNET6_PREFIX_POOLS_PREFIX_POOL:
+            w.key(info.key);
+            w.startList();
+            for (; i < end; i++) {
+                writePdPool(w, nodes[i]);
+            }
+            w.endList();
+            break;
 
-    rc = sr_get_item(session_, name.c_str(), &value);
-    if (rc == SR_ERR_OK) {
-        tmp << tabs(indent+1) << "\"subnet\": \"" << value->data.string_val
-            << "\"," << endl;
+        case KEA_NODE_NETWORK_RANGES_SUBNET6_RESERVED_HOST_DUID:
+            w.key(info.key);
+            writeKeaValue(w, node);
+            break;
 
-        sr_free_values(value, 1);
+        case KEA_NODE_NETWORK_RANGES_SUBNET6_RESERVED_HOST_HARDWARE_ADDR:
+            // Kea takes a single identifier, the DUID wins.
+            if (!parent || !parent->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_RESERVED_HOST_DUID)) {
+                w.key(info.key);
+                writeKeaValue(w, node);
+            }
+            break;
+
+        case KEA_NODE_RSOO_ENABLED_OPTIONS_RSOO_ENABLED_OPTION:
+            w.key(info.key);
+            w.startList();
+            for (; i < end; i++) {
+                const YangNode* code =
+                    nodes[i]->getChildById(KEA_NODE_RSOO_ENABLED_OPTIONS_RSOO_ENABLED_OPTION_OPTION_CODE);
+                if (code && code->getValue()) {
+                    writeKeaValue(w, code);
+                }
+            }
+            w.endList();
+            break;
+
+        default:
+            switch (info.scope) {
+            case KEA_SCOPE_MEMBER:
+                w.key(info.key);
+                if (info.kind == KEA_KIND_CONTAINER) {
+                    w.startMap();
+                    writeMembers(w, node);
+                    w.endMap();
+                } else if (info.kind == KEA_KIND_LIST) {
+                    w.startList();
+                    for (; i < end; i++) {
+                        w.startMap();
+                        writeMembers(w, nodes[i]);
+                        w.endMap();
+                    }
+                    w.endList();
+                } else if (info.kind == KEA_KIND_LEAF_LIST) {
+                    w.startList();
+                    for (; i < end; i++) {
+                        writeKeaValue(w, nodes[i]);
+                    }
+                    w.endList();
+                } else {
+                    writeKeaValue(w, node);
+                }
+                break;
+            case KEA_SCOPE_INLINE:
+                writeNodes(w, node, node->getChildren(), context);
+                break;
+            case KEA_SCOPE_CONTEXT:
+                context.push_back(node);
+                break;
+            default:
+                // Not translated, or translated elsewhere (e.g. subnets
+                // and option sets have fragments of their own).
+                break;
+            }
+        }
+        i = end;
+    }
+}
+
+void
+SysrepoKea::writeMembers(JsonWriter& w, const YangNode* node) {
+    vector<const YangNode*> context;
+    writeNodes(w, node, node->getChildren(), context);
+    writeUserContext(w, context);
+}
+
+
+bool
+SysrepoKea::getReservationId(const YangNode* host, string& type, string& id) {
+    const YangNode* duid = host->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_RESERVED_HOST_DUID);
+    if (duid && duid->getValue()) {
+        type = "duid";
+        id = rawValue(duid->getValue());
+        return (true);
+    }
+    const YangNode* hw = host->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_RESERVED_HOST_HARDWARE_ADDR);
+    if (hw && hw->getValue()) {
+        type = "hw-address";
+        id = rawValue(hw->getValue());
+        return (true);
     }
+    return (false);
+}
 
-    tmp << getPools(xpath, indent + 1);
-    tmp << tabs(indent) << "}" << endl;
+void
+SysrepoKea::writeReservationParams(JsonWriter& w, const YangNode* host) {
+    writeMembers(w, host);
+}
+
+void
+SysrepoKea::writeReservation(RenderContext& ctx, JsonWriter& w, const YangNode* host,
+                             const set<string>* changed, bool& listed) {
+    string type, id;
+    if (!getReservationId(host, type, id)) {
+        cerr << "no duid nor hardware-addr for " << host->getXPath()
+             << ", reservation skipped" << endl;
+        return;
+    }
+    IdentifierSet& index = (type == "duid") ? ctx.duids : ctx.hw_addrs;
+    if (!index.insert(id).second) {
+        cerr << "duplicate " << type << " " << id << " for "
+             << host->getXPath() << ", reservation skipped" << endl;
+        ctx.duplicates++;
+        return;
+    }
 
-    return tmp.str();
+    if (targeted_) {
+        // Kea deletes reservations by identifier.
+        ctx.host_ids[host->getXPath()] = make_pair(type, id);
+
+        if (changed && changed->count(host->getXPath())) {
+            // Rendered as members of the "reservation" map of
+            // reservation-add arguments.
+            string& params = ctx.host_params[host->getXPath()];
+            params.clear();
+            JsonWriter p(params, style_, 1);
+            p.startMembers();
+            writeReservationParams(p, host);
+            p.endMembers();
+        }
+    }
+
+    if (!listed) {
+        w.key("reservations");
+        w.startList();
+        listed = true;
+    }
+    w.startMap();
+    writeReservationParams(w, host);
+    w.endMap();
 }
 
-string
-SysrepoKea::getValue(const string& xpath) {
+int
+SysrepoKea::writeReservations(RenderContext& ctx, JsonWriter& w,
+                              const YangNode* subnet) {
+    if (!subnet->hasSkippedChildren()) {
+        // No reserved hosts, don't bother Sysrepo.
+        return (SR_ERR_OK);
+    }
+
+    const string& xpath = subnet->getXPath();
+    map<string, set<string> >::const_iterator it = changed_hosts_.find(xpath);
+    const set<string>* changed = it != changed_hosts_.end() ? &it->second : NULL;
+
+    // Kea wants identifiers unique within a subnet only.
+    ctx.duids.clear();
+    ctx.hw_addrs.clear();
+
+    YangListReader reader(ctx.session, xpath + "/reserved-host", RESERVATION_BATCH);
+    YangTree batch(keaNodeChild);
+    bool listed = false;
     int rc;
-    sr_val_t* value = NULL;
+    while ((rc = reader.next(batch)) == SR_ERR_OK) {
+        ctx.sr_calls++;
+        const vector<const YangNode*>& hosts = batch.getRoot()->getChildren();
+        for (size_t i = 0; i < hosts.size(); i++) {
+            writeReservation(ctx, w, hosts[i], changed, listed);
+        }
+    }
+    if (rc != SR_ERR_NOT_FOUND) {
+        cerr << "Failed to read reservations of " << xpath << ": "
+             << sr_strerror(rc) << endl;
+        return (rc);
+    }
 
-    string path = model_name_ + xpath;
+    if (listed) {
+        w.endList();
+    }
+    return (SR_ERR_OK);
+}
+
+void
+SysrepoKea::cacheSubnetInfo(const YangNode* subnet) {
+    const string& xpath = subnet->getXPath();
+
+    uint32_t number;
+    const YangNode* id = subnet->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_NETWORK_RANGE_ID);
+    if (id && id->getValue() && getUint(id->getValue(), number)) {
+        subnet_ids_[xpath] = number;
+    }
+
+    const YangNode* set = subnet->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_OPTION_SET_ID);
+    if (set && set->getValue() && getUint(set->getValue(), number)) {
+        subnet_option_sets_[xpath] = number;
+    }
 
-    rc = sr_get_item(session_, path.c_str(), &value);
+    const YangNode* pools = subnet->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_PREFIX_POOLS);
+    if (pools && !pools->getChildren().empty()) {
+        delegating_subnets_.insert(xpath);
+    }
+}
+
+void
+SysrepoKea::getSubnetIds(map<uint32_t, string>& subnets,
+                         set<uint32_t>& delegating) const {
+    subnets.clear();
+    delegating.clear();
+    if (!subnet_cache_) {
+        const string section = getSectionXPath(SECTION_NETWORK_RANGES);
+        SysrepoTimer timer;
+
+        // Prefixes of the subnets with prefix pools first
+        set<string> pool_prefixes;
+        const string pools = section + "/subnet6/prefix-pools/prefix-pool/pool-id";
+        sr_val_iter_t* iter = NULL;
+        if (sr_get_items_iter(session_, pools.c_str(), &iter) == SR_ERR_OK) {
+            sr_val_t* value = NULL;
+            while (sr_get_item_next(session_, iter, &value) == SR_ERR_OK) {
+                string prefix;
+                if (subnetPrefix(value->xpath, prefix)) {
+                    pool_prefixes.insert(prefix);
+                }
+                sr_free_val(value);
+            }
+            sr_free_val_iter(iter);
+        }
+
+        const string ids = section + "/subnet6/network-range-id";
+        iter = NULL;
+        if (sr_get_items_iter(session_, ids.c_str(), &iter) != SR_ERR_OK) {
+            return;
+        }
+        sr_val_t* value = NULL;
+        while (sr_get_item_next(session_, iter, &value) == SR_ERR_OK) {
+            uint32_t number;
+            string prefix;
+            if (getUint(value, number) && subnetPrefix(value->xpath, prefix)) {
+                subnets[number] = prefix;
+                if (pool_prefixes.count(prefix)) {
+                    delegating.insert(number);
+                }
+            }
+            sr_free_val(value);
+        }
+        sr_free_val_iter(iter);
+        return;
+    }
+    for (map<string, uint32_t>::const_iterator it = subnet_ids_.begin();
+         it != subnet_ids_.end(); ++it) {
+        string prefix;
+        if (subnetPrefix(it->first, prefix)) {
+            subnets[it->second] = prefix;
+            if (delegating_subnets_.count(it->first)) {
+                delegating.insert(it->second);
+            }
+        }
+    }
+}
+
+void
+SysrepoKea::forgetSubnetInfo(const string& xpath) {
+    subnet_ids_.erase(xpath);
+    subnet_option_sets_.erase(xpath);
+    delegating_subnets_.erase(xpath);
+
+    // Reservations of the subnet share its xpath as prefix.
+    const string prefix = xpath + "/";
+    map<string, pair<string, string> >::iterator it = host_ids_.lower_bound(prefix);
+    while (it != host_ids_.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        host_ids_.erase(it++);
+    }
+}
+
+void
+SysrepoKea::writeSubnetParams(JsonWriter& w, const YangNode* subnet) {
+    vector<const YangNode*> context;
+    writeNodes(w, subnet, subnet->getChildren(), context);
+
+    // network-ranges/rapid-commit is the default of the subnets.
+    if (default_rapid_commit_ >= 0 &&
+        !subnet->getChildById(KEA_NODE_NETWORK_RANGES_SUBNET6_RAPID_COMMIT)) {
+        w.key("rapid-commit");
+        w.value(default_rapid_commit_ > 0);
+    }
+    writeUserContext(w, context);
+}
+
+int
+SysrepoKea::writeSubnet(RenderContext& ctx, JsonWriter& w, const YangNode* subnet) {
+    writeSubnetParams(w, subnet);
+    return (writeReservations(ctx, w, subnet));
+}
+
+int
+SysrepoKea::renderSubnet(RenderContext& ctx, const YangNode* subnet, string& json) {
+    // Render into the scratch buffer (which keeps its memory) and copy,
+    // so the fragment gets allocated once and with the right size.
+    ctx.scratch.clear();
+    // Subnets end up in the subnet6 list of Dhcp6 (three levels deep).
+    JsonWriter w(ctx.scratch, style_, 3);
+    w.startMembers();
+    int rc = writeSubnet(ctx, w, subnet);
     if (rc != SR_ERR_OK) {
-        cerr << "sr_get_item() for xpath=" << xpath << " failed" << endl;
-        /// @todo: throw here
-        return "";
+        return (rc);
     }
+    w.endMembers();
+    json.assign(ctx.scratch);
+    return (SR_ERR_OK);
+}
+
+void
+SysrepoKea::mergeContext(RenderContext& ctx) {
+    if (host_ids_.empty()) {
+        // Full rebuild with a single thread
+        host_ids_.swap(ctx.host_ids);
+    } else {
+        for (map<string, pair<string, string> >::iterator it = ctx.host_ids.begin();
+             it != ctx.host_ids.end(); ++it) {
+            host_ids_[it->first].swap(it->second);
+        }
+    }
+    ctx.host_ids.clear();
 
-    string v = valueToText(value, false, false);
-    sr_free_values(value, 1);
-    return (v);
+    for (map<string, string>::iterator it = ctx.host_params.begin();
+         it != ctx.host_params.end(); ++it) {
+        changed_host_params_[it->first].swap(it->second);
+    }
+    ctx.host_params.clear();
+
+    sr_calls_ += ctx.sr_calls;
+    sr_ns_ += ctx.sr_ns;
+    duplicates_ += ctx.duplicates;
+    ctx.sr_calls = 0;
+    ctx.sr_ns = 0;
+    ctx.duplicates = 0;
 }
 
-string
-SysrepoKea::getFormattedValue(const string& xpath,
-                              const string& json_name, int indent,
-                              bool comma) {
-    stringstream tmp;
-    tmp << tabs(indent) << "\"" << json_name << "\": " << getValue(xpath);
-    if (comma) {
-        tmp << ",";
+int
+SysrepoKea::renderSubnets(const vector<const YangNode*>& subnets) {
+    vector<string*> fragments(subnets.size());
+    for (size_t i = 0; i < subnets.size(); i++) {
+        const string& xpath = subnets[i]->getXPath();
+        subnet_order_.push_back(xpath);
+        fragments[i] = &subnets_[xpath];
     }
-    return (tmp.str());
+
+    render_.session = session_;
+    if (workers_.empty() || !threads_enabled_ || subnets.size() <= SUBNET_CHUNK) {
+        int rc = SR_ERR_OK;
+        for (size_t i = 0; i < subnets.size() && rc == SR_ERR_OK; i++) {
+            rc = renderSubnet(render_, subnets[i], *fragments[i]);
+        }
+        mergeContext(render_);
+        return (rc);
+    }
+
+    // Threads take chunks of subnets from a shared counter, so those
+    // that get subnets with many reservations don't hold the others up.
+    // Each writes to its own fragments, the map is not modified.
+    atomic<size_t> next(0);
+    atomic<int> failed(SR_ERR_OK);
+    function<void (RenderContext&)> work = [&](RenderContext& ctx) {
+        // The calling thread is timed by getConfig().
+        uint64_t unused = 0;
+        SysrepoTimeCollector collector(&ctx != &render_ ? ctx.sr_ns : unused);
+        if (&ctx != &render_) {
+            // The translator session was refreshed by getConfig().
+            ctx.sr_calls++;
+            SysrepoTimer timer;
+            sr_session_refresh(ctx.session);
+        }
+        while (failed == SR_ERR_OK) {
+            size_t begin = next.fetch_add(SUBNET_CHUNK);
+            if (begin >= subnets.size()) {
+                break;
+            }
+            size_t end = min(begin + SUBNET_CHUNK, subnets.size());
+            for (size_t i = begin; i < end; i++) {
+                int rc = renderSubnet(ctx, subnets[i], *fragments[i]);
+                if (rc != SR_ERR_OK) {
+                    int ok = SR_ERR_OK;
+                    failed.compare_exchange_strong(ok, rc);
+                    break;
+                }
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (size_t t = 0; t < workers_.size(); t++) {
+        threads.push_back(thread(work, ref(workers_[t])));
+    }
+    work(render_);
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+
+    mergeContext(render_);
+    for (size_t t = 0; t < workers_.size(); t++) {
+        mergeContext(workers_[t]);
+    }
+    return (failed);
+}
+
+void
+SysrepoKea::writeSubnetEntry(JsonWriter& w, const string& xpath) {
+    w.startMap();
+    w.rawMembers(subnets_[xpath]);
+    map<string, uint32_t>::const_iterator set = subnet_option_sets_.find(xpath);
+    if (set != subnet_option_sets_.end()) {
+        writeOptionData(w, set->second, false);
+    }
+    w.endMap();
+}
+
+bool
+SysrepoKea::hasGlobals(Section section) {
+    // Option sets and subnets have fragments of their own.
+    return (section != SECTION_OPTION_SETS && section != SECTION_NETWORK_RANGES);
+}
+
+void
+SysrepoKea::renderGlobals(Section section, const YangNode* node) {
+    string& json = globals_[section];
+    json.clear();
+    contexts_[section].clear();
+    if (!node) {
+        return;
+    }
+    // Globals are members of the Dhcp6 map (one level deep).
+    vector<const YangNode*> context;
+    JsonWriter w(json, style_, 1);
+    w.startMembers();
+    writeNodes(w, NULL, vector<const YangNode*>(1, node), context);
+    w.endMembers();
+
+    // Members of its user-context are two levels deep.
+    JsonWriter c(contexts_[section], style_, 2);
+    c.startMembers();
+    for (size_t i = 0; i < context.size(); i++) {
+        c.key(keaNodeInfo(context[i]->getSchemaId()).key);
+        writeKeaValue(c, context[i]);
+    }
+    c.endMembers();
+}
+
+const char*
+SysrepoKea::getSectionName(Section section) {
+    return (SECTION_NAMES[section]);
 }
 
 string
-SysrepoKea::getSubnets(const string& xpath, int indent) {
-    stringstream s;
-    sr_val_t* subnets = NULL;
-    size_t subnets_cnt = 9999;
-    int rc = SR_ERR_OK;
-    string path = model_name_ + xpath;
-    rc = sr_get_items(session_, path.c_str(), &subnets, &subnets_cnt);
-    if (rc == SR_ERR_OK) {
-        s << tabs(indent) << "\"subnet6\": [" << endl;
-        for (int i = 0; i < subnets_cnt; i++) {
+SysrepoKea::getSectionXPath(Section section) const {
+    return (getRootXPath() + "/" + SECTION_NAMES[section]);
+}
+
+string
+SysrepoKea::getRootXPath() const {
+    // Root of the model, e.g. /ietf-kea-dhcpv6:server
+    string root = model_name_;
+    if (!root.empty() && root[root.size() - 1] == '/') {
+        root.erase(root.size() - 1);
+    }
+    return (root);
+}
 
-            if (i) {
-                s << tabs(indent + 1) << "," << endl;
+void
+SysrepoKea::invalidate() {
+    cache_valid_ = false;
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        globals_[s].clear();
+        contexts_[s].clear();
+        globals_changed_[s] = false;
+    }
+    subnets_.clear();
+    subnet_order_.clear();
+    changed_subnets_.clear();
+    changed_subnet_params_.clear();
+    changed_hosts_.clear();
+    subnet_ids_.clear();
+    host_ids_.clear();
+    changed_host_params_.clear();
+    subnet_option_sets_.clear();
+    delegating_subnets_.clear();
+    global_option_set_ = -1;
+    default_rapid_commit_ = -1;
+    option_sets_.clear();
+    option_set_ids_.clear();
+    changed_option_sets_.clear();
+}
+
+void
+SysrepoKea::markChanged(const string& xpath) {
+    if (!cache_valid_) {
+        // Everything will be regenerated anyway.
+        return;
+    }
+
+    const string root = getRootXPath();
+    const string serv = root + "/serv-attributes";
+    const string ranges = root + "/network-ranges";
+    const string sets = root + "/option-sets/";
+
+    if (xpath.compare(0, serv.size(), serv) == 0 &&
+        (xpath.size() == serv.size() || xpath[serv.size()] == '/')) {
+        globals_changed_[SECTION_SERV_ATTRIBUTES] = true;
+        return;
+    }
+
+    if (xpath == ranges + "/option-set-id") {
+        // Option data of Dhcp6 goes with the globals.
+        globals_changed_[SECTION_NETWORK_RANGES] = true;
+        return;
+    }
+
+    if (xpath.compare(0, sets.size(), sets) == 0) {
+        // The option-set-id key has no slashes, so the option set entry
+        // ends at the next one.
+        string set = xpath.substr(0, xpath.find('/', sets.size()));
+        string ignored;
+        if (xpathStepName(xpathLastStep(set, ignored)) == "option-set") {
+            changed_option_sets_.insert(set);
+            return;
+        }
+    }
+
+    if (xpath.compare(0, ranges.size() + 1, ranges + "/") == 0) {
+        // Find the subnet6 list entry the node belongs to and the node
+        // right below it.
+        string subnet = xpath;
+        string below;
+        string parent;
+        while (true) {
+            string step = xpathLastStep(subnet, parent);
+            if (parent == ranges) {
+                if (xpathStepName(step) == "subnet6") {
+                    changed_subnets_.insert(subnet);
+                    string ignored;
+                    if (!below.empty() &&
+                        xpathStepName(xpathLastStep(below, ignored)) == "reserved-host") {
+                        changed_hosts_[subnet].insert(below);
+                    } else {
+                        changed_subnet_params_.insert(subnet);
+                    }
+                    return;
+                }
+                break;
+            }
+            if (parent.size() <= ranges.size()) {
+                break;
             }
-            string subnet_txt = getSubnet(subnets[i].xpath, indent + 1);
-            s << subnet_txt;
+            below = subnet;
+            subnet = parent;
         }
-        s << tabs(indent) << "]" << endl;
+    }
 
-        sr_free_values(subnets, subnets_cnt);
+    if (xpath.compare(0, root.size(), root) == 0 &&
+        xpath.size() > root.size() && xpath[root.size()] == '/') {
+        string section = xpath.substr(root.size() + 1);
+        section = section.substr(0, section.find('/'));
+        // Option definitions and RSOO go with the globals.
+        if (section == SECTION_NAMES[SECTION_CUSTOM_OPTIONS]) {
+            globals_changed_[SECTION_CUSTOM_OPTIONS] = true;
+            return;
+        }
+        if (section == SECTION_NAMES[SECTION_RSOO_ENABLED_OPTIONS]) {
+            globals_changed_[SECTION_RSOO_ENABLED_OPTIONS] = true;
+            return;
+        }
     }
 
-    return (s.str());
+    // We don't know which fragment this belongs to, so start over.
+    invalidate();
 }
 
+int
+SysrepoKea::collectChanges(sr_session_ctx_t* session, uint64_t* digest) {
+    string module = getRootXPath();
+    return (walkChanges(session, module.substr(0, module.find(':')) + ":*",
+                        true, digest));
+}
 
-string
-SysrepoKea::getConfig() {
+int
+SysrepoKea::collectChanges(sr_session_ctx_t* session, Section section,
+                           uint64_t* digest) {
+    return (walkChanges(session, getSectionXPath(section), true, digest));
+}
+
+int
+SysrepoKea::getChangesDigest(sr_session_ctx_t* session, uint64_t& digest) {
+    string module = getRootXPath();
+    return (walkChanges(session, module.substr(0, module.find(':')) + ":*",
+                        false, &digest));
+}
+
+int
+SysrepoKea::walkChanges(sr_session_ctx_t* session, const string& xpath,
+                        bool mark, uint64_t* digest) {
+    sr_change_iter_t* iter = NULL;
+    sr_change_oper_t oper;
+    sr_val_t* old_value = NULL;
+    sr_val_t* new_value = NULL;
+
+    // Reading the changes is all Sysrepo work.
+    SysrepoTimeCollector collector(sr_ns_);
+    SysrepoTimer timer;
+    sr_calls_++;
+    int rc = sr_get_changes_iter(session, xpath.c_str(), &iter);
+    if (rc != SR_ERR_OK) {
+        cerr << "sr_get_changes_iter() failed: " << sr_strerror(rc) << endl;
+        if (mark) {
+            invalidate();
+        }
+        return (rc);
+    }
+
+    uint64_t hash = FNV_OFFSET;
+    while ((rc = sr_get_change_next(session, iter, &oper, &old_value,
+                                    &new_value)) == SR_ERR_OK) {
+        sr_calls_++;
+        sr_val_t* value = new_value ? new_value : old_value;
+        if (value && mark) {
+            markChanged(value->xpath);
+        }
+        if (value && digest) {
+            hashAppend(hash, string(1, static_cast<char>('0' + oper)));
+            hashAppend(hash, value->xpath);
+            hashAppend(hash, new_value ? valueToText(new_value) : "");
+        }
+        sr_free_val(old_value);
+        sr_free_val(new_value);
+        old_value = new_value = NULL;
+    }
+    sr_free_change_iter(iter);
+
+    if (digest) {
+        *digest = hash;
+    }
+    return (rc == SR_ERR_NOT_FOUND ? SR_ERR_OK : rc);
+}
+
+int
+SysrepoKea::rebuildAll() {
+    // Reserved hosts are streamed subnet by subnet when the subnets
+    // are rendered, so they are left out of the tree. Without the
+    // cache the subnets are rendered as they are streamed.
+    YangTree tree(keaNodeChild);
+    sr_calls_++;
+    int rc = tree.load(session_, getRootXPath(),
+                       subnet_cache_ ? "reserved-host" : "subnet6");
+    if (SR_ERR_OK != rc) {
+        cerr << "Error by sr_get_items: " << sr_strerror(rc) << endl;
+        return (rc);
+    }
+    const YangNode* server = tree.getRoot();
+
+    invalidate();
+
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        Section section = static_cast<Section>(s);
+        if (hasGlobals(section)) {
+            renderGlobals(section, server->getChildById(SECTION_NODES[s]));
+            rebuilt_++;
+        }
+    }
+
+    const YangNode* sets = server->getChildById(KEA_NODE_OPTION_SETS);
+    if (sets) {
+        const vector<const YangNode*>& children = sets->getChildren();
+        for (size_t i = 0; i < children.size(); i++) {
+            renderOptionSet(children[i]);
+            rebuilt_++;
+        }
+    }
+
+    const YangNode* ranges = server->getChildById(KEA_NODE_NETWORK_RANGES);
+    vector<const YangNode*> subnets;
+    if (ranges) {
+        const vector<const YangNode*>& children = ranges->getChildren();
+        for (size_t i = 0; i < children.size(); i++) {
+            const YangNode* child = children[i];
+            uint32_t number;
+            switch (child->getSchemaId()) {
+            case KEA_NODE_NETWORK_RANGES_SUBNET6:
+                subnets.push_back(child);
+                break;
+            case KEA_NODE_NETWORK_RANGES_OPTION_SET_ID:
+                if (child->getValue() && getUint(child->getValue(), number)) {
+                    global_option_set_ = number;
+                }
+                break;
+            case KEA_NODE_NETWORK_RANGES_RAPID_COMMIT:
+                if (child->getValue() && child->getValue()->type == SR_BOOL_T) {
+                    default_rapid_commit_ = child->getValue()->data.bool_val ? 1 : 0;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    rc = renderSubnets(subnets);
+    if (rc != SR_ERR_OK) {
+        invalidate();
+        return (rc);
+    }
+    for (size_t i = 0; i < subnets.size(); i++) {
+        cacheSubnetInfo(subnets[i]);
+        rebuilt_++;
+    }
+
+    cache_valid_ = true;
+    return (SR_ERR_OK);
+}
+
+int
+SysrepoKea::rebuildChanged() {
+    changed_host_params_.clear();
+
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        int rc = rebuildSection(static_cast<Section>(s));
+        if (rc != SR_ERR_OK) {
+            return (rc);
+        }
+    }
+    return (SR_ERR_OK);
+}
+
+int
+SysrepoKea::rebuildSection(Section section) {
+    int rc;
+
+    if (hasGlobals(section)) {
+        if (!globals_changed_[section]) {
+            return (SR_ERR_OK);
+        }
+        YangTree tree(keaNodeChild);
+        sr_calls_++;
+        rc = tree.load(session_, getSectionXPath(section));
+        if (rc != SR_ERR_OK && rc != SR_ERR_NOT_FOUND) {
+            return (rc);
+        }
+        renderGlobals(section, rc == SR_ERR_OK ? tree.getRoot() : NULL);
+        globals_changed_[section] = false;
+        rebuilt_++;
+        return (SR_ERR_OK);
+    }
+
+    if (section == SECTION_OPTION_SETS) {
+        for (set<string>::const_iterator it = changed_option_sets_.begin();
+             it != changed_option_sets_.end(); ++it) {
+            YangTree tree(keaNodeChild);
+            sr_calls_++;
+            rc = tree.load(session_, *it);
+            if (rc == SR_ERR_NOT_FOUND) {
+                // Option set has been deleted.
+                map<string, uint32_t>::iterator id = option_set_ids_.find(*it);
+                if (id != option_set_ids_.end()) {
+                    option_sets_.erase(id->second);
+                    option_set_ids_.erase(id);
+                }
+                continue;
+            }
+            if (rc != SR_ERR_OK) {
+                return (rc);
+            }
+            renderOptionSet(tree.getRoot());
+            rebuilt_++;
+        }
+        changed_option_sets_.clear();
+        return (SR_ERR_OK);
+    }
+
+    if (globals_changed_[SECTION_NETWORK_RANGES]) {
+        const string xpath = getSectionXPath(SECTION_NETWORK_RANGES) + "/option-set-id";
+        sr_val_t* value = NULL;
+        sr_calls_++;
+        {
+            SysrepoTimer timer;
+            rc = sr_get_item(session_, xpath.c_str(), &value);
+        }
+        if (rc != SR_ERR_OK && rc != SR_ERR_NOT_FOUND) {
+            return (rc);
+        }
+        uint32_t number;
+        global_option_set_ = -1;
+        if (rc == SR_ERR_OK && getUint(value, number)) {
+            global_option_set_ = number;
+        }
+        sr_free_val(value);
+        globals_changed_[SECTION_NETWORK_RANGES] = false;
+    }
+
+    if (!subnet_cache_) {
+        // Nothing is kept of the subnets.
+        changed_subnets_.clear();
+        changed_subnet_params_.clear();
+        changed_hosts_.clear();
+        return (SR_ERR_OK);
+    }
+
+    for (set<string>::const_iterator it = changed_subnets_.begin();
+         it != changed_subnets_.end(); ++it) {
+        YangTree tree(keaNodeChild);
+        sr_calls_++;
+        rc = tree.load(session_, *it, "reserved-host");
+        if (rc == SR_ERR_NOT_FOUND) {
+            // Subnet has been deleted.
+            forgetSubnetInfo(*it);
+            subnets_.erase(*it);
+            subnet_order_.erase(remove(subnet_order_.begin(),
+                                       subnet_order_.end(), *it),
+                                subnet_order_.end());
+            continue;
+        }
+        if (rc != SR_ERR_OK) {
+            return (rc);
+        }
+        if (subnets_.find(*it) == subnets_.end()) {
+            // New list entries are appended by Sysrepo.
+            subnet_order_.push_back(*it);
+        }
+        // Reservation identifiers are remembered while rendering.
+        forgetSubnetInfo(*it);
+        render_.session = session_;
+        rc = renderSubnet(render_, tree.getRoot(), subnets_[*it]);
+        mergeContext(render_);
+        if (rc != SR_ERR_OK) {
+            return (rc);
+        }
+        cacheSubnetInfo(tree.getRoot());
+        rebuilt_++;
+    }
+    changed_subnets_.clear();
+    changed_subnet_params_.clear();
+    changed_hosts_.clear();
+    return (SR_ERR_OK);
+}
+
+void
+SysrepoKea::startCounting() {
+    if (counted_) {
+        reused_ = 0;
+        rebuilt_ = 0;
+        duplicates_ = 0;
+        counted_ = false;
+    }
+}
+
+void
+SysrepoKea::finishCounting() {
+    size_t fragments = option_sets_.size() + subnets_.size();
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        if (hasGlobals(static_cast<Section>(s))) {
+            fragments++;
+        }
+    }
+    reused_ = fragments > rebuilt_ ? fragments - rebuilt_ : 0;
+    counted_ = true;
+}
+
+bool
+SysrepoKea::getCommands(vector<KeaCommand>& commands) {
+    SysrepoTimeCollector collector(sr_ns_);
+    commands.clear();
+
+    bool globals_changed = false;
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        globals_changed = globals_changed || globals_changed_[s];
+    }
+    if (!targeted_ || !subnet_cache_ || !cache_valid_ || globals_changed ||
+        !changed_option_sets_.empty()) {
+        // Subnets using a changed option set would need to be replaced
+        // too, a new configuration is simpler.
+        return (false);
+    }
+
+    // Remember how Kea knows the affected subnets and reservations
+    // before they get rebuilt from the new data.
+    set<string> subnets = changed_subnets_;
+    set<string> params = changed_subnet_params_;
+    map<string, set<string> > hosts = changed_hosts_;
+    map<string, uint32_t> old_ids;
+    map<string, pair<string, string> > old_hosts;
+    set<string> existed;
+    for (set<string>::const_iterator s = subnets.begin(); s != subnets.end(); ++s) {
+        if (subnets_.count(*s)) {
+            existed.insert(*s);
+        }
+        if (subnet_ids_.count(*s)) {
+            old_ids[*s] = subnet_ids_[*s];
+        }
+        const set<string>& h = hosts[*s];
+        for (set<string>::const_iterator it = h.begin(); it != h.end(); ++it) {
+            if (host_ids_.count(*it)) {
+                old_hosts[*it] = host_ids_[*it];
+            }
+        }
+    }
+
+    startCounting();
+    sr_calls_++;
+    {
+        SysrepoTimer timer;
+        sr_session_refresh(session_);
+    }
+    if (rebuildChanged() != SR_ERR_OK) {
+        invalidate();
+        return (false);
+    }
+    finishCounting();
+
+    for (set<string>::const_iterator s = subnets.begin(); s != subnets.end(); ++s) {
+        bool was = existed.count(*s);
+        bool is = subnets_.count(*s);
+        map<string, uint32_t>::const_iterator old_id = old_ids.find(*s);
+        map<string, uint32_t>::const_iterator new_id = subnet_ids_.find(*s);
+
+        // Kea identifies subnets by id only.
+        if ((was && old_id == old_ids.end()) || (is && new_id == subnet_ids_.end())) {
+            commands.clear();
+            return (false);
+        }
 
-    sr_val_t *all_values = NULL;
-    sr_val_t *values = NULL;
-    size_t count = 0;
-    size_t all_count = 0;
+        if (!was && !is) {
+            continue;
+        }
+
+        string del;
+        if (was) {
+            JsonWriter w(del, style_);
+            w.startMap();
+            w.key("id");
+            w.value(static_cast<uint64_t>(old_id->second));
+            w.endMap();
+        }
+        string add;
+        if (is) {
+            JsonWriter w(add, style_);
+            w.startMap();
+            w.key("subnet6");
+            w.startList();
+            writeSubnetEntry(w, *s);
+            w.endList();
+            w.endMap();
+        }
+
+        if (!is) {
+            commands.push_back(KeaCommand("subnet6-del", del));
+            continue;
+        }
+        if (!was) {
+            commands.push_back(KeaCommand("subnet6-add", add));
+            continue;
+        }
+        if (params.count(*s) || old_id->second != new_id->second) {
+            commands.push_back(KeaCommand("subnet6-del", del));
+            commands.push_back(KeaCommand("subnet6-add", add));
+            continue;
+        }
+
+        // Only reservations within the subnet have changed.
+        const set<string>& h = hosts[*s];
+        for (set<string>::const_iterator it = h.begin(); it != h.end(); ++it) {
+            map<string, pair<string, string> >::const_iterator old_host = old_hosts.find(*it);
+            if (old_host != old_hosts.end()) {
+                string args;
+                JsonWriter w(args, style_);
+                w.startMap();
+                w.key("subnet-id");
+                w.value(static_cast<uint64_t>(old_id->second));
+                w.key("identifier-type");
+                w.value(old_host->second.first);
+                w.key("identifier");
+                w.value(old_host->second.second);
+                w.endMap();
+                commands.push_back(KeaCommand("reservation-del", args));
+            }
+            map<string, string>::const_iterator new_host = changed_host_params_.find(*it);
+            if (new_host != changed_host_params_.end()) {
+                string args;
+                JsonWriter w(args, style_);
+                w.startMap();
+                w.key("reservation");
+                w.startMap();
+                w.key("subnet-id");
+                w.value(static_cast<uint64_t>(new_id->second));
+                w.rawMembers(new_host->second);
+                w.endMap();
+                w.endMap();
+                commands.push_back(KeaCommand("reservation-add", args));
+            }
+        }
+    }
+
+    changed_host_params_.clear();
+    return (true);
+}
+
+int
+SysrepoKea::updateConfig() {
+    SysrepoTimeCollector collector(sr_ns_);
     int rc = SR_ERR_OK;
 
-    /* Going through all of the nodes */
-    sr_session_refresh(session_);
-    rc = sr_get_items(session_, "/ietf-kea-dhcpv6:server//*", &all_values, &all_count);
+    startCounting();
+    sr_calls_++;
+    {
+        SysrepoTimer timer;
+        sr_session_refresh(session_);
+    }
+
+    if (cache_valid_) {
+        rc = rebuildChanged();
+        if (SR_ERR_OK != rc) {
+            cerr << "Failed to rebuild changed fragments: "
+                 << sr_strerror(rc) << endl;
+            reused_ = 0;
+            rebuilt_ = 0;
+            duplicates_ = 0;
+            cache_valid_ = false;
+        }
+    }
+    if (!cache_valid_) {
+        rc = rebuildAll();
+    }
+    finishCounting();
+    return (rc);
+}
+
+int
+SysrepoKea::updateSection(Section section) {
+    if (!cache_valid_) {
+        return (SR_ERR_OK);
+    }
+    SysrepoTimeCollector collector(sr_ns_);
+
+    startCounting();
+    sr_calls_++;
+    {
+        SysrepoTimer timer;
+        sr_session_refresh(session_);
+    }
+    changed_host_params_.clear();
+    int rc = rebuildSection(section);
     if (SR_ERR_OK != rc) {
-        cerr << "Error by sr_get_items: %s" << sr_strerror(rc);
+        cerr << "Failed to rebuild " << SECTION_NAMES[section] << ": "
+             << sr_strerror(rc) << endl;
+        invalidate();
+    }
+    return (rc);
+}
+
+string
+SysrepoKea::getConfig() {
+    if (SR_ERR_OK != updateConfig()) {
         return ("");
     }
-    sr_free_values(all_values, all_count);
 
-    ostringstream s;
+    // Assemble the document in one buffer of the right size.
+    size_t size = 64;
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        size += globals_[s].size() + contexts_[s].size();
+    }
+    for (map<string, string>::const_iterator it = subnets_.begin();
+         it != subnets_.end(); ++it) {
+        size += it->second.size() + 32;
+    }
+    for (map<string, uint32_t>::const_iterator it = subnet_option_sets_.begin();
+         it != subnet_option_sets_.end(); ++it) {
+        map<uint32_t, OptionData>::const_iterator set = option_sets_.find(it->second);
+        if (set != option_sets_.end()) {
+            size += set->second.subnet.size() + 32;
+        }
+    }
+    string json;
+    json.reserve(size);
 
-    s << "{" << endl << "\"Dhcp6\": {" << endl;
+    ConfigStream stream(*this);
+    const char* data;
+    size_t len;
+    while (stream.next(data, len)) {
+        json.append(data, len);
+    }
+    return (json);
+}
 
-    // Control socket parameters
-    s << tabs(1) << "\"control-socket\": {" << endl;
-    s << getFormattedValue("serv-attributes/control-socket/socket-type", "socket-type", 2, true) << endl;
-    s << getFormattedValue("serv-attributes/control-socket/socket-name", "socket-name", 2, false) << endl;
-    s << tabs(1) << "}," << endl;
+struct SysrepoKea::ConfigStream::Reader {
+    /// @brief Constructor
+    ///
+    /// @param session session to read with
+    /// @param xpath xpath of the subnet6 list
+    Reader(sr_session_ctx_t* session, const string& xpath)
+        :subnets(session, xpath, SUBNET_BATCH, "reserved-host"),
+         batch(keaNodeChild), next(0), count(0), subnet(NULL),
+         host_batch(keaNodeChild), listed(false) {
+        render.session = session;
+    }
 
-    /// @todo: There may be multiple interfaces specified, need to iterate through all of them, not just pick first.
-    sr_val_t* value = NULL;
-    rc = sr_get_item(session_, "/ietf-kea-dhcpv6:server/serv-attributes/interfaces-config/interfaces", &value);
-    if (rc == SR_ERR_OK) {
-        s << tabs(1) << "\"interfaces-config\": { " << endl;;
-        s << tabs(2) << "\"interfaces\": [ \"" << endl;;
-        s << tabs(2) << value->data.string_val << endl;
-        s << tabs(2) << "\" ]" << endl;
-        s << tabs(1) << "}," << endl;;
-        sr_free_values(value, 1);
+    YangListReader subnets;         ///< reads the subnets
+    YangTree batch;                 ///< subnets read last
+    size_t next;                    ///< next subnet in the batch
+    size_t count;                   ///< subnets in the batch
+    const YangNode* subnet;         ///< subnet being written
+    unique_ptr<YangListReader> hosts; ///< reads its reservations
+    YangTree host_batch;            ///< reservations read last
+    bool listed;                    ///< "reservations" list is started
+    RenderContext render;           ///< identifiers seen in the subnet
+};
 
+SysrepoKea::ConfigStream::ConfigStream(SysrepoKea& translator)
+    :translator_(translator), writer_(buffer_, translator.style_), stage_(START),
+     section_(0), subnet_(0), fragment_(NULL), error_(SR_ERR_OK) {
+    buffer_.reserve(CHUNK_SIZE + FRAGMENT_SIZE);
+    if (!translator.subnet_cache_) {
+        reader_.reset(new Reader(translator.session_,
+            translator.getSectionXPath(SECTION_NETWORK_RANGES) + "/subnet6"));
     }
+}
 
-    // Lease database
-    /// @todo: Lease database does not seem to be configurable using YANG model.
+SysrepoKea::ConfigStream::~ConfigStream() {
+}
 
-    // Generate all subnets
-    string subnets = getSubnets("network-ranges/subnet6", 1);
+bool
+SysrepoKea::ConfigStream::next(const char*& data, size_t& size) {
+    // A large fragment follows the text written before it.
+    if (fragment_) {
+        data = fragment_->data();
+        size = fragment_->size();
+        fragment_ = NULL;
+        return (true);
+    }
 
-    // Timers
-    s << getFormattedValue("serv-attributes/renew-timer", "renew-timer", 1, true) << endl;
-    s << getFormattedValue("serv-attributes/rebind-timer", "rebind-timer", 1, true) << endl;
-    s << getFormattedValue("serv-attributes/preferred-lifetime", "preferred-lifetime", 1, true) << endl;
-    s << getFormattedValue("serv-attributes/valid-lifetime", "valid-lifetime", 1, !subnets.empty()) << endl;
+    // Subnets read now count as read by the translator.
+    uint64_t unused = 0;
+    SysrepoTimeCollector collector(reader_ ? translator_.sr_ns_ : unused);
 
-    s << subnets << endl;
+    // The writer only appends, so the buffer can be emptied at any time.
+    buffer_.clear();
+    while (!fragment_ && stage_ != DONE && buffer_.size() < CHUNK_SIZE) {
+        step();
+    }
+    if (buffer_.empty()) {
+        return (false);
+    }
+    data = buffer_.data();
+    size = buffer_.size();
+    return (true);
+}
 
-    s << "}" << endl << "}" << endl;
+const YangNode*
+SysrepoKea::ConfigStream::nextSubnet() {
+    Reader& r = *reader_;
+    if (r.next == r.count) {
+        translator_.sr_calls_++;
+        int rc = r.subnets.next(r.batch);
+        if (rc != SR_ERR_OK) {
+            if (rc != SR_ERR_NOT_FOUND) {
+                cerr << "Failed to read subnets: " << sr_strerror(rc) << endl;
+                error_ = rc;
+            }
+            return (NULL);
+        }
+        r.count = r.batch.getRoot()->getChildren().size();
+        r.next = 0;
+    }
+    r.subnet = r.batch.getRoot()->getChildren()[r.next++];
+    return (r.subnet);
+}
+
+void
+SysrepoKea::ConfigStream::step() {
+    SysrepoKea& t = translator_;
+    switch (stage_) {
+    case START:
+        writer_.startMap();
+        writer_.key("Dhcp6");
+        writer_.startMap();
+        stage_ = GLOBALS;
+        break;
 
-    return (s.str());
+    case GLOBALS:
+        // In the order of the sections, whichever was rebuilt last.
+        if (section_ == SECTION_COUNT) {
+            bool context = false;
+            for (size_t s = 0; s < SECTION_COUNT; s++) {
+                if (!t.contexts_[s].empty()) {
+                    if (!context) {
+                        writer_.key("user-context");
+                        writer_.startMap();
+                        context = true;
+                    }
+                    writer_.rawMembers(t.contexts_[s]);
+                }
+            }
+            if (context) {
+                writer_.endMap();
+            }
+            stage_ = OPTIONS;
+            break;
+        }
+        addMembers(t.globals_[section_++]);
+        break;
+
+    case OPTIONS:
+        if (t.global_option_set_ >= 0) {
+            t.writeOptionData(writer_, static_cast<uint32_t>(t.global_option_set_), true);
+        }
+        stage_ = SUBNET;
+        break;
+
+    case SUBNET:
+        if (reader_ ? !nextSubnet() : subnet_ == t.subnet_order_.size()) {
+            if (error_ != SR_ERR_OK) {
+                // Cut short, Kea will not take it.
+                stage_ = DONE;
+                break;
+            }
+            if (subnet_) {
+                writer_.endList();
+            }
+            stage_ = END;
+            break;
+        }
+        if (!subnet_) {
+            writer_.key("subnet6");
+            writer_.startList();
+        }
+        writer_.startMap();
+        stage_ = SUBNET_END;
+        if (reader_) {
+            const YangNode* subnet = reader_->subnet;
+            t.writeSubnetParams(writer_, subnet);
+            if (subnet->hasSkippedChildren()) {
+                // Kea wants identifiers unique within a subnet only.
+                reader_->render.duids.clear();
+                reader_->render.hw_addrs.clear();
+                reader_->hosts.reset(new YangListReader(reader_->render.session,
+                    subnet->getXPath() + "/reserved-host", RESERVATION_BATCH));
+                reader_->listed = false;
+                stage_ = RESERVATIONS;
+            }
+        } else {
+            map<string, string>::const_iterator it = t.subnets_.find(t.subnet_order_[subnet_]);
+            if (it != t.subnets_.end()) {
+                addMembers(it->second);
+            }
+        }
+        break;
+
+    case RESERVATIONS:
+        {
+            // One batch at a time, the buffer is sent in between.
+            Reader& r = *reader_;
+            t.sr_calls_++;
+            int rc = r.hosts->next(r.host_batch);
+            if (rc == SR_ERR_OK) {
+                const vector<const YangNode*>& hosts = r.host_batch.getRoot()->getChildren();
+                for (size_t i = 0; i < hosts.size(); i++) {
+                    t.writeReservation(r.render, writer_, hosts[i], NULL, r.listed);
+                }
+                break;
+            }
+            r.hosts.reset();
+            if (rc != SR_ERR_NOT_FOUND) {
+                cerr << "Failed to read reservations of " << r.subnet->getXPath()
+                     << ": " << sr_strerror(rc) << endl;
+                error_ = rc;
+                stage_ = DONE;
+                break;
+            }
+            if (r.listed) {
+                writer_.endList();
+            }
+        }
+        stage_ = SUBNET_END;
+        break;
+
+    case SUBNET_END:
+        if (reader_) {
+            const YangNode* set = reader_->subnet->getChildById(
+                KEA_NODE_NETWORK_RANGES_SUBNET6_OPTION_SET_ID);
+            uint32_t number;
+            if (set && set->getValue() && getUint(set->getValue(), number)) {
+                t.writeOptionData(writer_, number, false);
+            }
+        } else {
+            map<string, uint32_t>::const_iterator set =
+                t.subnet_option_sets_.find(t.subnet_order_[subnet_]);
+            if (set != t.subnet_option_sets_.end()) {
+                t.writeOptionData(writer_, set->second, false);
+            }
+        }
+        writer_.endMap();
+        subnet_++;
+        stage_ = SUBNET;
+        break;
+
+    case END:
+        writer_.endMap();
+        writer_.endMap();
+        buffer_ += '\n';
+        stage_ = DONE;
+        break;
+
+    case DONE:
+        break;
+    }
+}
+
+void
+SysrepoKea::ConfigStream::addMembers(const string& members) {
+    if (members.size() < FRAGMENT_SIZE) {
+        writer_.rawMembers(members);
+        return;
+    }
+    writer_.beginRawMembers();
+    fragment_ = &members;
 }
@@ -13,18 +13,29 @@ extern "C" {
 #include "sysrepo.h"
 };
 
+#include "json-writer.h"
+#include "yang-tree.h"
+
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
-/// @brief convenient funtion that generates spaces for specified
-///        indentation level
-///
-/// For example for 1 it generates string("    "), for 2
-/// it is string("        ") and so on.
-///
-/// @param int identation level
-///
-/// @return a string with appropriate number of spaces.
-std::string tabs(int level);
+/// @brief A Kea command that applies part of a change.
+struct KeaCommand {
+    /// @brief Constructor
+    ///
+    /// @param name command name, e.g. "subnet6-add"
+    /// @param args JSON text of the command arguments
+    KeaCommand(const std::string& name, const std::string& args)
+        :command(name), arguments(args) {
+    }
+
+    std::string command;   ///< command name
+    std::string arguments; ///< JSON text of the arguments
+};
 
 class SysrepoKea {
 public:
@@ -36,6 +47,9 @@ public:
     /// @param session a Sysrepo session to be used.
     SysrepoKea(sr_session_ctx_t* session);
 
+    /// @brief Destructor (stops sessions of worker threads)
+    ~SysrepoKea();
+
     /// @brief Returns the model name.
     std::string getModelName() {
         return (model_name_);
@@ -48,6 +62,100 @@ public:
     /// @param name name of the model to be used.
     void setModelName(const std::string& name) {
         model_name_ = name;
+        invalidate();
+    }
+
+    /// @brief Sets the Sysrepo session used for retrieving data.
+    ///
+    /// The translator keeps its fragment cache across sessions, so
+    /// it can be used from callbacks that get their own session.
+    ///
+    /// @param session a Sysrepo session to be used.
+    void setSession(sr_session_ctx_t* session) {
+        session_ = session;
+    }
+
+    /// @brief Sets number of threads translating subnets.
+    ///
+    /// When the whole model is translated, subnets are split among a
+    /// fixed number of threads working on the same in-memory snapshot.
+    /// Fragments are put together in datastore order, so the output
+    /// does not depend on the number of threads. Sysrepo sessions must
+    /// not be shared between threads, so a session is started for each
+    /// thread but the calling one (which uses the translator session).
+    ///
+    /// @param threads number of threads (1 translates in the calling
+    ///        thread only)
+    /// @param connection Sysrepo connection the sessions are started on
+    /// @param datastore datastore of the translator session
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int setThreads(size_t threads, sr_conn_ctx_t* connection,
+                   sr_datastore_t datastore);
+
+    /// @brief Returns number of threads translating subnets.
+    size_t getThreads() const {
+        return (workers_.size() + 1);
+    }
+
+    /// @brief Enables or disables the translation threads.
+    ///
+    /// Sessions of the threads read the running datastore, which does
+    /// not have the changes of a commit being verified yet, so only
+    /// the calling thread (with the session of the change callback)
+    /// may translate in the verify event.
+    ///
+    /// @param enabled false to translate in the calling thread only
+    void setThreadsEnabled(bool enabled) {
+        threads_enabled_ = enabled;
+    }
+
+    /// @brief Enables or disables targeted commands (see getCommands()).
+    ///
+    /// Kea deletes reservations by identifier, so with targeted
+    /// commands the identifiers of all reservations are kept; without
+    /// them nothing is kept and getCommands() always returns false.
+    /// Enabling drops the cache, which has no identifiers.
+    ///
+    /// @param enabled true if getCommands() will be used
+    void setTargeted(bool enabled) {
+        if (enabled != targeted_) {
+            targeted_ = enabled;
+            invalidate();
+        }
+    }
+
+    /// @brief Enables or disables the cache of subnet fragments.
+    ///
+    /// With the cache (the default) a subnet is rendered once and its
+    /// fragment kept until it changes. Without it, only the global
+    /// parameters and the option sets are cached: subnets and their
+    /// reservations are read from Sysrepo in batches and rendered as a
+    /// ConfigStream is read, every time one is read. Memory then no
+    /// longer grows with the number of subnets and reservations (save
+    /// for the identifiers of one subnet's reservations, kept to tell
+    /// duplicates), at the cost of reading Sysrepo on each stream and
+    /// of targeted commands, which need the fragments.
+    ///
+    /// @param enabled false to render subnets as they are streamed
+    void setSubnetCache(bool enabled) {
+        if (enabled != subnet_cache_) {
+            subnet_cache_ = enabled;
+            invalidate();
+        }
+    }
+
+    /// @brief Sets the JSON output style.
+    ///
+    /// Kea does not need any white space, so COMPACT (the default)
+    /// is used for what is sent to it; PRETTY is meant for humans.
+    ///
+    /// @param style output style
+    void setStyle(JsonWriter::Style style) {
+        if (style != style_) {
+            style_ = style;
+            invalidate();
+        }
     }
 
     /// @brief converts sr_type_t to textual form
@@ -67,70 +175,686 @@ public:
     valueToText(sr_val_t *value, bool xpath = false,
                 bool type = false);
 
+    /// @brief Writes sysrepo value as JSON value.
+    ///
+    /// Strings and string-like types (enumerations, identities, bits,
+    /// binary and instance identifiers) become JSON strings, numbers
+    /// and booleans are written as such. Containers and lists produce
+    /// nothing.
+    ///
+    /// @param w writer to be used
+    /// @param value value to be written
+    static void writeValue(JsonWriter& w, const sr_val_t* value);
+
+    /// @brief Sections of the model (the containers below its root)
+    ///
+    /// Each section can have a change subscription of its own, which
+    /// marks and regenerates the fragments of that section only (see
+    /// collectChanges() and updateSection()).
+    enum Section {
+        SECTION_SERV_ATTRIBUTES,      ///< global parameters
+        SECTION_CUSTOM_OPTIONS,       ///< option definitions
+        SECTION_OPTION_SETS,          ///< option data, by option-set-id
+        SECTION_NETWORK_RANGES,       ///< subnets and their reservations
+        SECTION_RSOO_ENABLED_OPTIONS, ///< relay supplied options
+        SECTION_COUNT                 ///< number of sections
+    };
+
+    /// @brief Returns the name of a section (of its container).
+    static const char* getSectionName(Section section);
+
+    /// @brief Returns the xpath of a section, e.g.
+    ///        /ietf-kea-dhcpv6:server/network-ranges
+    std::string getSectionXPath(Section section) const;
+
     /// @brief Retrieves config from Sysrepo and generates Kea config
     ///        in JSON format.
     ///
+    /// The generated JSON is kept as fragments: one for the global
+    /// parameters of each section that has some (serv-attributes,
+    /// custom-options and rsoo-enabled-options), one per subnet and
+    /// one per option set. Option data of subnets and of the server refers to option
+    /// sets by id, so a shared option set is rendered once and inserted
+    /// wherever it is used when the document is assembled. On the first
+    /// call (or after invalidate()) the whole model is fetched with a
+    /// single Sysrepo call into an in-memory tree and all fragments are
+    /// generated. Subsequent calls only fetch and regenerate fragments
+    /// marked as changed by collectChanges() or markChanged() and reuse
+    /// the others.
+    ///
     /// @param returns Kea config in JSON format.
     std::string getConfig();
 
+    /// @brief Brings the fragments up to date, without assembling the
+    ///        document.
+    ///
+    /// Does what getConfig() does before the document is put together;
+    /// the document can then be read with a ConfigStream.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int updateConfig();
+
+    /// @brief The Kea configuration, assembled from the fragments as it
+    ///        is read.
+    ///
+    /// Small fragments and the text around them are put together in a
+    /// buffer of about CHUNK_SIZE bytes; larger fragments (e.g. a subnet
+    /// with many reservations) are returned from the fragment cache as
+    /// they are. However large the configuration, reading it takes no
+    /// more memory than that buffer. The fragments must not change
+    /// while the stream is read (see updateConfig()).
+    ///
+    /// Without the subnet cache (see setSubnetCache()), subnets are read
+    /// from Sysrepo with the session of the translator and rendered into
+    /// the buffer as the stream gets to them.
+    class ConfigStream : public JsonSource {
+    public:
+        /// Size the buffer is filled up to
+        static const size_t CHUNK_SIZE = 65536;
+
+        /// Fragments at least this large are not copied to the buffer
+        static const size_t FRAGMENT_SIZE = 4096;
+
+        /// @brief Constructor
+        ///
+        /// @param translator translator whose fragments are read
+        ConfigStream(SysrepoKea& translator);
+
+        /// @brief Destructor
+        ~ConfigStream();
+
+        /// @brief Returns the next piece of the configuration.
+        virtual bool next(const char*& data, size_t& size);
+
+        /// @brief Returns true when the whole configuration was read.
+        virtual bool done() const {
+            return (stage_ == DONE && !fragment_);
+        }
+
+        /// @brief Returns the Sysrepo error that cut the stream short.
+        ///
+        /// Only subnets read without the cache can fail; what was
+        /// returned then is not a complete document.
+        ///
+        /// @return Sysrepo error code (SR_ERR_OK if there was none)
+        int getError() const {
+            return (error_);
+        }
+
+    private:
+        /// @brief Parts of the document
+        enum Stage {
+            START,        ///< start of the Dhcp6 map
+            GLOBALS,      ///< global parameters of a section, then the
+                          ///< user-context of Dhcp6
+            OPTIONS,      ///< global option data, start of subnet6
+            SUBNET,       ///< start of a subnet entry
+            RESERVATIONS, ///< a batch of reservations (without the cache)
+            SUBNET_END,   ///< option data and end of a subnet entry
+            END,          ///< end of the document
+            DONE          ///< nothing left
+        };
+
+        /// @brief Writes the next part of the document to the buffer.
+        void step();
+
+        /// @brief Adds map members, to the buffer if they are small,
+        ///        as the next piece if they are not.
+        void addMembers(const std::string& members);
+
+        /// @brief Moves to the next subnet read from Sysrepo.
+        ///
+        /// @return the subnet6 node, NULL if there are no more
+        const YangNode* nextSubnet();
+
+        /// Subnets and reservations being read (without the cache)
+        struct Reader;
+
+        SysrepoKea& translator_;        ///< translator read from
+        std::string buffer_;            ///< text being put together
+        JsonWriter writer_;             ///< writes into the buffer
+        Stage stage_;                   ///< next part to write
+        size_t section_;                ///< next section (in globals_)
+        size_t subnet_;                 ///< next subnet (in subnet_order_)
+        const std::string* fragment_;   ///< fragment returned next
+        std::unique_ptr<Reader> reader_; ///< NULL with the cache
+        int error_;                     ///< Sysrepo error, see getError()
+    };
+
+    /// @brief Generates targeted Kea commands for the pending changes.
+    ///
+    /// Instead of a whole new configuration, changes to subnets and
+    /// their reservations are translated into subnet6-add, subnet6-del,
+    /// reservation-add and reservation-del commands (provided by Kea's
+    /// subnet_cmds and host_cmds hooks). A modified subnet is deleted
+    /// and added again; a modified reservation likewise.
+    ///
+    /// Like getConfig(), this regenerates the changed fragments, so a
+    /// getConfig() call that follows only assembles the document.
+    ///
+    /// @param commands (out) commands to be sent in order
+    ///
+    /// @return false if the changes can't be applied with targeted
+    ///         commands (not enabled by setTargeted(), no subnet
+    ///         cache, global parameters or option sets changed, no
+    ///         cached config, subnet without network-range-id, ...) and
+    ///         the full configuration must be pushed with config-set
+    ///         instead.
+    bool getCommands(std::vector<KeaCommand>& commands);
+
+    /// @brief Marks fragments affected by the changes of a commit.
+    ///
+    /// Must be called from a module change callback, as it walks the
+    /// change set with the Sysrepo change iterator.
+    ///
+    /// @param session session passed to the change callback
+    /// @param digest (out) if not NULL, digest of the changes (see
+    ///        getChangesDigest())
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int collectChanges(sr_session_ctx_t* session, uint64_t* digest = NULL);
+
+    /// @brief Marks fragments affected by the changes of a commit within
+    ///        a section.
+    ///
+    /// Like the other collectChanges(), but only the changes below the
+    /// section are walked, e.g. from the change callback of a
+    /// subscription to the section.
+    ///
+    /// @param session session passed to the change callback
+    /// @param section the section
+    /// @param digest (out) if not NULL, digest of the changes of the
+    ///        section
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int collectChanges(sr_session_ctx_t* session, Section section,
+                       uint64_t* digest = NULL);
+
+    /// @brief Regenerates the changed fragments of a section.
+    ///
+    /// The other sections are left as they are, so the work of a commit
+    /// can be done by the callbacks of the sections it touches and the
+    /// updateConfig() that follows only assembles the document. Nothing
+    /// is done while the cache is not valid, updateConfig() translates
+    /// the whole model then. Fragments regenerated here are counted in
+    /// getRebuiltFragments() of that updateConfig().
+    ///
+    /// Targeted commands are made from the fragments as they were
+    /// before, so this must not be used before getCommands().
+    ///
+    /// @param section the section
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success); the cache is
+    ///         invalidated on failure
+    int updateSection(Section section);
+
+    /// @brief Computes a digest of the changes of a commit.
+    ///
+    /// The digest covers the operation, xpath and new value of every
+    /// change, so the verify and apply events of a commit have the same
+    /// digest and those of different commits (almost surely) don't.
+    /// Nothing is marked as changed.
+    ///
+    /// @param session session passed to the change callback
+    /// @param digest (out) digest of the changes
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int getChangesDigest(sr_session_ctx_t* session, uint64_t& digest);
+
+    /// @brief Marks the fragment containing the xpath as changed.
+    ///
+    /// Changes that cannot be attributed to a single fragment
+    /// invalidate the whole cache.
+    ///
+    /// @param xpath xpath of a created, modified or deleted node
+    void markChanged(const std::string& xpath);
+
+    /// @brief Drops all cached fragments.
+    ///
+    /// The next getConfig() will translate the whole model.
+    void invalidate();
+
+    /// @brief Returns number of fragments reused by the last getConfig().
+    size_t getReusedFragments() const {
+        return (reused_);
+    }
+
+    /// @brief Returns number of fragments rebuilt by the last getConfig()
+    ///        (and by the updateSection() calls before it).
+    size_t getRebuiltFragments() const {
+        return (rebuilt_);
+    }
+
+    /// @brief Returns number of Sysrepo calls made so far.
+    ///
+    /// Every YangTree::load() counts as one call (it is a single
+    /// sr_get_items()).
+    size_t getSysrepoCalls() const {
+        return (sr_calls_);
+    }
+
+    /// @brief Returns time spent reading Sysrepo so far (nanoseconds).
+    ///
+    /// Time of translation threads is included, so it may grow faster
+    /// than the wall clock.
+    uint64_t getSysrepoTime() const {
+        return (sr_ns_);
+    }
+
+    /// @brief Returns number of reservations skipped by the last
+    ///        getConfig() because of a duplicate identifier.
+    size_t getDuplicateReservations() const {
+        return (duplicates_);
+    }
+
+    /// @brief Returns prefixes of the subnets that have a subnet id.
+    ///
+    /// Subnets without a network-range-id get their id from Kea and
+    /// are not included. Without the subnet cache the ids are read from
+    /// Sysrepo.
+    ///
+    /// @param subnets (out) Kea subnet id -> subnet prefix
+    /// @param delegating (out) ids of the subnets with prefix pools,
+    ///        whose leases are not all in the subnet prefix
+    void getSubnetIds(std::map<uint32_t, std::string>& subnets,
+                      std::set<uint32_t>& delegating) const;
+
 private:
-    /// @brief Returns a pool specified by xpath as JSON text
+    /// @brief Hash of a host identifier (see identifierHash())
+    struct IdentifierHash {
+        size_t operator()(const std::string& id) const;
+    };
+
+    /// @brief Equality of host identifiers, as Kea sees them
+    struct IdentifierEqual {
+        bool operator()(const std::string& a, const std::string& b) const;
+    };
+
+    /// Host identifiers, spelled any way Kea accepts
+    typedef std::unordered_set<std::string, IdentifierHash, IdentifierEqual> IdentifierSet;
+
+    /// @brief State of subnet rendering
+    ///
+    /// Threads rendering subnets in parallel have one each. Identifiers
+    /// of the reservations written are collected here and merged into
+    /// the translator by mergeContext() when the threads are done.
+    struct RenderContext {
+        /// @brief Constructor
+        RenderContext()
+            :session(NULL), sr_calls(0), sr_ns(0), duplicates(0) {
+        }
+
+        sr_session_ctx_t* session; ///< session reservations are read with
+        std::string scratch;       ///< buffer fragments are rendered into
+        IdentifierSet duids;       ///< DUIDs (per subnet)
+        IdentifierSet hw_addrs;    ///< hardware addresses (per subnet)
+        /// Identifiers of reservations, see host_ids_ (targeted only)
+        std::map<std::string, std::pair<std::string, std::string> > host_ids;
+        /// Parameters of changed reservations, see changed_host_params_
+        std::map<std::string, std::string> host_params;
+        size_t sr_calls;           ///< Sysrepo calls made
+        uint64_t sr_ns;            ///< time spent reading Sysrepo
+        size_t duplicates;         ///< reservations skipped as duplicates
+    };
+
+    /// @brief Merges results collected in a render context.
+    ///
+    /// @param ctx context to be merged (and emptied)
+    void mergeContext(RenderContext& ctx);
+
+    /// @brief Renders subnets of a snapshot, in parallel if configured.
+    ///
+    /// Fragments are stored (and subnet_order_ filled) in the order of
+    /// the subnets vector.
+    ///
+    /// @param subnets subnet6 nodes
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int renderSubnets(const std::vector<const YangNode*>& subnets);
+
+    /// @brief Option data rendered from an option set
+    ///
+    /// The same list is inserted at different depths, which matters
+    /// for indentation of PRETTY output.
+    struct OptionData {
+        std::string global; ///< for Dhcp6 (members are two levels deep)
+        std::string subnet; ///< for subnets (four levels deep)
+    };
+
+    /// @brief Gets value of an unsigned integer leaf
+    ///
+    /// @param value Sysrepo value (uint8, uint16 or uint32)
+    /// @param number (out) value of the leaf
+    ///
+    /// @return false if the value is not a number
+    static bool getUint(const sr_val_t* value, uint32_t& number);
+
+    /// @brief Renders option data of an option set
+    ///
+    /// @param set option-set node
+    /// @param json (out) option-data list
+    /// @param level depth the list will be inserted at
+    void renderOptionData(const YangNode* set, std::string& json, int level);
+
+    /// @brief Renders an option set and caches it by its id
+    ///
+    /// @param set option-set node
+    void renderOptionSet(const YangNode* set);
+
+    /// @brief Writes "option-data" member with a cached option set
+    ///
+    /// Nothing is written (but a warning logged) if there is no
+    /// option set with the id.
+    ///
+    /// @param w writer to be used
+    /// @param id option-set-id
+    /// @param global true for Dhcp6 option data, false for a subnet
+    void writeOptionData(JsonWriter& w, uint32_t id, bool global) const;
+
+    /// @brief Writes an address pool as JSON map
     ///
-    /// @param xpath XPath to the pool to be returned
-    /// @param indent indentation level
+    /// Either pool-prefix or the start and end addresses make the pool.
     ///
-    /// @return string with specified pool as JSON text
-    std::string getPool(const char *xpath, int indent);
+    /// @param w writer to be used
+    /// @param pool address-pool node
+    void writePool(JsonWriter& w, const YangNode* pool);
 
-    /// @brief Returns array of pools specified by xpath as JSON text
+    /// @brief Writes a prefix pool as JSON map
     ///
-    /// @param xpath XPath to the pools list to be returned
-    /// @param indent indentation level
+    /// The model has no delegated length, so the whole prefix is
+    /// delegated.
     ///
-    /// @return string with specified pools array as JSON text
-    std::string getPools(const char *xpath, int indent);
+    /// @param w writer to be used
+    /// @param pool prefix-pool node
+    void writePdPool(JsonWriter& w, const YangNode* pool);
 
-    /// @brief Returns a Subnet specified by xpath as JSON text
+    /// @brief Writes "server-id" member from the serv-attributes DUID
     ///
-    /// @param xpath XPath to the subnet to be returned
-    /// @param indent indentation level
+    /// The leaf has either the DUID type (1 to 3) or the whole DUID in
+    /// hex; the latter is split into the fields Kea wants.
     ///
-    /// @return string of JSON text
-    std::string getSubnet(const char *xpath, int indent);
+    /// @param w writer to be used
+    /// @param duid duid node
+    void writeServerId(JsonWriter& w, const YangNode* duid);
 
+    /// @brief Writes value of a leaf as the type its Kea parameter has
+    ///
+    /// @param w writer to be used
+    /// @param leaf leaf node (with a value)
+    static void writeKeaValue(JsonWriter& w, const YangNode* leaf);
 
-    /// @brief Returns array of subnets specified by xpath as JSON text
+    /// @brief Writes "user-context" member with leaves Kea has no
+    ///        parameter for
     ///
-    /// @param xpath XPath to the subnets list to be returned
-    /// @param indent indentation level
+    /// Nothing is written if there are no such leaves.
     ///
-    /// @return string with specified subnets array as JSON text
-    std::string getSubnets(const std::string& xpath, int indent);
+    /// @param w writer to be used
+    /// @param context leaves collected by writeNodes()
+    static void writeUserContext(JsonWriter& w,
+                                 const std::vector<const YangNode*>& context);
 
-    /// @brief Returns a value specified by xpath as JSON text
+    /// @brief Writes nodes as map members, as the mapping table says
     ///
-    /// @param xpath XPath to the value to be returned
+    /// Nodes are told apart by the schema id assigned when the tree was
+    /// loaded (see kea-map.h), so no names are compared here. Entries
+    /// of a list follow one another and become a single JSON list.
+    ///
+    /// @param w writer to be used
+    /// @param parent node the nodes belong to (may be NULL)
+    /// @param nodes nodes to be written
+    /// @param context (out) leaves that go to the user context
+    void writeNodes(JsonWriter& w, const YangNode* parent,
+                    const std::vector<const YangNode*>& nodes,
+                    std::vector<const YangNode*>& context);
+
+    /// @brief Writes children of a node as map members, with their
+    ///        user context
     ///
-    /// @return string with specified element as JSON text
-    std::string getValue(const std::string& xpath);
+    /// @param w writer to be used
+    /// @param node node the children belong to
+    void writeMembers(JsonWriter& w, const YangNode* node);
 
-    /// @brief Returns a formatted value of element specified by xpath as JSON text
+    /// @brief Writes "reservations" member of a subnet
+    ///
+    /// Reserved hosts are left out of the tree the subnet node belongs
+    /// to. They are read from Sysrepo in batches (if the tree says the
+    /// subnet has any), so the number of reservations held in memory is
+    /// bounded by the batch size.
+    ///
+    /// @param ctx render context
+    /// @param w writer to be used
+    /// @param subnet subnet6 node the reservations belong to
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int writeReservations(RenderContext& ctx, JsonWriter& w,
+                          const YangNode* subnet);
+
+    /// @brief Writes a host reservation as an entry of "reservations"
+    ///
+    /// Kea rejects a configuration with two reservations for the same
+    /// host in a subnet, so a reservation with the DUID or hardware
+    /// address of an earlier one is skipped (and reported). The check
+    /// uses sets of the identifiers seen in the subnet.
+    ///
+    /// Identifiers of the reservations are remembered for getCommands().
+    ///
+    /// @param ctx render context (its sets are cleared for each subnet)
+    /// @param w writer to be used
+    /// @param host reserved-host node
+    /// @param changed xpaths of the changed reservations of the subnet
+    ///        (NULL if there are none)
+    /// @param listed (in/out) whether the "reservations" list is started
+    void writeReservation(RenderContext& ctx, JsonWriter& w, const YangNode* host,
+                          const std::set<std::string>* changed, bool& listed);
+
+    /// @brief Writes parameters of a host reservation as map members
+    ///
+    /// @param w writer to be used
+    /// @param host reserved-host node
+    void writeReservationParams(JsonWriter& w, const YangNode* host);
+
+    /// @brief Returns host identifier used by Kea for a reservation
+    ///
+    /// @param host reserved-host node
+    /// @param type (out) identifier type ("duid" or "hw-address")
+    /// @param id (out) identifier value
+    ///
+    /// @return false if the reservation has no identifier
+    static bool getReservationId(const YangNode* host, std::string& type,
+                                 std::string& id);
+
+    /// @brief Remembers subnet id, option set and prefix pools of a
+    ///        subnet.
+    ///
+    /// Targeted commands for deleted subnets need the id after the
+    /// data is gone from Sysrepo. The option set is inserted when the
+    /// document is assembled.
+    ///
+    /// @param subnet subnet6 node
+    void cacheSubnetInfo(const YangNode* subnet);
+
+    /// @brief Forgets everything cached about a subnet.
+    ///
+    /// @param xpath subnet6 xpath
+    void forgetSubnetInfo(const std::string& xpath);
+
+    /// @brief Writes subnet parameters, but the reservations, as map
+    ///        members
+    ///
+    /// @param w writer to be used
+    /// @param subnet subnet6 node
+    void writeSubnetParams(JsonWriter& w, const YangNode* subnet);
+
+    /// @brief Writes subnet parameters as map members
+    ///
+    /// Option data is not included, see writeSubnetEntry().
     ///
-    /// @param xpath XPath to the element to be returned
-    /// @param json_name Name of the JSON parameter to be produced
-    /// @param indent indentation level
-    /// @param comma whether the JSON structure should end with a comma
+    /// @param ctx render context
+    /// @param w writer to be used
+    /// @param subnet subnet6 node
     ///
-    /// @return string with specified element as JSON text
-    std::string getFormattedValue(const std::string& xpath,
-                                  const std::string& json_name, int indent,
-                                  bool comma = true);
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int writeSubnet(RenderContext& ctx, JsonWriter& w, const YangNode* subnet);
+
+    /// @brief Renders a subnet fragment (map members)
+    ///
+    /// @param ctx render context
+    /// @param subnet subnet6 node
+    /// @param json (out) fragment, its memory is reused
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int renderSubnet(RenderContext& ctx, const YangNode* subnet,
+                     std::string& json);
+
+    /// @brief Writes a cached subnet with its option data as JSON map
+    ///
+    /// @param w writer to be used
+    /// @param xpath subnet6 xpath
+    void writeSubnetEntry(JsonWriter& w, const std::string& xpath);
+
+
+    /// @brief Returns true if a section has global parameters (a
+    ///        fragment of its own in globals_).
+    static bool hasGlobals(Section section);
+
+    /// @brief Renders global parameters of a section into its fragment
+    ///
+    /// @param section the section
+    /// @param node container of the section (NULL if it is empty)
+    void renderGlobals(Section section, const YangNode* node);
+
+    /// @brief Translates the whole model and fills the fragment cache.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int rebuildAll();
+
+    /// @brief Regenerates fragments marked as changed.
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int rebuildChanged();
+
+    /// @brief Regenerates fragments of a section marked as changed.
+    ///
+    /// @param section the section
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int rebuildSection(Section section);
+
+    /// @brief Starts counting reused and rebuilt fragments over, unless
+    ///        an updateSection() did since the document was assembled.
+    void startCounting();
+
+    /// @brief Counts the fragments not rebuilt as reused, once the
+    ///        document is up to date.
+    void finishCounting();
+
+    /// @brief Walks the changes of a commit.
+    ///
+    /// @param session session passed to the change callback
+    /// @param xpath changes walked (the module or a section)
+    /// @param mark whether to mark the changed fragments
+    /// @param digest (out) if not NULL, digest of the changes
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int walkChanges(sr_session_ctx_t* session, const std::string& xpath,
+                    bool mark, uint64_t* digest);
+
+    /// @brief Returns xpath of the model root (without trailing slash).
+    std::string getRootXPath() const;
 
     std::string model_name_; ///< Model name (usually /ietf-kea-dhcpv6:server/)
 
-    /// Sysrepo session (must be valid for the whole time this
-    /// object's lifetime)
+    /// Sysrepo session (must be valid whenever getConfig() is called)
     sr_session_ctx_t* session_;
+
+    /// Whether the fragments below reflect the datastore
+    bool cache_valid_;
+
+    /// Cached JSON text of global parameters, by section (empty for
+    /// sections without any)
+    std::string globals_[SECTION_COUNT];
+
+    /// Cached members of the Dhcp6 user-context, by section (the map
+    /// is put together from all sections, after their parameters)
+    std::string contexts_[SECTION_COUNT];
+
+    /// Sections whose global parameters need to be regenerated (for
+    /// network-ranges: its option-set-id)
+    bool globals_changed_[SECTION_COUNT];
+
+    /// Cached JSON text of subnets (map members), keyed by subnet6 xpath
+    std::map<std::string, std::string> subnets_;
+
+    /// Subnet6 xpaths in datastore order
+    std::vector<std::string> subnet_order_;
+
+    /// Subnet6 xpaths that need to be regenerated
+    std::set<std::string> changed_subnets_;
+
+    /// Changed subnets with changes outside of their reservations
+    std::set<std::string> changed_subnet_params_;
+
+    /// Changed reserved-host xpaths, keyed by subnet6 xpath
+    std::map<std::string, std::set<std::string> > changed_hosts_;
+
+    /// Kea subnet ids (network-range-id), keyed by subnet6 xpath
+    std::map<std::string, uint32_t> subnet_ids_;
+
+    /// Option sets used by subnets, keyed by subnet6 xpath
+    std::map<std::string, uint32_t> subnet_option_sets_;
+
+    /// Subnets with prefix pools (subnet6 xpaths)
+    std::set<std::string> delegating_subnets_;
+
+    /// Option set used globally (network-ranges/option-set-id), or -1
+    int64_t global_option_set_;
+
+    /// network-ranges/rapid-commit (1 or 0), or -1 if not set
+    int default_rapid_commit_;
+
+    /// Cached option data, keyed by option-set-id
+    std::map<uint32_t, OptionData> option_sets_;
+
+    /// Option-set-ids, keyed by option-set xpath
+    std::map<std::string, uint32_t> option_set_ids_;
+
+    /// Option-set xpaths that need to be regenerated
+    std::set<std::string> changed_option_sets_;
+
+    /// Kea host identifiers (type, value), keyed by reserved-host xpath
+    std::map<std::string, std::pair<std::string, std::string> > host_ids_;
+
+    /// Reservation parameters of changed hosts, kept until getCommands()
+    std::map<std::string, std::string> changed_host_params_;
+
+    /// JSON output style of all fragments
+    JsonWriter::Style style_;
+
+    /// Render context of the calling thread (uses session_)
+    RenderContext render_;
+
+    /// Render contexts of the other threads (with their own sessions)
+    std::vector<RenderContext> workers_;
+
+    /// Whether the other threads may translate (see setThreadsEnabled())
+    bool threads_enabled_;
+
+    /// Whether targeted commands are used (see setTargeted())
+    bool targeted_;
+
+    /// Whether subnet fragments are kept (see setSubnetCache())
+    bool subnet_cache_;
+
+    size_t reused_;  ///< fragments reused by the last getConfig()
+    size_t rebuilt_; ///< fragments rebuilt by the last getConfig()
+    size_t sr_calls_; ///< Sysrepo calls made so far
+    uint64_t sr_ns_;  ///< time spent reading Sysrepo so far
+    size_t duplicates_; ///< reservations skipped by the last getConfig()
+    bool counted_;   ///< the figures above are final (see startCounting())
+
+    /// Translators own Sysrepo sessions, so they are not copyable.
+    SysrepoKea(const SysrepoKea&);
+    SysrepoKea& operator=(const SysrepoKea&);
 };
 
 #endif /* YANG_KEA_H */
@@ -0,0 +1,437 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file yang-tree.cc
+
+#include "yang-tree.h"
+
+#include <string.h>
+
+using namespace std;
+
+namespace {
+
+/// Nanoseconds spent reading from Sysrepo by this thread
+thread_local uint64_t sysrepo_ns = 0;
+
+/// Number of SysrepoTimer instances of this thread
+thread_local int sysrepo_timers = 0;
+
+}
+
+SysrepoTimer::SysrepoTimer()
+    :start_(chrono::steady_clock::now()) {
+    sysrepo_timers++;
+}
+
+SysrepoTimer::~SysrepoTimer() {
+    if (--sysrepo_timers == 0) {
+        sysrepo_ns += chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - start_).count();
+    }
+}
+
+uint64_t
+SysrepoTimer::getThreadTotal() {
+    return (sysrepo_ns);
+}
+
+namespace {
+
+/// @brief Returns position where the xpath step starting at begin ends.
+///
+/// @return position of the next separator or length of the xpath
+size_t
+xpathStepEnd(const char* xpath, size_t begin) {
+    int depth = 0;
+    char quote = 0;
+    size_t i = begin;
+    for (; xpath[i]; i++) {
+        char c = xpath[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '[') {
+            depth++;
+        } else if (c == ']') {
+            depth--;
+        } else if (c == '/' && depth == 0) {
+            break;
+        }
+    }
+    return (i);
+}
+
+/// @brief Finds a step with the given name in the xpath.
+///
+/// @param xpath xpath to be checked (or its tail)
+/// @param name node name (steps with module prefix are not matched)
+///
+/// @return position of the separator before the step or string::npos
+size_t
+xpathFindStep(const char* xpath, const string& name) {
+    size_t begin = 0;
+    while (xpath[begin]) {
+        size_t end = xpathStepEnd(xpath, begin);
+        size_t len = end - begin;
+        if (len >= name.size() &&
+            strncmp(xpath + begin, name.c_str(), name.size()) == 0 &&
+            (len == name.size() || xpath[begin + name.size()] == '[')) {
+            return (begin ? begin - 1 : 0);
+        }
+        begin = xpath[end] ? end + 1 : end;
+    }
+    return (string::npos);
+}
+
+}
+
+string
+xpathLastStep(const string& xpath, string& parent) {
+    size_t sep = string::npos;
+    int depth = 0;
+    char quote = 0;
+
+    for (size_t i = 0; i < xpath.size(); i++) {
+        char c = xpath[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '[') {
+            depth++;
+        } else if (c == ']') {
+            depth--;
+        } else if (c == '/' && depth == 0) {
+            sep = i;
+        }
+    }
+
+    if (sep == string::npos) {
+        parent.clear();
+        return (xpath);
+    }
+    parent = xpath.substr(0, sep);
+    return (xpath.substr(sep + 1));
+}
+
+string
+xpathStepName(const string& step) {
+    size_t end = step.find('[');
+    if (end == string::npos) {
+        end = step.size();
+    }
+    size_t colon = step.find(':');
+    size_t begin = (colon != string::npos && colon < end) ? colon + 1 : 0;
+    return (step.substr(begin, end - begin));
+}
+
+YangNode::YangNode(const string& xpath, const sr_val_t* value)
+    :xpath_(xpath), schema_id_(0), value_(value), skipped_(false) {
+    string parent;
+    name_ = xpathStepName(xpathLastStep(xpath, parent));
+}
+
+vector<const YangNode*>
+YangNode::getChildren(const string& name) const {
+    vector<const YangNode*> result;
+    for (size_t i = 0; i < children_.size(); i++) {
+        if (children_[i]->name_ == name) {
+            result.push_back(children_[i]);
+        }
+    }
+    return (result);
+}
+
+const YangNode*
+YangNode::getChild(const char* name) const {
+    return (getChild(name, strlen(name)));
+}
+
+const YangNode*
+YangNode::getChild(const char* name, size_t len) const {
+    for (size_t i = 0; i < children_.size(); i++) {
+        if (children_[i]->name_.compare(0, string::npos, name, len) == 0) {
+            return (children_[i]);
+        }
+    }
+    return (NULL);
+}
+
+const YangNode*
+YangNode::getChildById(uint16_t id) const {
+    for (size_t i = 0; i < children_.size(); i++) {
+        if (children_[i]->schema_id_ == id) {
+            return (children_[i]);
+        }
+    }
+    return (NULL);
+}
+
+const YangNode*
+YangNode::find(const string& path) const {
+    const YangNode* node = this;
+    size_t begin = 0;
+    while (node && begin < path.size()) {
+        size_t end = path.find('/', begin);
+        if (end == string::npos) {
+            end = path.size();
+        }
+        node = node->getChild(path.data() + begin, end - begin);
+        begin = end + 1;
+    }
+    return (node);
+}
+
+YangTree::YangTree(YangSchemaResolver resolver)
+    :resolver_(resolver), values_(NULL), values_cnt_(0), root_(NULL) {
+}
+
+YangTree::~YangTree() {
+    clear();
+}
+
+void
+YangTree::clear() {
+    index_.clear();
+    nodes_.clear();
+    root_ = NULL;
+    if (values_) {
+        sr_free_values(values_, values_cnt_);
+    }
+    values_ = NULL;
+    values_cnt_ = 0;
+    for (size_t i = 0; i < owned_.size(); i++) {
+        sr_free_val(owned_[i]);
+    }
+    owned_.clear();
+}
+
+void
+YangTree::reset(const string& xpath) {
+    clear();
+
+    nodes_.push_back(YangNode(xpath, NULL));
+    root_ = &nodes_.back();
+    index_.insert(make_pair(xpath, root_));
+
+    // The root may be anywhere in the model, resolve it step by step.
+    if (resolver_) {
+        const char* path = xpath.c_str();
+        size_t begin = (path[0] == '/') ? 1 : 0;
+        uint16_t id = 0;
+        while (path[begin]) {
+            size_t end = xpathStepEnd(path, begin);
+            const string name = xpathStepName(xpath.substr(begin, end - begin));
+            id = resolver_(id, name.data(), name.size());
+            begin = path[end] ? end + 1 : end;
+        }
+        root_->schema_id_ = id;
+    }
+}
+
+void
+YangTree::adopt(sr_val_t* value) {
+    owned_.push_back(value);
+    getNode(value->xpath, value);
+}
+
+YangNode*
+YangTree::getNode(const string& xpath, const sr_val_t* value) {
+    map<string, YangNode*>::iterator it = index_.find(xpath);
+    if (it != index_.end()) {
+        if (!value) {
+            return (it->second);
+        }
+        if (!it->second->value_) {
+            // Node was created implicitly as an ancestor before its
+            // own value showed up.
+            it->second->value_ = value;
+            return (it->second);
+        }
+        // Leaf-list entries share the same xpath, so this is another
+        // instance. It gets its own node, but the index keeps the first.
+    }
+
+    string parent_xpath;
+    xpathLastStep(xpath, parent_xpath);
+
+    YangNode* parent = NULL;
+    if (xpath != root_->xpath_) {
+        parent = parent_xpath.empty() ? root_ : getNode(parent_xpath, NULL);
+    }
+
+    nodes_.push_back(YangNode(xpath, value));
+    YangNode* node = &nodes_.back();
+    index_.insert(make_pair(xpath, node));
+    if (parent) {
+        parent->children_.push_back(node);
+        if (resolver_ && parent->schema_id_) {
+            node->schema_id_ = resolver_(parent->schema_id_, node->name_.data(),
+                                         node->name_.size());
+        }
+    }
+    return (node);
+}
+
+int
+YangTree::load(sr_session_ctx_t* session, const string& xpath) {
+    SysrepoTimer timer;
+    reset(xpath);
+
+    string pattern = xpath + "//*";
+    int rc = sr_get_items(session, pattern.c_str(), &values_, &values_cnt_);
+    if (rc != SR_ERR_OK) {
+        values_ = NULL;
+        values_cnt_ = 0;
+        return (rc);
+    }
+
+    for (size_t i = 0; i < values_cnt_; i++) {
+        getNode(values_[i].xpath, &values_[i]);
+    }
+
+    return (SR_ERR_OK);
+}
+
+int
+YangTree::load(sr_session_ctx_t* session, const string& xpath,
+               const string& skip) {
+    SysrepoTimer timer;
+    reset(xpath);
+
+    string pattern = xpath + "//*";
+    sr_val_iter_t* iter = NULL;
+    int rc = sr_get_items_iter(session, pattern.c_str(), &iter);
+    if (rc != SR_ERR_OK) {
+        return (rc);
+    }
+
+    size_t found = 0;
+    string parent;
+    sr_val_t* value = NULL;
+    while ((rc = sr_get_item_next(session, iter, &value)) == SR_ERR_OK) {
+        found++;
+        size_t pos = xpathFindStep(value->xpath + xpath.size(), skip);
+        if (pos == string::npos) {
+            adopt(value);
+            continue;
+        }
+        // Flag the parent of the list (once per run of its entries).
+        pos += xpath.size();
+        if (parent.size() != pos ||
+            strncmp(value->xpath, parent.c_str(), pos) != 0) {
+            parent.assign(value->xpath, pos);
+            flagSkipped(parent);
+        }
+        sr_free_val(value);
+    }
+    sr_free_val_iter(iter);
+
+    if (rc != SR_ERR_NOT_FOUND) {
+        return (rc);
+    }
+    return (found ? SR_ERR_OK : SR_ERR_NOT_FOUND);
+}
+
+void
+YangTree::flagSkipped(const string& xpath) {
+    getNode(xpath, NULL)->skipped_ = true;
+}
+
+const YangNode*
+YangTree::find(const string& xpath) const {
+    map<string, YangNode*>::const_iterator it = index_.find(xpath);
+    if (it == index_.end()) {
+        return (NULL);
+    }
+    return (it->second);
+}
+
+YangListReader::YangListReader(sr_session_ctx_t* session, const string& xpath,
+                               size_t batch, const string& skip)
+    :session_(session), xpath_(xpath), batch_(batch ? batch : 1), skip_(skip),
+     iter_(NULL), pending_(NULL), done_(false) {
+    xpathLastStep(xpath, parent_);
+}
+
+YangListReader::~YangListReader() {
+    if (pending_) {
+        sr_free_val(pending_);
+    }
+    if (iter_) {
+        sr_free_val_iter(iter_);
+    }
+}
+
+int
+YangListReader::next(YangTree& tree) {
+    SysrepoTimer timer;
+    tree.reset(parent_);
+    if (done_) {
+        return (SR_ERR_NOT_FOUND);
+    }
+
+    if (!iter_) {
+        string pattern = xpath_ + "//*";
+        int rc = sr_get_items_iter(session_, pattern.c_str(), &iter_);
+        if (rc != SR_ERR_OK) {
+            iter_ = NULL;
+            done_ = true;
+            return (rc);
+        }
+    }
+
+    size_t entries = 0;
+    while (true) {
+        sr_val_t* value = pending_;
+        pending_ = NULL;
+        if (!value) {
+            int rc = sr_get_item_next(session_, iter_, &value);
+            if (rc != SR_ERR_OK) {
+                done_ = true;
+                if (rc != SR_ERR_NOT_FOUND) {
+                    return (rc);
+                }
+                break;
+            }
+        }
+
+        // Values of an entry come one after another, so a new entry
+        // starts whenever the entry part of the xpath changes.
+        const char* xpath = value->xpath;
+        if (entry_.empty() || strncmp(xpath, entry_.c_str(), entry_.size()) != 0 ||
+            (xpath[entry_.size()] != '/' && xpath[entry_.size()] != 0)) {
+            if (entries == batch_) {
+                pending_ = value;
+                break;
+            }
+            entry_.assign(xpath, xpathStepEnd(xpath, parent_.size() + 1));
+            entries++;
+        }
+
+        size_t pos = skip_.empty() ? string::npos :
+            xpathFindStep(xpath + entry_.size(), skip_);
+        if (pos == string::npos) {
+            tree.adopt(value);
+            continue;
+        }
+        // Flag the parent of the list (once per run of its entries).
+        pos += entry_.size();
+        if (skipped_.size() != pos || strncmp(xpath, skipped_.c_str(), pos) != 0) {
+            skipped_.assign(xpath, pos);
+            tree.flagSkipped(skipped_);
+        }
+        sr_free_val(value);
+    }
+
+    return (entries ? SR_ERR_OK : SR_ERR_NOT_FOUND);
+}
@@ -0,0 +1,326 @@
+// Copyright (C) 2018 Internet Systems Consortium, Inc. ("ISC")
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+/// @file yang-tree.h
+///
+/// In-memory copy of a Sysrepo data subtree. The whole subtree is
+/// fetched with a single sr_get_items() call and then indexed by
+/// xpath, so that the translator can walk it without going back
+/// to Sysrepo for every leaf.
+
+#ifndef YANG_TREE_H
+#define YANG_TREE_H
+
+extern "C" {
+#include "sysrepo.h"
+};
+
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+/// @brief Measures time spent reading from Sysrepo.
+///
+/// While an instance exists, time is added to the total of the calling
+/// thread. Nested instances are not counted twice.
+class SysrepoTimer {
+public:
+    /// @brief Constructor (starts timing)
+    SysrepoTimer();
+
+    /// @brief Destructor (adds the time to the thread total)
+    ~SysrepoTimer();
+
+    /// @brief Returns nanoseconds the calling thread spent reading.
+    static uint64_t getThreadTotal();
+
+private:
+    std::chrono::steady_clock::time_point start_; ///< when timing started
+};
+
+/// @brief Returns the last step of the xpath.
+///
+/// Slashes within list key predicates (e.g. subnet='2001:db8::/32')
+/// are not treated as separators.
+///
+/// @param xpath XPath to be split
+/// @param parent (out) XPath of the parent node (may be empty)
+///
+/// @return last step of the xpath, including predicates
+std::string xpathLastStep(const std::string& xpath, std::string& parent);
+
+/// @brief Returns the node name of an xpath step.
+///
+/// Module prefix and list key predicates are removed, so
+/// "ietf-kea-dhcpv6:server" becomes "server" and
+/// "subnet6[subnet='2001:db8::/32']" becomes "subnet6".
+///
+/// @param step single xpath step
+///
+/// @return name of the node
+std::string xpathStepName(const std::string& step);
+
+/// @brief Returns schema id of a node.
+///
+/// Ids are assigned by the user of the tree (e.g. generated from the
+/// model), 0 stands for an unknown node.
+///
+/// @param parent schema id of the parent (0 for the top of the model)
+/// @param name node name (not necessarily terminated)
+/// @param len length of the name
+/// @return schema id of the node
+typedef uint16_t (*YangSchemaResolver)(uint16_t parent, const char* name, size_t len);
+
+/// @brief A single node of the in-memory data tree.
+class YangNode {
+public:
+    /// @brief Constructor
+    ///
+    /// @param xpath full xpath of the node
+    /// @param value value retrieved from Sysrepo (may be NULL for
+    ///        the root node, which is not returned by sr_get_items)
+    YangNode(const std::string& xpath, const sr_val_t* value);
+
+    /// @brief Returns full xpath of the node.
+    const std::string& getXPath() const {
+        return (xpath_);
+    }
+
+    /// @brief Returns name of the node (without prefix and predicates).
+    const std::string& getName() const {
+        return (name_);
+    }
+
+    /// @brief Returns schema id of the node (0 if not known).
+    ///
+    /// See YangTree::YangTree().
+    uint16_t getSchemaId() const {
+        return (schema_id_);
+    }
+
+    /// @brief Returns Sysrepo value of the node (may be NULL).
+    const sr_val_t* getValue() const {
+        return (value_);
+    }
+
+    /// @brief Returns all children of the node in datastore order.
+    const std::vector<const YangNode*>& getChildren() const {
+        return (children_);
+    }
+
+    /// @brief Returns all children with specified name.
+    ///
+    /// This is used to get all instances of a list or leaf-list.
+    ///
+    /// @param name name of the children
+    /// @return vector of children in datastore order (may be empty)
+    std::vector<const YangNode*> getChildren(const std::string& name) const;
+
+    /// @brief Returns first child with specified name.
+    ///
+    /// @param name name of the child
+    /// @return child node or NULL if there is no such child
+    const YangNode* getChild(const std::string& name) const {
+        return (getChild(name.data(), name.size()));
+    }
+
+    /// @brief Returns first child with specified name.
+    ///
+    /// @param name name of the child
+    /// @return child node or NULL if there is no such child
+    const YangNode* getChild(const char* name) const;
+
+    /// @brief Returns first child with specified name.
+    ///
+    /// @param name name of the child (not necessarily terminated)
+    /// @param len length of the name
+    /// @return child node or NULL if there is no such child
+    const YangNode* getChild(const char* name, size_t len) const;
+
+    /// @brief Returns first child with specified schema id.
+    ///
+    /// @param id schema id of the child
+    /// @return child node or NULL if there is no such child
+    const YangNode* getChildById(uint16_t id) const;
+
+    /// @brief Returns true if children were left out when loading.
+    ///
+    /// See YangTree::load() with a list to be skipped.
+    bool hasSkippedChildren() const {
+        return (skipped_);
+    }
+
+    /// @brief Finds a descendant specified by relative path.
+    ///
+    /// @param path path relative to this node, e.g.
+    ///        "serv-attributes/control-socket/socket-type"
+    /// @return descendant node or NULL if not found
+    const YangNode* find(const std::string& path) const;
+
+private:
+    friend class YangTree;
+
+    std::string xpath_;    ///< full xpath
+    std::string name_;     ///< node name
+    uint16_t schema_id_;    ///< schema id (0 if not known)
+    const sr_val_t* value_; ///< value (owned by YangTree)
+    bool skipped_;          ///< some children were left out
+    std::vector<const YangNode*> children_; ///< children in datastore order
+};
+
+/// @brief In-memory data tree fetched from Sysrepo in one go.
+///
+/// The tree owns the values returned by Sysrepo and releases them when
+/// destroyed, so nodes must not be used after the tree is gone.
+class YangTree {
+public:
+    /// @brief Constructor
+    ///
+    /// @param resolver assigns schema ids to nodes as they are added, so
+    ///        that the tree can be walked without comparing names (NULL
+    ///        leaves all ids 0)
+    YangTree(YangSchemaResolver resolver = NULL);
+
+    /// @brief Destructor (frees Sysrepo values)
+    ~YangTree();
+
+    /// @brief Fetches the subtree rooted at xpath.
+    ///
+    /// This is the only place that talks to Sysrepo. All descendants of
+    /// the xpath are retrieved with one sr_get_items() call.
+    ///
+    /// @param session Sysrepo session to be used
+    /// @param xpath XPath of the subtree root (without trailing slash)
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success)
+    int load(sr_session_ctx_t* session, const std::string& xpath);
+
+    /// @brief Fetches the subtree rooted at xpath, leaving out a list.
+    ///
+    /// Entries of lists named skip (and everything below them) are not
+    /// kept. Values are pulled with the Sysrepo iterator and the skipped
+    /// ones are released right away, so a huge list (e.g. reserved-host)
+    /// does not have to fit in memory. Such lists are meant to be read
+    /// separately with YangListReader. Their parents are flagged (see
+    /// YangNode::hasSkippedChildren()), so lists that are known to be
+    /// empty need not be read.
+    ///
+    /// @param session Sysrepo session to be used
+    /// @param xpath XPath of the subtree root (without trailing slash)
+    /// @param skip name of the list to be left out
+    ///
+    /// @return Sysrepo error code (SR_ERR_OK on success, SR_ERR_NOT_FOUND
+    ///         if there is nothing at all under xpath)
+    int load(sr_session_ctx_t* session, const std::string& xpath,
+             const std::string& skip);
+
+    /// @brief Returns the subtree root (NULL before load()).
+    const YangNode* getRoot() const {
+        return (root_);
+    }
+
+    /// @brief Finds a node by its full xpath.
+    ///
+    /// @param xpath full xpath of the node
+    /// @return node or NULL if not present
+    const YangNode* find(const std::string& xpath) const;
+
+    /// @brief Returns number of values retrieved from Sysrepo.
+    size_t size() const {
+        return (values_cnt_ + owned_.size());
+    }
+
+private:
+    friend class YangListReader;
+
+    /// @brief Releases all nodes and values.
+    void clear();
+
+    /// @brief Releases everything and creates an empty root.
+    ///
+    /// @param xpath XPath of the subtree root
+    void reset(const std::string& xpath);
+
+    /// @brief Adds a single value to the tree.
+    ///
+    /// @param value value allocated by Sysrepo, the tree takes ownership
+    void adopt(sr_val_t* value);
+
+    /// @brief Returns node for the xpath, creating it (and any missing
+    ///        ancestors) if necessary.
+    YangNode* getNode(const std::string& xpath, const sr_val_t* value);
+
+    /// @brief Flags a node as having children that were left out.
+    ///
+    /// @param xpath xpath of the node (created if missing)
+    void flagSkipped(const std::string& xpath);
+
+    /// Trees own Sysrepo memory, so they are not copyable.
+    YangTree(const YangTree&);
+    YangTree& operator=(const YangTree&);
+
+    YangSchemaResolver resolver_;   ///< assigns schema ids (may be NULL)
+    sr_val_t* values_;              ///< values retrieved from Sysrepo
+    size_t values_cnt_;             ///< number of values
+    std::vector<sr_val_t*> owned_;  ///< values retrieved one by one
+    YangNode* root_;                ///< subtree root
+    std::deque<YangNode> nodes_;    ///< node storage (stable addresses)
+    std::map<std::string, YangNode*> index_; ///< xpath index
+};
+
+/// @brief Reads entries of a list from Sysrepo in batches.
+///
+/// Values are pulled with the Sysrepo iterator (which transfers them in
+/// chunks) and at most one batch of list entries is kept in memory, so
+/// the list can be arbitrarily long.
+class YangListReader {
+public:
+    /// @brief Constructor
+    ///
+    /// @param session Sysrepo session to be used
+    /// @param xpath XPath of the list without predicates, e.g.
+    ///        ".../subnet6[subnet='2001:db8::/32']/reserved-host"
+    /// @param batch maximum number of list entries per batch
+    /// @param skip name of a list inside the entries to be left out (as
+    ///        by YangTree::load()), empty to keep everything
+    YangListReader(sr_session_ctx_t* session, const std::string& xpath,
+                   size_t batch, const std::string& skip = "");
+
+    /// @brief Destructor (releases the Sysrepo iterator)
+    ~YangListReader();
+
+    /// @brief Reads the next batch of list entries.
+    ///
+    /// The tree is reset to the parent of the list, so the entries of
+    /// the batch are the children of the tree root.
+    ///
+    /// @param tree (out) tree to be filled
+    ///
+    /// @return SR_ERR_OK if some entries were read, SR_ERR_NOT_FOUND if
+    ///         there are no more, other Sysrepo error code on failure
+    int next(YangTree& tree);
+
+private:
+    /// Readers own a Sysrepo iterator, so they are not copyable.
+    YangListReader(const YangListReader&);
+    YangListReader& operator=(const YangListReader&);
+
+    sr_session_ctx_t* session_; ///< Sysrepo session
+    std::string xpath_;         ///< xpath of the list
+    std::string parent_;        ///< xpath of the list parent
+    size_t batch_;              ///< entries per batch
+    std::string skip_;          ///< list left out of the entries
+    std::string skipped_;       ///< xpath of the last parent flagged
+    sr_val_iter_t* iter_;       ///< Sysrepo iterator (NULL before first batch)
+    sr_val_t* pending_;         ///< first value of the next batch
+    std::string entry_;         ///< xpath of the last entry read
+    bool done_;                 ///< no more values
+};
+
+#endif /* YANG_TREE_H */